@@ -1,34 +1,75 @@
 """
 Uses imagemagick to convert the images into the correct size and format
-and then spits the images out into a .txt file in this format:
-- Each ascii character worth a nibble (b bits, half a byte)
-- Yes, this is shockingly inefficient
-- There must be an integer number of bytes within the file
-- First byte is the width of the image (so max width is 256)
-- Second byte is the height of the image (so max height is 256)
-- Subsequent bytes are the data in the image, left to right and top to bottom
+and then spits the images out into a binary .oimg file, which is what
+oled_sdWriteImage in source/oled/oled.cpp reads. The format is:
+- A 12 byte header, numbers are little endian
+  - 0 to 3: "OIMG"
+  - 4 to 5: Width of the image
+  - 6 to 7: Height of the image
+  - 8: Pixel format, 0 for RGB565, 1 for QOI565, or 2, 3, 4 and 5 for a
+    palette with 1, 2, 4 and 8 bits per pixel
+  - 9: Flags, none yet so 0
+  - 10 to 11: Reserved, 0
+- Then the pixels, left to right and top to bottom. Each RGB565 pixel is two
+  bytes, most significant byte first, which is what the display wants
+- Or for QOI565, the pixels compressed like QOI (https://qoiformat.org) but
+  with 5, 6 and 5 bit channels and no alpha. Each pixel is one of these, the
+  previous pixel starts as black and the 64 pixel index starts as all black
+  - 0b00iiiiii: The pixel in the index at i
+  - 0b01rrggbb: The previous pixel plus r, g and b, each biased by 2
+  - 0b10gggggg 0brrrrbbbb: The previous pixel plus g biased by 32, plus r and
+    b which are biased by 8 and relative to g
+  - 0b11llllll: The previous pixel l + 1 more times, l is up to 61
+  - 0xFE then two bytes: An RGB565 pixel, most significant byte first
+  Every pixel which is decoded goes in the index at
+  ((r * 3) + (g * 5) + (b * 7)) % 64. The differences wrap around, e.g. r
+  of 31 plus 1 is 0
+- Or for a palette with b bits per pixel, 2 to the power of b RGB565 colours,
+  most significant byte first. Then each row of the image as b bit indexes
+  into the palette, most significant bits first, with each row starting on a
+  new byte
+
+Unless a format is given, the encoder uses whichever of these is smallest
+without losing any colours. If a palette format is given, and the image has
+more colours than fit in the palette, they're reduced by median cut
+
+Images in the old .txt format (an ascii character for each nibble, plus 32)
+and .oimg images can be given as the input file too, to convert them
 
 Use the OPTIONS constant to change what gets converted
 """
 
-# OPTIONS: input file name, convert to this width, convert to this height, output to this txt file
+# OPTIONS: input file name, convert to this width, convert to this height, output to this file,
+# optionally followed by the format: "rgb565", "qoi565", "palette1", "palette2", "palette4" or "palette8"
 OPTIONS = [
-    # ["1F3DC.svg", 84, 84, "desert84.txt"],
-    # ["1F33F.svg", 100, 100, "herb100.txt"],
-    # ["26A0.svg", 100, 100, "warning100.txt"],
-    # ["26A1.svg", 64, 64, "bolt64.txt"],
-    ["274C.svg", 64, 64, "cross64.txt"],
-    ["2714.svg", 64, 64, "tick64.txt"],
-    ["E254.svg", 64, 64, "wifi64.txt"],
-    # ["bluebin84.png", 84, 84, "bluebin84.txt"],
-    # ["greenbin84.png", 84, 84, "greenbin84.txt"],
+    # ["1F3DC.svg", 84, 84, "desert84.oimg"],
+    # ["1F33F.svg", 100, 100, "herb100.oimg"],
+    # ["26A0.svg", 100, 100, "warning100.oimg"],
+    # ["26A1.svg", 64, 64, "bolt64.oimg"],
+    ["274C.svg", 64, 64, "cross64.oimg"],
+    ["2714.svg", 64, 64, "tick64.oimg"],
+    ["E254.svg", 64, 64, "wifi64.oimg"],
+    # ["bluebin84.png", 84, 84, "bluebin84.oimg"],
+    # ["greenbin84.png", 84, 84, "greenbin84.oimg"],
 ]
 
-from PIL import Image
-import os
-from time import sleep
+MAGIC = b"OIMG"
+FORMAT_RGB565 = 0
+FORMAT_QOI565 = 1
+# Bits per pixel of each palette format
+FORMAT_PALETTES = {2: 1, 3: 2, 4: 4, 5: 8}
+FORMAT_NAMES = {"rgb565": 0, "qoi565": 1, "palette1": 2, "palette2": 3, "palette4": 4, "palette8": 5}
 
-# Currently only supports RGB565
+QOI_OP_INDEX = 0x00
+QOI_OP_DIFF = 0x40
+QOI_OP_LUMA = 0x80
+QOI_OP_RUN = 0xC0
+QOI_OP_RGB565 = 0xFE
+QOI_MAX_RUN = 62
+QOI_INDEX_SIZE = 64
+
+import os
+import struct
 
 def main():
     if not os.path.exists("output"):
@@ -36,64 +77,261 @@ def main():
 
     for row in OPTIONS:
         source_file = row[0]
-        output_image_width = row[1]
-        output_image_height = row[2]
+        output_image_width = min(max(row[1], 0), 0xFFFF)
+        output_image_height = min(max(row[2], 0), 0xFFFF)
         output_image_file_name = row[3]
+        image_format = FORMAT_NAMES[row[4]] if len(row) > 4 else None
+
+        if os.path.splitext(source_file)[1] == ".txt":
+            output_image_width, output_image_height, pixels = read_text_image(source_file)
+        elif os.path.splitext(source_file)[1] == ".oimg":
+            output_image_width, output_image_height, pixels = read_oimg_image(source_file)
+        else:
+            pixels = read_image(source_file, output_image_width, output_image_height)
+
+        if image_format in FORMAT_PALETTES:
+            pixels = reduce_colours(pixels, 1 << FORMAT_PALETTES[image_format])
+        encodings = {FORMAT_RGB565: b"".join(struct.pack(">H", rgb565) for rgb565 in pixels)}
+        encodings[FORMAT_QOI565] = encode_qoi565(pixels)
+        if decode_qoi565(encodings[FORMAT_QOI565], len(pixels)) != pixels:
+            raise ValueError(source_file + " doesn't decode to the same pixels")
+        for palette_format, bits_per_pixel in FORMAT_PALETTES.items():
+            if len(set(pixels)) <= (1 << bits_per_pixel):
+                encodings[palette_format] = encode_palette(pixels, output_image_width, bits_per_pixel)
+                if decode_palette(encodings[palette_format], output_image_width, output_image_height,
+                                  bits_per_pixel) != pixels:
+                    raise ValueError(source_file + " doesn't decode to the same pixels")
+
+        if image_format is None:
+            image_format = min(encodings, key=lambda encoding: len(encodings[encoding]))
+        data = encodings[image_format]
+
+        with open(os.path.join("output", output_image_file_name), "wb") as output_file:
+            output_file.write(MAGIC)
+            output_file.write(struct.pack("<HHBBH", output_image_width, output_image_height, image_format, 0, 0))
+            output_file.write(data)
+
+        print("Converted", source_file, "to", output_image_file_name, "with", len(data), "bytes of pixels")
+
+def split_rgb565(rgb565):
+    return (rgb565 >> 11) & 0x1F, (rgb565 >> 5) & 0x3F, rgb565 & 0x1F
+
+def qoi565_hash(rgb565):
+    r, g, b = split_rgb565(rgb565)
+    return ((r * 3) + (g * 5) + (b * 7)) % QOI_INDEX_SIZE
+
+# Returns the difference from previous to current, wrapped to -half to half - 1
+def wrapped_difference(current, previous, bits):
+    half = 1 << (bits - 1)
+    return ((current - previous + half) % (1 << bits)) - half
+
+# Returns the bytes of a list of RGB565 pixels in the QOI565 format
+def encode_qoi565(pixels):
+    data = bytearray()
+    index = [0] * QOI_INDEX_SIZE
+    previous = 0
+    run = 0
+
+    for position, pixel in enumerate(pixels):
+        if pixel == previous:
+            run += 1
+            if run == QOI_MAX_RUN or position == len(pixels) - 1:
+                data.append(QOI_OP_RUN | (run - 1))
+                run = 0
+            continue
+        if run > 0:
+            data.append(QOI_OP_RUN | (run - 1))
+            run = 0
+
+        hash_index = qoi565_hash(pixel)
+        if index[hash_index] == pixel:
+            data.append(QOI_OP_INDEX | hash_index)
+        else:
+            index[hash_index] = pixel
+            r, g, b = split_rgb565(pixel)
+            previous_r, previous_g, previous_b = split_rgb565(previous)
+            dr = wrapped_difference(r, previous_r, 5)
+            dg = wrapped_difference(g, previous_g, 6)
+            db = wrapped_difference(b, previous_b, 5)
+            dr_dg = dr - dg
+            db_dg = db - dg
+
+            if -2 <= dr < 2 and -2 <= dg < 2 and -2 <= db < 2:
+                data.append(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2))
+            elif -32 <= dg < 32 and -8 <= dr_dg < 8 and -8 <= db_dg < 8:
+                data.append(QOI_OP_LUMA | (dg + 32))
+                data.append(((dr_dg + 8) << 4) | (db_dg + 8))
+            else:
+                data.append(QOI_OP_RGB565)
+                data += struct.pack(">H", pixel)
+        previous = pixel
+
+    return bytes(data)
+
+# Returns the list of RGB565 pixels in QOI565 data, the same as oled.cpp does
+def decode_qoi565(data, pixel_count):
+    pixels = []
+    index = [0] * QOI_INDEX_SIZE
+    pixel = 0
+    position = 0
+
+    while len(pixels) < pixel_count:
+        tag = data[position]
+        position += 1
+        r, g, b = split_rgb565(pixel)
+        if tag == QOI_OP_RGB565:
+            pixel = (data[position] << 8) | data[position + 1]
+            position += 2
+        elif tag & 0xC0 == QOI_OP_INDEX:
+            pixel = index[tag & 0x3F]
+        elif tag & 0xC0 == QOI_OP_DIFF:
+            r = (r + ((tag >> 4) & 0x03) - 2) % 32
+            g = (g + ((tag >> 2) & 0x03) - 2) % 64
+            b = (b + (tag & 0x03) - 2) % 32
+            pixel = (r << 11) | (g << 5) | b
+        elif tag & 0xC0 == QOI_OP_LUMA:
+            dg = (tag & 0x3F) - 32
+            r = (r + dg + (data[position] >> 4) - 8) % 32
+            g = (g + dg) % 64
+            b = (b + dg + (data[position] & 0x0F) - 8) % 32
+            position += 1
+            pixel = (r << 11) | (g << 5) | b
+        else:
+            pixels += [pixel] * ((tag & 0x3F) + 1)
+            continue
+        index[qoi565_hash(pixel)] = pixel
+        pixels.append(pixel)
+
+    return pixels
+
+# Returns the bytes of a list of RGB565 pixels as a palette and indexes, there
+# must be no more colours than fit in the palette
+def encode_palette(pixels, width, bits_per_pixel):
+    palette = sorted(set(pixels))
+    palette += [0] * ((1 << bits_per_pixel) - len(palette))
+    data = bytearray(b"".join(struct.pack(">H", colour) for colour in palette))
+    indexes = {colour: index for index, colour in enumerate(palette)}
+
+    for row_start in range(0, len(pixels), width):
+        byte = 0
+        bits = 0
+        for pixel in pixels[row_start:row_start + width]:
+            byte = (byte << bits_per_pixel) | indexes[pixel]
+            bits += bits_per_pixel
+            if bits == 8:
+                data.append(byte)
+                byte = 0
+                bits = 0
+        # Pad the end of the row to a whole byte
+        if bits > 0:
+            data.append(byte << (8 - bits))
+
+    return bytes(data)
+
+# Returns the list of RGB565 pixels in palette and index data, the same as oled.cpp does
+def decode_palette(data, width, height, bits_per_pixel):
+    palette_size = 2 << bits_per_pixel
+    palette = [(data[index] << 8) + data[index + 1] for index in range(0, palette_size, 2)]
+    row_size = ((width * bits_per_pixel) + 7) // 8
+    pixels = []
+
+    for row in range(height):
+        row_data = data[palette_size + (row * row_size):palette_size + ((row + 1) * row_size)]
+        for column in range(width):
+            bit = column * bits_per_pixel
+            index = (row_data[bit // 8] >> (8 - bits_per_pixel - (bit % 8))) & ((1 << bits_per_pixel) - 1)
+            pixels.append(palette[index])
+
+    return pixels
+
+# Returns the RGB565 pixels with no more than colour_count colours. The colours
+# are split into boxes by median cut, and each box becomes its most common
+# colour so that flat areas, like a black background, keep their exact colour
+def reduce_colours(pixels, colour_count):
+    counts = {}
+    for pixel in pixels:
+        counts[pixel] = counts.get(pixel, 0) + 1
+    if len(counts) <= colour_count:
+        return pixels
+
+    boxes = [list(counts)]
+    while len(boxes) < colour_count:
+        # Split the box with the widest channel, scaled to 6 bits
+        def channel_range(box, channel):
+            values = [split_rgb565(colour)[channel] << (1 if channel != 1 else 0) for colour in box]
+            return max(values) - min(values)
+        box, channel = max(((box, channel) for box in boxes if len(box) > 1 for channel in range(3)),
+                           key=lambda candidate: channel_range(*candidate), default=(None, None))
+        if box is None:
+            break
+        box.sort(key=lambda colour: split_rgb565(colour)[channel])
+        # Split where half of the pixels are on each side
+        half = sum(counts[colour] for colour in box) / 2
+        total = 0
+        for split in range(1, len(box)):
+            total += counts[box[split - 1]]
+            if total >= half:
+                break
+        boxes.remove(box)
+        boxes += [box[:split], box[split:]]
+
+    palette = [max(box, key=lambda colour: counts[colour]) for box in boxes]
+    def nearest(colour):
+        r, g, b = split_rgb565(colour)
+        return min(palette, key=lambda entry: ((split_rgb565(entry)[0] - r) * 2) ** 2 +
+                   (split_rgb565(entry)[1] - g) ** 2 + ((split_rgb565(entry)[2] - b) * 2) ** 2)
+    mapping = {colour: nearest(colour) for colour in counts}
+    return [mapping[pixel] for pixel in pixels]
+
+# Returns a list of RGB565 pixels, left to right and top to bottom
+def read_image(source_file, width, height):
+    from PIL import Image
+
+    # Extra bit for SVG files
+    if os.path.splitext(source_file)[1] == ".svg":
+        os.system("convert -background black -flatten " + source_file + " -resize " + str(width) + "x" + str(height) + "! temp.png")
+        source_file = "temp.png"
+
+    # Open the image
+    image = Image.open(source_file, 'r')
+    # Resize the image
+    resized_image = image.resize((width, height))
+    # Ensure the image is in RGB format
+    rgb_image = resized_image.convert("RGB")
+
+    pixels = []
+    for pixel in rgb_image.getdata():
+        r = int((float(pixel[0]) / 255.0) * 0b11111) << 11
+        g = int((float(pixel[1]) / 255.0) * 0b111111) << 5
+        b = int((float(pixel[2]) / 255.0) * 0b11111)
+        pixels.append(r + g + b)
+    return pixels
+
+# Returns the width, height and RGB565 pixels of an image in the old .txt format
+def read_text_image(source_file):
+    with open(source_file, "r") as text_file:
+        text = text_file.read().replace("\n", "")
+    data = bytes(((ord(text[index]) - 32) << 4) + (ord(text[index + 1]) - 32) for index in range(0, len(text) - 1, 2))
+
+    width = data[0]
+    height = data[1]
+    pixels = [(data[index] << 8) + data[index + 1] for index in range(2, 2 + (width * height * 2), 2)]
+    return width, height, pixels
+
+# Returns the width, height and RGB565 pixels of a .oimg image
+def read_oimg_image(source_file):
+    with open(source_file, "rb") as oimg_file:
+        data = oimg_file.read()
+    if data[0:4] != MAGIC:
+        raise ValueError(source_file + " isn't a .oimg image")
 
-        if output_image_width > 0xFFFF:
-            output_image_width = 0xFFFF
-        elif output_image_width < 0x0000:
-            output_image_width = 0x0000
-
-        if output_image_height > 0xFFFF:
-            output_image_height = 0xFFFF
-        elif output_image_height < 0x0000:
-            output_image_height = 0x0000
-
-        # Extra bit for SVG files
-        if os.path.splitext(source_file)[1] == ".svg":
-            os.system("convert -background black -flatten " + source_file + " -resize " + str(output_image_width) + "x" + str(output_image_height) + "! temp.png")
-            source_file = "temp.png"
-
-        # Open the image
-        image = Image.open(source_file, 'r')
-        # Resize the image
-        resized_image = image.resize((output_image_width, output_image_height))
-        # Ensure the image is in RGB format
-        rgb_image = resized_image.convert("RGB")
-        # Convert the pixels into a list or a tuple
-        pixel_values = tuple(resized_image.getdata())
-        
-        txt_file = open(os.path.join("output", output_image_file_name), 'w')
-        # Write the image width and height
-        txt_file.write(convert_byte_to_ascii(output_image_width))
-        txt_file.write(convert_byte_to_ascii(output_image_height))
-
-        for pixel in pixel_values:
-            r = int((float(pixel[0]) / 255.0) * 0b11111) << 11
-            g = int((float(pixel[1]) / 255.0) * 0b111111) << 5
-            b = int((float(pixel[2]) / 255.0) * 0b11111)
-            # print(bin(r), bin(g), bin(b))
-            rgb565 = r + g + b
-            byte1 = (rgb565 & 0b1111111100000000) >> 8
-            byte2 = rgb565 & 0b0000000011111111
-            txt_file.write(convert_byte_to_ascii(byte1))
-            txt_file.write(convert_byte_to_ascii(byte2))
-
-        print("First value in", row[0], "is", pixel_values[0])
-
-# Input a value from 0 to 255
-# Output is a string with two ascii characters
-def convert_byte_to_ascii(byte) -> str:
-    if byte > 0xFFFF:
-        byte = 0xFFFF
-    elif byte < 0x0000:
-        byte = 0x0000
-    nibble1 = ((byte & 0b11110000) >> 4) + 32
-    nibble2 = (byte & 0b00001111) + 32
-    char1 = chr(nibble1)
-    char2 = chr(nibble2)
-    return char1 + char2
+    width, height, image_format = struct.unpack("<HHB", data[4:9])
+    data = data[12:]
+    if image_format == FORMAT_QOI565:
+        return width, height, decode_qoi565(data, width * height)
+    if image_format in FORMAT_PALETTES:
+        return width, height, decode_palette(data, width, height, FORMAT_PALETTES[image_format])
+    return width, height, [(data[index] << 8) + data[index + 1] for index in range(0, width * height * 2, 2)]
 
 if __name__ == '__main__':
     main()
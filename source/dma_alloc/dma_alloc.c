@@ -0,0 +1,122 @@
+/* --- STANDARD LIBRARY INCLUDES ---------------------------------------------- */
+#include "dma_alloc.h"
+
+#include <stddef.h>
+
+/* --- PICO LIBRARY INCLUDES -------------------------------------------------- */
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+static t_dmaAllocOwner m_owners[NUM_DMA_CHANNELS];
+static volatile t_dmaAllocCallback m_callbacks[NUM_DMA_CHANNELS];
+static bool m_irqHandlerInstalled = false;
+
+/* --- MODULE SCOPE FUNCTION PROTOTYPES --------------------------------------- */
+static void m_irqHandler( void );
+static inline bool m_isClaimedHere( int channel );
+
+/* --- PUBLIC FUNCTION IMPLEMENTATIONS ---------------------------------------- */
+
+int dmaAlloc_claim( t_dmaAllocOwner owner )
+{
+    // The SDK claim is safe to call from both cores, and also knows about
+    // channels claimed by libraries which don't use this module
+    int channel = dma_claim_unused_channel( false );
+    if( channel < 0 )
+        return -1;
+
+    m_owners[channel] = owner;
+    m_callbacks[channel] = NULL;
+
+    return channel;
+}
+
+void dmaAlloc_release( int channel )
+{
+    if( !m_isClaimedHere( channel ) )
+        return;
+
+    (void) dmaAlloc_setCallback( channel, NULL );
+    m_owners[channel] = e_dmaAllocOwnerNone;
+    dma_channel_unclaim( (uint) channel );
+}
+
+t_dmaAllocOwner dmaAlloc_getOwner( int channel )
+{
+    if( ( channel < 0 ) || ( channel >= (int) NUM_DMA_CHANNELS ) )
+        return e_dmaAllocOwnerNone;
+
+    return m_owners[channel];
+}
+
+int dmaAlloc_setCallback( int channel, t_dmaAllocCallback callback )
+{
+    if( !m_isClaimedHere( channel ) )
+        return 1;
+
+    if( callback == NULL )
+    {
+        dma_channel_set_irq1_enabled( (uint) channel, false );
+        m_callbacks[channel] = NULL;
+        return 0;
+    }
+
+    if( !m_irqHandlerInstalled )
+    {
+        // Shared, so that anything else which wants DMA_IRQ_1 can still have it
+        irq_add_shared_handler( DMA_IRQ_1, m_irqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY );
+        irq_set_enabled( DMA_IRQ_1, true );
+        m_irqHandlerInstalled = true;
+    }
+
+    m_callbacks[channel] = callback;
+    // Clear anything left over from a previous transfer before enabling
+    dma_hw->ints1 = 1U << channel;
+    dma_channel_set_irq1_enabled( (uint) channel, true );
+
+    return 0;
+}
+
+/* --- MODULE SCOPE FUNCTION IMPLEMENTATIONS ---------------------------------- */
+
+/*
+ * Function: m_irqHandler
+ * --------------------
+ * Handler for DMA_IRQ_1, calls the callback of each channel which has finished
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void __not_in_flash_func(m_irqHandler)( void )
+{
+    t_dmaAllocCallback callback;
+
+    for( uint channel = 0U; channel < NUM_DMA_CHANNELS; channel++ )
+    {
+        callback = m_callbacks[channel];
+        // Only touch channels registered here, other handlers may share the line
+        if( ( callback != NULL ) && ( dma_hw->ints1 & ( 1U << channel ) ) )
+        {
+            dma_hw->ints1 = 1U << channel; // Clear it
+            callback( channel );
+        }
+    }
+}
+
+/*
+ * Function: m_isClaimedHere
+ * --------------------
+ * Check that a channel number is valid and was claimed through this module
+ *
+ * channel: Channel number
+ *
+ * returns: bool true if the channel was claimed with dmaAlloc_claim
+ */
+static inline bool m_isClaimedHere( int channel )
+{
+    return ( channel >= 0 ) && ( channel < (int) NUM_DMA_CHANNELS ) &&
+        ( m_owners[channel] != e_dmaAllocOwnerNone );
+}
@@ -0,0 +1,85 @@
+#ifndef DMA_ALLOC_H
+#define DMA_ALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The RP2040 DMA channels and interrupt lines are shared between the display
+ * and the SD card driver (and the CYW43 driver, which claims its own channels
+ * through the pico SDK). Every user in this project claims its channels through
+ * this module so that it is known who owns what, and so that completion
+ * interrupts are routed sensibly:
+ *   DMA_IRQ_0 is left to the SD card driver, which installs its own handler
+ *   DMA_IRQ_1 is owned by this module, channels registered with
+ *             dmaAlloc_setCallback are dispatched from a single handler */
+
+typedef enum
+{
+    e_dmaAllocOwnerNone,
+    e_dmaAllocOwnerSdCard,
+    e_dmaAllocOwnerOled,
+} t_dmaAllocOwner;
+
+// Called from interrupt context when a transfer on the channel has finished
+typedef void (*t_dmaAllocCallback)( unsigned int channel );
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Function: dmaAlloc_claim
+ * --------------------
+ * Claim an unused DMA channel
+ *
+ * owner: Which part of the project will be using the channel
+ *
+ * returns: int the claimed channel number on success
+ *              -1 on fail because all channels are in use
+ */
+int dmaAlloc_claim( t_dmaAllocOwner owner );
+
+/*
+ * Function: dmaAlloc_release
+ * --------------------
+ * Release a channel claimed with dmaAlloc_claim. Any callback for the channel
+ * is removed and its interrupt is disabled. The channel must not be busy
+ *
+ * channel: Channel number returned by dmaAlloc_claim
+ *
+ * returns: void
+ */
+void dmaAlloc_release( int channel );
+
+/*
+ * Function: dmaAlloc_getOwner
+ * --------------------
+ * Find out who claimed a channel, useful when debugging
+ *
+ * channel: Channel number
+ *
+ * returns: t_dmaAllocOwner the owner, e_dmaAllocOwnerNone if the channel was
+ *          not claimed through this module
+ */
+t_dmaAllocOwner dmaAlloc_getOwner( int channel );
+
+/*
+ * Function: dmaAlloc_setCallback
+ * --------------------
+ * Call a function each time a transfer on the channel finishes. The channel
+ * raises DMA_IRQ_1, and the shared handler is installed on the first call.
+ * Passing NULL disables the interrupt for the channel
+ *
+ * channel: Channel number returned by dmaAlloc_claim
+ * callback: Function to be called from interrupt context, or NULL
+ *
+ * returns: int 0 on success
+ *              1 on fail because the channel wasn't claimed through this module
+ */
+int dmaAlloc_setCallback( int channel, t_dmaAllocCallback callback );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DMA_ALLOC_H
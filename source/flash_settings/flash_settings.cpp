@@ -0,0 +1,220 @@
+#include "flash_settings.hpp"
+
+#include <string.h>
+
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+#define FLASH_SETTINGS_OFFSET    ( PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE )
+#define FLASH_SETTINGS_SLOT_SIZE ( FLASH_SECTOR_SIZE / FLASH_SETTINGS_SLOTS )
+#define FLASH_SETTINGS_MAGIC     ( 0x53544553UL ) // "SETS"
+#define FLASH_SETTINGS_DMA_TIMEOUT_MS  ( 100U ) // Longest a DMA transfer from flash is waited for
+#define FLASH_SETTINGS_SAFE_TIMEOUT_MS ( 100U ) // Longest the other core is waited for to stop using the flash
+
+// Start of each slot, the CRC32 of it is in the last 4 bytes of the slot
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence; // One more than the record written before it
+    uint16_t version;
+    uint16_t size;     // Of t_flashSettings
+    t_flashSettings settings;
+} t_flashSettingsRecord;
+
+// What m_program needs, as flash_safe_execute only passes it one pointer
+typedef struct
+{
+    uint32_t offset;
+    const uint8_t* dataPtr;
+    bool isEraseNeeded;
+} t_flashProgramParams;
+
+static_assert( ( sizeof( t_flashSettingsRecord ) + sizeof( uint32_t ) ) <= FLASH_SETTINGS_SLOT_SIZE,
+    "t_flashSettings doesn't fit in a slot, use fewer slots" );
+static_assert( ( FLASH_SETTINGS_SLOT_SIZE % FLASH_PAGE_SIZE ) == 0U,
+    "Slots must be a whole number of flash pages" );
+
+static inline const uint8_t* m_slotPtr( uint8_t slot );
+static int m_findNewest( t_flashSettingsRecord* recordPtr );
+static bool m_isSlotErased( uint8_t slot );
+static uint32_t m_crc32( const uint8_t data[], size_t length );
+static bool m_waitForFlashDma( void );
+static void m_program( void* paramsPtr );
+
+int flashSettings_read( t_flashSettings* flashSettingsPtr )
+{
+    t_flashSettingsRecord record;
+
+    if( m_findNewest( &record ) < 0 )
+        return 1;
+
+    *flashSettingsPtr = record.settings;
+    return 0;
+}
+
+int flashSettings_write( const t_flashSettings* flashSettingsPtr )
+{
+    // Static to keep it off the stack
+    static uint8_t slotData[FLASH_SETTINGS_SLOT_SIZE];
+    t_flashSettingsRecord record;
+    int newestSlot = m_findNewest( &record );
+    uint32_t sequence = 0U;
+    uint8_t slot = 0U;
+    bool isEraseNeeded;
+    uint32_t crc;
+    t_flashProgramParams params;
+
+    if( newestSlot >= 0 )
+    {
+        // Save the flash from wearing out when nothing has changed
+        if( memcmp( &record.settings, flashSettingsPtr, sizeof( t_flashSettings ) ) == 0 )
+            return 0;
+        sequence = record.sequence + 1U;
+        slot = (uint8_t) ( newestSlot + 1 );
+    }
+    isEraseNeeded = ( slot >= FLASH_SETTINGS_SLOTS ) || !m_isSlotErased( slot );
+    if( isEraseNeeded )
+        slot = 0U;
+
+    // Zero any padding, so the CRC32 doesn't depend on what was on the stack
+    memset( &record, 0, sizeof( record ) );
+    record.magic = FLASH_SETTINGS_MAGIC;
+    record.sequence = sequence;
+    record.version = FLASH_SETTINGS_VERSION;
+    record.size = sizeof( t_flashSettings );
+    record.settings = *flashSettingsPtr;
+
+    memset( slotData, 0xFF, sizeof( slotData ) );
+    memcpy( slotData, &record, sizeof( record ) );
+    crc = m_crc32( slotData, sizeof( record ) );
+    memcpy( &slotData[FLASH_SETTINGS_SLOT_SIZE - sizeof( crc )], &crc, sizeof( crc ) );
+
+    // Nothing can be read from flash while it's being written, including code
+    // run by interrupts or the other core, and DMA transfers
+    if( !m_waitForFlashDma() )
+        return 2;
+    params.offset = FLASH_SETTINGS_OFFSET + ( slot * FLASH_SETTINGS_SLOT_SIZE );
+    params.dataPtr = slotData;
+    params.isEraseNeeded = isEraseNeeded;
+    if( flash_safe_execute( m_program, &params, FLASH_SETTINGS_SAFE_TIMEOUT_MS ) != PICO_OK )
+        return 3;
+
+    return ( memcmp( m_slotPtr( slot ), slotData, FLASH_SETTINGS_SLOT_SIZE ) == 0 ) ? 0 : 1;
+}
+
+// --- MODULE SCOPE FUNCTIONS ---
+
+static inline const uint8_t* m_slotPtr( uint8_t slot )
+{
+    return (const uint8_t*) (uintptr_t) ( XIP_BASE + FLASH_SETTINGS_OFFSET + ( slot * FLASH_SETTINGS_SLOT_SIZE ) );
+}
+
+/*
+ * Function: m_findNewest
+ * --------------------
+ * Find the slot with the highest sequence number out of those with a correct
+ * CRC32, magic number, version and size
+ *
+ * recordPtr: Where the newest record goes
+ *
+ * returns: int the slot on success
+ *              -1 on fail because no slots are correct
+ */
+static int m_findNewest( t_flashSettingsRecord* recordPtr )
+{
+    t_flashSettingsRecord record;
+    uint32_t crc;
+    int newestSlot = -1;
+
+    for( uint8_t slot = 0U; slot < FLASH_SETTINGS_SLOTS; slot++ )
+    {
+        memcpy( &record, m_slotPtr( slot ), sizeof( record ) );
+        memcpy( &crc, &m_slotPtr( slot )[FLASH_SETTINGS_SLOT_SIZE - sizeof( crc )], sizeof( crc ) );
+        if( ( record.magic != FLASH_SETTINGS_MAGIC ) || ( record.version != FLASH_SETTINGS_VERSION ) ||
+            ( record.size != sizeof( t_flashSettings ) ) ||
+            ( crc != m_crc32( m_slotPtr( slot ), sizeof( record ) ) ) )
+            continue;
+
+        if( ( newestSlot < 0 ) || ( record.sequence > recordPtr->sequence ) )
+        {
+            *recordPtr = record;
+            newestSlot = slot;
+        }
+    }
+
+    return newestSlot;
+}
+
+static bool m_isSlotErased( uint8_t slot )
+{
+    const uint8_t* slotPtr = m_slotPtr( slot );
+
+    for( uint16_t index = 0U; index < FLASH_SETTINGS_SLOT_SIZE; index++ )
+    {
+        if( slotPtr[index] != 0xFFU )
+            return false;
+    }
+    return true;
+}
+
+// The usual CRC32 (as in zip), a bit at a time as the records are small
+static uint32_t m_crc32( const uint8_t data[], size_t length )
+{
+    uint32_t crc = 0xFFFFFFFFUL;
+
+    for( size_t index = 0U; index < length; index++ )
+    {
+        crc ^= data[index];
+        for( uint8_t bit = 0U; bit < 8U; bit++ )
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320UL & ( 0U - ( crc & 1U ) ) );
+    }
+    return ~crc;
+}
+
+/*
+ * Function: m_waitForFlashDma
+ * --------------------
+ * Wait for any DMA channel reading from flash (any of the XIP aliases, which
+ * are all below SRAM) to finish, for up to FLASH_SETTINGS_DMA_TIMEOUT_MS
+ *
+ * parameters: none
+ *
+ * returns: bool true if none are reading from flash
+ *               false if one still was when it timed out
+ */
+static bool m_waitForFlashDma( void )
+{
+    absolute_time_t timeoutTs = make_timeout_time_ms( FLASH_SETTINGS_DMA_TIMEOUT_MS );
+
+    for( uint channel = 0U; channel < NUM_DMA_CHANNELS; channel++ )
+    {
+        while( dma_channel_is_busy( channel ) && ( dma_hw->ch[channel].read_addr >= XIP_BASE ) &&
+            ( dma_hw->ch[channel].read_addr < SRAM_BASE ) )
+        {
+            if( absolute_time_diff_us( get_absolute_time(), timeoutTs ) < 0 )
+                return false;
+            tight_loop_contents();
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: m_program
+ * --------------------
+ * Erase the sector if needed then program a slot. Run by flash_safe_execute,
+ * which stops interrupts and the other core from reading flash meanwhile
+ *
+ * paramsPtr: A t_flashProgramParams
+ *
+ * returns: void
+ */
+static void m_program( void* paramsPtr )
+{
+    const t_flashProgramParams* programParamsPtr = (const t_flashProgramParams*) paramsPtr;
+
+    if( programParamsPtr->isEraseNeeded )
+        flash_range_erase( FLASH_SETTINGS_OFFSET, FLASH_SECTOR_SIZE );
+    flash_range_program( programParamsPtr->offset, programParamsPtr->dataPtr, FLASH_SETTINGS_SLOT_SIZE );
+}
@@ -0,0 +1,63 @@
+#ifndef FLASH_SETTINGS_HPP
+#define FLASH_SETTINGS_HPP
+
+/* Keeps a small record in the last sector of the on-chip flash, for anything
+ * which has to be known at boot before the SD card can be read. The sector is
+ * split in to FLASH_SETTINGS_SLOTS slots which are written in turn, so it is
+ * only erased once every FLASH_SETTINGS_SLOTS writes. Each slot has a CRC32,
+ * so if the power is cut while a slot is written the previous record is read
+ * instead (unless it was cut while the sector was being erased).
+ * It also keeps the last settings read from the SD card, so they can be used
+ * at boot straight away, and still be used if the SD card can't be read.
+ * Nothing else in the project may use the last sector of the flash */
+
+#include "pico/stdlib.h"
+
+#include "settings.hpp"
+
+#define FLASH_SETTINGS_SLOTS   ( 16U )
+#define FLASH_SETTINGS_VERSION ( 2U ) // Change whenever t_flashSettings changes, older records are then ignored
+
+typedef struct
+{
+    uint8_t sdClockStep; // SPI clock step the SD card last calibrated to, see sd_card.h
+    bool isSdCardSettingsValid; // False until the settings have been read from the SD card once
+    t_sdCardSettings sdCardSettings; // The last settings read from the SD card successfully
+} t_flashSettings;
+
+/*
+ * Function: flashSettings_read
+ * --------------------
+ * Read the newest record from flash
+ *
+ * flashSettingsPtr: Where the record goes, left alone if there isn't one
+ *
+ * returns: int 0 on success
+ *              1 on fail because there is no record with a correct CRC32 and
+ *                FLASH_SETTINGS_VERSION, e.g. on the first boot
+ */
+int flashSettings_read( t_flashSettings* flashSettingsPtr );
+
+/*
+ * Function: flashSettings_write
+ * --------------------
+ * Write a record to the next free slot, erasing the sector first if none are
+ * free. Nothing is written if the newest record is already the same.
+ * The flash is written through flash_safe_execute, so interrupts are disabled
+ * (and the other core paused if it's running) for up to ~50 ms when the
+ * sector has to be erased, so only call it when that doesn't matter.
+ * Waits for any DMA transfer reading from flash to finish first, e.g. an
+ * image from the asset pack being sent to the display
+ *
+ * flashSettingsPtr: The record
+ *
+ * returns: int 0 on success
+ *              1 on fail because it read back different to what was written
+ *              2 on fail because a DMA transfer from flash didn't finish in
+ *                FLASH_SETTINGS_DMA_TIMEOUT_MS, nothing was written
+ *              3 on fail because flash_safe_execute couldn't make the flash
+ *                safe to write, nothing was written
+ */
+int flashSettings_write( const t_flashSettings* flashSettingsPtr );
+
+#endif // FLASH_SETTINGS_HPP
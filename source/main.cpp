@@ -8,7 +8,7 @@
 #if !defined(OLED_INCLUDE_FONT12) || !defined(OLED_INCLUDE_FONT20)  || !defined(OLED_INCLUDE_LOADING_CIRCLE) || !defined(OLED_INCLUDE_LOADING_BAR_HORIZONTAL) || !defined(OLED_INCLUDE_SD_IMAGES) || !defined(OLED_INCLUDE_QR_GENERATOR)
 #error "A required part of oled.hpp has not been included"
 // Parts of oled.hpp that should not have been included
-#elif defined(OLED_INCLUDE_FONT8) || defined(OLED_INCLUDE_FONT16) || defined(OLED_INCLUDE_FONT24) || defined(OLED_INCLUDE_TEST_FUNCTION)
+#elif defined(OLED_INCLUDE_TEST_FUNCTION)
 #error "An unnecessary part of oled.hpp has been included, this can waste lots of RAM or program space"
 #endif
 
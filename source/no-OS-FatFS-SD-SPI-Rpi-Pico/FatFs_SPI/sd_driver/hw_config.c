@@ -62,11 +62,16 @@ static spi_t spis[] = {  // One for each SPI.
         .mosi_gpio = 11,
         .sck_gpio = 10,
 
-        .baud_rate = 1000 * 1000
-        // .baud_rate = 12500 * 1000
-        // .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333.
+        // The fastest the SD card's clock is ramped up to, see sd_card.h. Cards
+        // which misbehave at this speed are stepped down to one that works.
+        // Without SD_CRC_ENABLED nothing is verified, so it stays at 1 MHz
+        .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333.
     }};
 
+// Sector cache for each SD card, see sector_cache.h. Uses about
+// 512 * ( SECTOR_CACHE_SECTORS + 2 * SECTOR_CACHE_READ_AHEAD ) bytes of RAM
+static sector_cache_t sd_card_caches[1];
+
 // Hardware Configuration of the SD Card "objects"
 static sd_card_t sd_cards[] = {  // One for each SD card
     {
@@ -75,8 +80,10 @@ static sd_card_t sd_cards[] = {  // One for each SD card
         .ss_gpio = 9,    // The SPI slave select GPIO for this SD card
         .use_card_detect = false,
         .card_detect_gpio = 22,  // Card detect
-        .card_detected_true = 1  // What the GPIO read returns when a card is
-                                 // present.
+        .card_detected_true = 1,  // What the GPIO read returns when a card is
+                                  // present.
+        .cache = &sd_card_caches[0],
+        .clock_hint = SD_CLOCK_NO_HINT  // Set from flash by sm_init.cpp
     }};
 
 /* ********************************************************************** */
@@ -366,6 +366,8 @@ static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
 // An SD card can only do one thing at a time.
 static void sd_lock(sd_card_t *pSD) {
     myASSERT(mutex_is_initialized(&pSD->mutex));
+    // An asynchronous read keeps the card locked until it has finished
+    if (pSD->async_read.busy) sd_read_blocks_finish(pSD);
     mutex_enter_blocking(&pSD->mutex);
 }
 static void sd_unlock(sd_card_t *pSD) {
@@ -809,9 +811,8 @@ static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
 
     return 0;
 }
+static int sd_read_block_crc(sd_card_t *pSD, const uint8_t *buffer, uint32_t length);
 static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
-    uint16_t crc;
-
     // read until start byte (0xFE)
     if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
@@ -822,7 +823,12 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     if (!sd_spi_transfer(pSD, NULL, buffer, length)) {
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    // Read the CRC16 checksum for the data block
+    return sd_read_block_crc(pSD, buffer, length);
+}
+// Read the CRC16 checksum for the data block, after the block itself
+static int sd_read_block_crc(sd_card_t *pSD, const uint8_t *buffer, uint32_t length) {
+    uint16_t crc;
+
     crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
     crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
 
@@ -838,6 +844,10 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
     }
+#else
+    (void)buffer;
+    (void)length;
+    (void)crc;
 #endif
 
     return SD_BLOCK_DEVICE_ERROR_NONE;
@@ -874,8 +884,9 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     // receive the data : one block at a time
     int rd_status = 0;
     while (blockCnt) {
-        if (0 != sd_read_block(pSD, buffer, _block_size)) {
-            rd_status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        // Keep CRC errors apart from timeouts, for sd_clock_step_down
+        rd_status = sd_read_block(pSD, buffer, _block_size);
+        if (0 != rd_status) {
             break;
         }
         buffer += _block_size;
@@ -888,16 +899,155 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     return rd_status ? rd_status : status;
 }
 
+// SPI clock rates for each clock step, slowest first. The first is the rate
+// this driver always used
+static const uint sd_clock_rates[SD_CLOCK_STEPS] = {
+    1000 * 1000, 5 * 1000 * 1000, 12500 * 1000, 25 * 1000 * 1000};
+
+/* Count a transfer error against the clock step in use. If it was a CRC error
+or a timeout, and there is a slower step, go down to it.
+Returns true if the clock was stepped down, so the transfer should be retried */
+static bool sd_clock_step_down(sd_card_t *pSD, int status) {
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) {
+        ++pSD->crc_errors[pSD->clock_step];
+    } else if (SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status) {
+        ++pSD->timeouts[pSD->clock_step];
+    } else {
+        return false;
+    }
+    if (0 == pSD->clock_step) return false;
+    --pSD->clock_step;
+    DBG_PRINTF("%s: SPI clock down to %u Hz\r\n", __FUNCTION__,
+               sd_clock_rates[pSD->clock_step]);
+    sd_spi_set_frequency(pSD, sd_clock_rates[pSD->clock_step]);
+    return true;
+}
+
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount) {
     sd_acquire(pSD);
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, ulSectorCount);
-    int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    int status;
+    do {
+        status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    } while (sd_clock_step_down(pSD, status));
     sd_release(pSD);
     return status;
 }
 
+/* Asynchronous reads. sd_read_blocks_start sends the read command and waits for
+the first block's start token, then the block comes in by DMA while the caller
+gets on with something else. sd_read_blocks_poll checks each block's CRC16 and
+looks for the next block's start token without blocking, so it has to be
+called until it stops returning SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK. The card
+stays locked until then. sd_lock finishes the read first, so anything else
+done with the card in the meantime just waits for it */
+
+static void sd_async_read_dma_done(void *context) {
+    sd_card_t *pSD = (sd_card_t *)context;
+    if (pSD->async_read.callback) pSD->async_read.callback(pSD, pSD->async_read.context);
+}
+
+static void sd_async_read_receive(sd_card_t *pSD) {
+    pSD->async_read.receiving = true;
+    sd_spi_transfer_start(pSD, NULL, pSD->async_read.buffer, _block_size,
+                          sd_async_read_dma_done, pSD);
+}
+
+static int sd_async_read_end(sd_card_t *pSD, int status) {
+    sd_async_read_t *p_read = &pSD->async_read;
+    if (p_read->multiple) {
+        int stop_status = sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status) status = stop_status;
+    }
+    // It isn't retried here like sd_read_blocks does, the caller can start it again
+    (void)sd_clock_step_down(pSD, status);
+    p_read->status = status;
+    p_read->busy = false;
+    sd_release(pSD);
+    return status;
+}
+
+int sd_read_blocks_start(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                         uint32_t ulSectorCount, sd_read_callback_t callback, void *context) {
+    sd_async_read_t *p_read = &pSD->async_read;
+    TRACE_PRINTF("sd_read_blocks_start(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
+                 ulSectorNumber, ulSectorCount);
+
+    sd_acquire(pSD);
+    if (0 == ulSectorCount || ulSectorNumber + ulSectorCount > pSD->sectors ||
+        (pSD->m_Status & (STA_NOINIT | STA_NODISK))) {
+        sd_release(pSD);
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    uint64_t addr;
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    if (SDCARD_V2HC == pSD->card_type) {
+        addr = ulSectorNumber;
+    } else {
+        addr = ulSectorNumber * _block_size;
+    }
+    p_read->multiple = ulSectorCount > 1;
+    int status = sd_cmd(pSD, p_read->multiple ? CMD18_READ_MULTIPLE_BLOCK : CMD17_READ_SINGLE_BLOCK,
+                        addr, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        (void)sd_clock_step_down(pSD, status);
+        sd_release(pSD);
+        return status;
+    }
+
+    p_read->busy = true;
+    p_read->receiving = false;
+    p_read->buffer = buffer;
+    p_read->blocks_left = ulSectorCount;
+    p_read->callback = callback;
+    p_read->context = context;
+    if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
+        return sd_async_read_end(pSD, SD_BLOCK_DEVICE_ERROR_NO_RESPONSE);
+    }
+    sd_async_read_receive(pSD);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+int sd_read_blocks_poll(sd_card_t *pSD) {
+    sd_async_read_t *p_read = &pSD->async_read;
+    while (p_read->busy) {
+        if (p_read->receiving) {
+            if (!sd_spi_transfer_done(pSD)) return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+            p_read->receiving = false;
+            int status = sd_spi_transfer_wait(pSD, 0)
+                             ? sd_read_block_crc(pSD, p_read->buffer, _block_size)
+                             : SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status || 0 == --p_read->blocks_left) {
+                return sd_async_read_end(pSD, status);
+            }
+            p_read->buffer += _block_size;
+            p_read->timeout = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+        }
+        // One byte at a time, looking for the next block's start token
+        if (SPI_START_BLOCK == sd_spi_write(pSD, SPI_FILL_CHAR)) {
+            sd_async_read_receive(pSD);
+        } else if (0 > absolute_time_diff_us(get_absolute_time(), p_read->timeout)) {
+            DBG_PRINTF("%s: timeout\r\n", __FUNCTION__);
+            return sd_async_read_end(pSD, SD_BLOCK_DEVICE_ERROR_NO_RESPONSE);
+        } else {
+            return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+        }
+    }
+    return p_read->status;
+}
+
+int sd_read_blocks_finish(sd_card_t *pSD) {
+    int status;
+    while (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == (status = sd_read_blocks_poll(pSD))) {
+        tight_loop_contents();
+    }
+    return status;
+}
+
 static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
                               uint8_t token, uint32_t length) {
     uint16_t crc = (~0);
@@ -1020,11 +1170,75 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     sd_acquire(pSD);
     TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, blockCnt);
-    int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    int status;
+    do {
+        status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    } while (sd_clock_step_down(pSD, status));
     sd_release(pSD);
     return status;
 }
 
+#if SD_CRC_ENABLED
+#define SD_CLOCK_VERIFY_READS 4 /*!< Reads of the boot sector which must all pass at a clock step */
+
+static uint8_t sd_clock_block[512];
+
+/* Read sector 0 SD_CLOCK_VERIFY_READS times at a clock step. Each read is
+checked with the CRC16 sent by the card, and against the CRC16 of the copy
+read at the initialisation clock */
+static int sd_clock_verify(sd_card_t *pSD, uint8_t step, uint16_t expected) {
+    sd_spi_set_frequency(pSD, sd_clock_rates[step]);
+    for (int i = 0; i < SD_CLOCK_VERIFY_READS; i++) {
+        int status = in_sd_read_blocks(pSD, sd_clock_block, 0, 1);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status &&
+            expected != crc16((const char *)sd_clock_block, sizeof(sd_clock_block))) {
+            status = SD_BLOCK_DEVICE_ERROR_CRC;
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            if (SD_BLOCK_DEVICE_ERROR_CRC == status) ++pSD->crc_errors[step];
+            if (SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status) ++pSD->timeouts[step];
+            return status;
+        }
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+#endif
+
+/* Choose the SPI clock for data transfer, once the card is initialised.
+If pSD->clock_hint passes sd_clock_verify it's used straight away. Otherwise
+the clock is ramped up from the slowest step, stopping below the first step
+which fails or at spi->baud_rate. Without CRC16 nothing can be verified, so
+the slowest step is used */
+static void sd_clock_calibrate(sd_card_t *pSD) {
+    uint8_t top = 0;
+    while (top + 1 < SD_CLOCK_STEPS && sd_clock_rates[top + 1] <= pSD->spi->baud_rate) {
+        ++top;
+    }
+    pSD->clock_step = 0;
+#if SD_CRC_ENABLED
+    if (crc_on && SD_BLOCK_DEVICE_ERROR_NONE == in_sd_read_blocks(pSD, sd_clock_block, 0, 1)) {
+        uint16_t expected = crc16((const char *)sd_clock_block, sizeof(sd_clock_block));
+        if (pSD->clock_hint <= top &&
+            SD_BLOCK_DEVICE_ERROR_NONE == sd_clock_verify(pSD, pSD->clock_hint, expected)) {
+            pSD->clock_step = pSD->clock_hint;
+        } else {
+            for (uint8_t step = 1; step <= top; step++) {
+                if (SD_BLOCK_DEVICE_ERROR_NONE != sd_clock_verify(pSD, step, expected)) break;
+                pSD->clock_step = step;
+            }
+        }
+    }
+#else
+    // Nothing to check the reads with, so stay at the slowest step, which is
+    // the rate this driver always used. spi->baud_rate is only a cap
+    (void)top;
+#endif
+    // Kept apart from clock_step, so a step down later isn't saved as the next boot's hint
+    pSD->clock_calibrated = pSD->clock_step;
+    DBG_PRINTF("%s: SPI clock %u Hz\r\n", __FUNCTION__, sd_clock_rates[pSD->clock_step]);
+    sd_spi_set_frequency(pSD, sd_clock_rates[pSD->clock_step]);
+}
+
 static int sd_init_medium(sd_card_t *pSD) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response, arg;
@@ -1225,12 +1439,12 @@ static int sd_init(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
-    // Set SCK for data transfer
-    sd_spi_go_high_frequency(pSD);
-
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
 
+    // Set SCK for data transfer, after the card is initialized so it can be read
+    sd_clock_calibrate(pSD);
+
     sd_spi_release(pSD);
     sd_unlock(pSD);
 
@@ -21,17 +21,41 @@ specific language governing permissions and limitations under the License.
 //
 #include "hardware/gpio.h"
 #include "pico/mutex.h"
+#include "pico/time.h"
 //
 #include "ff.h"
 //
 #include "spi.h"
+#include "sector_cache.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// SPI clock rates the card is ramped through after initialisation, see
+// sd_clock_rates in sd_card.c
+#define SD_CLOCK_STEPS 4
+#define SD_CLOCK_NO_HINT 0xFF
+
 typedef struct sd_card_t sd_card_t;
 
+// Called from the DMA interrupt each time a block of an asynchronous read has
+// arrived, so whoever is waiting knows to call sd_read_blocks_poll. Keep it short
+typedef void (*sd_read_callback_t)(sd_card_t *sd_card_p, void *context);
+
+// An asynchronous read, see sd_read_blocks_start in sd_card.c
+typedef struct {
+    bool busy;                // From sd_read_blocks_start until a poll finishes it
+    bool receiving;           // A block's data is coming in by DMA
+    bool multiple;            // Read with CMD18, so it's stopped with CMD12
+    uint8_t *buffer;          // Where the block being received goes
+    uint32_t blocks_left;     // Including the one being received
+    absolute_time_t timeout;  // For the next block's start token
+    int status;               // The result, once it isn't busy
+    sd_read_callback_t callback;
+    void *context;
+} sd_async_read_t;
+
 // "Class" representing SD Cards
 struct sd_card_t {
     const char *pcName;
@@ -54,6 +78,16 @@ struct sd_card_t {
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    sector_cache_t *cache;  // Between FatFs and the card, NULL for none. See sector_cache.h
+    // SPI clock calibration. After initialisation the clock is ramped up to
+    // spi->baud_rate, checking reads with CRC16 at each step, and it steps back
+    // down whenever a transfer fails with a CRC error or times out
+    uint8_t clock_hint;  // Step to try first, e.g. saved from the last boot. SD_CLOCK_NO_HINT to ramp up
+    uint8_t clock_step;  // Step in use, assigned dynamically
+    uint8_t clock_calibrated;  // Step chosen by the last calibration, clock_step can be lower after errors
+    uint32_t crc_errors[SD_CLOCK_STEPS];  // At each step
+    uint32_t timeouts[SD_CLOCK_STEPS];    // At each step
+    sd_async_read_t async_read;
 
     int (*init)(sd_card_t *sd_card_p);
     int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
@@ -91,6 +125,13 @@ bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
 
 bool sd_init_driver();
+
+// Asynchronous block reads, one at a time per card. Anything else done with the
+// card waits for the read to finish first. See sd_card.c
+int sd_read_blocks_start(sd_card_t *sd_card_p, uint8_t *buffer, uint64_t ulSectorNumber,
+                         uint32_t ulSectorCount, sd_read_callback_t callback, void *context);
+int sd_read_blocks_poll(sd_card_t *sd_card_p);
+int sd_read_blocks_finish(sd_card_t *sd_card_p);
 bool sd_card_detect(sd_card_t *sd_card_p);
 
 #ifdef __cplusplus
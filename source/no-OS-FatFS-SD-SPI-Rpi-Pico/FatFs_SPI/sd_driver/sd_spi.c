@@ -38,6 +38,10 @@ void sd_spi_go_low_frequency(sd_card_t *pSD) {
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
 }
+void sd_spi_set_frequency(sd_card_t *pSD, uint baud_rate) {
+    uint actual = spi_set_baudrate(pSD->spi->hw_inst, baud_rate);
+    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+}
 
 #pragma GCC diagnostic pop
 
@@ -91,6 +95,19 @@ bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
     return spi_transfer(pSD->spi, tx, rx, length);
 }
 
+void sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                           spi_callback_t callback, void *context) {
+    spi_transfer_start(pSD->spi, tx, rx, length, callback, context);
+}
+
+bool sd_spi_transfer_done(sd_card_t *pSD) {
+    return spi_transfer_done(pSD->spi);
+}
+
+bool sd_spi_transfer_wait(sd_card_t *pSD, uint32_t timeout_ms) {
+    return spi_transfer_wait(pSD->spi, timeout_ms);
+}
+
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     // TRACE_PRINTF("%s\n", __FUNCTION__);
     uint8_t received = SPI_FILL_CHAR;
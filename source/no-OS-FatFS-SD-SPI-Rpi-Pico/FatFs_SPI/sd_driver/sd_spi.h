@@ -21,12 +21,18 @@ specific language governing permissions and limitations under the License.
 /* Transfer tx to SPI while receiving SPI to rx. 
 tx or rx can be NULL if not important. */
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+/* sd_spi_transfer in two halves, see spi_transfer_start */
+void sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                           spi_callback_t callback, void *context);
+bool sd_spi_transfer_done(sd_card_t *pSD);
+bool sd_spi_transfer_wait(sd_card_t *pSD, uint32_t timeout_ms);
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value);
 void sd_spi_deselect_pulse(sd_card_t *pSD);
 void sd_spi_acquire(sd_card_t *pSD);
 void sd_spi_release(sd_card_t *pSD);
 void sd_spi_go_low_frequency(sd_card_t *this);
 void sd_spi_go_high_frequency(sd_card_t *this);
+void sd_spi_set_frequency(sd_card_t *pSD, uint baud_rate);
 
 /* 
 After power up, the host starts the clock and sends the initializing sequence on the CMD line. 
@@ -0,0 +1,366 @@
+/* sector_cache.c
+Write-back sector cache between FatFs (glue.c) and the SD card driver, see
+sector_cache.h
+*/
+
+#include <string.h>
+//
+#include "sector_cache.h"
+
+#define SECTOR_CACHE_NO_SLOT (-1)
+#define SECTOR_CACHE_NO_BANK (-1)
+
+static uint32_t load_word(const uint8_t *p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8); }
+
+static uint32_t load_dword(const uint8_t *p) {
+    return load_word(p) | (load_word(&p[2]) << 16);
+}
+
+static bool in_range(const sector_cache_range_t *range, uint64_t sector) {
+    return sector >= range->first && sector < range->end;
+}
+
+static bool is_pinned_sector(const sector_cache_t *cache, uint64_t sector) {
+    if (SECTOR_CACHE_MAX_PINNED == 0) return false;
+    return in_range(&cache->pinned_ranges[0], sector) ||
+           in_range(&cache->pinned_ranges[1], sector);
+}
+
+static int find_slot(const sector_cache_t *cache, uint64_t sector) {
+    for (int i = 0; i < SECTOR_CACHE_SECTORS; i++) {
+        if (cache->slots[i].valid && cache->slots[i].sector == sector) return i;
+    }
+    return SECTOR_CACHE_NO_SLOT;
+}
+
+static void ahead_update(sector_cache_t *cache, const uint8_t *buffer, uint64_t sector);
+
+static int write_back(sector_cache_t *cache, int i) {
+    int rc = cache->backend.write_blocks(cache->backend.context, cache->data[i],
+                                         cache->slots[i].sector, 1);
+    if (rc) return rc;
+    cache->slots[i].dirty = false;
+    cache->stats.write_backs++;
+    // It may have been read ahead from the card before this was written
+    ahead_update(cache, cache->data[i], cache->slots[i].sector);
+    return 0;
+}
+
+// Find a slot for a sector which isn't cached, writing back what was in it if
+// needed. *slot is SECTOR_CACHE_NO_SLOT if every slot is pinned and the sector
+// isn't a pinned one
+static int take_slot(sector_cache_t *cache, bool pinned, int *slot) {
+    int pinned_count = 0;
+    for (int i = 0; i < SECTOR_CACHE_SECTORS; i++) {
+        if (cache->slots[i].valid && cache->slots[i].pinned) pinned_count++;
+    }
+    // A pinned sector replaces another pinned one once there are enough
+    bool replace_pinned = pinned && pinned_count >= SECTOR_CACHE_MAX_PINNED;
+
+    *slot = SECTOR_CACHE_NO_SLOT;
+    for (int i = 0; i < SECTOR_CACHE_SECTORS; i++) {
+        const sector_cache_slot_t *p_slot = &cache->slots[i];
+        if (!p_slot->valid) {
+            if (!replace_pinned) {
+                *slot = i;
+                break;
+            }
+            continue;
+        }
+        if (p_slot->pinned != replace_pinned) continue;
+        if (*slot == SECTOR_CACHE_NO_SLOT ||
+            p_slot->last_used < cache->slots[*slot].last_used)
+            *slot = i;
+    }
+
+    if (*slot != SECTOR_CACHE_NO_SLOT && cache->slots[*slot].valid &&
+        cache->slots[*slot].dirty) {
+        int rc = write_back(cache, *slot);
+        if (rc) {
+            *slot = SECTOR_CACHE_NO_SLOT;
+            return rc;
+        }
+    }
+    return 0;
+}
+
+static void fill_slot(sector_cache_t *cache, int i, uint64_t sector, bool pinned) {
+    cache->slots[i].sector = sector;
+    cache->slots[i].valid = true;
+    cache->slots[i].dirty = false;
+    cache->slots[i].pinned = pinned;
+    cache->slots[i].last_used = ++cache->clock;
+}
+
+// Which read-ahead buffer has the sector, including one still being read
+static int ahead_find(const sector_cache_t *cache, uint64_t sector) {
+    for (int b = 0; b < 2; b++) {
+        if (sector >= cache->ahead_first[b] &&
+            sector < cache->ahead_first[b] + cache->ahead_count[b])
+            return b;
+    }
+    return SECTOR_CACHE_NO_BANK;
+}
+
+// Wait for the background read, if there is one. The backend can only do one
+// thing at a time, so this comes before anything else uses it
+static void ahead_finish(sector_cache_t *cache) {
+    int b = cache->ahead_pending;
+    if (b == SECTOR_CACHE_NO_BANK) return;
+    cache->ahead_pending = SECTOR_CACHE_NO_BANK;
+    if (cache->backend.read_blocks_finish(cache->backend.context)) cache->ahead_count[b] = 0;
+}
+
+// Start reading the sectors after read-ahead buffer b in to the other one in
+// the background, while b is being used
+static void ahead_prefetch(sector_cache_t *cache, int b) {
+#if SECTOR_CACHE_READ_AHEAD > 0
+    if (!cache->backend.read_blocks_start || cache->ahead_pending != SECTOR_CACHE_NO_BANK) return;
+    uint64_t sector = cache->ahead_first[b] + cache->ahead_count[b];
+    int other = 1 - b;
+    if (sector >= cache->sector_count) return;
+    if (cache->ahead_count[other] && cache->ahead_first[other] == sector) return;
+    uint32_t ahead_count = SECTOR_CACHE_READ_AHEAD;
+    if (sector + ahead_count > cache->sector_count)
+        ahead_count = (uint32_t)(cache->sector_count - sector);
+    cache->ahead_count[other] = 0;
+    // If it can't be started it's read when it's needed instead
+    if (cache->backend.read_blocks_start(cache->backend.context, cache->ahead_data[other][0],
+                                         sector, ahead_count))
+        return;
+    cache->ahead_first[other] = sector;
+    cache->ahead_count[other] = ahead_count;
+    cache->ahead_pending = other;
+    cache->next_sequential = sector + ahead_count;
+    cache->stats.read_aheads++;
+#else
+    (void)cache;
+    (void)b;
+#endif
+}
+
+// Keep the read-ahead buffers the same as what has been written. Nothing may
+// be being read in to them in the background
+static void ahead_update(sector_cache_t *cache, const uint8_t *buffer, uint64_t sector) {
+#if SECTOR_CACHE_READ_AHEAD > 0
+    int b = ahead_find(cache, sector);
+    if (b != SECTOR_CACHE_NO_BANK)
+        memcpy(cache->ahead_data[b][sector - cache->ahead_first[b]], buffer,
+               SECTOR_CACHE_SECTOR_SIZE);
+#else
+    (void)cache;
+    (void)buffer;
+    (void)sector;
+#endif
+}
+
+// If the sector is the boot sector of a FAT or exFAT volume, pin its FAT(s)
+// and root directory. FatFs reads it while mounting, before anything else on
+// the volume
+static void check_boot_sector(sector_cache_t *cache, const uint8_t *b, uint64_t sector) {
+    if (load_word(&b[510]) != 0xAA55) return;
+    if (b[0] != 0xEB && b[0] != 0xE9 && b[0] != 0xE8) return;  // Jump instruction
+
+    if (memcmp(&b[3], "EXFAT   ", 8) == 0) {
+        uint64_t fat_first = sector + load_dword(&b[80]);
+        uint32_t cluster_shift = b[109];
+        uint64_t heap = sector + load_dword(&b[88]);
+        uint32_t root_cluster = load_dword(&b[96]);
+        if (cluster_shift > 25 || root_cluster < 2) return;
+        cache->pinned_ranges[0].first = fat_first;
+        cache->pinned_ranges[0].end = fat_first + (uint64_t)load_dword(&b[84]) * b[110];
+        cache->pinned_ranges[1].first = heap + ((uint64_t)(root_cluster - 2) << cluster_shift);
+        cache->pinned_ranges[1].end = cache->pinned_ranges[1].first + (1U << cluster_shift);
+        return;
+    }
+
+    uint32_t bytes_per_sector = load_word(&b[11]);
+    uint32_t sectors_per_cluster = b[13];
+    uint32_t reserved_sectors = load_word(&b[14]);
+    uint32_t fats = b[16];
+    uint32_t root_sectors = (load_word(&b[17]) * 32 + SECTOR_CACHE_SECTOR_SIZE - 1) /
+                            SECTOR_CACHE_SECTOR_SIZE;
+    uint32_t fat_size = load_word(&b[22]);
+    if (!fat_size) fat_size = load_dword(&b[36]);
+    if (bytes_per_sector != SECTOR_CACHE_SECTOR_SIZE || !sectors_per_cluster ||
+        (sectors_per_cluster & (sectors_per_cluster - 1)) || !reserved_sectors || fats < 1 ||
+        fats > 2 || !fat_size)
+        return;
+
+    // FAT12/16 have the root directory straight after the FATs
+    cache->pinned_ranges[0].first = sector + reserved_sectors;
+    cache->pinned_ranges[0].end =
+        cache->pinned_ranges[0].first + (uint64_t)fats * fat_size + root_sectors;
+    cache->pinned_ranges[1].first = 0;
+    cache->pinned_ranges[1].end = 0;
+    if (!root_sectors) {
+        // FAT32 has it in a cluster
+        uint32_t root_cluster = load_dword(&b[44]);
+        if (root_cluster < 2) return;
+        cache->pinned_ranges[1].first = cache->pinned_ranges[0].end +
+                                        (uint64_t)(root_cluster - 2) * sectors_per_cluster;
+        cache->pinned_ranges[1].end = cache->pinned_ranges[1].first + sectors_per_cluster;
+    }
+}
+
+void sector_cache_init(sector_cache_t *cache, const sector_cache_backend_t *backend,
+                       uint64_t sector_count) {
+    memset(cache->slots, 0, sizeof(cache->slots));
+    memset(cache->pinned_ranges, 0, sizeof(cache->pinned_ranges));
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    cache->backend = *backend;
+    cache->sector_count = sector_count;
+    memset(cache->ahead_first, 0, sizeof(cache->ahead_first));
+    memset(cache->ahead_count, 0, sizeof(cache->ahead_count));
+    cache->ahead_pending = SECTOR_CACHE_NO_BANK;
+    cache->next_sequential = UINT64_MAX;
+    cache->clock = 0;
+}
+
+int sector_cache_read(sector_cache_t *cache, uint8_t *buffer, uint64_t sector, uint32_t count) {
+    int rc;
+
+    if (count > 1) {
+        // Part of a file, straight from the card, then anything newer from the cache
+        ahead_finish(cache);
+        rc = cache->backend.read_blocks(cache->backend.context, buffer, sector, count);
+        if (rc) return rc;
+        cache->stats.misses += count;
+        for (int i = 0; i < SECTOR_CACHE_SECTORS; i++) {
+            const sector_cache_slot_t *p_slot = &cache->slots[i];
+            if (p_slot->valid && p_slot->dirty && p_slot->sector >= sector &&
+                p_slot->sector < sector + count)
+                memcpy(&buffer[(p_slot->sector - sector) * SECTOR_CACHE_SECTOR_SIZE],
+                       cache->data[i], SECTOR_CACHE_SECTOR_SIZE);
+        }
+        cache->next_sequential = sector + count;
+        return 0;
+    }
+
+    int i = find_slot(cache, sector);
+    if (i != SECTOR_CACHE_NO_SLOT) {
+        memcpy(buffer, cache->data[i], SECTOR_CACHE_SECTOR_SIZE);
+        cache->slots[i].last_used = ++cache->clock;
+        cache->stats.hits++;
+        return 0;
+    }
+
+#if SECTOR_CACHE_READ_AHEAD > 0
+    int b = ahead_find(cache, sector);
+    if (b != SECTOR_CACHE_NO_BANK && b == cache->ahead_pending) {
+        cache->stats.ahead_waits++;
+        ahead_finish(cache);
+        b = ahead_find(cache, sector);
+    }
+    if (b != SECTOR_CACHE_NO_BANK) {
+        memcpy(buffer, cache->ahead_data[b][sector - cache->ahead_first[b]],
+               SECTOR_CACHE_SECTOR_SIZE);
+        cache->stats.hits++;
+        ahead_prefetch(cache, b);
+        return 0;
+    }
+#endif
+    ahead_finish(cache);
+#if SECTOR_CACHE_READ_AHEAD > 0
+    // Reading in order, so fetch this sector and the next few in one go
+    if (sector == cache->next_sequential && sector + 1 < cache->sector_count) {
+        uint32_t ahead_count = SECTOR_CACHE_READ_AHEAD;
+        if (sector + ahead_count > cache->sector_count)
+            ahead_count = (uint32_t)(cache->sector_count - sector);
+        cache->ahead_count[0] = 0;
+        rc = cache->backend.read_blocks(cache->backend.context, cache->ahead_data[0][0], sector,
+                                        ahead_count);
+        if (!rc) {
+            cache->ahead_first[0] = sector;
+            cache->ahead_count[0] = ahead_count;
+            cache->next_sequential = sector + ahead_count;
+            cache->stats.read_aheads++;
+            cache->stats.misses++;
+            memcpy(buffer, cache->ahead_data[0][0], SECTOR_CACHE_SECTOR_SIZE);
+            ahead_prefetch(cache, 0);
+            return 0;
+        }
+        // Try just the one sector
+    }
+#endif
+
+    cache->stats.misses++;
+    cache->next_sequential = sector + 1;
+    bool pinned = is_pinned_sector(cache, sector);
+    rc = take_slot(cache, pinned, &i);
+    if (rc) return rc;
+    if (i == SECTOR_CACHE_NO_SLOT) {
+        rc = cache->backend.read_blocks(cache->backend.context, buffer, sector, 1);
+    } else {
+        rc = cache->backend.read_blocks(cache->backend.context, cache->data[i], sector, 1);
+        if (rc) {
+            cache->slots[i].valid = false;
+        } else {
+            fill_slot(cache, i, sector, pinned);
+            memcpy(buffer, cache->data[i], SECTOR_CACHE_SECTOR_SIZE);
+        }
+    }
+    if (rc) return rc;
+
+    check_boot_sector(cache, buffer, sector);
+    return 0;
+}
+
+int sector_cache_write(sector_cache_t *cache, const uint8_t *buffer, uint64_t sector,
+                       uint32_t count) {
+    int rc;
+
+    ahead_finish(cache);
+    if (count > 1) {
+        // Part of a file, straight to the card. Cached copies are now clean
+        rc = cache->backend.write_blocks(cache->backend.context, buffer, sector, count);
+        if (rc) return rc;
+        for (uint32_t n = 0; n < count; n++) {
+            const uint8_t *p_data = &buffer[n * SECTOR_CACHE_SECTOR_SIZE];
+            int i = find_slot(cache, sector + n);
+            if (i != SECTOR_CACHE_NO_SLOT) {
+                memcpy(cache->data[i], p_data, SECTOR_CACHE_SECTOR_SIZE);
+                cache->slots[i].dirty = false;
+            }
+            ahead_update(cache, p_data, sector + n);
+        }
+        return 0;
+    }
+
+    ahead_update(cache, buffer, sector);
+    check_boot_sector(cache, buffer, sector);
+
+    int i = find_slot(cache, sector);
+    if (i == SECTOR_CACHE_NO_SLOT) {
+        bool pinned = is_pinned_sector(cache, sector);
+        rc = take_slot(cache, pinned, &i);
+        if (rc) return rc;
+        if (i == SECTOR_CACHE_NO_SLOT)
+            return cache->backend.write_blocks(cache->backend.context, buffer, sector, 1);
+        fill_slot(cache, i, sector, pinned);
+    } else {
+        cache->slots[i].last_used = ++cache->clock;
+    }
+    memcpy(cache->data[i], buffer, SECTOR_CACHE_SECTOR_SIZE);
+    cache->slots[i].dirty = true;
+    return 0;
+}
+
+int sector_cache_sync(sector_cache_t *cache) {
+    ahead_finish(cache);
+    // In sector order, which is kinder to the card
+    while (true) {
+        int lowest = SECTOR_CACHE_NO_SLOT;
+        for (int i = 0; i < SECTOR_CACHE_SECTORS; i++) {
+            if (cache->slots[i].valid && cache->slots[i].dirty &&
+                (lowest == SECTOR_CACHE_NO_SLOT ||
+                 cache->slots[i].sector < cache->slots[lowest].sector))
+                lowest = i;
+        }
+        if (lowest == SECTOR_CACHE_NO_SLOT) return 0;
+        int rc = write_back(cache, lowest);
+        if (rc) return rc;
+    }
+}
+
+/* [] END OF FILE */
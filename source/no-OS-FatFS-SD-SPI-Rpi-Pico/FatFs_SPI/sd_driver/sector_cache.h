@@ -0,0 +1,109 @@
+/* sector_cache.h
+Write-back sector cache between FatFs (glue.c) and the SD card driver.
+
+- Single sector reads and writes go through an LRU cache of
+  SECTOR_CACHE_SECTORS sectors. Writes stay in the cache, marked dirty, until
+  they're evicted or sector_cache_sync is called (FatFs does that with
+  CTRL_SYNC from f_sync and f_close).
+- The FAT and root directory sectors are pinned, so reading a big file can't
+  push them out. They're found from the boot sector when FatFs reads it while
+  mounting. At most SECTOR_CACHE_MAX_PINNED slots are pinned at once.
+- When single sectors are read one after another, the next
+  SECTOR_CACHE_READ_AHEAD sectors are read in one multi-block read into a
+  separate buffer. If the backend can read in the background, the sectors
+  after those are read into a second buffer while the first is used.
+- Multi-sector reads and writes are the bulk of a file, so they go straight
+  to the card without filling the cache.
+
+It doesn't depend on the pico SDK, the card is reached through a
+sector_cache_backend_t, so it can be run on a PC against a RAM disk.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SECTOR_CACHE_SECTORS
+#define SECTOR_CACHE_SECTORS 8  // Slots in the LRU cache, each uses 512 bytes of RAM
+#endif
+#ifndef SECTOR_CACHE_MAX_PINNED
+#define SECTOR_CACHE_MAX_PINNED 4  // Slots which FAT and root directory sectors can keep
+#endif
+#ifndef SECTOR_CACHE_READ_AHEAD
+#define SECTOR_CACHE_READ_AHEAD 4  // Sectors read at once when reading sequentially, each uses 512 bytes of RAM, 0 for none
+#endif
+
+#define SECTOR_CACHE_SECTOR_SIZE 512
+
+// Reaches the card, all return SD_BLOCK_DEVICE_ERROR_NONE (0) on success
+typedef struct {
+    void *context;  // Passed to all the functions, e.g. the sd_card_t
+    int (*read_blocks)(void *context, uint8_t *buffer, uint64_t sector, uint32_t count);
+    int (*write_blocks)(void *context, const uint8_t *buffer, uint64_t sector, uint32_t count);
+    // Optional, NULL if the backend can't read in the background. Once started,
+    // read_blocks_finish is called before anything else is done with the backend
+    int (*read_blocks_start)(void *context, uint8_t *buffer, uint64_t sector, uint32_t count);
+    int (*read_blocks_finish)(void *context);
+} sector_cache_backend_t;
+
+typedef struct {
+    uint32_t hits;         // Sectors read from the cache or the read-ahead buffer
+    uint32_t misses;       // Sectors read from the card
+    uint32_t read_aheads;  // Multi-block reads started because sectors were being read in order
+    uint32_t ahead_waits;  // Sectors which had to wait for a background read to finish
+    uint32_t write_backs;  // Dirty sectors written to the card
+} sector_cache_stats_t;
+
+typedef struct {
+    uint64_t sector;
+    uint32_t last_used;  // clock when it was last read or written
+    bool valid;
+    bool dirty;
+    bool pinned;
+} sector_cache_slot_t;
+
+// A range of sectors which is pinned, end is one past the last sector
+typedef struct {
+    uint64_t first;
+    uint64_t end;
+} sector_cache_range_t;
+
+typedef struct {
+    sector_cache_backend_t backend;
+    uint64_t sector_count;  // Of the card, read-ahead stops at the end
+    sector_cache_slot_t slots[SECTOR_CACHE_SECTORS];
+    uint8_t data[SECTOR_CACHE_SECTORS][SECTOR_CACHE_SECTOR_SIZE];
+#if SECTOR_CACHE_READ_AHEAD > 0
+    uint8_t ahead_data[2][SECTOR_CACHE_READ_AHEAD][SECTOR_CACHE_SECTOR_SIZE];
+#endif
+    uint64_t ahead_first[2];
+    uint32_t ahead_count[2];   // Sectors in each of ahead_data, 0 if none
+    int ahead_pending;         // Which of ahead_data is being read in the background, or -1
+    uint64_t next_sequential;  // The sector after the last one read from the card
+    sector_cache_range_t pinned_ranges[2];  // The FAT(s), and the root directory
+    uint32_t clock;
+    sector_cache_stats_t stats;
+} sector_cache_t;
+
+// Start empty, e.g. after the card has been (re)initialised. Nothing dirty is written
+void sector_cache_init(sector_cache_t *cache, const sector_cache_backend_t *backend,
+                       uint64_t sector_count);
+
+// Both return SD_BLOCK_DEVICE_ERROR_NONE (0) on success, or the backend's error
+int sector_cache_read(sector_cache_t *cache, uint8_t *buffer, uint64_t sector, uint32_t count);
+int sector_cache_write(sector_cache_t *cache, const uint8_t *buffer, uint64_t sector,
+                       uint32_t count);
+
+// Write every dirty sector to the card
+int sector_cache_sync(sector_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -21,6 +21,7 @@ specific language governing permissions and limitations under the License.
 //
 #include "my_debug.h"
 #include "hw_config.h"
+#include "dma_alloc.h"
 //
 #include "spi.h"
 
@@ -39,6 +40,7 @@ static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p)
                 bool ok = sem_release(&spi_p->sem);
                 assert(ok);
                 (void) ok; // TF AVOID UNUSED VARIABLE ERROR
+                if (spi_p->callback) spi_p->callback(spi_p->callback_context);
             }
         }
     }
@@ -61,6 +63,15 @@ void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
 //     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
 //     element.
 bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    spi_transfer_start(spi_p, tx, rx, length, NULL, NULL);
+    return spi_transfer_wait(spi_p, 1000); /* Timeout 1 sec */
+}
+
+// Start an SPI transfer, see spi_transfer. callback (can be NULL) is called
+// from the DMA interrupt when it has finished. spi_transfer_wait must be
+// called before the next transfer
+void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                        spi_callback_t callback, void *context) {
     // assert(512 == length || 1 == length);
     assert(tx || rx);
     // assert(!(tx && rx));
@@ -107,13 +118,22 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
             assert(false);
     }
     sem_reset(&spi_p->sem, 0);
+    spi_p->callback = callback;
+    spi_p->callback_context = context;
 
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << spi_p->tx_dma) | (1u << spi_p->rx_dma));
+}
 
+// True once the transfer started by spi_transfer_start has finished
+bool spi_transfer_done(spi_t *spi_p) {
+    return sem_available(&spi_p->sem);
+}
+
+// Wait for the transfer started by spi_transfer_start to finish
+bool spi_transfer_wait(spi_t *spi_p, uint32_t timeOut) {
     /* Wait until master completes transfer or time out has occured. */
-    uint32_t timeOut = 1000; /* Timeout 1 sec */
     bool rc = sem_acquire_timeout_ms(
         &spi_p->sem, timeOut);  // Wait for notification from ISR
     if (!rc) {
@@ -184,9 +204,20 @@ bool my_spi_init(spi_t *spi_p) {
         // SD cards' DO MUST be pulled up.
         gpio_pull_up(spi_p->miso_gpio);
 
-        // Grab some unused dma channels
-        spi_p->tx_dma = dma_claim_unused_channel(true);
-        spi_p->rx_dma = dma_claim_unused_channel(true);
+        // Grab some unused dma channels. These come from the project's
+        // allocator, which the display also claims its channel from
+        int tx_dma = dmaAlloc_claim(e_dmaAllocOwnerSdCard);
+        int rx_dma = dmaAlloc_claim(e_dmaAllocOwnerSdCard);
+        if (tx_dma < 0 || rx_dma < 0) {
+            DBG_PRINTF("No free DMA channels in %s\n", __FUNCTION__);
+            dmaAlloc_release(tx_dma);
+            dmaAlloc_release(rx_dma);
+            spi_unlock(spi_p);
+            mutex_exit(&my_spi_init_mutex);
+            return false;
+        }
+        spi_p->tx_dma = (uint)tx_dma;
+        spi_p->rx_dma = (uint)rx_dma;
 
         spi_p->tx_dma_cfg = dma_channel_get_default_config(spi_p->tx_dma);
         spi_p->rx_dma_cfg = dma_channel_get_default_config(spi_p->rx_dma);
@@ -27,6 +27,10 @@ specific language governing permissions and limitations under the License.
 
 #define SPI_FILL_CHAR (0xFF)
 
+// Called from the DMA interrupt when a transfer started by spi_transfer_start
+// has finished
+typedef void (*spi_callback_t)(void *context);
+
 // "Class" representing SPIs
 typedef struct {
     // SPI HW
@@ -53,6 +57,8 @@ typedef struct {
     bool initialized;  
     semaphore_t sem;
     mutex_t mutex;    
+    spi_callback_t callback;  // For the transfer in progress, NULL for none
+    void *callback_context;
 } spi_t;
 
 #ifdef __cplusplus
@@ -60,6 +66,12 @@ extern "C" {
 #endif
   
 bool __not_in_flash_func(spi_transfer)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);  
+// spi_transfer in two halves, so something else can be done while the DMA runs
+void __not_in_flash_func(spi_transfer_start)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx,
+                                             size_t length, spi_callback_t callback,
+                                             void *context);
+bool spi_transfer_done(spi_t *pSPI);
+bool __not_in_flash_func(spi_transfer_wait)(spi_t *pSPI, uint32_t timeout_ms);
 void spi_lock(spi_t *pSPI);
 void spi_unlock(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
@@ -32,6 +32,27 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
 
+// sector_cache_backend_t functions, the context is the sd_card_t
+static int cache_read_blocks(void *context, uint8_t *buffer, uint64_t sector, uint32_t count) {
+    sd_card_t *p_sd = (sd_card_t *)context;
+    return p_sd->read_blocks(p_sd, buffer, sector, count);
+}
+
+static int cache_write_blocks(void *context, const uint8_t *buffer, uint64_t sector,
+                              uint32_t count) {
+    sd_card_t *p_sd = (sd_card_t *)context;
+    return p_sd->write_blocks(p_sd, buffer, sector, count);
+}
+
+static int cache_read_blocks_start(void *context, uint8_t *buffer, uint64_t sector,
+                                   uint32_t count) {
+    return sd_read_blocks_start((sd_card_t *)context, buffer, sector, count, NULL, NULL);
+}
+
+static int cache_read_blocks_finish(void *context) {
+    return sd_read_blocks_finish((sd_card_t *)context);
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -60,7 +81,14 @@ DSTATUS disk_initialize(
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
-    return p_sd->init(p_sd);  
+    DSTATUS status = p_sd->init(p_sd);
+    // It may be a different card, so start with an empty cache
+    if (!(status & STA_NOINIT) && p_sd->cache) {
+        sector_cache_backend_t backend = {p_sd, cache_read_blocks, cache_write_blocks,
+                                          cache_read_blocks_start, cache_read_blocks_finish};
+        sector_cache_init(p_sd->cache, &backend, p_sd->sectors);
+    }
+    return status;
 }
 
 static int sdrc2dresult(int sd_rc) {
@@ -98,7 +126,11 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    int rc;
+    if (p_sd->cache)
+        rc = sector_cache_read(p_sd->cache, buff, sector, count);
+    else
+        rc = p_sd->read_blocks(p_sd, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -116,7 +148,11 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    int rc;
+    if (p_sd->cache)
+        rc = sector_cache_write(p_sd->cache, buff, sector, count);
+    else
+        rc = p_sd->write_blocks(p_sd, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -160,7 +196,8 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
+        case CTRL_SYNC:  // Write anything the cache is holding back
+            if (p_sd->cache) return sdrc2dresult(sector_cache_sync(p_sd->cache));
             return RES_OK;
         default:
             return RES_PARERR;
@@ -24,4 +24,22 @@ typedef struct
   uint16_t Height;
 } tFontTable;
 
+// The packed fonts made from the tables by utils/makefonts.py, see autogen_fonts.h
+typedef struct
+{
+  uint32_t x : 5;        // Bounding box of the lit pixels within the character cell
+  uint32_t y : 5;
+  uint32_t width : 5;
+  uint32_t height : 5;
+  uint32_t offset : 12;  // Index in the font's data of the first byte of the glyph
+} tFontGlyph;
+
+typedef struct
+{
+  const uint8_t *data;
+  const tFontGlyph *glyphs; // ascii 32 to 126
+  uint16_t Width;
+  uint16_t Height;
+} tFontPacked;
+
 #endif /* FONT_COMMON_H */    
@@ -0,0 +1,61 @@
+#ifndef FF_H
+#define FF_H
+
+/* The part of the FatFs API that oled.cpp uses, on top of stdio, so that SD
+ * images can be drawn on a PC. Drive "0:" is the folder set by
+ * OLED_HOST_SD_CARD_DIRECTORY in host/CMakeLists.txt, and a path starting with
+ * "1:" is in OLED_HOST_IMAGE_DIRECTORY */
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef char TCHAR;
+typedef uint32_t FSIZE_t;
+typedef uint16_t WORD;
+
+typedef enum {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED
+} FRESULT;
+
+typedef struct {
+    BYTE fs_type;
+} FATFS;
+
+typedef struct {
+    FILE* filePtr;
+    FSIZE_t size;
+} FIL;
+
+typedef struct {
+    FSIZE_t fsize;
+    WORD fdate;
+    WORD ftime;
+} FILINFO;
+
+#define FA_READ     0x01
+
+FRESULT f_mount( FATFS* fs, const TCHAR* path, BYTE opt );
+FRESULT f_open( FIL* fp, const TCHAR* path, BYTE mode );
+FRESULT f_close( FIL* fp );
+FRESULT f_read( FIL* fp, void* buff, UINT btr, UINT* br );
+FRESULT f_lseek( FIL* fp, FSIZE_t ofs );
+TCHAR* f_gets( TCHAR* buff, int len, FIL* fp );
+// Only for storage.cpp to build, the folder is never changed
+FRESULT f_unlink( const TCHAR* path );
+FRESULT f_rename( const TCHAR* path_old, const TCHAR* path_new );
+FRESULT f_stat( const TCHAR* path, FILINFO* fno );
+
+#define f_size(fp) ((fp)->size)
+#define f_rewind(fp) f_lseek((fp), 0)
+#define f_unmount(path) f_mount(0, path, 0)
+
+#endif // FF_H
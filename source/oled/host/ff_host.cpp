@@ -0,0 +1,97 @@
+/* --- STANDARD LIBRARY INCLUDES ---------------------------------------------- */
+#include "ff.h"
+#include "oled_host.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+/* --- PREPROCESSOR -----------------------------------------------------------*/
+#define FF_HOST_PATH_SIZE       ( 256U )
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+static uint32_t m_sdBytesRead = 0U;
+
+/* --- PUBLIC FUNCTION IMPLEMENTATIONS ---------------------------------------- */
+
+FRESULT f_mount( FATFS* fs, const TCHAR* path, BYTE opt )
+{
+    // The folder is always there
+    (void) fs;
+    (void) path;
+    (void) opt;
+
+    return FR_OK;
+}
+
+FRESULT f_open( FIL* fp, const TCHAR* path, BYTE mode )
+{
+    char hostPath[FF_HOST_PATH_SIZE];
+
+    (void) mode; // Only reading is supported
+    if( strncmp( path, "1:", 2U ) == 0 )
+        snprintf( hostPath, sizeof( hostPath ), "%s/%s", OLED_HOST_IMAGE_DIRECTORY, &path[2] );
+    else
+        snprintf( hostPath, sizeof( hostPath ), "%s/%s", OLED_HOST_SD_CARD_DIRECTORY, path );
+    fp->filePtr = fopen( hostPath, "rb" );
+    if( fp->filePtr == NULL )
+        return FR_NO_FILE;
+
+    fseek( fp->filePtr, 0, SEEK_END );
+    fp->size = (FSIZE_t) ftell( fp->filePtr );
+    fseek( fp->filePtr, 0, SEEK_SET );
+
+    return FR_OK;
+}
+
+FRESULT f_close( FIL* fp )
+{
+    return ( fclose( fp->filePtr ) == 0 ) ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_read( FIL* fp, void* buff, UINT btr, UINT* br )
+{
+    *br = (UINT) fread( buff, 1U, btr, fp->filePtr );
+    m_sdBytesRead += *br;
+
+    return ferror( fp->filePtr ) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_lseek( FIL* fp, FSIZE_t ofs )
+{
+    return ( fseek( fp->filePtr, (long) ofs, SEEK_SET ) == 0 ) ? FR_OK : FR_DISK_ERR;
+}
+
+TCHAR* f_gets( TCHAR* buff, int len, FIL* fp )
+{
+    TCHAR* result = fgets( buff, len, fp->filePtr );
+
+    if( result != NULL )
+        m_sdBytesRead += (uint32_t) strlen( result );
+
+    return result;
+}
+
+FRESULT f_unlink( const TCHAR* path )
+{
+    (void) path;
+    return FR_DENIED;
+}
+
+FRESULT f_rename( const TCHAR* path_old, const TCHAR* path_new )
+{
+    (void) path_old;
+    (void) path_new;
+    return FR_DENIED;
+}
+
+FRESULT f_stat( const TCHAR* path, FILINFO* fno )
+{
+    (void) path;
+    (void) fno;
+    return FR_DENIED;
+}
+
+uint32_t oledHost_getSdBytesRead( void )
+{
+    return m_sdBytesRead;
+}
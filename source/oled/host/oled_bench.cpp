@@ -0,0 +1,550 @@
+/* Runs the OLED driver against the emulated panel in oled_transport_host.cpp
+ * and prints what each drawing call costs on the SPI. Any single call whose
+ * estimated time doesn't fit in one main loop period is flagged, and the exit
+ * code is then 1. It is also 1 if an image in sd_card/ doesn't draw the same
+ * as its uncompressed copy in host/images/, or a palette image in there doesn't
+ * draw the same as its QOI565 copy, or if black drawn into a colour layer
+ * doesn't cover the layer under it.
+ *
+ * usage: oled_bench [snapshot directory]
+ * If a directory is given, a PPM image of the screen is saved after each test */
+
+#include "oled.hpp"
+#include "oled_host.hpp"
+
+#include <stdio.h>
+
+/* --- PREPROCESSOR -----------------------------------------------------------*/
+// Keep these the same as OLED_BAUD_RATE_HZ and MAIN_LOOP_TIME_PERIOD_MS in
+// settings.hpp, which can't be included here as it needs the pico SDK
+#define BENCH_BAUD_RATE_HZ      ( 14000000U )
+#define BENCH_LOOP_BUDGET_US    ( 50U * 1000U )
+#define BENCH_DISPLAY_SIZE      ( 128U )
+// The same as the gauge in pump.cpp
+#define BENCH_GAUGE_INNER_RADIUS ( 45U )
+#define BENCH_GAUGE_OUTER_RADIUS ( 55U )
+#define BENCH_GAUGE_COLOUR       ( 0xBE9CU )
+#define BENCH_TEXT_COLOUR        ( 0x2444U )
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+typedef struct
+{
+    const char* name;
+    uint32_t calls;
+    uint32_t worstCallUs;
+    t_oledHostStats total;
+    uint32_t sdBytesAtBegin;
+} t_benchResult;
+
+#ifdef OLED_INCLUDE_SD_IMAGES
+// oled_sdWriteImage or one of the functions like it
+typedef int ( *t_drawImage )( const char filename[], uint8_t originX, uint8_t originY );
+#endif // OLED_INCLUDE_SD_IMAGES
+
+static t_benchResult m_result;
+static const char* m_snapshotDirectory = NULL;
+static bool m_isOverBudget = false;
+static bool m_isImageWrong = false;
+static bool m_isLayerWrong = false;
+
+/* --- MODULE SCOPE FUNCTION PROTOTYPES --------------------------------------- */
+static void m_benchBegin( const char name[] );
+static void m_callBegin( void );
+static void m_callEnd( void );
+static void m_benchEnd( void );
+#ifdef OLED_INCLUDE_SD_IMAGES
+static void m_checkImage( t_drawImage drawImage, const char filename[], const char referenceFilename[] );
+#endif // OLED_INCLUDE_SD_IMAGES
+
+/* --- MAIN ------------------------------------------------------------------- */
+
+int main( int argc, char* argv[] )
+{
+    char text[32];
+
+    if( argc > 1 )
+        m_snapshotDirectory = argv[1];
+
+    printf( "%-24s %5s %6s %6s %6s %8s %9s %9s %6s\n", "test", "calls", "trans", "dc", "cmd", "data",
+        "worst ms", "total ms", "sd" );
+
+    // The pins don't matter on the host
+    oled_init( 19, 18, 17, 16, 20, 0, BENCH_BAUD_RATE_HZ, BENCH_DISPLAY_SIZE, BENCH_DISPLAY_SIZE );
+
+    m_benchBegin( "clear" );
+    m_callBegin();
+    oled_clear();
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "fill_rect_64x64" );
+    m_callBegin();
+    oled_fillRect( 32U, 32U, 64U, 64U, 0xF800U );
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "set_pixel_diagonal" );
+    for( uint8_t i = 0U; i < BENCH_DISPLAY_SIZE; i++ )
+    {
+        m_callBegin();
+        oled_setPixel( i, i, 0xFFFFU );
+        m_callEnd();
+    }
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "line_thickness_1" );
+    m_callBegin();
+    oled_drawLineBetweenPoints( 0U, 0U, 127U, 90U, 0x07E0U, 1U );
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "line_thickness_5" );
+    m_callBegin();
+    oled_drawLineBetweenPoints( 10U, 120U, 120U, 10U, 0x001FU, 5U );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "fill_circle" );
+    m_callBegin();
+    oled_fillCircle( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS, 0xF800U );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "draw_circle" );
+    m_callBegin();
+    oled_drawCircle( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS,
+        BENCH_GAUGE_OUTER_RADIUS - BENCH_GAUGE_INNER_RADIUS, BENCH_GAUGE_COLOUR );
+    m_callEnd();
+    m_benchEnd();
+
+    // The gauge's redline on top of part of its ring
+    oled_clear();
+    m_benchBegin( "draw_arc" );
+    m_callBegin();
+    oled_drawArc( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS,
+        BENCH_GAUGE_INNER_RADIUS, 0, 250, BENCH_GAUGE_COLOUR );
+    m_callEnd();
+    m_callBegin();
+    oled_drawArc( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS,
+        BENCH_GAUGE_INNER_RADIUS, 300, 380, 0xF800U );
+    m_callEnd();
+    m_callBegin();
+    oled_drawLineBetweenPoints( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, 20U, 40U, 0xF800U, 2U );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "write_text_font12" );
+    m_callBegin();
+    oled_writeText( 0U, 0U, "Hello, basil!", 12U, BENCH_TEXT_COLOUR, false );
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "write_text_font20" );
+    m_callBegin();
+    oled_writeText( 0U, 20U, "Watering", 20U, BENCH_TEXT_COLOUR, false );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "write_text_background" );
+    m_callBegin();
+    oled_writeTextWithBackground( 0U, 0U, "Hello, basil!", 12U, BENCH_TEXT_COLOUR, 0x0000U, false );
+    m_callEnd();
+    m_callBegin();
+    oled_writeTextWithBackground( ( BENCH_DISPLAY_SIZE - oled_measureText( "Watering", 20U ) ) / 2U, 20U,
+        "Watering", 20U, 0x0000U, BENCH_GAUGE_COLOUR, false );
+    m_callEnd();
+    m_callBegin();
+    oled_writeTextWithBackground( 0U, 60U, "Text which wraps onto the next lines", 12U, 0xFFFFU, 0x0000U, true );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "terminal_init_font12" );
+    m_callBegin();
+    oled_terminalInit( 12U, BENCH_TEXT_COLOUR );
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "terminal_write_font12" );
+    for( uint8_t line = 0U; line < 16U; line++ )
+    {
+        snprintf( text, sizeof( text ), "Line %u of the log", line );
+        m_callBegin();
+        oled_terminalWrite( text );
+        m_callEnd();
+    }
+    m_benchEnd();
+
+    m_benchBegin( "terminal_set_colour" );
+    m_callBegin();
+    oled_terminalSetNewColour( 0xFFE0U );
+    m_callEnd();
+    m_benchEnd();
+    oled_terminalDeinit();
+
+    oled_clear();
+    m_benchBegin( "terminal_scroll_init" );
+    m_callBegin();
+    oled_terminalInitScrolling( 12U, BENCH_TEXT_COLOUR );
+    m_callEnd();
+    m_benchEnd();
+
+    m_benchBegin( "terminal_scroll_write" );
+    for( uint8_t line = 0U; line < 16U; line++ )
+    {
+        snprintf( text, sizeof( text ), "Line %u of the log", line );
+        m_callBegin();
+        oled_terminalWrite( text );
+        m_callEnd();
+    }
+    m_benchEnd();
+
+    m_benchBegin( "terminal_scroll_colour" );
+    m_callBegin();
+    oled_terminalSetNewColour( 0xFFE0U );
+    m_callEnd();
+    m_benchEnd();
+    oled_clear();
+    oled_terminalDeinit();
+
+    oled_clear();
+    oled_terminalInit( 20U, BENCH_TEXT_COLOUR );
+    m_benchBegin( "terminal_write_font20" );
+    for( uint8_t line = 0U; line < 8U; line++ )
+    {
+        snprintf( text, sizeof( text ), "Pump %u", line );
+        m_callBegin();
+        oled_terminalWrite( text );
+        m_callEnd();
+    }
+    m_benchEnd();
+    oled_terminalDeinit();
+
+    oled_clear();
+    oled_loadingBarInit( 10U, 117U, 56U, 71U, BENCH_GAUGE_COLOUR );
+    m_benchBegin( "loading_bar_sweep" );
+    for( uint16_t progress = 0U; progress <= 255U; progress += 17U )
+    {
+        m_callBegin();
+        oled_loadingBarDisplay( (uint8_t) progress );
+        m_callEnd();
+    }
+    m_benchEnd();
+    oled_loadingBarDeinit();
+
+    oled_clear();
+    m_benchBegin( "loading_circle_init" );
+    m_callBegin();
+    oled_loadingCircleInit( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS,
+        BENCH_GAUGE_INNER_RADIUS, BENCH_GAUGE_COLOUR );
+    m_callEnd();
+    m_benchEnd();
+
+    // Like pump_run, small steps up then back down
+    m_benchBegin( "loading_circle_sweep" );
+    for( uint16_t progress = 0U; progress <= 252U; progress += 12U )
+    {
+        m_callBegin();
+        oled_loadingCircleDisplay( (uint8_t) progress );
+        m_callEnd();
+    }
+    for( int16_t progress = 252; progress >= 0; progress -= 36 )
+    {
+        m_callBegin();
+        oled_loadingCircleDisplay( (uint8_t) progress );
+        m_callEnd();
+    }
+    m_benchEnd();
+    oled_loadingCircleDeinit();
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+    // Like pump_run, the redline's own layer over the gauge. The gauge is
+    // started after the redline but mustn't draw over it
+    oled_clear();
+    t_oledLayer redlineLayer;
+    (void) oled_layerCreate( 0U, 0U, BENCH_DISPLAY_SIZE, BENCH_DISPLAY_SIZE / 2U, OLED_LAYER_Z_LOADING + 1,
+        e_oledLayerMono, 0xF800U, &redlineLayer );
+    (void) oled_layerSelect( redlineLayer );
+    oled_drawLineBetweenPoints( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, 10U, 30U, 0xF800U, 1U );
+    (void) oled_layerSelect( OLED_LAYER_NONE );
+    oled_loadingCircleInit( BENCH_DISPLAY_SIZE / 2U, BENCH_DISPLAY_SIZE / 2U, BENCH_GAUGE_OUTER_RADIUS,
+        BENCH_GAUGE_INNER_RADIUS, BENCH_GAUGE_COLOUR );
+    m_benchBegin( "layered_gauge_sweep" );
+    for( uint16_t progress = 0U; progress <= 252U; progress += 12U )
+    {
+        m_callBegin();
+        oled_loadingCircleDisplay( (uint8_t) progress );
+        m_callEnd();
+    }
+    m_benchEnd();
+    oled_loadingCircleDeinit();
+    oled_layerDestroy( redlineLayer );
+
+    // Black drawn into a colour layer covers the layers under it, e.g. the
+    // background of oled_writeTextWithBackground, rather than being see through
+    oled_clear();
+    t_oledLayer lowerLayer;
+    t_oledLayer upperLayer;
+    (void) oled_layerCreate( 0U, 0U, 32U, 32U, 0, e_oledLayerMono, 0xF800U, &lowerLayer );
+    (void) oled_layerCreate( 0U, 0U, 32U, 32U, 1, e_oledLayerColour, 0x0000U, &upperLayer );
+    (void) oled_layerSelect( lowerLayer );
+    oled_fillRect( 0U, 0U, 32U, 32U, 0xF800U );
+    (void) oled_layerSelect( upperLayer );
+    oled_fillRect( 0U, 0U, 16U, 32U, 0x0000U );
+    (void) oled_layerSelect( OLED_LAYER_NONE );
+    oled_flush();
+    if( ( oledHost_getPixel( 8U, 8U ) != 0x0000U ) || ( oledHost_getPixel( 24U, 8U ) != 0xF800U ) )
+    {
+        printf( "Black in a colour layer didn't cover the layer under it\n" );
+        m_isLayerWrong = true;
+    }
+    oled_layerDestroy( upperLayer );
+    oled_layerDestroy( lowerLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+    oled_clear();
+    m_benchBegin( "qr_code" );
+    m_callBegin();
+    oled_printQrCode( "http://192.168.1.100/settings", 0x0000U, 0xFFFFU );
+    m_callEnd();
+    m_benchEnd();
+
+#ifdef OLED_INCLUDE_SD_IMAGES
+    // The same as smWifi, read from sd_card/ by ff_host.cpp
+    oled_clear();
+    m_benchBegin( "sd_images_64x64" );
+    m_callBegin();
+    oled_sdWriteImage( "wifi64.oimg", 0U, 64U );
+    m_callEnd();
+    m_callBegin();
+    oled_sdWriteImage( "tick64.oimg", 64U, 64U );
+    m_callEnd();
+    m_benchEnd();
+
+    oled_clear();
+    m_benchBegin( "sd_images_palette" );
+    m_callBegin();
+    oled_sdWriteImage( "1:cross64_1bpp.oimg", 0U, 0U );
+    m_callEnd();
+    m_callBegin();
+    oled_sdWriteImage( "1:tick64_2bpp.oimg", 64U, 0U );
+    m_callEnd();
+    m_callBegin();
+    oled_sdWriteImage( "1:wifi64_4bpp.oimg", 0U, 64U );
+    m_callEnd();
+    m_callBegin();
+    oled_sdWriteImage( "1:wifi64_8bpp.oimg", 64U, 64U );
+    m_callEnd();
+    m_benchEnd();
+
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+    // Like smWifi on each connection attempt, only the first should read the card
+    oled_clear();
+    m_benchBegin( "sd_images_cached" );
+    for( uint8_t attempt = 0U; attempt < 3U; attempt++ )
+    {
+        m_callBegin();
+        oled_drawCachedImage( "wifi64.oimg", 0U, 64U );
+        m_callEnd();
+        m_callBegin();
+        oled_drawCachedImage( "tick64.oimg", 64U, 64U );
+        m_callEnd();
+    }
+    m_benchEnd();
+    oled_imageCacheClear();
+
+#ifdef OLED_INCLUDE_ASSET_PACK
+    // The same images from flash, which shouldn't read the card at all
+    oled_clear();
+    m_benchBegin( "asset_images" );
+    m_callBegin();
+    oled_drawAsset( "wifi64.oimg", 0U, 64U );
+    m_callEnd();
+    m_callBegin();
+    oled_drawAsset( "tick64.oimg", 64U, 64U );
+    m_callEnd();
+    m_benchEnd();
+#endif // OLED_INCLUDE_ASSET_PACK
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
+    m_checkImage( oled_sdWriteImage, "cross64.oimg", "1:cross64.oimg" );
+    m_checkImage( oled_sdWriteImage, "tick64.oimg", "1:tick64.oimg" );
+    m_checkImage( oled_sdWriteImage, "wifi64.oimg", "1:wifi64.oimg" );
+    m_checkImage( oled_sdWriteImage, "1:cross64_1bpp.oimg", "1:cross64_1bpp_qoi.oimg" );
+    m_checkImage( oled_sdWriteImage, "1:tick64_2bpp.oimg", "1:tick64_2bpp_qoi.oimg" );
+    m_checkImage( oled_sdWriteImage, "1:wifi64_4bpp.oimg", "1:wifi64_4bpp_qoi.oimg" );
+    // The icons have less than 256 colours, so this is the same as the original
+    m_checkImage( oled_sdWriteImage, "1:wifi64_8bpp.oimg", "1:wifi64.oimg" );
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+    // Sent from RAM without going through the line buffers
+    m_checkImage( oled_drawCachedImage, "1:wifi64.oimg", "1:wifi64_8bpp.oimg" );
+    oled_imageCacheClear();
+#endif // OLED_INCLUDE_IMAGE_CACHE
+#ifdef OLED_INCLUDE_ASSET_PACK
+    m_checkImage( oled_drawAsset, "cross64.oimg", "cross64.oimg" );
+    m_checkImage( oled_drawAsset, "tick64.oimg", "tick64.oimg" );
+    m_checkImage( oled_drawAsset, "wifi64.oimg", "wifi64.oimg" );
+#endif // OLED_INCLUDE_ASSET_PACK
+#endif // OLED_INCLUDE_SD_IMAGES
+
+    return ( m_isOverBudget || m_isImageWrong || m_isLayerWrong ) ? 1 : 0;
+}
+
+/* --- MODULE SCOPE FUNCTION IMPLEMENTATIONS ---------------------------------- */
+
+/*
+ * Function: m_benchBegin
+ * --------------------
+ * Start a test, which is made up of one or more measured calls
+ *
+ * name: Name of the test, also used for the snapshot filename
+ *
+ * returns: void
+ */
+static void m_benchBegin( const char name[] )
+{
+    // Send anything drawn while setting up, so it isn't counted
+    oled_flush();
+
+    m_result = ( t_benchResult ) { 0 };
+    m_result.name = name;
+    m_result.sdBytesAtBegin = oledHost_getSdBytesRead();
+}
+
+/*
+ * Function: m_callBegin
+ * --------------------
+ * Start measuring a single API call
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_callBegin( void )
+{
+    oledHost_resetStats();
+}
+
+/*
+ * Function: m_callEnd
+ * --------------------
+ * Finish measuring a single API call, including the flush which the main loop
+ * would do after it, and add it to the test
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_callEnd( void )
+{
+    oled_flush();
+
+    const t_oledHostStats stats = oledHost_getStats();
+    const uint32_t callUs = oledHost_estimateMicroseconds( &stats, BENCH_BAUD_RATE_HZ );
+
+    ++m_result.calls;
+    m_result.total.transactions += stats.transactions;
+    m_result.total.dcToggles += stats.dcToggles;
+    m_result.total.commandBytes += stats.commandBytes;
+    m_result.total.dataBytes += stats.dataBytes;
+    m_result.total.spiWrites += stats.spiWrites;
+    if( callUs > m_result.worstCallUs )
+        m_result.worstCallUs = callUs;
+}
+
+/*
+ * Function: m_benchEnd
+ * --------------------
+ * Print the results of the test and save a snapshot if asked to
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_benchEnd( void )
+{
+    char filename[256];
+    const uint32_t totalUs = oledHost_estimateMicroseconds( &m_result.total, BENCH_BAUD_RATE_HZ );
+    const bool isOverBudget = ( m_result.worstCallUs > BENCH_LOOP_BUDGET_US );
+
+    printf( "%-24s %5u %6u %6u %6u %8u %9.2f %9.2f %6u%s\n", m_result.name, m_result.calls,
+        m_result.total.transactions, m_result.total.dcToggles, m_result.total.commandBytes,
+        m_result.total.dataBytes, m_result.worstCallUs / 1000.0, totalUs / 1000.0,
+        oledHost_getSdBytesRead() - m_result.sdBytesAtBegin, isOverBudget ? "  OVER BUDGET" : "" );
+
+    if( isOverBudget )
+        m_isOverBudget = true;
+
+    if( m_snapshotDirectory != NULL )
+    {
+        snprintf( filename, sizeof( filename ), "%s/%s.ppm", m_snapshotDirectory, m_result.name );
+        if( oledHost_writePpm( filename ) != 0 )
+            printf( "Couldn't write %s\n", filename );
+    }
+}
+
+#ifdef OLED_INCLUDE_SD_IMAGES
+
+/*
+ * Function: m_checkImage
+ * --------------------
+ * Draw two images and check that they're the same. If they aren't it's printed
+ * and the exit code will be 1. Images in host/images/ are on drive 1, see
+ * ff_host.cpp
+ *
+ * drawImage: What draws the image being checked, the reference is always
+ *            drawn with oled_sdWriteImage
+ * filename: Name of the image being checked, which must fit on the display
+ * referenceFilename: Name of the image it should look like
+ *
+ * returns: void
+ */
+static void m_checkImage( t_drawImage drawImage, const char filename[], const char referenceFilename[] )
+{
+    static uint16_t referencePixels[BENCH_DISPLAY_SIZE][BENCH_DISPLAY_SIZE];
+    uint32_t wrongPixels = 0U;
+
+    oled_clear();
+    if( oled_sdWriteImage( referenceFilename, 0U, 0U ) != 0 )
+    {
+        printf( "Couldn't draw %s\n", referenceFilename );
+        m_isImageWrong = true;
+        return;
+    }
+    oled_flush();
+    for( uint8_t y = 0U; y < BENCH_DISPLAY_SIZE; y++ )
+    {
+        for( uint8_t x = 0U; x < BENCH_DISPLAY_SIZE; x++ )
+            referencePixels[y][x] = oledHost_getPixel( x, y );
+    }
+
+    oled_clear();
+    if( drawImage( filename, 0U, 0U ) != 0 )
+    {
+        printf( "Couldn't draw %s\n", filename );
+        m_isImageWrong = true;
+        return;
+    }
+    oled_flush();
+    for( uint8_t y = 0U; y < BENCH_DISPLAY_SIZE; y++ )
+    {
+        for( uint8_t x = 0U; x < BENCH_DISPLAY_SIZE; x++ )
+        {
+            if( oledHost_getPixel( x, y ) != referencePixels[y][x] )
+                ++wrongPixels;
+        }
+    }
+
+    if( wrongPixels != 0U )
+    {
+        printf( "%s has %u pixels different to %s\n", filename, wrongPixels, referenceFilename );
+        m_isImageWrong = true;
+    }
+}
+
+#endif // OLED_INCLUDE_SD_IMAGES
@@ -0,0 +1,91 @@
+#ifndef OLED_HOST_HPP
+#define OLED_HOST_HPP
+
+#include <stdint.h>
+
+/* Extra functions of the host transport (oled_transport_host.cpp), which
+ * emulates an SSD1351 in RAM so that the driver can be run on a PC */
+
+// What went over the (emulated) SPI since the last oledHost_resetStats
+typedef struct
+{
+    uint32_t transactions;  // Number of times CS went low then high
+    uint32_t dcToggles;     // Number of times DC changed level
+    uint32_t commandBytes;  // Bytes sent with DC low
+    uint32_t dataBytes;     // Parameter and pixel bytes sent with DC high
+    uint32_t spiWrites;     // Number of separate blocking or DMA writes
+} t_oledHostStats;
+
+/*
+ * Function: oledHost_resetStats
+ * --------------------
+ * Set all of the transport statistics to 0
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oledHost_resetStats( void );
+
+/*
+ * Function: oledHost_getStats
+ * --------------------
+ * Get the transport statistics since the last oledHost_resetStats
+ *
+ * parameters: none
+ *
+ * returns: t_oledHostStats the statistics
+ */
+t_oledHostStats oledHost_getStats( void );
+
+/*
+ * Function: oledHost_estimateMicroseconds
+ * --------------------
+ * Rough time the statistics would take on the real hardware: every byte at
+ * the given SPI clock, plus a fixed cost for each separate write and each
+ * transaction for the CPU work around it
+ *
+ * statsPtr: Statistics to estimate the time of
+ * baudrate: SPI clock in Hz, e.g. OLED_BAUD_RATE_HZ
+ *
+ * returns: uint32_t estimated time in microseconds
+ */
+uint32_t oledHost_estimateMicroseconds( const t_oledHostStats* statsPtr, unsigned int baudrate );
+
+/*
+ * Function: oledHost_getPixel
+ * --------------------
+ * Get a pixel as it would be seen on the panel, i.e. with the display start
+ * line applied
+ *
+ * x, y: Screen coordinates, 0 to 127
+ *
+ * returns: uint16_t the RGB565 colour
+ */
+uint16_t oledHost_getPixel( uint8_t x, uint8_t y );
+
+/*
+ * Function: oledHost_writePpm
+ * --------------------
+ * Save what would be seen on the panel as a binary PPM image
+ *
+ * filename: Path of the file to be written
+ *
+ * returns: int 0 on success
+ *              1 on fail because the file couldn't be written
+ */
+int oledHost_writePpm( const char filename[] );
+
+/*
+ * Function: oledHost_getSdBytesRead
+ * --------------------
+ * Get how many bytes have been read from files on the emulated SD card, by
+ * f_read and f_gets in ff_host.cpp
+ *
+ * parameters: none
+ *
+ * returns: uint32_t bytes read since the program started
+ */
+uint32_t oledHost_getSdBytesRead( void );
+
+#endif // OLED_HOST_HPP
@@ -0,0 +1,292 @@
+/* --- STANDARD LIBRARY INCLUDES ---------------------------------------------- */
+#include "oled_transport.hpp"
+#include "oled_host.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+/* --- PREPROCESSOR -----------------------------------------------------------*/
+#define OLED_HOST_PANEL_SIZE            ( 128U )
+// CPU time around each separate SPI write and around each CS low/high pair,
+// measured roughly on the pico at 125 MHz
+#define OLED_HOST_WRITE_OVERHEAD_US     ( 1U )
+#define OLED_HOST_TRANSACTION_OVERHEAD_US ( 1U )
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+// The SSD1351's display RAM
+static uint16_t m_gddram[OLED_HOST_PANEL_SIZE][OLED_HOST_PANEL_SIZE];
+static t_oledHostStats m_stats;
+static bool m_isSelected = false;
+static int8_t m_dcLevel = -1; // Unknown until the first write
+// Command decoding
+static uint8_t m_command = 0x00U;
+static uint8_t m_parameterIndex = 0U;
+static bool m_isWritingRam = false;
+static bool m_isHighBytePending = false;
+static uint8_t m_highByte;
+static uint8_t m_columnStart = 0U;
+static uint8_t m_columnEnd = OLED_HOST_PANEL_SIZE - 1U;
+static uint8_t m_rowStart = 0U;
+static uint8_t m_rowEnd = OLED_HOST_PANEL_SIZE - 1U;
+static uint8_t m_column = 0U;
+static uint8_t m_row = 0U;
+static uint8_t m_startLine = 0U;
+// Asynchronous writes complete straight away, callbacks are run one after
+// another rather than nested, like they would be from an interrupt
+static t_oledTransportCallback m_callback = NULL;
+static bool m_isInCallback = false;
+static bool m_isCallbackPending = false;
+
+/* --- MODULE SCOPE FUNCTION PROTOTYPES --------------------------------------- */
+static inline void m_setDc( int8_t level );
+static void m_decodeDataByte( uint8_t data );
+static inline void m_writePixel( uint16_t colour );
+
+/* --- PUBLIC FUNCTION IMPLEMENTATIONS ---------------------------------------- */
+
+int oledTransport_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
+    int8_t rstPin, int8_t spiOutput, unsigned int baudrate )
+{
+    // There are no pins on the host
+    (void) dinPin;
+    (void) clkPin;
+    (void) csPin;
+    (void) dcPin;
+    (void) rstPin;
+    (void) spiOutput;
+    (void) baudrate;
+
+    oledTransport_reset();
+    oledHost_resetStats();
+
+    return 0;
+}
+
+void oledTransport_reset( void )
+{
+    memset( m_gddram, 0, sizeof( m_gddram ) );
+    m_command = 0x00U;
+    m_parameterIndex = 0U;
+    m_isWritingRam = false;
+    m_isHighBytePending = false;
+    m_columnStart = 0U;
+    m_columnEnd = OLED_HOST_PANEL_SIZE - 1U;
+    m_rowStart = 0U;
+    m_rowEnd = OLED_HOST_PANEL_SIZE - 1U;
+    m_startLine = 0U;
+}
+
+void oledTransport_delayMs( uint32_t ms )
+{
+    // Nothing to wait for
+    (void) ms;
+}
+
+void oledTransport_select( void )
+{
+    m_isSelected = true;
+}
+
+void oledTransport_deselect( void )
+{
+    if( m_isSelected )
+        ++m_stats.transactions;
+    m_isSelected = false;
+}
+
+void oledTransport_writeCommand( uint8_t command )
+{
+    m_setDc( 0 );
+    ++m_stats.spiWrites;
+    ++m_stats.commandBytes;
+
+    m_command = command;
+    m_parameterIndex = 0U;
+    m_isWritingRam = ( command == 0x5CU ); // Write RAM
+    if( m_isWritingRam )
+    {
+        m_column = m_columnStart;
+        m_row = m_rowStart;
+        m_isHighBytePending = false;
+    }
+}
+
+void oledTransport_writeData( const uint8_t* data, size_t length )
+{
+    m_setDc( 1 );
+    ++m_stats.spiWrites;
+    m_stats.dataBytes += (uint32_t) length;
+
+    for( size_t index = 0U; index < length; index++ )
+        m_decodeDataByte( data[index] );
+}
+
+void oledTransport_writeDataAsync( const uint8_t* data, size_t length )
+{
+    oledTransport_writeData( data, length );
+
+    m_isCallbackPending = true;
+    if( m_isInCallback )
+        return; // The loop below picks it up
+
+    m_isInCallback = true;
+    while( m_isCallbackPending )
+    {
+        m_isCallbackPending = false;
+        if( m_callback != NULL )
+            m_callback();
+    }
+    m_isInCallback = false;
+}
+
+bool oledTransport_isBusy( void )
+{
+    return false;
+}
+
+void oledTransport_setCallback( t_oledTransportCallback callback )
+{
+    m_callback = callback;
+}
+
+void oledHost_resetStats( void )
+{
+    memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+t_oledHostStats oledHost_getStats( void )
+{
+    return m_stats;
+}
+
+uint32_t oledHost_estimateMicroseconds( const t_oledHostStats* statsPtr, unsigned int baudrate )
+{
+    uint64_t bits = ( (uint64_t) statsPtr->commandBytes + statsPtr->dataBytes ) * 8U;
+
+    return (uint32_t) ( ( bits * 1000000U ) / baudrate ) +
+        ( statsPtr->spiWrites * OLED_HOST_WRITE_OVERHEAD_US ) +
+        ( statsPtr->transactions * OLED_HOST_TRANSACTION_OVERHEAD_US );
+}
+
+uint16_t oledHost_getPixel( uint8_t x, uint8_t y )
+{
+    // Screen row 0 shows the RAM row set by the display start line
+    return m_gddram[( y + m_startLine ) % OLED_HOST_PANEL_SIZE][x % OLED_HOST_PANEL_SIZE];
+}
+
+int oledHost_writePpm( const char filename[] )
+{
+    FILE* filePtr = fopen( filename, "wb" );
+    uint16_t colour;
+    uint8_t rgb[3];
+
+    if( filePtr == NULL )
+        return 1;
+
+    fprintf( filePtr, "P6\n%u %u\n255\n", OLED_HOST_PANEL_SIZE, OLED_HOST_PANEL_SIZE );
+    for( uint8_t y = 0U; y < OLED_HOST_PANEL_SIZE; y++ )
+    {
+        for( uint8_t x = 0U; x < OLED_HOST_PANEL_SIZE; x++ )
+        {
+            // Expand RGB565 to 8 bits per channel
+            colour = oledHost_getPixel( x, y );
+            rgb[0] = (uint8_t) ( ( ( colour >> 11 ) & 0x1FU ) * 255U / 0x1FU );
+            rgb[1] = (uint8_t) ( ( ( colour >> 5 ) & 0x3FU ) * 255U / 0x3FU );
+            rgb[2] = (uint8_t) ( ( colour & 0x1FU ) * 255U / 0x1FU );
+            fwrite( rgb, 1U, sizeof( rgb ), filePtr );
+        }
+    }
+
+    return ( fclose( filePtr ) == 0 ) ? 0 : 1;
+}
+
+/* --- MODULE SCOPE FUNCTION IMPLEMENTATIONS ---------------------------------- */
+
+/*
+ * Function: m_setDc
+ * --------------------
+ * Set the emulated DC pin, counting each change of level
+ *
+ * level: 0 for command, 1 for data
+ *
+ * returns: void
+ */
+static inline void m_setDc( int8_t level )
+{
+    if( m_dcLevel != level )
+        ++m_stats.dcToggles;
+    m_dcLevel = level;
+}
+
+/*
+ * Function: m_decodeDataByte
+ * --------------------
+ * Handle a byte sent with DC high, either a parameter of the last command or
+ * half of a pixel after a Write RAM command. Commands this emulator doesn't
+ * care about have their parameters ignored
+ *
+ * data: The byte
+ *
+ * returns: void
+ */
+static void m_decodeDataByte( uint8_t data )
+{
+    if( m_isWritingRam )
+    {
+        // Pixels are sent most significant byte first
+        if( m_isHighBytePending )
+            m_writePixel( ( (uint16_t) m_highByte << 8 ) | data );
+        else
+            m_highByte = data;
+        m_isHighBytePending = !m_isHighBytePending;
+        return;
+    }
+
+    switch( m_command )
+    {
+        case 0x15U: // Set column address
+            if( m_parameterIndex == 0U )
+                m_columnStart = data & 0x7FU;
+            else if( m_parameterIndex == 1U )
+                m_columnEnd = data & 0x7FU;
+            break;
+        case 0x75U: // Set row address
+            if( m_parameterIndex == 0U )
+                m_rowStart = data & 0x7FU;
+            else if( m_parameterIndex == 1U )
+                m_rowEnd = data & 0x7FU;
+            break;
+        case 0xA1U: // Set display start line
+            if( m_parameterIndex == 0U )
+                m_startLine = data & 0x7FU;
+            break;
+        default:
+            break;
+    }
+    ++m_parameterIndex;
+}
+
+/*
+ * Function: m_writePixel
+ * --------------------
+ * Write a pixel at the RAM address pointer and move it on, left to right then
+ * top to bottom within the window, like the 0xA0 0x74 re-map set in oled.cpp
+ *
+ * colour: RGB565 colour
+ *
+ * returns: void
+ */
+static inline void m_writePixel( uint16_t colour )
+{
+    m_gddram[m_row][m_column] = colour;
+
+    if( m_column >= m_columnEnd )
+    {
+        m_column = m_columnStart;
+        m_row = ( m_row >= m_rowEnd ) ? m_rowStart : (uint8_t) ( m_row + 1U );
+    }
+    else
+    {
+        ++m_column;
+    }
+}
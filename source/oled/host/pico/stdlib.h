@@ -0,0 +1,37 @@
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+/* The part of the pico SDK time API that storage.cpp uses, on top of the
+ * host's monotonic clock, so that it can be built into oled_bench */
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint64_t absolute_time_t; // Microseconds, 0 is nil
+
+static const absolute_time_t nil_time = 0U;
+
+static inline absolute_time_t get_absolute_time( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    // Never nil
+    return ( (uint64_t) now.tv_sec * 1000000U ) + ( (uint64_t) now.tv_nsec / 1000U ) + 1U;
+}
+
+static inline absolute_time_t make_timeout_time_ms( uint32_t ms )
+{
+    return get_absolute_time() + ( (uint64_t) ms * 1000U );
+}
+
+static inline int64_t absolute_time_diff_us( absolute_time_t from, absolute_time_t to )
+{
+    return (int64_t) ( to - from );
+}
+
+static inline bool is_nil_time( absolute_time_t t )
+{
+    return t == nil_time;
+}
+
+#endif // PICO_STDLIB_H
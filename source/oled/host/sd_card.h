@@ -0,0 +1,6 @@
+#ifndef SD_CARD_H
+#define SD_CARD_H
+
+// Nothing is needed from the SD card driver on the host, see ff.h
+
+#endif // SD_CARD_H
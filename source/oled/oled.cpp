@@ -2,54 +2,211 @@
 #include "oled.hpp"
 
 #include <cstdlib> // For the 'free' function
+#include <string.h> // For memcpy and memset
 #include <stdio.h> // Just for debugging
 #ifdef OLED_INCLUDE_LOADING_CIRCLE
 #include <math.h>
 #endif // OLED_INCLUDE_LOADING_CIRCLE
 
 
-/* --- PICO LIBRARY INCLUDES -------------------------------------------------- */
-#include "pico/stdlib.h"
-#include "pico/binary_info.h"
-#include "hardware/spi.h"
-
 /* --- OTHER LIBRARY INCLUDES ------------------------------------------------ */
+// All panel I/O goes through the transport, so this file doesn't depend on the pico SDK
+#include "oled_transport.hpp"
+
 #ifdef OLED_INCLUDE_QR_GENERATOR
 #include "qrcodegen.h"
 #endif
 
-#ifdef OLED_INCLUDE_LOADING_CIRCLE
 #include "intcos.hpp"
-#endif // defined OLED_INCLUDE_LOADING_CIRCLE
+
+#ifdef OLED_INCLUDE_SD_IMAGES
+#include "storage.hpp"
+#endif
 
 /* --- PREPROCESSOR -----------------------------------------------------------*/
-#ifdef OLED_INCLUDE_FONT8
-#include "font8.h"
-#endif /* OLED_INCLUDE_FONT8 */
-#ifdef OLED_INCLUDE_FONT12
-#include "font12.h"
-#endif /* OLED_INCLUDE_FONT12 */
-#ifdef OLED_INCLUDE_FONT16
-#include "font16.h"
-#endif /* OLED_INCLUDE_FONT16 */
-#ifdef OLED_INCLUDE_FONT20
-#include "font20.h"
-#endif /* OLED_INCLUDE_FONT20 */
-#ifdef OLED_INCLUDE_FONT24
-#include "font24.h"
-#endif /* OLED_INCLUDE_FONT24 */
+#if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+// Generated from font*.h by utils/makefonts.py, only has the included fonts
+#include "autogen_fonts.h"
+#endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 
 #ifdef OLED_INCLUDE_SD_IMAGES
-#define OLED_SD_BUFFER_SIZE     ( 100U )
+// Image files are read a sector at a time
+#define OLED_SD_BUFFER_SIZE     ( 512U )
+// Header of the binary images made by assets/image_encoder.py, all numbers are
+// little endian:
+// 0 to 3: "OIMG"
+// 4 to 5: Width in pixels
+// 6 to 7: Height in pixels
+// 8: Pixel format, one of OLED_SD_IMAGE_FORMAT_*
+// 9: Flags, none yet
+// 10 to 11: Reserved, 0
+#define OLED_SD_IMAGE_HEADER_SIZE   ( 12U )
+#define OLED_SD_IMAGE_MAGIC         "OIMG"
+// RGB565 pixels, most significant byte first like the display wants them, left
+// to right and top to bottom
+#define OLED_SD_IMAGE_FORMAT_RGB565 ( 0U )
+// The pixels compressed like QOI, with RGB565 channels, see image_encoder.py
+#define OLED_SD_IMAGE_FORMAT_QOI565 ( 1U )
+#define OLED_QOI_OP_INDEX           ( 0x00U )
+#define OLED_QOI_OP_DIFF            ( 0x40U )
+#define OLED_QOI_OP_LUMA            ( 0x80U )
+#define OLED_QOI_OP_RUN             ( 0xC0U )
+#define OLED_QOI_OP_RGB565          ( 0xFEU )
+#define OLED_QOI_OP_MASK            ( 0xC0U )
+#define OLED_QOI_INDEX_SIZE         ( 64U )
+// A palette of 1 << ( format - OLED_SD_IMAGE_FORMAT_PALETTE1 ) bit RGB565
+// colours, then each row as indexes into it, see image_encoder.py
+#define OLED_SD_IMAGE_FORMAT_PALETTE1 ( 2U )
+#define OLED_SD_IMAGE_FORMAT_PALETTE8 ( 5U )
+// The most colours used by any format, in m_sdColours
+#define OLED_SD_MAX_COLOURS         ( 256U )
 #endif // OLED_INCLUDE_SD_IMAGES
 
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+// Most images kept at once, and the longest filename which can be kept including the '\0'
+#define OLED_IMAGE_CACHE_ENTRIES    ( 8U )
+#define OLED_IMAGE_CACHE_NAME_SIZE  ( 32U )
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
+#ifdef OLED_INCLUDE_ASSET_PACK
+// Generated from the sd_card/*.oimg files by utils/makeassetpack.py
+#include "autogen_assets.h"
+#endif // OLED_INCLUDE_ASSET_PACK
+
+// The SSD1351 is at most 128x128 pixels, a line buffer holds one row in RGB565
+#define OLED_MAX_DISPLAY_WIDTH  ( 128U )
+#define OLED_MAX_DISPLAY_HEIGHT ( 128U )
+#define OLED_LINE_BUFFER_SIZE   ( OLED_MAX_DISPLAY_WIDTH * 2U )
+
+#if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+// Changed runs on a row of the terminal closer than this many pixels are sent as one
+#define OLED_TERMINAL_RUN_JOIN_GAP  ( 8U )
+// Joined runs are at least one pixel apart, so there can't be more than this
+#define OLED_TERMINAL_MAX_RUNS      ( OLED_MAX_DISPLAY_WIDTH / 2U )
+// Rows are added to a taller window if that resends no more than this many unchanged pixels
+#define OLED_TERMINAL_BLOCK_SLACK   ( 32U )
+// Decoded glyphs kept in RAM. This must be more than the number of characters
+// which fit on one line in the smallest font, see m_glyphGet
+#define OLED_GLYPH_CACHE_SIZE       ( 32U )
+#define OLED_GLYPH_MAX_HEIGHT       ( 24U )
+#endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+#define OLED_FRAMEBUFFER_SIZE       ( OLED_MAX_DISPLAY_WIDTH * OLED_MAX_DISPLAY_HEIGHT * 2U )
+#define OLED_MAX_DIRTY_RECTANGLES   ( 8U )
+// Two dirty rectangles are merged if that adds fewer than this many clean
+// pixels, as sending a few extra pixels is cheaper than another window setup
+#define OLED_DIRTY_MERGE_SLACK      ( 64U )
+#endif // OLED_INCLUDE_FRAMEBUFFER
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+#define OLED_MAX_LAYERS             ( 8U )
+#define OLED_TILE_SIZE              ( 8U )
+// A row of tiles is one bit each in a uint16_t, so the display can't be wider than 128
+#define OLED_TILE_COLUMNS           ( OLED_MAX_DISPLAY_WIDTH / OLED_TILE_SIZE )
+#define OLED_TILE_ROWS              ( OLED_MAX_DISPLAY_HEIGHT / OLED_TILE_SIZE )
+// Hash of a tile which has been drawn on outside of the layers, so the display
+// has something unknown. The hash of a real tile is never this
+#define OLED_TILE_HASH_UNKNOWN      ( 0U )
+#endif // OLED_INCLUDE_COMPOSITOR
+
+#ifdef OLED_INCLUDE_LOADING_CIRCLE
+// Threshold of the pixels outside the loading circle, more than any progress
+#define OLED_LOADING_CIRCLE_OUTSIDE ( 0xFFU )
+#endif // OLED_INCLUDE_LOADING_CIRCLE
+
 /* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
-static int8_t m_csPin;
-static int8_t m_dcPin;
-static int8_t m_rstPin;
-static int8_t m_spiInstance;
 static uint8_t m_displayWidth;
 static uint8_t m_displayHeight;
+// Used to build up rows of pixels before they are sent to the display
+static uint8_t m_lineBuffer[OLED_LINE_BUFFER_SIZE];
+static t_oledFlushCallback m_flushCallback = NULL;
+
+/* --- FRAMEBUFFER RELATED MODULE SCOPE VARIABLES --- */
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+// RGB565 with the most significant byte first, the same as the display wants it
+static uint8_t m_framebuffer[OLED_FRAMEBUFFER_SIZE];
+typedef struct
+{
+    // Corners are inclusive
+    uint8_t x1;
+    uint8_t y1;
+    uint8_t x2;
+    uint8_t y2;
+} t_dirtyRectangle;
+static t_dirtyRectangle m_dirtyRectangles[OLED_MAX_DIRTY_RECTANGLES];
+static uint8_t m_dirtyRectangleCount = 0U;
+// Position of the window being streamed into the framebuffer
+static uint8_t m_windowX;
+static uint8_t m_windowY;
+static uint8_t m_windowWidth;
+static uint8_t m_windowColumn;
+static uint8_t m_windowRow;
+#endif // OLED_INCLUDE_FRAMEBUFFER
+
+/* --- DMA RELATED MODULE SCOPE VARIABLES --- */
+#ifdef OLED_INCLUDE_DMA
+// Rows are copied into one buffer while the other one is being sent
+static uint8_t m_dmaLineBuffers[2][OLED_LINE_BUFFER_SIZE];
+static uint8_t m_dmaLineBufferIndex = 0U;
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+// The rectangles being sent, kept apart from the ones being drawn into
+static t_dirtyRectangle m_flushRectangles[OLED_MAX_DIRTY_RECTANGLES];
+static uint8_t m_flushRectangleCount;
+static volatile uint8_t m_flushRectangleIndex;
+static volatile uint8_t m_flushRow;
+static volatile bool m_flushInProgress = false;
+#endif // OLED_INCLUDE_FRAMEBUFFER
+#endif // OLED_INCLUDE_DMA
+
+/* --- COMPOSITOR RELATED MODULE SCOPE VARIABLES --- */
+#ifdef OLED_INCLUDE_COMPOSITOR
+typedef struct
+{
+    uint8_t* pixelsPtr; // NULL if the layer isn't being used
+    // A bit per pixel, set where the layer covers what's under it. For a mono
+    // layer these are the pixels, a colour layer has them after its pixels
+    uint8_t* coveragePtr;
+    size_t size; // Bytes at pixelsPtr, including a colour layer's coverage
+    t_oledLayerFormat format;
+    uint16_t colour; // Of the set pixels of a mono layer
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+    uint16_t bytesPerRow;
+    int8_t z;
+} t_layer;
+static t_layer m_layers[OLED_MAX_LAYERS];
+// The layers being used, top first
+static t_oledLayer m_layerOrder[OLED_MAX_LAYERS];
+static uint8_t m_layerCount = 0U;
+static t_oledLayer m_layerSelected = OLED_LAYER_NONE;
+// Position of the window being streamed into the selected layer
+static uint8_t m_layerWindowX;
+static uint8_t m_layerWindowY;
+static uint8_t m_layerWindowWidth;
+static uint8_t m_layerWindowColumn;
+static uint8_t m_layerWindowRow;
+// Tiles to be composed at the next flush, one bit per tile column
+static uint16_t m_tileDirtyRows[OLED_TILE_ROWS];
+// Hash of what each tile has on the display
+static uint32_t m_tileHashes[OLED_TILE_ROWS][OLED_TILE_COLUMNS];
+// A row of composed tiles, RGB565 with the most significant byte first
+static uint8_t m_tileRowBuffer[OLED_MAX_DISPLAY_WIDTH * OLED_TILE_SIZE * 2U];
+static bool m_isComposing = false; // Drawing is the compositor's own output
+#endif // OLED_INCLUDE_COMPOSITOR
+
+/* --- SHAPE RELATED MODULE SCOPE VARIABLES --- */
+// Limits an arc to the part of a ring clockwise from the start to the end
+typedef struct
+{
+    int32_t startX; // Direction of the start of the arc, scaled by 1000
+    int32_t startY;
+    int32_t endX;   // Direction of the end of the arc, scaled by 1000
+    int32_t endY;
+    bool isOverHalf;
+} t_arcSector;
 
 /* --- LOADING BAR RELATED MODULE SCOPE VARIABLES --- */
 #if defined OLED_INCLUDE_LOADING_BAR_HORIZONTAL || defined OLED_INCLUDE_LOADING_CIRCLE
@@ -71,6 +228,9 @@ typedef enum
 } t_loadingBarBitmapNext;
 static t_loadingBarState m_loadingBarState = e_loadingBarStateUninitialised;
 static t_loadingBarBitmapNext m_loadingBarBitmapNext;
+#ifdef OLED_INCLUDE_COMPOSITOR
+static t_oledLayer m_loadingBarLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
 #endif // defined OLED_INCLUDE_LOADING_BAR_HORIZONTAL || defined OLED_INCLUDE_LOADING_CIRCLE
 #ifdef OLED_INCLUDE_LOADING_BAR_HORIZONTAL
 static uint8_t m_loadingBarHorizontalTopLeftX;
@@ -81,11 +241,39 @@ static uint8_t m_loadingBarHorizontalBottomRightY;
 #ifdef OLED_INCLUDE_LOADING_CIRCLE
 static uint8_t m_loadingCircleCenterX;
 static uint8_t m_loadingCircleCenterY;
-static uint8_t m_loadingCircleBitmapWidth;
 static uint8_t m_loadingCircleOuterRadius;
-static uint8_t m_loadingCircleInnerRadius;
+// Progress at which each pixel of one quadrant lights up, see m_loadingCircleGetThreshold
+static uint8_t* m_loadingCircleThresholdsPtr = NULL;
+static uint8_t m_loadingCircleProgress; // What's on the display
 #endif // defined OLED_INCLUDE_LOADING_CIRCLE
 
+/* --- SD IMAGE RELATED MODULE SCOPE VARIABLES --- */
+#ifdef OLED_INCLUDE_SD_IMAGES
+// Part of the image file being drawn. Not on the stack, FatFs already uses a lot of it
+static uint8_t m_sdBuffer[OLED_SD_BUFFER_SIZE];
+// What is being read, either m_sdBuffer or a whole image in the cache
+static const uint8_t* m_sdBufferPtr = m_sdBuffer;
+static UINT m_sdBufferLength; // Bytes at m_sdBufferPtr
+static UINT m_sdBufferIndex;  // The next byte to be used
+// Pixels seen recently in a QOI565 image by hash, or the palette of a palette image
+static uint16_t m_sdColours[OLED_SD_MAX_COLOURS];
+#endif // OLED_INCLUDE_SD_IMAGES
+
+/* --- IMAGE CACHE RELATED MODULE SCOPE VARIABLES --- */
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+typedef struct
+{
+    char filename[OLED_IMAGE_CACHE_NAME_SIZE];
+    const uint8_t* dataPtr; // The whole file, NULL if the entry isn't being used
+    UINT size;
+    bool isInFlash; // dataPtr is in the asset pack, so it doesn't use any RAM
+    uint32_t lastUsed; // m_imageCacheClock when it was last drawn
+} t_imageCacheEntry;
+static t_imageCacheEntry m_imageCache[OLED_IMAGE_CACHE_ENTRIES];
+static uint32_t m_imageCacheBytes = 0U;
+static uint32_t m_imageCacheClock = 0U;
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
 /* --- FONT RELATED MODULE SCOPE VARIABLES --- */
 #if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 static uint8_t* m_terminalBitmapPtr1 = NULL;
@@ -95,16 +283,43 @@ typedef enum
     e_terminalUninitialised,
     e_terminalBitmap1Next,
     e_terminalBitmap2Next,
+    e_terminalScrolling, // No bitmaps, see oled_terminalInitScrolling
 } t_terminalBitmapState;
 static t_terminalBitmapState m_terminalBitmapState = e_terminalUninitialised;
 static uint8_t m_terminalFontSize;
 static uint16_t m_terminalFontColour;
 static uint8_t m_terminalCurrentLine;
-static tFontTable* m_terminalFontTablePtr;
+static const tFontPacked* m_terminalFontTablePtr;
 static uint8_t m_terminalBitmapBytesPerRow;
 static uint16_t m_terminalBitmapCallocSize;
 static bool m_terminalIsLineTemp;
 static uint8_t m_terminalHeightInLines;
+#ifdef OLED_INCLUDE_COMPOSITOR
+static t_oledLayer m_terminalLayer = OLED_LAYER_NONE; // Not used by the scrolling terminal
+#endif // OLED_INCLUDE_COMPOSITOR
+// Scrolling terminal only. The display RAM is used as a ring of text lines,
+// m_terminalStartLine is the RAM row shown at the top of the display
+static uint8_t m_terminalStartLine = 0U;
+static char* m_terminalTextPtr = NULL; // Text of every line, kept for redrawing in a new colour
+static uint8_t m_terminalTextLineSize; // Bytes per line of m_terminalTextPtr, including the terminator
+static uint8_t m_terminalTopTextLine;  // Line of m_terminalTextPtr currently at the top of the display
+// A glyph decoded from a font table. Bit n of a row is set if the pixel n from
+// the left of the glyph is lit
+typedef struct
+{
+    const tFontPacked* fontTablePtr; // NULL if the entry is unused
+    char character;
+    uint32_t lastUsed;              // Value of m_glyphCacheClock when last looked up
+    uint32_t rows[OLED_GLYPH_MAX_HEIGHT];
+} t_glyph;
+static t_glyph m_glyphCache[OLED_GLYPH_CACHE_SIZE];
+static uint32_t m_glyphCacheClock = 0U;
+// A run of changed pixels on one row of the terminal bitmap, end is exclusive
+typedef struct
+{
+    uint8_t start;
+    uint8_t end;
+} t_terminalRun;
 #endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 
 
@@ -114,19 +329,105 @@ static inline void m_chipSelect( void );
 static inline void m_chipDeselect( void );
 static inline void m_writeReg( uint8_t reg );
 static inline void m_writeData( uint8_t data );
+static inline void m_writeDataBuffer( const uint8_t* data, size_t length );
+static inline void m_windowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height );
+static inline void m_windowWrite( const uint8_t* data, size_t length );
+static inline void m_windowWriteInPlace( const uint8_t* data, size_t length );
+static inline void m_windowEnd( void );
+static inline void m_lineBufferFill( uint8_t numberOfPixels, uint16_t colour );
+static inline void m_panelWindowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height );
+static inline void m_panelWindowWrite( const uint8_t* data, size_t length );
+static inline void m_panelWindowEnd( void );
+
+/* --- SHAPE MODULE SCOPE FUNCTIONS --- */
+static void m_fillArea( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t colour );
+static inline int32_t m_divideRounded( int32_t numerator, int32_t denominator );
+static inline uint16_t m_squareRoot( uint32_t value );
+static void m_drawThinLine( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t colour );
+static void m_drawThickLine( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t thickness,
+    uint16_t colour );
+static inline bool m_arcSectorContains( const t_arcSector* sectorPtr, int32_t x, int32_t y );
+static void m_drawRingSpan( int16_t centerX, int16_t y, int16_t dxStart, int16_t dxEnd, int16_t dy,
+    const t_arcSector* sectorPtr, uint16_t colour );
+static void m_drawRing( uint8_t centerX, uint8_t centerY, uint8_t outerRadius, uint8_t innerRadius,
+    const t_arcSector* sectorPtr, uint16_t colour );
+
+/* --- FRAMEBUFFER MODULE SCOPE FUNCTIONS --- */
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+static void m_framebufferAddDirty( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 );
+static inline uint16_t m_dirtyRectangleArea( const t_dirtyRectangle* rectanglePtr );
+static inline t_dirtyRectangle m_dirtyRectangleUnion( const t_dirtyRectangle* rectangle1Ptr,
+    const t_dirtyRectangle* rectangle2Ptr );
+#endif // OLED_INCLUDE_FRAMEBUFFER
+
+/* --- COMPOSITOR MODULE SCOPE FUNCTIONS --- */
+#ifdef OLED_INCLUDE_COMPOSITOR
+static inline t_layer* m_layerGet( t_oledLayer layer );
+static void m_layerWindowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height );
+static void m_layerWindowWrite( const uint8_t* data, size_t length );
+static inline bool m_layerGetPixel( const t_layer* layerPtr, uint8_t x, uint8_t y, uint16_t* colourPtr );
+static t_oledLayer m_layerCreateForWidget( int16_t x1, int16_t y1, int16_t x2, int16_t y2, int8_t z,
+    uint16_t colour );
+static void m_tilesMarkDirty( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, bool isDisplayUnknown );
+static void m_compositorFlush( void );
+static uint32_t m_composeTile( uint8_t tileColumn, uint8_t tileRow );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+/* --- DMA MODULE SCOPE FUNCTIONS --- */
+#if defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
+static void m_dmaFlushSendNext( void );
+static void m_dmaTransferDone( void );
+#endif // defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
 
 /* --- FONT RELATED MODULE SCOPE FUNCTIONS --- */
 #if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+static const tFontPacked* m_fontGetTable( uint8_t fontSize );
+static const t_glyph* m_glyphGet( const tFontPacked* fontTablePtr, char character );
+static void m_glyphDraw( const t_glyph* glyphPtr, uint8_t x, uint8_t y, uint16_t colour );
+static inline void m_glyphRenderRow( const t_glyph* glyphPtr, uint8_t row, uint8_t x, uint16_t colour );
 static void m_terminalPushBitmap( void );
+static uint8_t m_terminalFindChangedRuns( const uint8_t* desiredRowPtr, const uint8_t* currentRowPtr,
+    t_terminalRun* runs );
+static void m_terminalSendRun( const uint8_t* bitmapPtr, t_terminalRun run, uint8_t y, uint8_t height );
 static inline void m_terminalWriteChar( char character, uint8_t textOriginX, uint8_t textOriginY );
 static inline void m_terminalWrite( const char text[] );
+static void m_terminalScrollingWrite( const char text[] );
+static void m_terminalScrollingDrawRows( uint8_t screenRow, uint8_t rowCount, const char text[] );
+static void m_terminalScrollingSetStartLine( uint8_t startLine );
+static inline char* m_terminalScrollingGetText( uint8_t line );
 #endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 
+/* --- SD IMAGE MODULE SCOPE FUNCTIONS --- */
+#ifdef OLED_INCLUDE_SD_IMAGES
+static int m_sdImageDraw( FIL* filPtr, uint8_t originX, uint8_t originY );
+static const uint8_t* m_sdRead( FIL* filPtr, UINT* lengthPtr );
+static inline int16_t m_sdReadByte( FIL* filPtr );
+static inline uint8_t m_sdQoiHash( uint16_t pixel );
+static bool m_sdImageDrawRgb565( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight );
+static bool m_sdImageDrawQoi565( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight );
+static bool m_sdImageDrawPalette( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight,
+    uint8_t bitsPerPixel );
+static void m_sdImageDrawText( FIL* filPtr, uint8_t originX, uint8_t originY );
+#endif // OLED_INCLUDE_SD_IMAGES
+
+/* --- IMAGE CACHE MODULE SCOPE FUNCTIONS --- */
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+static t_imageCacheEntry* m_imageCacheFind( const char filename[] );
+static t_imageCacheEntry* m_imageCacheAdd( const char filename[], UINT size, const uint8_t* assetPtr );
+static void m_imageCacheRemove( t_imageCacheEntry* entryPtr );
+static int m_imageCacheDraw( t_imageCacheEntry* entryPtr, uint8_t originX, uint8_t originY );
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
+/* --- ASSET PACK MODULE SCOPE FUNCTIONS --- */
+#ifdef OLED_INCLUDE_ASSET_PACK
+static const t_asset* m_assetFind( const char filename[] );
+#endif // OLED_INCLUDE_ASSET_PACK
+
 /* --- LOADING CIRCLE MODULE SCOPE FUNCTIONS --- */
 #ifdef OLED_INCLUDE_LOADING_CIRCLE
-static inline void m_loadingCircleProcessQuadrant( uint8_t* bitmapPtr, uint8_t xLowerBound,
-    uint8_t xUpperBound, bool yIsPositive, uint8_t angle );
-static inline void m_loadingCircleSetBitmap( uint8_t* bitmapPtr, uint8_t x, uint8_t y, bool val );
+static inline uint8_t m_loadingCircleGetThreshold( uint8_t quadrant, int16_t dx, int16_t dy );
+static void m_loadingCirclePaintQuadrant( uint8_t quadrant, uint8_t progressLow, uint8_t progressHigh,
+    uint16_t colour );
 #endif // OLED_INCLUDE_LOADING_CIRCLE
 
 /* --- PUBLIC FUNCTION IMPLEMENTATIONS ---------------------------------------- */
@@ -136,100 +437,148 @@ int oled_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
     int8_t rstPin, int8_t spiOutput, unsigned int baudrate, uint8_t displayWidth,
     uint8_t displayHeight )
 {
+    // The line buffer (and framebuffer) are sized for the largest SSD1351
+    if( ( displayWidth > OLED_MAX_DISPLAY_WIDTH ) || ( displayHeight > OLED_MAX_DISPLAY_HEIGHT ) )
+        return 1;
+
     // Set module variables
-    m_csPin = csPin;
-    m_dcPin = dcPin;
-    m_rstPin = rstPin;
     m_displayWidth = displayWidth;
     m_displayHeight = displayHeight;
 
-    // Set cs, dc and rst pins to be GPIO output pins
-    gpio_init( m_csPin );
-    gpio_init( m_dcPin );
-    gpio_init( m_rstPin );
-    gpio_set_dir( m_csPin, GPIO_OUT );
-    gpio_set_dir( m_dcPin, GPIO_OUT );
-    gpio_set_dir( m_rstPin, GPIO_OUT );
-    // Set cs, dc and rst pins to high output
-    gpio_put( m_csPin, 1 );
-    gpio_put( m_dcPin, 1 );
-    gpio_put( m_rstPin, 1 );
-
-    // Set the SPI pins
-    gpio_set_function( clkPin, GPIO_FUNC_SPI );
-    gpio_set_function( dinPin, GPIO_FUNC_SPI );
-
-    // Check din and clk pins are suitable, and init SPI at specified baud rate
-    if( ( spiOutput == 0 ) &&
-        ( ( dinPin == 3 ) || ( dinPin == 7 ) || ( dinPin == 19 ) ) && // Check din pin is connected to a SPI0 TX
-        ( ( clkPin == 2 ) || ( clkPin == 6 ) || ( clkPin == 18 ) ) )  // Check clk pin is connected to a SPI0 SCK
-    {
-        spi_init( spi0, baudrate );
-        m_spiInstance = 0;
-        /* Set the SPI format to be the same as Arduino's SPI Mode 3, i.e.:
-         * Most significant bit first, clock polarity = 1, clock phase = 1
-         * This line made no difference, but I'd like to ensure correct settings */
-        spi_set_format( spi0, 8U, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST );
-    }
-    else if( ( spiOutput == 1 ) &&
-        ( ( dinPin == 11 ) || ( dinPin == 15 ) ) && // Check din pin is connected to a SPI1 TX
-        ( ( clkPin == 10 ) || ( clkPin == 14 ) ) )  // Check clk pin is connected to a SPI1 SCK
-    {
-        spi_init( spi1, baudrate );
-        // m_spiInstance is so that 
-        m_spiInstance = 1;
-        /* Set the SPI format to be the same as Arduino's SPI Mode 3, i.e.:
-         * Most significant bit first, clock polarity = 1, clock phase = 1
-         * This line made no difference, but I'd like to ensure correct settings */
-        spi_set_format( spi1, 8U, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST );
-    }
-    else
-    {
-        // Invalid settings
+    if( oledTransport_init( dinPin, clkPin, csPin, dcPin, rstPin, spiOutput, baudrate ) != 0 )
         return 1;
-    }
+
+#if defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
+    // Asynchronous flushes are driven by the end of each transfer
+    oledTransport_setCallback( m_dmaTransferDone );
+#endif // defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
 
     m_chipSelect();
 
-    gpio_put( m_rstPin, 1 );
-    sleep_ms( 10U );
-    gpio_put( m_rstPin, 0 );
-    sleep_ms( 10U );
-    gpio_put( m_rstPin, 1 );
+    oledTransport_reset();
 
     m_displayInit();
 
-    sleep_ms( 10U );
+    oledTransport_delayMs( 10U );
 
     // Turn on the display
     m_writeReg(0xAF);
 
-    sleep_ms( 10U );
+    oledTransport_delayMs( 10U );
 
     oled_clear();
+    oled_flush();
     // CS is now inactive (high)
 
     return 0;
 }
 
-void oled_clear( void )
+void oled_flush( void )
 {
-    m_chipSelect();
-    m_writeReg(0x15);
-    m_writeData(0);
-    m_writeData(127);
-    m_writeReg(0x75);
-    m_writeData(0);
-    m_writeData(127);
+#if defined OLED_INCLUDE_FRAMEBUFFER && defined OLED_INCLUDE_DMA
+    // Let a flush which is already going finish, then send whatever is left
+    while( oled_isBusy() )
+    {
+        // Wait
+    }
+    (void) oled_flushAsync();
+    while( oled_isBusy() )
+    {
+        // Wait
+    }
+#else
+#ifdef OLED_INCLUDE_COMPOSITOR
+    m_compositorFlush();
+#endif // OLED_INCLUDE_COMPOSITOR
 
-    m_writeReg(0x5C);
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+    const t_dirtyRectangle* rectanglePtr;
+    uint8_t width;
 
-    for( uint16_t i = 0; i < m_displayWidth * m_displayHeight; ++i )
+    for( uint8_t index = 0U; index < m_dirtyRectangleCount; index++ )
     {
-        m_writeData( 0x00 );
-        m_writeData( 0x00 );
+        rectanglePtr = &m_dirtyRectangles[index];
+        width = ( rectanglePtr->x2 - rectanglePtr->x1 ) + 1U;
+
+        // One window per rectangle, each row is already in display byte order
+        m_panelWindowBegin( rectanglePtr->x1, rectanglePtr->y1, width, ( rectanglePtr->y2 - rectanglePtr->y1 ) + 1U );
+        for( uint8_t y = rectanglePtr->y1; y <= rectanglePtr->y2; y++ )
+        {
+            m_panelWindowWrite( &m_framebuffer[( ( (uint16_t) y * m_displayWidth ) + rectanglePtr->x1 ) * 2U],
+                (size_t) width * 2U );
+        }
+        m_panelWindowEnd();
     }
-    m_chipDeselect();
+
+    m_dirtyRectangleCount = 0U;
+#endif // OLED_INCLUDE_FRAMEBUFFER
+
+    if( m_flushCallback != NULL )
+        m_flushCallback();
+#endif // defined OLED_INCLUDE_FRAMEBUFFER && defined OLED_INCLUDE_DMA
+}
+
+int oled_flushAsync( void )
+{
+#if defined OLED_INCLUDE_FRAMEBUFFER && defined OLED_INCLUDE_DMA
+    const t_dirtyRectangle* rectanglePtr;
+
+    if( m_flushInProgress )
+        return 1;
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+    // The composed tiles go into the framebuffer, and out with everything else
+    m_compositorFlush();
+#endif // OLED_INCLUDE_COMPOSITOR
+
+    if( m_dirtyRectangleCount == 0U )
+    {
+        // Nothing to send, so the flush is already finished
+        if( m_flushCallback != NULL )
+            m_flushCallback();
+        return 0;
+    }
+
+    // Take the dirty rectangles, drawing can carry on into a fresh list
+    memcpy( m_flushRectangles, m_dirtyRectangles, sizeof( t_dirtyRectangle ) * m_dirtyRectangleCount );
+    m_flushRectangleCount = m_dirtyRectangleCount;
+    m_dirtyRectangleCount = 0U;
+    m_flushRectangleIndex = 0U;
+    m_flushInProgress = true;
+
+    // Open the first window, then the DMA interrupt takes it from here
+    rectanglePtr = &m_flushRectangles[0];
+    m_panelWindowBegin( rectanglePtr->x1, rectanglePtr->y1, ( rectanglePtr->x2 - rectanglePtr->x1 ) + 1U,
+        ( rectanglePtr->y2 - rectanglePtr->y1 ) + 1U );
+    m_flushRow = rectanglePtr->y1;
+    m_dmaFlushSendNext();
+#else
+    // Without both the framebuffer and DMA there is nothing to send in the background
+    oled_flush();
+#endif // defined OLED_INCLUDE_FRAMEBUFFER && defined OLED_INCLUDE_DMA
+
+    return 0;
+}
+
+bool oled_isBusy( void )
+{
+#if defined OLED_INCLUDE_FRAMEBUFFER && defined OLED_INCLUDE_DMA
+    return m_flushInProgress;
+#elif defined OLED_INCLUDE_DMA
+    return oledTransport_isBusy();
+#else
+    return false;
+#endif
+}
+
+void oled_setFlushCallback( t_oledFlushCallback callback )
+{
+    m_flushCallback = callback;
+}
+
+void oled_clear( void )
+{
+    oled_fillRect( 0U, 0U, m_displayWidth, m_displayHeight, 0x0000U );
 }
 
 void oled_deinitAll( void )
@@ -241,27 +590,18 @@ void oled_deinitAll( void )
 
 void oled_setPixel( uint8_t x, uint8_t y, uint16_t colour )
 {
-    if( ( x < 0U ) || ( y < 0U ) || ( x > m_displayWidth ) || ( y > m_displayHeight ) )
+    if( ( x >= m_displayWidth ) || ( y >= m_displayHeight ) )
     {
         // Pixel is out of bounds
         return;
     }
 
-    m_chipSelect();
-
-    m_writeReg(0x15);
-    m_writeData(x);
-    m_writeData(x);
-    m_writeReg(0x75);
-    m_writeData(y);
-    m_writeData(y);
-    m_writeReg(0x5C);   
-    
     // The 16 bits are sent in two bytes
-    m_writeData(colour >> 8);
-    m_writeData(colour);
+    const uint8_t pixel[2] = { (uint8_t) ( colour >> 8 ), (uint8_t) colour };
 
-    m_chipDeselect();
+    m_windowBegin( x, y, 1U, 1U );
+    m_windowWrite( pixel, sizeof( pixel ) );
+    m_windowEnd();
 }
 
 void oled_fill( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint16_t colour )
@@ -290,81 +630,232 @@ void oled_fill( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint16_t colour
         yMin = y2;
         yMax = y1;
     }
-    for( uint8_t x = xMin; x <= xMax; ++x )
+
+    // The corners are inclusive
+    oled_fillRect( xMin, yMin, ( xMax - xMin ) + 1U, ( yMax - yMin ) + 1U, colour );
+}
+
+void oled_fillRect( uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint16_t colour )
+{
+    if( ( width == 0U ) || ( height == 0U ) || ( x >= m_displayWidth ) || ( y >= m_displayHeight ) )
+        return; // Nothing to draw
+
+    // Clip the rectangle to the display
+    if( ( (uint16_t) x + (uint16_t) width ) > m_displayWidth )
+        width = m_displayWidth - x;
+    if( ( (uint16_t) y + (uint16_t) height ) > m_displayHeight )
+        height = m_displayHeight - y;
+
+    // Every row is identical, so only build the row once
+    m_lineBufferFill( width, colour );
+
+    m_windowBegin( x, y, width, height );
+    for( uint8_t row = 0U; row < height; row++ )
+        m_windowWrite( m_lineBuffer, (size_t) width * 2U );
+    m_windowEnd();
+}
+
+void oled_blitRect( uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+    const uint16_t* pixels )
+{
+    if( ( pixels == NULL ) || ( width == 0U ) || ( height == 0U ) ||
+        ( x >= m_displayWidth ) || ( y >= m_displayHeight ) )
+        return; // Nothing to draw
+
+    // The source stride stays the same even if the rectangle gets clipped
+    const uint8_t sourceWidth = width;
+
+    // Clip the rectangle to the display
+    if( ( (uint16_t) x + (uint16_t) width ) > m_displayWidth )
+        width = m_displayWidth - x;
+    if( ( (uint16_t) y + (uint16_t) height ) > m_displayHeight )
+        height = m_displayHeight - y;
+
+    m_windowBegin( x, y, width, height );
+    for( uint8_t row = 0U; row < height; row++ )
     {
-        for( uint8_t y = yMin; y <= yMax; ++y )
+        const uint16_t* rowPixels = &pixels[(uint16_t) row * (uint16_t) sourceWidth];
+        // The display wants the most significant byte of each pixel first
+        for( uint8_t column = 0U; column < width; column++ )
         {
-            oled_setPixel( x, y, colour );
+            m_lineBuffer[column * 2U] = (uint8_t) ( rowPixels[column] >> 8 );
+            m_lineBuffer[( column * 2U ) + 1U] = (uint8_t) rowPixels[column];
         }
+        m_windowWrite( m_lineBuffer, (size_t) width * 2U );
     }
+    m_windowEnd();
 }
 
 void oled_drawLineBetweenPoints( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, 
     uint16_t colour, uint8_t thickness )
 {
-    /* To avoid the use of floats/doubles, int32_t will be used and each coordinate
-     * will be multipied by a constant */
-    const int32_t scale = 1000;
-    int32_t xScaled = (int32_t) x1 * scale;
-    int32_t yScaled = (int32_t) y1 * scale;
-    int32_t dx = (int32_t) x2 - (int32_t) x1;
-    int32_t dy = (int32_t) y2 - (int32_t) y1;
-    uint8_t x;
-    uint8_t y;
-
-    uint16_t stepsLimit;
-    uint16_t dxAbs;
-    uint16_t dyAbs;
-    
-    if( dx < 0 )
-        dxAbs = (uint16_t) ( -1 * dx );
+    if( thickness == 0U )
+        m_drawThinLine( x1, y1, x2, y2, colour );
     else
-        dxAbs = (uint16_t) dx;
+        m_drawThickLine( x1, y1, x2, y2, thickness, colour );
+}
 
-    if( dy < 0 )
-        dyAbs = (uint16_t) ( -1 * dy );
-    else
-        dyAbs = (uint16_t) dy;
-    
-    if( dxAbs > dyAbs )
-        stepsLimit = dxAbs;
-    else
-        stepsLimit = dyAbs;
+void oled_fillCircle( uint8_t centerX, uint8_t centerY, uint8_t radius, uint16_t colour )
+{
+    m_drawRing( centerX, centerY, radius, 0U, NULL, colour );
+}
+
+void oled_drawCircle( uint8_t centerX, uint8_t centerY, uint8_t radius, uint8_t thickness,
+    uint16_t colour )
+{
+    if( thickness == 0U )
+        return; // Nothing to draw
 
-    int32_t xIncrementScaled = ( dx * scale ) / stepsLimit;
-    int32_t yIncrementScaled = ( dy * scale ) / stepsLimit;
+    m_drawRing( centerX, centerY, radius, ( thickness > radius ) ? 0U : ( radius - thickness + 1U ), NULL, colour );
+}
+
+void oled_drawArc( uint8_t centerX, uint8_t centerY, uint8_t outerRadius, uint8_t innerRadius,
+    int16_t startAngle, int16_t endAngle, uint16_t colour )
+{
+    t_arcSector sector;
+    int16_t sweep = endAngle - startAngle;
 
-    for( uint16_t step = 0U; step < stepsLimit; step++ )
+    if( sweep >= 360 )
     {
-        x = (uint8_t) ( xScaled / scale );
-        y = (uint8_t) ( yScaled / scale );
+        // The whole ring
+        m_drawRing( centerX, centerY, outerRadius, innerRadius, NULL, colour );
+        return;
+    }
 
-        if( thickness > 0 )
-        {
-            for( int16_t xThicken = x - thickness; xThicken < x + thickness + 1; xThicken++ )
-            {
-                if( xThicken < 0 )
-                    continue;
-                
-                for( int16_t yThicken = y - thickness; yThicken < y + thickness + 1; yThicken++ )
-                {
-                    if( yThicken < 0 )
-                        continue;
+    sweep %= 360;
+    if( sweep < 0 )
+        sweep += 360;
+    if( sweep == 0 )
+        return; // Nothing to draw
 
-                    oled_setPixel( (uint8_t) xThicken, (uint8_t) yThicken, colour );
-                }
-            }
-        }
-        else // don't thicken line
-        {
-            oled_setPixel( x, y, colour );
-        }
+    // Directions of the ends of the arc, on the display y is down
+    sector.startX = intsin( startAngle );
+    sector.startY = -intcos( startAngle );
+    sector.endX = intsin( endAngle );
+    sector.endY = -intcos( endAngle );
+    sector.isOverHalf = ( sweep > 180 );
 
-        xScaled += xIncrementScaled;
-        yScaled += yIncrementScaled;
-    }
+    m_drawRing( centerX, centerY, outerRadius, innerRadius, &sector, colour );
+}
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+
+int oled_layerCreate( uint8_t x, uint8_t y, uint8_t width, uint8_t height, int8_t z,
+    t_oledLayerFormat format, uint16_t colour, t_oledLayer* layerPtr )
+{
+    t_oledLayer layer = 0U;
+    t_layer* layerStatePtr;
+    uint8_t orderIndex = 0U;
+
+    *layerPtr = OLED_LAYER_NONE;
+
+    if( ( width == 0U ) || ( height == 0U ) || ( x >= m_displayWidth ) || ( y >= m_displayHeight ) ||
+        ( width > m_displayWidth - x ) || ( height > m_displayHeight - y ) )
+        return 3;
+
+    // Find a free layer
+    while( ( layer < OLED_MAX_LAYERS ) && ( m_layers[layer].pixelsPtr != NULL ) )
+        ++layer;
+    if( layer == OLED_MAX_LAYERS )
+        return 1;
+
+    layerStatePtr = &m_layers[layer];
+    layerStatePtr->bytesPerRow = ( format == e_oledLayerMono ) ? ( ( width + 7U ) / 8U ) : ( (uint16_t) width * 2U );
+    layerStatePtr->size = (size_t) layerStatePtr->bytesPerRow * height;
+    if( format == e_oledLayerColour )
+        layerStatePtr->size += (size_t) ( ( width + 7U ) / 8U ) * height;
+    // All zeros is see through
+    layerStatePtr->pixelsPtr = (uint8_t*) calloc( layerStatePtr->size, sizeof( uint8_t ) );
+    if( layerStatePtr->pixelsPtr == NULL )
+        return 2;
+    layerStatePtr->coveragePtr = layerStatePtr->pixelsPtr;
+    if( format == e_oledLayerColour )
+        layerStatePtr->coveragePtr += (size_t) layerStatePtr->bytesPerRow * height;
+
+    layerStatePtr->format = format;
+    layerStatePtr->colour = colour;
+    layerStatePtr->x = x;
+    layerStatePtr->y = y;
+    layerStatePtr->width = width;
+    layerStatePtr->height = height;
+    layerStatePtr->z = z;
+
+    // Goes on top of every layer with the same z or lower
+    while( ( orderIndex < m_layerCount ) && ( m_layers[m_layerOrder[orderIndex]].z > z ) )
+        ++orderIndex;
+    memmove( &m_layerOrder[orderIndex + 1U], &m_layerOrder[orderIndex], m_layerCount - orderIndex );
+    m_layerOrder[orderIndex] = layer;
+    ++m_layerCount;
+
+    *layerPtr = layer;
+    return 0;
+}
+
+void oled_layerDestroy( t_oledLayer layer )
+{
+    t_layer* layerStatePtr = m_layerGet( layer );
+    uint8_t orderIndex = 0U;
+    t_oledLayer previousLayer;
+
+    if( layerStatePtr == NULL )
+        return;
+
+    free( layerStatePtr->pixelsPtr );
+    layerStatePtr->pixelsPtr = NULL;
+
+    while( m_layerOrder[orderIndex] != layer )
+        ++orderIndex;
+    --m_layerCount;
+    memmove( &m_layerOrder[orderIndex], &m_layerOrder[orderIndex + 1U], m_layerCount - orderIndex );
+
+    if( m_layerSelected == layer )
+        m_layerSelected = OLED_LAYER_NONE;
+
+    previousLayer = oled_layerSelect( OLED_LAYER_NONE );
+    oled_fillRect( layerStatePtr->x, layerStatePtr->y, layerStatePtr->width, layerStatePtr->height, 0x0000U );
+    (void) oled_layerSelect( previousLayer );
+    // Put back any layers under it at the next flush. This is needed even if
+    // it was the last layer, so no tile is left with the hash of what it had
+    m_tilesMarkDirty( layerStatePtr->x, layerStatePtr->y, layerStatePtr->x + layerStatePtr->width - 1U,
+        layerStatePtr->y + layerStatePtr->height - 1U, true );
+}
+
+t_oledLayer oled_layerSelect( t_oledLayer layer )
+{
+    const t_oledLayer previousLayer = m_layerSelected;
+
+    m_layerSelected = ( m_layerGet( layer ) != NULL ) ? layer : OLED_LAYER_NONE;
+
+    return previousLayer;
+}
+
+void oled_layerClear( t_oledLayer layer )
+{
+    t_layer* layerStatePtr = m_layerGet( layer );
+
+    if( layerStatePtr == NULL )
+        return;
+
+    memset( layerStatePtr->pixelsPtr, 0, layerStatePtr->size );
+    m_tilesMarkDirty( layerStatePtr->x, layerStatePtr->y, layerStatePtr->x + layerStatePtr->width - 1U,
+        layerStatePtr->y + layerStatePtr->height - 1U, false );
+}
+
+void oled_layerSetColour( t_oledLayer layer, uint16_t colour )
+{
+    t_layer* layerStatePtr = m_layerGet( layer );
+
+    if( ( layerStatePtr == NULL ) || ( layerStatePtr->format != e_oledLayerMono ) ||
+        ( layerStatePtr->colour == colour ) )
+        return;
+
+    layerStatePtr->colour = colour;
+    m_tilesMarkDirty( layerStatePtr->x, layerStatePtr->y, layerStatePtr->x + layerStatePtr->width - 1U,
+        layerStatePtr->y + layerStatePtr->height - 1U, false );
 }
 
+#endif // OLED_INCLUDE_COMPOSITOR
+
 #ifdef OLED_INCLUDE_TEST_FUNCTION
 void oled_test( void ) // Needs rewriting
 {
@@ -410,7 +901,7 @@ void oled_test( void ) // Needs rewriting
                 m_writeData(color);
             }
         }
-        sleep_ms( 1000U );
+        oledTransport_delayMs( 1000U );
         ++drawMode;
         if( drawMode == 4 )
             drawMode = 0;
@@ -477,6 +968,10 @@ int oled_loadingBarInit( uint8_t x1, uint8_t x2, uint8_t y1, uint8_t y2,
     m_loadingBarState = e_loadingBarStateHorizontal;
     m_loadingBarBitmapNext = e_loadingBarBitmap1Next;
     m_loadingBarColour = colour;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    m_loadingBarLayer = m_layerCreateForWidget( m_loadingBarHorizontalTopLeftX, m_loadingBarHorizontalTopLeftY,
+        m_loadingBarHorizontalBottomRightX, m_loadingBarHorizontalBottomRightY, OLED_LAYER_Z_LOADING, colour );
+#endif // OLED_INCLUDE_COMPOSITOR
 
     return 0;
 }
@@ -542,6 +1037,9 @@ void oled_loadingBarDisplay( uint8_t progress )
     uint8_t bitmapPixel = 0U; // Can exceed 8, refers to pixel number along the loading bar
     bitmapIndex = 0U; // Reuse this variable
     uint8_t bitmapBitmask;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    const t_oledLayer previousLayer = oled_layerSelect( m_loadingBarLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
 
     while( xPixelPosition <= m_loadingBarHorizontalBottomRightX )
     {
@@ -552,22 +1050,25 @@ void oled_loadingBarDisplay( uint8_t progress )
         if( ( ( bitmapCurrent[bitmapIndex] & bitmapBitmask ) != 0U ) && 
             ( ( bitmapToChange[bitmapIndex] & bitmapBitmask ) == 0U ) )
         {
-            // Turn some pixels off
-            for( uint8_t y = m_loadingBarHorizontalBottomRightY; y <= m_loadingBarHorizontalTopLeftY; y++ )
-                oled_setPixel( xPixelPosition, y, 0x0000U );
+            // Turn a column of pixels off
+            oled_fillRect( xPixelPosition, m_loadingBarHorizontalTopLeftY, 1U,
+                ( m_loadingBarHorizontalBottomRightY - m_loadingBarHorizontalTopLeftY ) + 1U, 0x0000U );
         }
         else if( ( ( bitmapCurrent[bitmapIndex] & bitmapBitmask ) == 0U ) && 
             ( ( bitmapToChange[bitmapIndex] & bitmapBitmask ) != 0U ) )
         {
-            // Turn some pixels on
-            for( uint8_t y = m_loadingBarHorizontalBottomRightY; y <= m_loadingBarHorizontalTopLeftY; y++ )
-                oled_setPixel( xPixelPosition, y, m_loadingBarColour );
+            // Turn a column of pixels on
+            oled_fillRect( xPixelPosition, m_loadingBarHorizontalTopLeftY, 1U,
+                ( m_loadingBarHorizontalBottomRightY - m_loadingBarHorizontalTopLeftY ) + 1U, m_loadingBarColour );
         }
         // Otherwise leave display as is
 
         ++bitmapPixel;
         ++xPixelPosition;
     }
+#ifdef OLED_INCLUDE_COMPOSITOR
+    (void) oled_layerSelect( previousLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
 
     // Change the next bitmap
     m_loadingBarBitmapNext = ( m_loadingBarBitmapNext == e_loadingBarBitmap1Next ) ? e_loadingBarBitmap2Next : e_loadingBarBitmap1Next;
@@ -592,6 +1093,11 @@ void oled_loadingBarDeinit( void )
         m_loadingBarBitmapPtr2 = NULL;
     }
 
+#ifdef OLED_INCLUDE_COMPOSITOR
+    oled_layerDestroy( m_loadingBarLayer );
+    m_loadingBarLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
+
     m_loadingBarState = e_loadingBarStateUninitialised;
 #endif
 }
@@ -610,38 +1116,41 @@ int oled_loadingCircleInit( uint8_t originX, uint8_t originY, uint8_t outerRadiu
         ( outerRadius <= 4U ) )
         return 3;
     
-    // Calculate the required calloc size
-    uint16_t bitmapWidthInPixels = ( (uint16_t) outerRadius * 2U ) - 1U;
-    uint16_t bitmapTotalNumberOfPixels = bitmapWidthInPixels * bitmapWidthInPixels;
-    m_loadingBarCallocSize = bitmapTotalNumberOfPixels / 8U;
-    // Round up if needed 
-    if( bitmapTotalNumberOfPixels % 8U != 0U )
-        ++m_loadingBarCallocSize;
-
-    // Callocs
-    m_loadingBarBitmapPtr1 = (uint8_t*) calloc( m_loadingBarCallocSize, sizeof( uint8_t ) );
-    if( m_loadingBarBitmapPtr1 == NULL )
-    {
+    // One quadrant of thresholds, indexed by the distance from the centre
+    const uint8_t lastOffset = outerRadius - 1U;
+    const int32_t outerLimit = ( (int32_t) lastOffset * lastOffset ) + lastOffset;
+    const int32_t innerLimit = ( innerRadius == 0U ) ? -1 :
+        ( ( (int32_t) ( innerRadius - 1 ) * ( innerRadius - 1 ) ) + ( innerRadius - 1 ) );
+    int32_t distanceSquared;
+
+    m_loadingCircleThresholdsPtr = (uint8_t*) calloc( (uint16_t) outerRadius * outerRadius, sizeof( uint8_t ) );
+    if( m_loadingCircleThresholdsPtr == NULL )
         return 2; // Failed calloc, RIP
-    }
-    m_loadingBarBitmapPtr2 = (uint8_t*) calloc( m_loadingBarCallocSize, sizeof( uint8_t ) );
-    if( m_loadingBarBitmapPtr2 == NULL )
+
+    for( uint8_t v = 0U; v < outerRadius; v++ )
     {
-        // Free the first bitmap before exiting
-        free( m_loadingBarBitmapPtr1 );
-        m_loadingBarBitmapPtr1 = NULL;
-        return 2;
+        for( uint8_t u = 0U; u < outerRadius; u++ )
+        {
+            // The same ring as oled_drawCircle with a radius of outerRadius - 1
+            distanceSquared = ( (int32_t) u * u ) + ( (int32_t) v * v );
+            if( ( distanceSquared > outerLimit ) || ( distanceSquared <= innerLimit ) )
+                m_loadingCircleThresholdsPtr[( v * outerRadius ) + u] = OLED_LOADING_CIRCLE_OUTSIDE;
+            else
+                m_loadingCircleThresholdsPtr[( v * outerRadius ) + u] = (uint8_t) ( atan2( u, v ) * 126.0 / M_PI );
+        }
     }
 
     m_loadingCircleCenterX = originX;
     m_loadingCircleCenterY = originY;
-    m_loadingCircleInnerRadius = innerRadius;
     m_loadingCircleOuterRadius = outerRadius;
-    m_loadingCircleBitmapWidth = ( m_loadingCircleOuterRadius * 2U ) - 1U;
+    m_loadingCircleProgress = 0U; // Nothing is drawn until the first display
 
     m_loadingBarColour = colour;
     m_loadingBarState = e_loadingBarStateCircle;
-    m_loadingBarBitmapNext = e_loadingBarBitmap1Next;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    m_loadingBarLayer = m_layerCreateForWidget( (int16_t) originX - lastOffset, (int16_t) originY - lastOffset,
+        (int16_t) originX + lastOffset, (int16_t) originY + lastOffset, OLED_LAYER_Z_LOADING, colour );
+#endif // OLED_INCLUDE_COMPOSITOR
 
     return 0;
 }
@@ -667,138 +1176,29 @@ void oled_loadingCircleDisplay( uint8_t progress )
     if( m_loadingBarState != e_loadingBarStateCircle )
         return;
 
-    // Get the bitmaps
-    uint8_t* nextBitmap;
-    uint8_t* currentBitmap;
-    if( m_loadingBarBitmapNext == e_loadingBarBitmap1Next )
-    {
-        nextBitmap = m_loadingBarBitmapPtr1;
-        currentBitmap = m_loadingBarBitmapPtr2;
-    }
-    else
-    {
-        nextBitmap = m_loadingBarBitmapPtr2;
-        currentBitmap = m_loadingBarBitmapPtr1;
-    }
-
-    uint8_t progressRemaining = progress;
-    uint8_t currentQuadrant = 0U; // This should be set by a parameter in the init function
-    /* If I coded this well, you could change the currentQuadrant start value to make it start in a different place
-     * Q3 | Q0
-     * -------            Brain go brr
-     * Q2 | Q1 */
-    uint8_t quadrantCounter = 0U; // Need to process all 4 quadrants
-    uint8_t xLowerBound;
-    uint8_t xUpperBound;
-    bool yIsPositive; // Positive meaning the upper part of the display (which actually has lower y values)
-
-    while( quadrantCounter < 4U )
-    {
-        // These coordinates refer to the bitmap. Top left of the bitmap is 0, 0
-        if( currentQuadrant == 0U )
-        {
-            xLowerBound = m_loadingCircleOuterRadius - 1U;
-            xUpperBound = ( m_loadingCircleOuterRadius * 2U ) - 1U;
-            yIsPositive = true;
-        }
-        else if( currentQuadrant == 1U )
-        {
-            xLowerBound = m_loadingCircleOuterRadius - 1U;
-            xUpperBound = ( m_loadingCircleOuterRadius * 2U ) - 1U;
-            yIsPositive = false;
-        }
-        else if( currentQuadrant == 2U )
-        {
-            xLowerBound = 0U;
-            xUpperBound = m_loadingCircleOuterRadius;
-            yIsPositive = false;
-        }
-        else // currentQuadrant == 3U
-        {
-            xLowerBound = 0U;
-            xUpperBound = m_loadingCircleOuterRadius;
-            yIsPositive = true;
-        }
+    if( progress == m_loadingCircleProgress )
+        return; // Nothing has changed
 
-        if( progressRemaining >= 63U )
-        {
-            // This currentQuadrant will be completely filled
-
-            m_loadingCircleProcessQuadrant( nextBitmap, xLowerBound, xUpperBound, yIsPositive, 90U );
-
-            progressRemaining -= 63U;
-        }
-        else if( progressRemaining == 0U)
-        {
-            // This quarter of the bitmap will be empty
-
-            m_loadingCircleProcessQuadrant( nextBitmap, xLowerBound, xUpperBound, yIsPositive, 0U );
-        }
-        else // Then progressRemaining <= 62
-        {
-            // This quadrant won't be completely filled
-
-            m_loadingCircleProcessQuadrant( nextBitmap, xLowerBound, xUpperBound, yIsPositive, (uint8_t) ( ( (uint16_t) progressRemaining * 90U ) / 63U ) );
-            progressRemaining = 0U;
-        }
-
-        ++quadrantCounter;
-        ++currentQuadrant;
-        if( currentQuadrant == 4U )
-            currentQuadrant = 0U;
-    }
-
-    // Cut out the middle of the loading donut
-    uint8_t triangleWidth = ( m_loadingCircleInnerRadius - 1U );
-    uint8_t yLimit;
-    if( m_loadingCircleInnerRadius > 0U )
-    {
-        for( uint8_t x = ( m_loadingCircleOuterRadius - 1 ) - ( m_loadingCircleInnerRadius - 1U ); x < ( m_loadingCircleOuterRadius - 1 ) + ( m_loadingCircleInnerRadius ); x++ )
-        {
-            yLimit = (uint8_t) sqrt( ( (uint16_t) m_loadingCircleInnerRadius * (uint16_t) m_loadingCircleInnerRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) );
-            for( uint8_t y = ( m_loadingCircleOuterRadius - 1 ) - yLimit; y < ( m_loadingCircleOuterRadius - 1 ) + yLimit; y++ )
-            {
-                m_loadingCircleSetBitmap( nextBitmap, x, y, false );
-            }
-            if( x < ( m_loadingCircleOuterRadius - 1 ) )
-                --triangleWidth;
-            else
-                ++triangleWidth;
-        }
-    }
+    // Only the sector between the old and new progress needs painting
+    const bool isGrowing = ( progress > m_loadingCircleProgress );
+    const uint8_t progressLow = isGrowing ? m_loadingCircleProgress : progress;
+    const uint8_t progressHigh = isGrowing ? progress : m_loadingCircleProgress;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    const t_oledLayer previousLayer = oled_layerSelect( m_loadingBarLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
 
-    // Push the bitmap
-    uint16_t bitPosition = 0U;
-    uint8_t displayPositionX = m_loadingCircleCenterX - ( m_loadingCircleOuterRadius - 1U );
-    uint8_t displayPositionY = m_loadingCircleCenterY - ( m_loadingCircleOuterRadius - 1U );
-    const uint8_t displayLimitX = m_loadingCircleCenterX + ( m_loadingCircleOuterRadius - 1U );
-    while( bitPosition < ( (uint16_t) m_loadingCircleBitmapWidth * (uint16_t) m_loadingCircleBitmapWidth ) )
+    for( uint8_t quadrant = 0U; quadrant < 4U; quadrant++ )
     {
-        if( ( ( nextBitmap[bitPosition / 8U] & ( 0b10000000 >> bitPosition % 8U ) ) == 0U ) &&
-            ( ( currentBitmap[bitPosition / 8U] & ( 0b10000000 >> bitPosition % 8U ) ) != 0U ) )
-        {
-            oled_setPixel( displayPositionX, displayPositionY, 0x0000U );
-        }
-        else if( ( ( nextBitmap[bitPosition / 8U] & ( 0b10000000 >> bitPosition % 8U ) ) != 0U ) &&
-            ( ( currentBitmap[bitPosition / 8U] & ( 0b10000000 >> bitPosition % 8U ) ) == 0U ) )
-        {
-            oled_setPixel( displayPositionX, displayPositionY, m_loadingBarColour );
-        }
-        // Otherwise leave display as is
-
-        ++displayPositionX;
-        if( displayPositionX > displayLimitX )
-        {
-            displayPositionX = m_loadingCircleCenterX - ( m_loadingCircleOuterRadius - 1U );
-            ++displayPositionY;
-        }
-
-        ++bitPosition;
+        // Quadrant 0 goes up to and including 63, the others stop short of the next one
+        if( ( quadrant * 63U < progressHigh ) && ( ( quadrant * 63U ) + 63U >= progressLow ) )
+            m_loadingCirclePaintQuadrant( quadrant, progressLow, progressHigh,
+                isGrowing ? m_loadingBarColour : 0x0000U );
     }
+#ifdef OLED_INCLUDE_COMPOSITOR
+    (void) oled_layerSelect( previousLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
 
-    // Update the module scope variables
-    m_loadingBarBitmapNext = ( m_loadingBarBitmapNext == e_loadingBarBitmap1Next ) ? e_loadingBarBitmap2Next : e_loadingBarBitmap1Next;
-    
+    m_loadingCircleProgress = progress;
 }
 
 #endif /* OLED_INCLUDE_LOADING_CIRCLE */
@@ -809,17 +1209,17 @@ void oled_loadingCircleDeinit( void )
     if( m_loadingBarState != e_loadingBarStateCircle )
         return;
 
-    if( m_loadingBarBitmapPtr1 != NULL )
-    {
-        free( m_loadingBarBitmapPtr1 );
-        m_loadingBarBitmapPtr1 = NULL;
-    }
-    if( m_loadingBarBitmapPtr2 != NULL )
+    if( m_loadingCircleThresholdsPtr != NULL )
     {
-        free( m_loadingBarBitmapPtr2 );
-        m_loadingBarBitmapPtr2 = NULL;
+        free( m_loadingCircleThresholdsPtr );
+        m_loadingCircleThresholdsPtr = NULL;
     }
 
+#ifdef OLED_INCLUDE_COMPOSITOR
+    oled_layerDestroy( m_loadingBarLayer );
+    m_loadingBarLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
+
     m_loadingBarState = e_loadingBarStateUninitialised;
 #endif
 }
@@ -827,92 +1227,15 @@ void oled_loadingCircleDeinit( void )
 #if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 void oled_writeChar( uint8_t x, uint8_t y, char character, uint8_t fontSize, uint16_t colour )
 {
-    tFontTable* fontTable;
+    const tFontPacked* fontTablePtr = m_fontGetTable( fontSize );
 
-    if( ( x < 0 ) || ( x > m_displayWidth ) || ( y < 0 ) || ( y > m_displayHeight ) )
-    {
-        // Out of display bounds
-        return;
-    }
+    if( fontTablePtr == NULL )
+        return; // Font height not supported
 
-    if( ( character < 32 ) || ( character > ( 32 + 95 ) ) )
-    {
-        // Invalid ascii character, draw a blank character
-        character = ' '; // = 32
-    }
+    if( ( x >= m_displayWidth ) || ( y >= m_displayHeight ) )
+        return; // Out of display bounds
 
-    switch( fontSize )
-    {
-#ifdef OLED_INCLUDE_FONT8
-        case 8U:
-        {
-            fontTable = &Font8;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT8 */
-#ifdef OLED_INCLUDE_FONT12
-        case 12U:
-        {
-            fontTable = &Font12;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT12 */
-#ifdef OLED_INCLUDE_FONT16
-        case 16U:
-        {
-            fontTable = &Font16;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT16 */
-#ifdef OLED_INCLUDE_FONT20
-        case 20U:
-        {
-            fontTable = &Font20;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT20 */
-#ifdef OLED_INCLUDE_FONT24
-        case 24U:
-        {
-            fontTable = &Font24;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT24 */
-        default:
-        {
-            // Do nothing, font height not supported
-            return;
-        }
-        break;
-    }
-
-    // Write the character
-
-    // Calculate the width of a character in bytes
-    uint16_t characterWidthBytes = ( fontTable->Width / 8U ) + 1U;
-    // Find starting position in the array. Note that the first 32 characters of
-    // ascii aren't human readable
-    uint16_t arrayPosition = fontTable->Height * characterWidthBytes * (uint16_t) ( character - 32U );
-    // bitPosition records the position within each byte
-    uint8_t bitPosition;
-    // Displacement variables is relative to the characters origin
-    for( uint8_t yDisplacement = 0U; yDisplacement < fontTable->Height; yDisplacement++ )
-    {
-        bitPosition = 0;
-        for( uint8_t xDisplacement = 0U; xDisplacement < fontTable->Width; xDisplacement++ )
-        {
-            if( ( fontTable->table[arrayPosition] & ( 0b10000000 >> bitPosition ) ) != 0 )
-                oled_setPixel( x + xDisplacement, y + yDisplacement, colour );
-
-            ++bitPosition;
-            if( bitPosition == 8 )
-            {
-                ++arrayPosition;
-                bitPosition = 0U;
-            }
-        }
-        ++arrayPosition;
-    }
+    m_glyphDraw( m_glyphGet( fontTablePtr, character ), x, y, colour );
 }
 
 void oled_writeText( uint8_t xStartPos, uint8_t yStartPos, const char text[],
@@ -921,22 +1244,13 @@ void oled_writeText( uint8_t xStartPos, uint8_t yStartPos, const char text[],
     // Text position is pixel coordinate for the top left of the glyph
     uint8_t xCurrentTextPosition = xStartPos;
     uint8_t yCurrentTextPosition = yStartPos;
-    uint8_t characterWidth;
-    if( fontSize == 8U )
-        characterWidth = OLED_FONT8_WIDTH;
-    else if( fontSize == 12U )
-        characterWidth = OLED_FONT12_WIDTH;
-    else if( fontSize == 16U )
-        characterWidth = OLED_FONT16_WIDTH;
-    else if( fontSize == 20U )
-        characterWidth = OLED_FONT20_WIDTH;
-    else if( fontSize == 24U )
-        characterWidth = OLED_FONT24_WIDTH;
-    else
+    const tFontPacked* fontTablePtr = m_fontGetTable( fontSize );
+    if( fontTablePtr == NULL )
     {
         // Unsupported font size
         return;
     }
+    const uint8_t characterWidth = fontTablePtr->Width;
 
     while( *text != 0 )
     {
@@ -962,55 +1276,78 @@ void oled_writeText( uint8_t xStartPos, uint8_t yStartPos, const char text[],
     }
 }
 
-int oled_terminalInit( uint8_t fontSize, uint16_t colour )
+void oled_writeTextWithBackground( uint8_t xStartPos, uint8_t yStartPos, const char text[],
+    uint8_t fontSize, uint16_t colour, uint16_t backgroundColour, bool useTextWrapping )
 {
-    if( m_terminalBitmapState != e_terminalUninitialised )
-        return 2; // Fail as terminal already initialised
+    const tFontPacked* fontTablePtr = m_fontGetTable( fontSize );
+    const t_glyph* glyphPtrs[OLED_GLYPH_CACHE_SIZE - 1U];
+    uint8_t characterCount;
+    uint8_t characterPitch;
+    uint8_t lineWidth;
+    uint8_t lineHeight;
+    uint8_t yCurrentTextPosition = yStartPos;
 
-    switch( fontSize )
+    if( fontTablePtr == NULL )
+        return; // Unsupported font size
+
+    characterPitch = fontTablePtr->Width + OLED_WRITE_TEXT_CHARACTER_GAP;
+    while( ( *text != 0 ) && ( yCurrentTextPosition < m_displayHeight ) )
     {
-#ifdef OLED_INCLUDE_FONT8
-        case 8U:
-        {
-            m_terminalFontTablePtr = &Font8;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT8 */
-#ifdef OLED_INCLUDE_FONT12
-        case 12U:
-        {
-            m_terminalFontTablePtr = &Font12;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT12 */
-#ifdef OLED_INCLUDE_FONT16
-        case 16U:
-        {
-            m_terminalFontTablePtr = &Font16;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT16 */
-#ifdef OLED_INCLUDE_FONT20
-        case 20U:
-        {
-            m_terminalFontTablePtr = &Font20;
-        }
-        break;
-#endif /* OLED_INCLUDE_FONT20 */
-#ifdef OLED_INCLUDE_FONT24
-        case 24U:
+        // Like oled_writeText, wrapped text stops rather than writing a line off the display
+        if( ( useTextWrapping == true ) && ( ( (uint16_t) yCurrentTextPosition + fontSize ) > m_displayHeight ) )
+            break;
+
+        // Take as many whole characters as fit on this line, looking up each glyph once
+        characterCount = 0U;
+        while( ( *text != 0 ) && ( characterCount < ( OLED_GLYPH_CACHE_SIZE - 1U ) ) &&
+            ( ( (uint16_t) xStartPos + ( (uint16_t) characterCount * characterPitch ) + fontTablePtr->Width ) <= m_displayWidth ) )
         {
-            m_terminalFontTablePtr = &Font24;
+            glyphPtrs[characterCount] = m_glyphGet( fontTablePtr, *text );
+            ++characterCount;
+            ++text;
         }
-        break;
-#endif /* OLED_INCLUDE_FONT24 */
-        default:
+        if( characterCount == 0U )
+            break; // Not even one character fits
+
+        // Render the line a row at a time into a single window
+        lineWidth = ( characterCount * characterPitch ) - OLED_WRITE_TEXT_CHARACTER_GAP;
+        lineHeight = ( ( (uint16_t) yCurrentTextPosition + fontTablePtr->Height ) > m_displayHeight ) ?
+            ( m_displayHeight - yCurrentTextPosition ) : fontTablePtr->Height;
+        m_windowBegin( xStartPos, yCurrentTextPosition, lineWidth, lineHeight );
+        for( uint8_t row = 0U; row < lineHeight; row++ )
         {
-            // Do nothing, font height not supported
-            return 3;
+            m_lineBufferFill( lineWidth, backgroundColour );
+            for( uint8_t character = 0U; character < characterCount; character++ )
+                m_glyphRenderRow( glyphPtrs[character], row, character * characterPitch, colour );
+            m_windowWrite( m_lineBuffer, (size_t) lineWidth * 2U );
         }
-        break;
+        m_windowEnd();
+
+        if( useTextWrapping == false )
+            break;
+        yCurrentTextPosition += fontSize + OLED_WRITE_TEXT_CHARACTER_GAP;
     }
+}
+
+uint16_t oled_measureText( const char text[], uint8_t fontSize )
+{
+    const tFontPacked* fontTablePtr = m_fontGetTable( fontSize );
+    const size_t characterCount = strlen( text );
+
+    if( ( fontTablePtr == NULL ) || ( characterCount == 0U ) )
+        return 0U;
+
+    return (uint16_t) ( ( characterCount * ( fontTablePtr->Width + OLED_WRITE_TEXT_CHARACTER_GAP ) ) - OLED_WRITE_TEXT_CHARACTER_GAP );
+}
+
+int oled_terminalInit( uint8_t fontSize, uint16_t colour )
+{
+    if( m_terminalBitmapState != e_terminalUninitialised )
+        return 2; // Fail as terminal already initialised
+
+    m_terminalFontTablePtr = m_fontGetTable( fontSize );
+    if( m_terminalFontTablePtr == NULL )
+        return 3; // Font size not supported
 
     // Need enough bits to cover the the screen width, might have a few bits unused per row
     // This is so that bytes for each row align, which makes scrolling much much easier
@@ -1026,7 +1363,7 @@ int oled_terminalInit( uint8_t fontSize, uint16_t colour )
         return 1; // Memory allocation failed
 
     m_terminalBitmapPtr2 = (uint8_t*) calloc( m_terminalBitmapCallocSize, sizeof( uint8_t ) );
-    if( m_terminalBitmapPtr1 == NULL )
+    if( m_terminalBitmapPtr2 == NULL )
     {
         // Memory allocation failed
         free( m_terminalBitmapPtr1 );
@@ -1040,6 +1377,44 @@ int oled_terminalInit( uint8_t fontSize, uint16_t colour )
     m_terminalBitmapState = e_terminalBitmap1Next;
     m_terminalIsLineTemp = false;
     m_terminalHeightInLines = m_displayHeight / m_terminalFontSize;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    m_terminalLayer = m_layerCreateForWidget( 0, 0, m_displayWidth - 1,
+        ( m_terminalHeightInLines * m_terminalFontSize ) - 1, OLED_LAYER_Z_TERMINAL, colour );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+    return 0; // Success
+}
+
+int oled_terminalInitScrolling( uint8_t fontSize, uint16_t colour )
+{
+    if( m_terminalBitmapState != e_terminalUninitialised )
+        return 2; // Fail as terminal already initialised
+
+    m_terminalFontTablePtr = m_fontGetTable( fontSize );
+    if( m_terminalFontTablePtr == NULL )
+        return 3; // Font size not supported
+
+    // The start line wraps around all 128 rows of the display RAM, so the ring
+    // of lines only lines up with the screen on a full height display
+    if( m_displayHeight != OLED_MAX_DISPLAY_HEIGHT )
+        return 4;
+
+    m_terminalHeightInLines = m_displayHeight / fontSize;
+    m_terminalTextLineSize = ( m_displayWidth / ( m_terminalFontTablePtr->Width + OLED_WRITE_TEXT_CHARACTER_GAP ) ) + 1U;
+    m_terminalTextPtr = (char*) calloc( (size_t) m_terminalTextLineSize * m_terminalHeightInLines, sizeof( char ) );
+    if( m_terminalTextPtr == NULL )
+        return 1; // Memory allocation failed
+
+    m_terminalFontSize = fontSize;
+    m_terminalFontColour = colour;
+    m_terminalCurrentLine = 0U;
+    m_terminalTopTextLine = 0U;
+    m_terminalIsLineTemp = false;
+    m_terminalBitmapState = e_terminalScrolling;
+
+    // Start from a blank display with nothing scrolled
+    oled_clear();
+    m_terminalScrollingSetStartLine( 0U );
 
     return 0; // Success
 }
@@ -1058,7 +1433,9 @@ bool oled_terminalIsInit( void )
 
 int oled_terminalSetHeight( uint8_t newHeightInLines )
 {
-    if( newHeightInLines == 0U )
+    if( m_terminalBitmapState == e_terminalScrolling )
+        return 1; // Invalid, the scrolling terminal always uses the whole display
+    else if( newHeightInLines == 0U )
         return 1; // Invalid, too few lines
     else if( newHeightInLines > ( m_displayHeight / m_terminalFontSize ) )
         return 1; // Invalid, too many lines for the screen size
@@ -1067,6 +1444,17 @@ int oled_terminalSetHeight( uint8_t newHeightInLines )
 
     m_terminalHeightInLines = newHeightInLines;
 
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( m_terminalLayer != OLED_LAYER_NONE )
+    {
+        // Move to a layer of the new height, and redraw the terminal into it
+        oled_layerDestroy( m_terminalLayer );
+        m_terminalLayer = m_layerCreateForWidget( 0, 0, m_displayWidth - 1,
+            ( m_terminalHeightInLines * m_terminalFontSize ) - 1, OLED_LAYER_Z_TERMINAL, m_terminalFontColour );
+        oled_terminalSetNewColour( m_terminalFontColour );
+    }
+#endif // OLED_INCLUDE_COMPOSITOR
+
     return 0;
 }
 
@@ -1106,6 +1494,16 @@ void oled_terminalWriteTemp( const char text[] )
 
 void oled_terminalClear( void )
 {
+    if( m_terminalBitmapState == e_terminalScrolling )
+    {
+        memset( m_terminalTextPtr, 0, (size_t) m_terminalTextLineSize * m_terminalHeightInLines );
+        m_terminalTopTextLine = 0U;
+        m_terminalCurrentLine = 0U;
+        oled_clear();
+        m_terminalScrollingSetStartLine( 0U );
+        return;
+    }
+
     uint8_t* desiredBitmapPtr = ( m_terminalBitmapState == e_terminalBitmap1Next ) ? m_terminalBitmapPtr1 : m_terminalBitmapPtr2;
     // Set all pixels to off
     for( uint16_t index = 0U; index < m_terminalBitmapCallocSize; index++ )
@@ -1129,6 +1527,25 @@ void oled_terminalSetLine( uint8_t line )
 
 void oled_terminalSetNewColour( uint16_t colour )
 {
+    if( m_terminalBitmapState == e_terminalScrolling )
+    {
+        m_terminalFontColour = colour;
+        // Redraw every line from its text, the rows below the last line are already blank
+        for( uint8_t line = 0U; line < m_terminalHeightInLines; line++ )
+            m_terminalScrollingDrawRows( line * m_terminalFontSize, m_terminalFontSize, m_terminalScrollingGetText( line ) );
+        return;
+    }
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( ( m_terminalLayer != OLED_LAYER_NONE ) && ( colour != m_terminalFontColour ) )
+    {
+        // Only the layer's colour needs to change
+        m_terminalFontColour = colour;
+        oled_layerSetColour( m_terminalLayer, colour );
+        return;
+    }
+#endif // OLED_INCLUDE_COMPOSITOR
+
     uint8_t* currentBitmapPtr; // What the screen currently has
     uint8_t* desiredBitmapPtr; // We need to change this bitmap to what we want the screen to have next
     if( m_terminalBitmapState == e_terminalBitmap1Next )
@@ -1164,6 +1581,15 @@ void oled_terminalDeinit( void )
     if( m_terminalBitmapState == e_terminalUninitialised )
         return;
 
+    if( m_terminalBitmapState == e_terminalScrolling )
+    {
+        free( m_terminalTextPtr );
+        m_terminalTextPtr = NULL;
+        // Put the display back to unscrolled for everything else
+        if( m_terminalStartLine != 0U )
+            m_terminalScrollingSetStartLine( 0U );
+    }
+
     // Free the memory and set the bitmap pointers to NULL. Never free a NULL pointer
     if( m_terminalBitmapPtr1 != NULL )
     {
@@ -1175,6 +1601,10 @@ void oled_terminalDeinit( void )
         free( m_terminalBitmapPtr2 );
         m_terminalBitmapPtr2 = NULL;
     }
+#ifdef OLED_INCLUDE_COMPOSITOR
+    oled_layerDestroy( m_terminalLayer );
+    m_terminalLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
     // Change the bitmap state module scope variable to uninitialised
     m_terminalBitmapState = e_terminalUninitialised;
 #endif
@@ -1184,109 +1614,124 @@ void oled_terminalDeinit( void )
 
 int oled_sdWriteImage( const char filename[], uint8_t originX, uint8_t originY )
 {
-    FRESULT fr;
-    FATFS fs;
     FIL fil;
-    char buf[OLED_SD_BUFFER_SIZE];
+    int result;
 
-    // Mount the SD card
-    fr = f_mount( &fs, "0:", 1 );
-    if( fr != FR_OK )
-        return 1;
+    // Open the file that needs to be read, mounting the SD card if needed
+    result = storage_open( &fil, filename, FA_READ );
+    if( result != 0 )
+        return result;
 
-    // Open the file that needs to be read
-    fr = f_open( &fil, filename, FA_READ );
-    if( fr != FR_OK )
-        return 2;
+    m_sdBufferPtr = m_sdBuffer;
+    m_sdBufferLength = 0U;
+    m_sdBufferIndex = 0U;
+    result = m_sdImageDraw( &fil, originX, originY );
 
-    // Read the file and push to the display
-    uint8_t x = originX;
-    uint8_t y = originY;
-    uint8_t imageWidth = 0U;  // Init to invalid number
-    uint8_t imageHeight = 0U; // Init to invalid number
-    uint16_t nibbleBuffer;
-    uint8_t nibblesInBuffer = 0U;
-    bool end = false;
-    while( f_gets( buf, sizeof(buf), &fil ) )
-    {
-        for( uint8_t bufferIndex = 0U; bufferIndex < OLED_SD_BUFFER_SIZE; bufferIndex++ )
-        {
-            if( buf[bufferIndex] == 0 )
-                break; // End of buffer
-            if( buf[bufferIndex] == 10 )
-                continue; // Newline within file
-            if( ( buf[bufferIndex] < 32U ) || ( buf[bufferIndex] > 63U ) )
-                buf[bufferIndex] = 32; // To avoid bad nibbles over spilling
+    // Close the file, the SD card stays mounted for a while in case it's needed again
+    if( ( storage_close( &fil ) != 0 ) && ( result == 0 ) )
+        result = 3;
 
-            // Add the nibble to the nibbleBuffer
-            if( nibblesInBuffer == 0U )
-            {
-                nibbleBuffer = ( (uint8_t) buf[bufferIndex] - 32U ) << 12;
-            }
-            else if( nibblesInBuffer == 1U )
-            {
-                nibbleBuffer += ( (uint8_t) buf[bufferIndex] - 32U ) << 8;
-            }
-            else if( nibblesInBuffer == 2U )
-            {
-                nibbleBuffer += ( (uint8_t) buf[bufferIndex] - 32U ) << 4;
-            }
-            else // if( nibbleBuffer == 3U )
-            {
-                nibbleBuffer += (uint8_t) buf[bufferIndex] - 32U;
-            }
-            ++nibblesInBuffer;
+    return result;
+}
 
-            // Check if the nibble buffer is full
-            if( nibblesInBuffer == 4U )
-            {
-                // Do something with the full nibbleBuffer
-                // Check if the image width and height have been read
-                if( imageWidth == 0U )
-                {
-                    imageWidth = (uint8_t) ( ( nibbleBuffer & 0b1111111100000000U ) >> 8 );
-                    imageHeight = (uint8_t) ( nibbleBuffer & 0b0000000011111111U );
-                }
-                // Otherwise write to the display
-                else
-                {
-                    oled_setPixel( x, y, nibbleBuffer );
+#ifdef OLED_INCLUDE_IMAGE_CACHE
 
-                    ++x;
-                    if( x == ( originX + imageWidth ) )
-                    {
-                        ++y;
-                        x = originX;
-                        if( y == originY + imageHeight )
-                        {
-                            end = true;
-                            break;
-                        }
-                    }
+int oled_drawCachedImage( const char filename[], uint8_t originX, uint8_t originY )
+{
+    FRESULT fr;
+    FIL fil;
+    t_imageCacheEntry* entryPtr = m_imageCacheFind( filename );
+    UINT length;
+    int result;
 
-                }
-                // The nibbleBuffer is now considered empty
-                nibblesInBuffer = 0U;
-            }
+    if( entryPtr != NULL )
+    {
+        // Draw it straight from RAM, or flash
+        return m_imageCacheDraw( entryPtr, originX, originY );
+    }
+
+    // Open the file that needs to be read, mounting the SD card if needed
+    result = storage_open( &fil, filename, FA_READ );
+    if( result != 0 )
+    {
+#ifdef OLED_INCLUDE_ASSET_PACK
+        // Not on the SD card, so use the copy in flash if there is one
+        const t_asset* assetPtr = m_assetFind( filename );
+        if( assetPtr != NULL )
+        {
+            entryPtr = m_imageCacheAdd( filename, (UINT) assetPtr->size, &Assets_Data[assetPtr->offset] );
+            if( entryPtr != NULL )
+                return m_imageCacheDraw( entryPtr, originX, originY );
+            return oled_drawAsset( filename, originX, originY );
         }
-        if( end )
-            break;
+#endif // OLED_INCLUDE_ASSET_PACK
+        return result;
     }
 
-    // Close the file
-    fr = f_close( &fil );
-    if( fr != FR_OK )
+    // Keep the whole file, if it's a .oimg that fits
+    entryPtr = m_imageCacheAdd( filename, (UINT) f_size( &fil ), NULL );
+    if( entryPtr != NULL )
     {
-        f_unmount( "0:" );
-        return 3;
+        // m_imageCacheAdd allocated this
+        fr = f_read( &fil, (uint8_t*) entryPtr->dataPtr, entryPtr->size, &length );
+        if( ( fr != FR_OK ) || ( length != entryPtr->size ) ||
+            ( memcmp( entryPtr->dataPtr, OLED_SD_IMAGE_MAGIC, 4U ) != 0 ) )
+        {
+            m_imageCacheRemove( entryPtr );
+            entryPtr = NULL;
+            fr = f_rewind( &fil );
+            if( fr != FR_OK )
+                result = 5;
+        }
     }
 
-    // Unmount the SD card
-    f_unmount( "0:" );
-    
-    return 0;
+    if( entryPtr != NULL )
+    {
+        result = m_imageCacheDraw( entryPtr, originX, originY );
+    }
+    else if( result == 0 )
+    {
+        m_sdBufferPtr = m_sdBuffer;
+        m_sdBufferLength = 0U;
+        m_sdBufferIndex = 0U;
+        result = m_sdImageDraw( &fil, originX, originY );
+    }
+
+    // Close the file, the SD card stays mounted for a while in case it's needed again
+    if( ( storage_close( &fil ) != 0 ) && ( result == 0 ) )
+        result = 3;
+
+    return result;
+}
+
+void oled_imageCacheClear( void )
+{
+    for( uint8_t entry = 0U; entry < OLED_IMAGE_CACHE_ENTRIES; entry++ )
+    {
+        if( m_imageCache[entry].dataPtr != NULL )
+            m_imageCacheRemove( &m_imageCache[entry] );
+    }
+}
+
+#ifdef OLED_INCLUDE_ASSET_PACK
+
+int oled_drawAsset( const char filename[], uint8_t originX, uint8_t originY )
+{
+    const t_asset* assetPtr = m_assetFind( filename );
+
+    if( assetPtr == NULL )
+        return 2;
+
+    m_sdBufferPtr = &Assets_Data[assetPtr->offset];
+    m_sdBufferLength = (UINT) assetPtr->size;
+    m_sdBufferIndex = 0U;
+    return m_sdImageDraw( NULL, originX, originY );
 }
 
+#endif // OLED_INCLUDE_ASSET_PACK
+
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
 #endif // OLED_INCLUDE_SD_IMAGES
 
 #ifdef OLED_INCLUDE_QR_GENERATOR
@@ -1311,45 +1756,33 @@ int oled_printQrCode( const char text[], uint16_t colour1, uint16_t colour2 )
     const uint8_t qrSize = (uint8_t) qrcodegen_getSize( qrcode );
     const uint8_t pixelsPerQrBit = m_displayWidth / qrSize;
     const uint8_t qrOrigin = ( m_displayWidth - ( pixelsPerQrBit * qrSize ) ) / 2U;
-    uint8_t qrcodeX = 0U;
-    uint8_t qrcodeY = 0U;
-    uint8_t displayX;
-    uint8_t displayY;
+    const uint8_t qrWidthInPixels = pixelsPerQrBit * qrSize;
+    uint16_t colour;
+
+    if( qrWidthInPixels == 0U )
+        return 0; // QR code is too big for the display, nothing to draw
 
-    while( qrcodeY < qrSize )
+    // The whole QR code is streamed into a single display window
+    m_windowBegin( qrOrigin, qrOrigin, qrWidthInPixels, qrWidthInPixels );
+    for( uint8_t qrcodeY = 0U; qrcodeY < qrSize; qrcodeY++ )
     {
-        if( qrcodegen_getModule( qrcode, qrcodeX, qrcodeY ) )
+        // Build one row of display pixels for this row of the QR code
+        for( uint8_t qrcodeX = 0U; qrcodeX < qrSize; qrcodeX++ )
         {
-            // Typically you'd set the screen dark here
-            for( displayX = qrOrigin + ( qrcodeX * pixelsPerQrBit ); displayX < qrOrigin + ( qrcodeX * pixelsPerQrBit ) + pixelsPerQrBit; displayX++ )
+            // True for dark. Typically colour1 is dark and colour2 is bright
+            colour = qrcodegen_getModule( qrcode, qrcodeX, qrcodeY ) ? colour1 : colour2;
+            for( uint8_t bitPixel = 0U; bitPixel < pixelsPerQrBit; bitPixel++ )
             {
-                for( displayY = qrOrigin + ( qrcodeY * pixelsPerQrBit ); displayY < qrOrigin + ( qrcodeY * pixelsPerQrBit ) + pixelsPerQrBit; displayY++ )
-                {
-                    oled_setPixel( displayX, displayY, colour1 );
-                }
-            }
-        }
-        else
-        {
-            // Typically you'd set the screen bright here
-            for( displayX = qrOrigin + ( qrcodeX * pixelsPerQrBit ); displayX < qrOrigin + ( qrcodeX * pixelsPerQrBit ) + pixelsPerQrBit; displayX++ )
-            {
-                for( displayY = qrOrigin + ( qrcodeY * pixelsPerQrBit ); displayY < qrOrigin + ( qrcodeY * pixelsPerQrBit ) + pixelsPerQrBit; displayY++ )
-                {
-                    oled_setPixel( displayX, displayY, colour2 );
-                }
+                uint16_t lineBufferIndex = ( ( (uint16_t) qrcodeX * pixelsPerQrBit ) + bitPixel ) * 2U;
+                m_lineBuffer[lineBufferIndex] = (uint8_t) ( colour >> 8 );
+                m_lineBuffer[lineBufferIndex + 1U] = (uint8_t) colour;
             }
         }
-
-        ++qrcodeX;
-        if( qrcodeX == qrSize )
-        {
-            qrcodeX = 0U;
-            ++qrcodeY;
-        }
+        // Each QR code row is pixelsPerQrBit display rows tall
+        for( uint8_t bitPixel = 0U; bitPixel < pixelsPerQrBit; bitPixel++ )
+            m_windowWrite( m_lineBuffer, (size_t) qrWidthInPixels * 2U );
     }
-
-    // True for dark
+    m_windowEnd();
 
     return 0; // Success
 }
@@ -1358,73 +1791,543 @@ int oled_printQrCode( const char text[], uint16_t colour1, uint16_t colour2 )
 
 /* --- MODULE SCOPE FUNCTION IMPLEMENTATIONS ---------------------------------- */
 
-#if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
 /*
- * Function: m_terminalWriteChar
+ * Function: m_fillArea
  * --------------------
- * Write a char to the terminal bitmap
+ * oled_fillRect for signed corner coordinates, clipped to the display
+ *
+ * x1, y1: Top left of the area, inclusive
+ * x2, y2: Bottom right of the area, inclusive
+ * colour: Colour in RGB565 format
  *
- * bitmapPtr: Pointer to the bitmap to be written to
- * fontTablePtr: Pointer to the relevant font table
- * 
  * returns: void
  */
-static inline void m_terminalWriteChar( char character, uint8_t textOriginX, uint8_t textOriginY )
+static void m_fillArea( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t colour )
 {
-    uint8_t* bitmapPtr = ( m_terminalBitmapState == e_terminalBitmap1Next ) ? m_terminalBitmapPtr1 : m_terminalBitmapPtr2;
-    // Calculate the width of a character in bytes
-    uint8_t fontWidthBytes = ( (uint8_t) m_terminalFontTablePtr->Width / 8U ) + 1U;
-    // Find starting position in the array. Note that the first 32 characters of
-    // ascii aren't human readable
-    uint16_t fontTableIndex = m_terminalFontTablePtr->Height * (uint16_t) fontWidthBytes * (uint16_t) ( character - 32U );
-    // fontTableBitPosition records the position within each byte, for the font table
-    uint8_t fontTableBitPosition;
-    uint16_t bitmapIndex;
-
-    for( uint8_t yPixelPosition = 0U; yPixelPosition < m_terminalFontTablePtr->Height; yPixelPosition++ )
-    {
-        fontTableBitPosition = 0U;
-        for( uint8_t xPixelPosition = 0U; xPixelPosition < m_terminalFontTablePtr->Width; xPixelPosition++ )
-        {
-            // Check the bit in the font table
-            if( ( m_terminalFontTablePtr->table[fontTableIndex] & ( 0b10000000 >> fontTableBitPosition ) ) != 0 )
-            {
-                // Find the bit within the bitmap that needs to be set high
-                bitmapIndex = m_terminalBitmapBytesPerRow * ( textOriginY + yPixelPosition );
-                bitmapIndex += ( textOriginX + xPixelPosition ) / 8U;
-                // Set the pixel in the bitmap high
-
-                bitmapPtr[bitmapIndex] |= 0b1 << ( ( textOriginX + xPixelPosition ) % 8U);
-            }
-
-            ++fontTableBitPosition;
-            if( fontTableBitPosition == 8 )
-            {
-                ++fontTableIndex;
-                fontTableBitPosition = 0U;
-            }
-        }
-        ++fontTableIndex;
-    }
-
+    x1 = ( x1 < 0 ) ? 0 : x1;
+    y1 = ( y1 < 0 ) ? 0 : y1;
+    x2 = ( x2 >= m_displayWidth ) ? ( m_displayWidth - 1 ) : x2;
+    y2 = ( y2 >= m_displayHeight ) ? ( m_displayHeight - 1 ) : y2;
+    if( ( x1 > x2 ) || ( y1 > y2 ) )
+        return; // Nothing on the display
+
+    oled_fillRect( (uint8_t) x1, (uint8_t) y1, (uint8_t) ( x2 - x1 + 1 ), (uint8_t) ( y2 - y1 + 1 ), colour );
 }
 
 /*
- * Function: m_terminalWrite
+ * Function: m_divideRounded
  * --------------------
- * Code common to oled_terminalWritea and oled_terminalWriteTemp
- * The changing of m_terminalCurrentLine and m_terminalIsLineTemp is done by the
- * aforementioned functions
+ * Integer division rounded to the nearest whole number, halves away from 0
  *
- * text: Text to be written
- * 
- * returns: void
+ * numerator: Number to be divided
+ * denominator: Number to divide by, must not be 0
+ *
+ * returns: int32_t the rounded quotient
  */
-static inline void m_terminalWrite( const char text[] )
+static inline int32_t m_divideRounded( int32_t numerator, int32_t denominator )
 {
-    printf("m_terminalCurrentLine = %d, m_terminalHeightInLines=%d\n", m_terminalCurrentLine, m_terminalHeightInLines);
-    if( m_terminalBitmapState == e_terminalUninitialised )
-        return; // Terminal not ininitialised
+    if( ( numerator < 0 ) != ( denominator < 0 ) )
+        return ( numerator - ( denominator / 2 ) ) / denominator;
+    else
+        return ( numerator + ( denominator / 2 ) ) / denominator;
+}
+
+/*
+ * Function: m_squareRoot
+ * --------------------
+ * Integer square root, rounded down
+ *
+ * value: Number to find the square root of
+ *
+ * returns: uint16_t floor( sqrt( value ) )
+ */
+static inline uint16_t m_squareRoot( uint32_t value )
+{
+    uint32_t root = 0U;
+    uint32_t bit = 1UL << 30;
+
+    while( bit > value )
+        bit >>= 2;
+
+    while( bit != 0U )
+    {
+        if( value >= ( root + bit ) )
+        {
+            value -= root + bit;
+            root = ( root >> 1 ) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint16_t) root;
+}
+
+/*
+ * Function: m_drawThinLine
+ * --------------------
+ * Draw a one pixel wide line with Bresenham's line algorithm. The pixels are
+ * collected into runs along the major axis of the line, and each run is drawn
+ * as one rectangle, so a shallow line is a few horizontal spans
+ *
+ * x1, y1, x2, y2: End points of the line, both are drawn
+ * colour: Colour of line in RGB565
+ *
+ * returns: void
+ */
+static void m_drawThinLine( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t colour )
+{
+    const int16_t dx = ( x2 > x1 ) ? ( x2 - x1 ) : ( x1 - x2 );
+    const int16_t dy = ( y2 > y1 ) ? ( y1 - y2 ) : ( y2 - y1 ); // Always negative or 0
+    const int16_t xStep = ( x1 < x2 ) ? 1 : -1;
+    const int16_t yStep = ( y1 < y2 ) ? 1 : -1;
+    const bool isXMajor = ( dx >= -dy );
+    int16_t error = dx + dy;
+    int16_t doubleError;
+    int16_t x = x1;
+    int16_t y = y1;
+    int16_t nextX;
+    int16_t nextY;
+    // Start of the current run
+    int16_t runX = x1;
+    int16_t runY = y1;
+    bool isEnd;
+
+    for( ;; )
+    {
+        isEnd = ( x == x2 ) && ( y == y2 );
+        nextX = x;
+        nextY = y;
+        if( !isEnd )
+        {
+            doubleError = 2 * error;
+            if( doubleError >= dy )
+            {
+                error += dy;
+                nextX += xStep;
+            }
+            if( doubleError <= dx )
+            {
+                error += dx;
+                nextY += yStep;
+            }
+        }
+
+        // The run ends when the line steps along its minor axis
+        if( isEnd || ( isXMajor ? ( nextY != y ) : ( nextX != x ) ) )
+        {
+            m_fillArea( ( runX < x ) ? runX : x, ( runY < y ) ? runY : y,
+                ( runX < x ) ? x : runX, ( runY < y ) ? y : runY, colour );
+            runX = nextX;
+            runY = nextY;
+        }
+
+        if( isEnd )
+            break;
+        x = nextX;
+        y = nextY;
+    }
+}
+
+/*
+ * Function: m_drawThickLine
+ * --------------------
+ * Draw the shape made by sliding a square, thickness pixels out from its
+ * center, along a line. Each row of the shape is a single span, so every pixel
+ * is drawn once
+ *
+ * x1, y1, x2, y2: End points of the line
+ * thickness: Pixels either side of the line
+ * colour: Colour of line in RGB565
+ *
+ * returns: void
+ */
+static void m_drawThickLine( int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t thickness,
+    uint16_t colour )
+{
+    const int16_t yTop = ( y1 < y2 ) ? y1 : y2;
+    const int16_t yBottom = ( y1 < y2 ) ? y2 : y1;
+    int16_t rowStart = yTop - thickness;
+    int16_t rowEnd = yBottom + thickness;
+    int16_t lineY1;
+    int16_t lineY2;
+    int16_t xA;
+    int16_t xB;
+
+    // Only the rows on the display
+    rowStart = ( rowStart < 0 ) ? 0 : rowStart;
+    rowEnd = ( rowEnd >= m_displayHeight ) ? ( m_displayHeight - 1 ) : rowEnd;
+
+    for( int16_t y = rowStart; y <= rowEnd; y++ )
+    {
+        // The part of the line which is within thickness rows of this one
+        lineY1 = ( ( y - thickness ) > yTop ) ? ( y - thickness ) : yTop;
+        lineY2 = ( ( y + thickness ) < yBottom ) ? ( y + thickness ) : yBottom;
+
+        if( y1 == y2 )
+        {
+            xA = x1;
+            xB = x2;
+        }
+        else
+        {
+            xA = x1 + (int16_t) m_divideRounded( (int32_t) ( lineY1 - y1 ) * ( x2 - x1 ), y2 - y1 );
+            xB = x1 + (int16_t) m_divideRounded( (int32_t) ( lineY2 - y1 ) * ( x2 - x1 ), y2 - y1 );
+        }
+
+        m_fillArea( ( ( xA < xB ) ? xA : xB ) - thickness, y, ( ( xA < xB ) ? xB : xA ) + thickness, y, colour );
+    }
+}
+
+/*
+ * Function: m_arcSectorContains
+ * --------------------
+ * Check if a direction is within an arc's sector
+ *
+ * sectorPtr: The sector
+ * x, y: Direction from the center of the arc, on the display y is down
+ *
+ * returns: bool true if inside the sector, or on its edge
+ */
+static inline bool m_arcSectorContains( const t_arcSector* sectorPtr, int32_t x, int32_t y )
+{
+    // Positive if the direction is clockwise from the start or end, within half a turn
+    const int32_t fromStart = ( sectorPtr->startX * y ) - ( sectorPtr->startY * x );
+    const int32_t fromEnd = ( sectorPtr->endX * y ) - ( sectorPtr->endY * x );
+
+    if( sectorPtr->isOverHalf )
+        return !( ( fromEnd > 0 ) && ( fromStart < 0 ) ); // Not strictly in the rest of the circle
+    else
+        return ( fromStart >= 0 ) && ( fromEnd <= 0 );
+}
+
+/*
+ * Function: m_drawRingSpan
+ * --------------------
+ * Draw part of a row of a ring, split into runs by the arc sector if there is
+ * one
+ *
+ * centerX, y: Center column of the ring, and the display row
+ * dxStart, dxEnd: Columns of the span relative to the center, inclusive
+ * dy: Row relative to the center
+ * sectorPtr: Sector of an arc, or NULL for a whole ring
+ * colour: Colour in RGB565
+ *
+ * returns: void
+ */
+static void m_drawRingSpan( int16_t centerX, int16_t y, int16_t dxStart, int16_t dxEnd, int16_t dy,
+    const t_arcSector* sectorPtr, uint16_t colour )
+{
+    int16_t runStart = -1;
+    bool isInside;
+
+    if( sectorPtr == NULL )
+    {
+        m_fillArea( centerX + dxStart, y, centerX + dxEnd, y, colour );
+        return;
+    }
+
+    // Clip first so the sector isn't checked for pixels that can't be seen
+    if( ( centerX + dxStart ) < 0 )
+        dxStart = -centerX;
+    if( ( centerX + dxEnd ) >= m_displayWidth )
+        dxEnd = m_displayWidth - 1 - centerX;
+
+    for( int16_t dx = dxStart; dx <= ( dxEnd + 1 ); dx++ )
+    {
+        isInside = ( dx <= dxEnd ) && m_arcSectorContains( sectorPtr, dx, dy );
+        if( isInside && ( runStart < 0 ) )
+        {
+            runStart = centerX + dx;
+        }
+        else if( !isInside && ( runStart >= 0 ) )
+        {
+            m_fillArea( runStart, y, centerX + dx - 1, y, colour );
+            runStart = -1;
+        }
+    }
+}
+
+/*
+ * Function: m_drawRing
+ * --------------------
+ * Draw the pixels of a disc which aren't in a smaller disc, a row at a time.
+ * A pixel is in a disc of radius r if x^2 + y^2 <= r^2 + r, which looks
+ * rounder than x^2 + y^2 <= r^2
+ *
+ * centerX, centerY: Center of the ring
+ * outerRadius: Radius of the outside edge of the ring, which is drawn
+ * innerRadius: Radius of the inside edge of the ring, which is drawn. 0 for a
+ *              filled circle
+ * sectorPtr: Sector to limit the ring to for an arc, or NULL
+ * colour: Colour in RGB565
+ *
+ * returns: void
+ */
+static void m_drawRing( uint8_t centerX, uint8_t centerY, uint8_t outerRadius, uint8_t innerRadius,
+    const t_arcSector* sectorPtr, uint16_t colour )
+{
+    const int32_t outerLimit = ( (int32_t) outerRadius * outerRadius ) + outerRadius;
+    // The hole is the disc of radius innerRadius - 1
+    const int32_t innerLimit = ( innerRadius == 0U ) ? -1 :
+        ( ( (int32_t) ( innerRadius - 1 ) * ( innerRadius - 1 ) ) + ( innerRadius - 1 ) );
+    int16_t y;
+    int16_t outerHalfWidth;
+    int16_t innerHalfWidth;
+
+    if( innerRadius > outerRadius )
+        return; // Nothing to draw
+
+    for( int16_t dy = -outerRadius; dy <= outerRadius; dy++ )
+    {
+        y = centerY + dy;
+        if( ( y < 0 ) || ( y >= m_displayHeight ) )
+            continue;
+
+        outerHalfWidth = (int16_t) m_squareRoot( (uint32_t) ( outerLimit - ( (int32_t) dy * dy ) ) );
+        if( ( (int32_t) dy * dy ) > innerLimit )
+        {
+            // The row misses the hole
+            m_drawRingSpan( centerX, y, -outerHalfWidth, outerHalfWidth, dy, sectorPtr, colour );
+        }
+        else
+        {
+            innerHalfWidth = (int16_t) m_squareRoot( (uint32_t) ( innerLimit - ( (int32_t) dy * dy ) ) );
+            m_drawRingSpan( centerX, y, -outerHalfWidth, -innerHalfWidth - 1, dy, sectorPtr, colour );
+            m_drawRingSpan( centerX, y, innerHalfWidth + 1, outerHalfWidth, dy, sectorPtr, colour );
+        }
+    }
+}
+
+#if defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+/*
+ * Function: m_fontGetTable
+ * --------------------
+ * Get the packed font for a font size
+ *
+ * fontSize: Height of text in pixels, can be 8, 12, 16, 20 or 24
+ *
+ * returns: const tFontPacked* the font, NULL if the font size isn't included
+ *          or is invalid
+ */
+static const tFontPacked* m_fontGetTable( uint8_t fontSize )
+{
+    switch( fontSize )
+    {
+#ifdef OLED_INCLUDE_FONT8
+        case 8U:
+            return &Font8;
+#endif /* OLED_INCLUDE_FONT8 */
+#ifdef OLED_INCLUDE_FONT12
+        case 12U:
+            return &Font12;
+#endif /* OLED_INCLUDE_FONT12 */
+#ifdef OLED_INCLUDE_FONT16
+        case 16U:
+            return &Font16;
+#endif /* OLED_INCLUDE_FONT16 */
+#ifdef OLED_INCLUDE_FONT20
+        case 20U:
+            return &Font20;
+#endif /* OLED_INCLUDE_FONT20 */
+#ifdef OLED_INCLUDE_FONT24
+        case 24U:
+            return &Font24;
+#endif /* OLED_INCLUDE_FONT24 */
+        default:
+            // Font height not supported
+            return NULL;
+    }
+}
+
+/*
+ * Function: m_glyphGet
+ * --------------------
+ * Get a glyph from the glyph cache, unpacking it from the font if it
+ * isn't there. A miss replaces the least recently used entry, so up to
+ * OLED_GLYPH_CACHE_SIZE - 1 glyphs from earlier calls stay valid
+ *
+ * fontTablePtr: Font of the glyph
+ * character: ascii character, anything which isn't printable is a space
+ *
+ * returns: const t_glyph* the glyph
+ */
+static const t_glyph* m_glyphGet( const tFontPacked* fontTablePtr, char character )
+{
+    t_glyph* glyphPtr = &m_glyphCache[0];
+
+    // The fonts have the 95 printable characters, from space to tilde
+    if( ( character < 32 ) || ( character > ( 32 + 94 ) ) )
+        character = ' ';
+
+    ++m_glyphCacheClock;
+    for( uint8_t index = 0U; index < OLED_GLYPH_CACHE_SIZE; index++ )
+    {
+        if( ( m_glyphCache[index].fontTablePtr == fontTablePtr ) && ( m_glyphCache[index].character == character ) )
+        {
+            m_glyphCache[index].lastUsed = m_glyphCacheClock;
+            return &m_glyphCache[index];
+        }
+        if( m_glyphCache[index].lastUsed < glyphPtr->lastUsed )
+            glyphPtr = &m_glyphCache[index];
+    }
+
+    // Unpack the bounding box of the glyph, which is stored without padding
+    const tFontGlyph* packedGlyphPtr = &fontTablePtr->glyphs[character - 32];
+    const uint8_t* dataPtr = &fontTablePtr->data[packedGlyphPtr->offset];
+    uint16_t bitIndex = 0U;
+    uint32_t rowBits;
+    uint8_t glyphRow;
+
+    glyphPtr->fontTablePtr = fontTablePtr;
+    glyphPtr->character = character;
+    glyphPtr->lastUsed = m_glyphCacheClock;
+    memset( glyphPtr->rows, 0, sizeof( glyphPtr->rows ) );
+    for( uint8_t row = 0U; row < packedGlyphPtr->height; row++ )
+    {
+        rowBits = 0U;
+        for( uint8_t x = 0U; x < packedGlyphPtr->width; x++ )
+        {
+            // The data is most significant bit first
+            if( ( dataPtr[bitIndex / 8U] & ( 0b10000000 >> ( bitIndex % 8U ) ) ) != 0U )
+                rowBits |= 1UL << x;
+            ++bitIndex;
+        }
+        glyphRow = (uint8_t) ( packedGlyphPtr->y + row );
+        if( glyphRow < OLED_GLYPH_MAX_HEIGHT )
+            glyphPtr->rows[glyphRow] = rowBits << packedGlyphPtr->x;
+    }
+
+    return glyphPtr;
+}
+
+/*
+ * Function: m_glyphDraw
+ * --------------------
+ * Draw the lit pixels of a glyph, leaving the rest of the display alone. Each
+ * horizontal run of lit pixels is one filled rectangle, which is made taller
+ * when the rows below it are identical, e.g. the stem of an 'l'
+ *
+ * glyphPtr: Glyph to draw
+ * x: x coordinate of the top left of the glyph
+ * y: y coordinate of the top left of the glyph
+ * colour: Glyph colour in RGB565 format
+ *
+ * returns: void
+ */
+static void m_glyphDraw( const t_glyph* glyphPtr, uint8_t x, uint8_t y, uint16_t colour )
+{
+    const uint8_t height = glyphPtr->fontTablePtr->Height;
+    uint8_t nextRow;
+    uint32_t rowBits;
+    uint8_t runStart;
+    uint8_t runLength;
+
+    for( uint8_t row = 0U; row < height; row = nextRow )
+    {
+        rowBits = glyphPtr->rows[row];
+        nextRow = row + 1U;
+        while( ( nextRow < height ) && ( glyphPtr->rows[nextRow] == rowBits ) )
+            ++nextRow;
+
+        while( rowBits != 0U )
+        {
+            runStart = (uint8_t) __builtin_ctz( rowBits );
+            // Glyphs are under 32 pixels wide, so there is always a clear bit above the run
+            runLength = (uint8_t) __builtin_ctz( ~( rowBits >> runStart ) );
+            if( ( (uint16_t) x + runStart ) >= m_displayWidth )
+                break; // The rest of the glyph is off the display
+            oled_fillRect( x + runStart, y + row, runLength, nextRow - row, colour );
+            rowBits &= ~( ( ( 1UL << runLength ) - 1UL ) << runStart );
+        }
+    }
+}
+
+/*
+ * Function: m_glyphRenderRow
+ * --------------------
+ * Set the lit pixels of one row of a glyph in m_lineBuffer. The glyph must fit
+ * within the line buffer
+ *
+ * glyphPtr: Glyph to render
+ * row: Row of the glyph
+ * x: Pixel position in the line buffer of the left of the glyph
+ * colour: Glyph colour in RGB565 format
+ *
+ * returns: void
+ */
+static inline void m_glyphRenderRow( const t_glyph* glyphPtr, uint8_t row, uint8_t x, uint16_t colour )
+{
+    uint32_t rowBits = glyphPtr->rows[row];
+    uint16_t lineBufferIndex;
+
+    while( rowBits != 0U )
+    {
+        lineBufferIndex = ( (uint16_t) x + (uint16_t) __builtin_ctz( rowBits ) ) * 2U;
+        m_lineBuffer[lineBufferIndex] = (uint8_t) ( colour >> 8 );
+        m_lineBuffer[lineBufferIndex + 1U] = (uint8_t) colour;
+        rowBits &= rowBits - 1U;
+    }
+}
+
+/*
+ * Function: m_terminalWriteChar
+ * --------------------
+ * Write a char to the terminal bitmap which is next to be pushed. The
+ * character must fit on the bitmap
+ *
+ * character: ascii character to write
+ * textOriginX, textOriginY: Top left of the glyph
+ *
+ * returns: void
+ */
+static inline void m_terminalWriteChar( char character, uint8_t textOriginX, uint8_t textOriginY )
+{
+    uint8_t* bitmapPtr = ( m_terminalBitmapState == e_terminalBitmap1Next ) ? m_terminalBitmapPtr1 : m_terminalBitmapPtr2;
+    const t_glyph* glyphPtr = m_glyphGet( m_terminalFontTablePtr, character );
+    uint8_t* bitmapRowPtr;
+    uint64_t rowBits;
+
+    for( uint8_t row = 0U; row < m_terminalFontTablePtr->Height; row++ )
+    {
+        // Bitmap bytes are least significant bit first, the same as glyph rows,
+        // so a glyph row is ORed in a byte at a time
+        rowBits = (uint64_t) glyphPtr->rows[row] << ( textOriginX % 8U );
+        bitmapRowPtr = &bitmapPtr[( m_terminalBitmapBytesPerRow * ( textOriginY + row ) ) + ( textOriginX / 8U )];
+        while( rowBits != 0U )
+        {
+            *bitmapRowPtr |= (uint8_t) rowBits;
+            ++bitmapRowPtr;
+            rowBits >>= 8;
+        }
+    }
+}
+
+/*
+ * Function: m_terminalWrite
+ * --------------------
+ * Code common to oled_terminalWritea and oled_terminalWriteTemp
+ * The changing of m_terminalCurrentLine and m_terminalIsLineTemp is done by the
+ * aforementioned functions
+ *
+ * text: Text to be written
+ * 
+ * returns: void
+ */
+static inline void m_terminalWrite( const char text[] )
+{
+    printf("m_terminalCurrentLine = %d, m_terminalHeightInLines=%d\n", m_terminalCurrentLine, m_terminalHeightInLines);
+    if( m_terminalBitmapState == e_terminalUninitialised )
+        return; // Terminal not ininitialised
+
+    if( m_terminalBitmapState == e_terminalScrolling )
+    {
+        m_terminalScrollingWrite( text );
+        return;
+    }
 
     uint8_t* currentBitmapPtr; // What the screen currently has
     uint8_t* desiredBitmapPtr; // We need to change this bitmap to what we want the screen to have next
@@ -1554,7 +2457,11 @@ static inline void m_terminalWrite( const char text[] )
  * Function: m_terminalPushBitmap
  * --------------------
  * Push the current terminal bitmap to the screen. This function does
- * change the value of m_terminalBitmapState
+ * change the value of m_terminalBitmapState.
+ * Only the pixels which differ between the two bitmaps are sent. Rows are
+ * compared a word at a time and unchanged rows are skipped, each run of changed
+ * pixels is then sent as one window. When consecutive rows have a single run
+ * covering nearly the same columns, they are sent together as one taller window
  *
  * parameters: none
  *
@@ -1562,12 +2469,6 @@ static inline void m_terminalWrite( const char text[] )
  */
 static void m_terminalPushBitmap( void )
 {
-    // Position within each byte in the bitmap array
-    uint8_t bitPosition = 0U;
-    uint16_t bitmapIndex = 0U;
-    // Position on the display
-    uint8_t displayPositionX = 0U;
-    uint8_t displayPositionY = 0U;
     // Check which bitmap to push
     uint8_t* desiredStateBitmap;
     uint8_t* currentStateBitmap;
@@ -1582,36 +2483,71 @@ static void m_terminalPushBitmap( void )
         currentStateBitmap = m_terminalBitmapPtr1;
     }
 
-    while( displayPositionY != m_displayHeight )
+    t_terminalRun runs[OLED_TERMINAL_MAX_RUNS];
+    uint8_t runCount;
+    // A block of rows which all changed over the same columns, waiting to be sent
+    t_terminalRun block = { 0U, 0U };
+    uint8_t blockY = 0U;
+    uint8_t blockHeight = 0U;
+    t_terminalRun widened;
+    uint16_t extraPixels;
+    uint16_t rowOffset;
+#ifdef OLED_INCLUDE_COMPOSITOR
+    const t_oledLayer previousLayer = oled_layerSelect( m_terminalLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+    for( uint8_t y = 0U; y < m_displayHeight; y++ )
     {
-        // Check if a pixel needs to be turned on
-        if( ( ( currentStateBitmap[bitmapIndex] & ( 1 << bitPosition ) ) == 0 ) &&
-            ( ( desiredStateBitmap[bitmapIndex] & ( 1 << bitPosition ) ) != 0 ) )
+        rowOffset = (uint16_t) y * m_terminalBitmapBytesPerRow;
+        if( memcmp( &desiredStateBitmap[rowOffset], &currentStateBitmap[rowOffset], m_terminalBitmapBytesPerRow ) == 0 )
+            runCount = 0U; // Nothing changed on this row
+        else
+            runCount = m_terminalFindChangedRuns( &desiredStateBitmap[rowOffset], &currentStateBitmap[rowOffset], runs );
+
+        // Carry on with the block if this row changed over nearly the same columns.
+        // Widening the block resends some unchanged pixels, which is fine as
+        // they are resent with the colour they already have
+        if( ( runCount == 1U ) && ( blockHeight > 0U ) )
         {
-            oled_setPixel( displayPositionX, displayPositionY, m_terminalFontColour );
+            widened.start = ( runs[0].start < block.start ) ? runs[0].start : block.start;
+            widened.end = ( runs[0].end > block.end ) ? runs[0].end : block.end;
+            extraPixels = ( (uint16_t) ( ( widened.end - widened.start ) - ( block.end - block.start ) ) * blockHeight ) +
+                ( ( widened.end - widened.start ) - ( runs[0].end - runs[0].start ) );
+            if( extraPixels <= OLED_TERMINAL_BLOCK_SLACK )
+            {
+                block = widened;
+                ++blockHeight;
+                continue;
+            }
         }
-        // Check if a pixel needs to be turned off
-        else if( ( ( currentStateBitmap[bitmapIndex] & ( 1 << bitPosition ) ) != 0 ) &&
-            ( ( desiredStateBitmap[bitmapIndex] & ( 1 << bitPosition ) ) == 0 ) )
+
+        // Otherwise the block is finished
+        if( blockHeight > 0U )
         {
-            oled_setPixel( displayPositionX, displayPositionY, 0x0000 );
+            m_terminalSendRun( desiredStateBitmap, block, blockY, blockHeight );
+            blockHeight = 0U;
         }
-        // Otherwise leave the screen as it is
-        
-        ++bitPosition;
-        if( bitPosition == 8U )
+
+        if( runCount == 1U )
         {
-            bitPosition = 0U;
-            ++bitmapIndex;
+            // Might be the start of another block
+            block = runs[0];
+            blockY = y;
+            blockHeight = 1U;
         }
-        ++displayPositionX;
-        if( displayPositionX == m_displayWidth )
+        else
         {
-            displayPositionX = 0U;
-            ++displayPositionY;
+            for( uint8_t run = 0U; run < runCount; run++ )
+                m_terminalSendRun( desiredStateBitmap, runs[run], y, 1U );
         }
     }
 
+    if( blockHeight > 0U )
+        m_terminalSendRun( desiredStateBitmap, block, blockY, blockHeight );
+#ifdef OLED_INCLUDE_COMPOSITOR
+    (void) oled_layerSelect( previousLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
+
     // Change the next bitmap value
     if( m_terminalBitmapState == e_terminalBitmap1Next )
         m_terminalBitmapState = e_terminalBitmap2Next;
@@ -1619,449 +2555,1922 @@ static void m_terminalPushBitmap( void )
         m_terminalBitmapState = e_terminalBitmap1Next;
 }
 
-#endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
-
-#ifdef OLED_INCLUDE_LOADING_CIRCLE
-
 /*
- * Function: m_loadingCircleProcessQuadrant
+ * Function: m_terminalFindChangedRuns
  * --------------------
- * This is used for drawing each quadrant on the bitmap using the m_loadingCircleSetBitmap
- * function
+ * Find the runs of pixels which differ between two rows of terminal bitmap,
+ * comparing 32 pixels at a time. Runs separated by only a few unchanged pixels
+ * are joined, as resending a few pixels is cheaper than setting up a window
  *
- * bitmapPtr: Pointer to the loading circle bitmap that needs to be changed
- * xLowerBound: Left most value of x for the quadrant
- * xUpperBound: Right most value of x for the quadrant
- * yIsPositive: Is this one of the two quadrants which is higher on the display?
- *              Note: If yIsPositive is true, then lower y value will be used, because
- *              the positive y axis extends down the display
- * angle: Amount of quadrant which is completed, clockwise in degrees
+ * desiredRowPtr: Row of the bitmap to be pushed
+ * currentRowPtr: The same row of the bitmap which is on the screen
+ * runs: Filled with the runs found, needs OLED_TERMINAL_MAX_RUNS entries
  *
- * returns: void
+ * returns: uint8_t number of runs found
  */
-static inline void m_loadingCircleProcessQuadrant( uint8_t* bitmapPtr, uint8_t xLowerBound,
-    uint8_t xUpperBound, bool yIsPositive, uint8_t angle )
+static uint8_t m_terminalFindChangedRuns( const uint8_t* desiredRowPtr, const uint8_t* currentRowPtr,
+    t_terminalRun* runs )
 {
-    uint8_t limit; // May be upper or lower bound for y
-    uint8_t triangleWidth; // Referring to pythag triangle
-
-    // Delete everything in this quarter of the bitmap
-    if( yIsPositive )
-    {
-        for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
-        {
-            for( uint8_t y = 0U; y < ( m_loadingCircleOuterRadius - 1U ); y++ )
-            {
-                m_loadingCircleSetBitmap( bitmapPtr, x, y, false );
-            }
-        }
-    }
-    else
+    uint8_t runCount = 0U;
+    bool isInRun = false;
+    uint32_t desiredWord;
+    uint32_t currentWord;
+    uint32_t difference;
+    uint32_t remaining;
+    uint8_t bytesInWord;
+    uint8_t bit;
+    uint8_t position;
+
+    for( uint16_t wordStart = 0U; wordStart < m_displayWidth; wordStart += 32U )
     {
-        for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
+        // The first pixel of each byte is the least significant bit, so on
+        // a little endian CPU pixel wordStart + n is bit n of the word
+        bytesInWord = m_terminalBitmapBytesPerRow - ( wordStart / 8U );
+        bytesInWord = ( bytesInWord < 4U ) ? bytesInWord : 4U;
+        desiredWord = 0U;
+        currentWord = 0U;
+        memcpy( &desiredWord, &desiredRowPtr[wordStart / 8U], bytesInWord );
+        memcpy( &currentWord, &currentRowPtr[wordStart / 8U], bytesInWord );
+        difference = desiredWord ^ currentWord;
+        // Ignore the padding bits past the edge of the display
+        if( (uint16_t) ( m_displayWidth - wordStart ) < 32U )
+            difference &= ( 1UL << ( m_displayWidth - wordStart ) ) - 1UL;
+
+        bit = 0U;
+        while( bit < 32U )
         {
-            for( uint8_t y = ( m_loadingCircleOuterRadius - 1U ); y < ( ( m_loadingCircleOuterRadius * 2U ) - 1U ); y++ )
+            if( isInRun )
             {
-                m_loadingCircleSetBitmap( bitmapPtr, x, y, false );
+                // Look for the end of the run, i.e. the next unchanged pixel
+                remaining = ~difference >> bit;
+                if( remaining == 0U )
+                    break; // The run carries on into the next word
+                bit += (uint8_t) __builtin_ctz( remaining );
+                runs[runCount - 1U].end = (uint8_t) ( wordStart + bit );
+                isInRun = false;
             }
-        }
-    }
-
-    // Now add the circle quadrants in as needed
-    if( angle >= 90U ) // Then angle is 90U
-    {
-        if( yIsPositive )
-        {
-            if( xLowerBound == 0 )
-                triangleWidth = m_loadingCircleOuterRadius;
             else
-                triangleWidth = 0U;
-            
-            for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
             {
-                limit = ( m_loadingCircleOuterRadius - 1U ) - (uint8_t) ( sqrt( ( (uint16_t) m_loadingCircleOuterRadius * (uint16_t) m_loadingCircleOuterRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) ) );
-                for( uint8_t y = limit; y < ( m_loadingCircleOuterRadius - 1U ); y++ )
+                // Look for the start of the next run
+                remaining = difference >> bit;
+                if( remaining == 0U )
+                    break; // Nothing else changed in this word
+                bit += (uint8_t) __builtin_ctz( remaining );
+                position = (uint8_t) ( wordStart + bit );
+                if( ( runCount > 0U ) && ( (uint8_t) ( position - runs[runCount - 1U].end ) <= OLED_TERMINAL_RUN_JOIN_GAP ) )
                 {
-                    m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
+                    // Close enough to join onto the last run
                 }
-                if( xLowerBound == 0 )
-                    --triangleWidth;
                 else
-                    ++triangleWidth;
-                
+                {
+                    runs[runCount].start = position;
+                    ++runCount;
+                }
+                isInRun = true;
             }
         }
-        else
-        {
-            if( xLowerBound == 0 )
-                triangleWidth = m_loadingCircleOuterRadius;
+    }
+
+    // A run that reaches the edge of the display ends there
+    if( isInRun )
+        runs[runCount - 1U].end = m_displayWidth;
+
+    return runCount;
+}
+
+/*
+ * Function: m_terminalSendRun
+ * --------------------
+ * Send a run of pixels from the terminal bitmap to the display as one window,
+ * set pixels in the font colour and clear ones in black
+ *
+ * bitmapPtr: The bitmap to be sent
+ * run: The columns to be sent
+ * y: First row to be sent
+ * height: Number of rows to be sent, each covering the same columns
+ *
+ * returns: void
+ */
+static void m_terminalSendRun( const uint8_t* bitmapPtr, t_terminalRun run, uint8_t y, uint8_t height )
+{
+    const uint8_t width = run.end - run.start;
+    const uint8_t* rowPtr;
+    uint16_t colour;
+
+    m_windowBegin( run.start, y, width, height );
+    for( uint8_t row = 0U; row < height; row++ )
+    {
+        rowPtr = &bitmapPtr[(uint16_t) ( y + row ) * m_terminalBitmapBytesPerRow];
+        for( uint8_t x = run.start; x < run.end; x++ )
+        {
+            colour = ( ( rowPtr[x / 8U] & ( 1U << ( x % 8U ) ) ) != 0U ) ? m_terminalFontColour : 0x0000U;
+            m_lineBuffer[( x - run.start ) * 2U] = (uint8_t) ( colour >> 8 );
+            m_lineBuffer[( ( x - run.start ) * 2U ) + 1U] = (uint8_t) colour;
+        }
+        m_windowWrite( m_lineBuffer, (size_t) width * 2U );
+    }
+    m_windowEnd();
+}
+
+
+/*
+ * Function: m_terminalScrollingGetText
+ * --------------------
+ * Get the stored text of a line of the scrolling terminal
+ *
+ * line: Line on the display, top of terminal is line 0
+ *
+ * returns: char* the line's text, up to m_terminalTextLineSize - 1 characters
+ */
+static inline char* m_terminalScrollingGetText( uint8_t line )
+{
+    uint8_t textLine = ( m_terminalTopTextLine + line ) % m_terminalHeightInLines;
+
+    return &m_terminalTextPtr[(uint16_t) textLine * m_terminalTextLineSize];
+}
+
+/*
+ * Function: m_terminalScrollingWrite
+ * --------------------
+ * m_terminalWrite for the scrolling terminal. When out of lines, the display
+ * start line is moved down by one line of text so that the display RAM rows of
+ * the top line become the bottom line, then only the new line is drawn
+ *
+ * text: Text to be written
+ *
+ * returns: void
+ */
+static void m_terminalScrollingWrite( const char text[] )
+{
+    bool isScrolling = false;
+    uint8_t line;
+    uint8_t rowCount = m_terminalFontSize;
+
+    if( ( m_terminalIsLineTemp == false ) && ( m_terminalCurrentLine == m_terminalHeightInLines ) )
+    {
+        isScrolling = true;
+        m_terminalTopTextLine = ( m_terminalTopTextLine + 1U ) % m_terminalHeightInLines;
+        m_terminalStartLine = (uint8_t) ( ( (uint16_t) m_terminalStartLine + m_terminalFontSize ) % OLED_MAX_DISPLAY_HEIGHT );
+    }
+
+    // After scrolling, write on the last line rather than off the display
+    line = ( m_terminalCurrentLine == m_terminalHeightInLines ) ? ( m_terminalHeightInLines - 1U ) : m_terminalCurrentLine;
+
+    char* lineTextPtr = m_terminalScrollingGetText( line );
+    strncpy( lineTextPtr, text, m_terminalTextLineSize - 1U );
+    lineTextPtr[m_terminalTextLineSize - 1U] = 0;
+
+    // The rows below the last line held part of the old top line, so blank them too
+    if( isScrolling )
+        rowCount = m_displayHeight - ( line * m_terminalFontSize );
+    m_terminalScrollingDrawRows( line * m_terminalFontSize, rowCount, lineTextPtr );
+
+    // Only show the new position once the new line is in the display RAM
+    if( isScrolling )
+        m_terminalScrollingSetStartLine( m_terminalStartLine );
+}
+
+/*
+ * Function: m_terminalScrollingDrawRows
+ * --------------------
+ * Draw full width rows of the scrolling terminal, in the terminal colour on a
+ * black background. Rows are given in screen coordinates and written to the
+ * display RAM rows currently behind them, wrapping past the bottom of the RAM
+ *
+ * screenRow: First row to draw, relative to the top of the display
+ * rowCount: Number of rows to draw, the rows after the text are left black
+ * text: Text to draw from the first row, or NULL for blank rows
+ *
+ * returns: void
+ */
+static void m_terminalScrollingDrawRows( uint8_t screenRow, uint8_t rowCount, const char text[] )
+{
+    const uint8_t ramRow = (uint8_t) ( ( (uint16_t) m_terminalStartLine + screenRow ) % OLED_MAX_DISPLAY_HEIGHT );
+    const uint8_t rowsBeforeWrap = OLED_MAX_DISPLAY_HEIGHT - ramRow;
+    const uint8_t windowRows = ( rowCount < rowsBeforeWrap ) ? rowCount : rowsBeforeWrap;
+    const uint8_t characterPitch = m_terminalFontTablePtr->Width + OLED_WRITE_TEXT_CHARACTER_GAP;
+    const t_glyph* glyphPtrs[OLED_GLYPH_CACHE_SIZE - 1U];
+    uint8_t characterCount = 0U;
+
+    if( rowCount == 0U )
+        return;
+
+    // Look up every glyph once rather than on every row. No text wrapping for the terminal
+    while( ( text != NULL ) && ( text[characterCount] != 0 ) && ( characterCount < ( OLED_GLYPH_CACHE_SIZE - 1U ) ) &&
+        ( ( ( (uint16_t) characterCount * characterPitch ) + m_terminalFontTablePtr->Width ) <= m_displayWidth ) )
+    {
+        glyphPtrs[characterCount] = m_glyphGet( m_terminalFontTablePtr, text[characterCount] );
+        ++characterCount;
+    }
+
+    m_windowBegin( 0U, ramRow, m_displayWidth, windowRows );
+    for( uint8_t row = 0U; row < rowCount; row++ )
+    {
+        if( row == windowRows )
+        {
+            // Carry on from the top of the display RAM
+            m_windowEnd();
+            m_windowBegin( 0U, 0U, m_displayWidth, rowCount - windowRows );
+        }
+
+        m_lineBufferFill( m_displayWidth, 0x0000U );
+        if( row < m_terminalFontTablePtr->Height )
+        {
+            for( uint8_t character = 0U; character < characterCount; character++ )
+                m_glyphRenderRow( glyphPtrs[character], row, character * characterPitch, m_terminalFontColour );
+        }
+        m_windowWrite( m_lineBuffer, (size_t) m_displayWidth * 2U );
+    }
+    m_windowEnd();
+}
+
+/*
+ * Function: m_terminalScrollingSetStartLine
+ * --------------------
+ * Set which display RAM row is shown at the top of the display. Anything still
+ * waiting in the framebuffer is flushed first, so the panel never shows the
+ * new position with old contents
+ *
+ * startLine: RAM row, 0 to 127
+ *
+ * returns: void
+ */
+static void m_terminalScrollingSetStartLine( uint8_t startLine )
+{
+    m_terminalStartLine = startLine;
+
+    oled_flush();
+
+    m_chipSelect();
+    m_writeReg( 0xA1 ); // Set display start line
+    m_writeData( startLine );
+    m_chipDeselect();
+}
+
+#endif // defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24
+
+#ifdef OLED_INCLUDE_SD_IMAGES
+
+/*
+ * Function: m_sdImageDraw
+ * --------------------
+ * Draw the image being read by m_sdRead, whose buffer must have been set up,
+ * in any of the formats made by image_encoder.py
+ *
+ * filPtr: The open file, at the start. NULL if the whole file is at
+ *         m_sdBufferPtr, in which case it must be a .oimg
+ * originX, originY: Coordinates of the top left of the image
+ *
+ * returns: int 0 on success
+ *              4 on fail because the image's pixel format isn't supported
+ *              5 on fail because the file couldn't be read or ended early
+ */
+static int m_sdImageDraw( FIL* filPtr, uint8_t originX, uint8_t originY )
+{
+    const uint8_t* headerPtr;
+    UINT length;
+    int result = 0;
+
+    length = OLED_SD_IMAGE_HEADER_SIZE;
+    headerPtr = m_sdRead( filPtr, &length );
+    if( ( headerPtr != NULL ) && ( length == OLED_SD_IMAGE_HEADER_SIZE ) &&
+        ( memcmp( headerPtr, OLED_SD_IMAGE_MAGIC, 4U ) == 0 ) )
+    {
+        uint16_t imageWidth = (uint16_t) headerPtr[4] | ( (uint16_t) headerPtr[5] << 8 );
+        uint16_t imageHeight = (uint16_t) headerPtr[6] | ( (uint16_t) headerPtr[7] << 8 );
+        uint8_t format = headerPtr[8];
+        // Part of the image that fits on the display
+        uint8_t visibleWidth = 0U;
+        uint8_t visibleHeight = 0U;
+
+        // Clip the image to the display
+        if( originX < m_displayWidth )
+            visibleWidth = ( ( (uint32_t) originX + imageWidth ) > m_displayWidth ) ? ( m_displayWidth - originX ) : (uint8_t) imageWidth;
+        if( originY < m_displayHeight )
+            visibleHeight = ( ( (uint32_t) originY + imageHeight ) > m_displayHeight ) ? ( m_displayHeight - originY ) : (uint8_t) imageHeight;
+
+        if( format > OLED_SD_IMAGE_FORMAT_PALETTE8 )
+        {
+            result = 4;
+        }
+        // The whole image is streamed into a single display window
+        else if( ( visibleWidth != 0U ) && ( visibleHeight != 0U ) )
+        {
+            bool isDrawn;
+
+            m_windowBegin( originX, originY, visibleWidth, visibleHeight );
+            if( format == OLED_SD_IMAGE_FORMAT_RGB565 )
+                isDrawn = m_sdImageDrawRgb565( filPtr, imageWidth, visibleWidth, visibleHeight );
+            else if( format == OLED_SD_IMAGE_FORMAT_QOI565 )
+                isDrawn = m_sdImageDrawQoi565( filPtr, imageWidth, visibleWidth, visibleHeight );
+            else
+                isDrawn = m_sdImageDrawPalette( filPtr, imageWidth, visibleWidth, visibleHeight,
+                    1U << ( format - OLED_SD_IMAGE_FORMAT_PALETTE1 ) );
+            if( !isDrawn )
+                result = 5;
+            m_windowEnd();
+        }
+    }
+    else if( filPtr != NULL )
+    {
+        // Made by an older image_encoder.py
+        m_sdBufferLength = 0U;
+        m_sdBufferIndex = 0U;
+        if( f_rewind( filPtr ) == FR_OK )
+            m_sdImageDrawText( filPtr, originX, originY );
+        else
+            result = 5;
+    }
+    else
+    {
+        // The cache only keeps .oimg files
+        result = 4;
+    }
+
+    return result;
+}
+
+/*
+ * Function: m_sdRead
+ * --------------------
+ * Get the next bytes of a file, reading another sector into m_sdBuffer when
+ * it has all been used. Before the first read of a file m_sdBufferPtr must be
+ * set to m_sdBuffer and m_sdBufferLength and m_sdBufferIndex to 0, or for a
+ * file in RAM, m_sdBufferPtr and m_sdBufferLength to the whole file
+ *
+ * filPtr: The open file, NULL if the whole file is in RAM
+ * lengthPtr: The most bytes wanted, set to how many were got, which is less if
+ *            the end of the buffer is reached first
+ *
+ * returns: const uint8_t* the bytes, NULL if the file couldn't be read or has ended
+ */
+static const uint8_t* m_sdRead( FIL* filPtr, UINT* lengthPtr )
+{
+    const uint8_t* dataPtr;
+
+    if( m_sdBufferIndex == m_sdBufferLength )
+    {
+        if( filPtr == NULL )
+            return NULL; // The end of the file in RAM
+
+        m_sdBufferIndex = 0U;
+        if( ( f_read( filPtr, m_sdBuffer, sizeof( m_sdBuffer ), &m_sdBufferLength ) != FR_OK ) ||
+            ( m_sdBufferLength == 0U ) )
+        {
+            m_sdBufferLength = 0U;
+            return NULL;
+        }
+    }
+
+    dataPtr = &m_sdBufferPtr[m_sdBufferIndex];
+    if( *lengthPtr > ( m_sdBufferLength - m_sdBufferIndex ) )
+        *lengthPtr = m_sdBufferLength - m_sdBufferIndex;
+    m_sdBufferIndex += *lengthPtr;
+
+    return dataPtr;
+}
+
+/*
+ * Function: m_sdReadByte
+ * --------------------
+ * Get the next byte of a file, see m_sdRead
+ *
+ * filPtr: The open file
+ *
+ * returns: int16_t the byte, -1 if the file couldn't be read or has ended
+ */
+static inline int16_t m_sdReadByte( FIL* filPtr )
+{
+    const uint8_t* dataPtr;
+    UINT length = 1U;
+
+    if( m_sdBufferIndex < m_sdBufferLength )
+        return m_sdBufferPtr[m_sdBufferIndex++];
+
+    dataPtr = m_sdRead( filPtr, &length );
+    return ( dataPtr == NULL ) ? -1 : *dataPtr;
+}
+
+/*
+ * Function: m_sdImageDrawRgb565
+ * --------------------
+ * Stream the pixels of an OLED_SD_IMAGE_FORMAT_RGB565 image from the SD card
+ * buffer into the window opened for it, without copying them. An image in RAM
+ * or flash is sent from where it is, see m_windowWriteInPlace
+ *
+ * filPtr: The open file, just after the header, NULL if it's in RAM or flash
+ * imageWidth: Width of the image in the file
+ * visibleWidth, visibleHeight: Size of the window, the part of the image on
+ *                              the display
+ *
+ * returns: bool true on success, false if the file couldn't be read or ended early
+ */
+static bool m_sdImageDrawRgb565( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight )
+{
+    const uint8_t* dataPtr;
+    uint32_t rowBytes = (uint32_t) imageWidth * 2U;
+    uint32_t visibleBytes = (uint32_t) visibleWidth * 2U;
+    uint8_t rows = visibleHeight;
+    uint32_t rowIndex;
+    UINT length;
+    size_t sendLength;
+
+    // If all of each row is visible the rows are back to back in the file and
+    // the window, so they can be streamed as one long row
+    if( visibleWidth == imageWidth )
+    {
+        rowBytes *= visibleHeight;
+        visibleBytes = rowBytes;
+        rows = 1U;
+    }
+
+    for( uint8_t row = 0U; row < rows; row++ )
+    {
+        rowIndex = 0U;
+        while( rowIndex < rowBytes )
+        {
+            length = (UINT) ( rowBytes - rowIndex );
+            dataPtr = m_sdRead( filPtr, &length );
+            if( dataPtr == NULL )
+                return false;
+
+            // Only the part of the row on the display is sent
+            if( rowIndex < visibleBytes )
+            {
+                sendLength = ( ( rowIndex + length ) > visibleBytes ) ? ( visibleBytes - rowIndex ) : length;
+                if( filPtr == NULL )
+                    m_windowWriteInPlace( dataPtr, sendLength );
+                else
+                    m_windowWrite( dataPtr, sendLength );
+            }
+            rowIndex += length;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Function: m_sdQoiHash
+ * --------------------
+ * Get where a pixel goes in the index of a QOI565 image
+ *
+ * pixel: RGB565 colour
+ *
+ * returns: uint8_t position in m_sdColours
+ */
+static inline uint8_t m_sdQoiHash( uint16_t pixel )
+{
+    return (uint8_t) ( ( ( ( pixel >> 11 ) * 3U ) + ( ( ( pixel >> 5 ) & 0x3FU ) * 5U ) + ( ( pixel & 0x1FU ) * 7U ) ) %
+        OLED_QOI_INDEX_SIZE );
+}
+
+/*
+ * Function: m_sdImageDrawQoi565
+ * --------------------
+ * Decode an OLED_SD_IMAGE_FORMAT_QOI565 image a row at a time into the line
+ * buffer, and send the visible part of each row to the window opened for it.
+ * Decoding stops after the last visible row
+ *
+ * filPtr: The open file, just after the header
+ * imageWidth: Width of the image in the file
+ * visibleWidth, visibleHeight: Size of the window, the part of the image on
+ *                              the display
+ *
+ * returns: bool true on success, false if the file couldn't be read or ended early
+ */
+static bool m_sdImageDrawQoi565( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight )
+{
+    uint16_t pixel = 0x0000U;
+    uint8_t run = 0U;
+    int16_t tag;
+    int16_t next;
+    int16_t red;
+    int16_t green;
+    int16_t blue;
+    int16_t greenDifference;
+    bool isNewPixel;
+
+    memset( m_sdColours, 0, OLED_QOI_INDEX_SIZE * sizeof( m_sdColours[0] ) );
+
+    for( uint8_t row = 0U; row < visibleHeight; row++ )
+    {
+        for( uint16_t column = 0U; column < imageWidth; column++ )
+        {
+            if( run > 0U )
+            {
+                --run;
+            }
             else
-                triangleWidth = 0U;
-            
-            for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
             {
-                limit = ( m_loadingCircleOuterRadius - 1U ) + (uint8_t) ( sqrt( ( m_loadingCircleOuterRadius * m_loadingCircleOuterRadius ) - ( triangleWidth * triangleWidth ) ) );
-                for( uint8_t y = ( m_loadingCircleOuterRadius - 1U ); y < limit; y++ )
+                isNewPixel = true;
+                tag = m_sdReadByte( filPtr );
+                if( tag < 0 )
+                    return false;
+
+                red = pixel >> 11;
+                green = ( pixel >> 5 ) & 0x3F;
+                blue = pixel & 0x1F;
+                if( tag == OLED_QOI_OP_RGB565 )
                 {
-                    m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
+                    next = m_sdReadByte( filPtr );
+                    if( next < 0 )
+                        return false;
+                    pixel = (uint16_t) ( next << 8 );
+                    next = m_sdReadByte( filPtr );
+                    if( next < 0 )
+                        return false;
+                    pixel |= (uint16_t) next;
                 }
-                if( xLowerBound == 0 )
-                    --triangleWidth;
-                else
-                    ++triangleWidth;
-                
+                else if( ( tag & OLED_QOI_OP_MASK ) == OLED_QOI_OP_INDEX )
+                {
+                    pixel = m_sdColours[tag];
+                }
+                else if( ( tag & OLED_QOI_OP_MASK ) == OLED_QOI_OP_DIFF )
+                {
+                    // The channels wrap around
+                    red = ( red + ( ( tag >> 4 ) & 0x03 ) - 2 ) & 0x1F;
+                    green = ( green + ( ( tag >> 2 ) & 0x03 ) - 2 ) & 0x3F;
+                    blue = ( blue + ( tag & 0x03 ) - 2 ) & 0x1F;
+                    pixel = (uint16_t) ( ( red << 11 ) | ( green << 5 ) | blue );
+                }
+                else if( ( tag & OLED_QOI_OP_MASK ) == OLED_QOI_OP_LUMA )
+                {
+                    next = m_sdReadByte( filPtr );
+                    if( next < 0 )
+                        return false;
+                    // Red and blue are relative to green
+                    greenDifference = ( tag & 0x3F ) - 32;
+                    red = ( red + greenDifference + ( next >> 4 ) - 8 ) & 0x1F;
+                    green = ( green + greenDifference ) & 0x3F;
+                    blue = ( blue + greenDifference + ( next & 0x0F ) - 8 ) & 0x1F;
+                    pixel = (uint16_t) ( ( red << 11 ) | ( green << 5 ) | blue );
+                }
+                else // OLED_QOI_OP_RUN
+                {
+                    // This is the first pixel of the run, the previous pixel
+                    // is already in the index
+                    run = tag & 0x3F;
+                    isNewPixel = false;
+                }
+
+                if( isNewPixel )
+                    m_sdColours[m_sdQoiHash( pixel )] = pixel;
+            }
+
+            if( column < visibleWidth )
+            {
+                m_lineBuffer[column * 2U] = (uint8_t) ( pixel >> 8 );
+                m_lineBuffer[( column * 2U ) + 1U] = (uint8_t) pixel;
             }
         }
+
+        m_windowWrite( m_lineBuffer, (size_t) visibleWidth * 2U );
+    }
+
+    return true;
+}
+
+/*
+ * Function: m_sdImageDrawPalette
+ * --------------------
+ * Read the palette of an OLED_SD_IMAGE_FORMAT_PALETTE* image, then expand the
+ * indexes of each row into RGB565 in the line buffer and send the visible part
+ * to the window opened for it
+ *
+ * filPtr: The open file, just after the header
+ * imageWidth: Width of the image in the file
+ * visibleWidth, visibleHeight: Size of the window, the part of the image on
+ *                              the display
+ * bitsPerPixel: 1, 2, 4 or 8
+ *
+ * returns: bool true on success, false if the file couldn't be read or ended early
+ */
+static bool m_sdImageDrawPalette( FIL* filPtr, uint16_t imageWidth, uint8_t visibleWidth, uint8_t visibleHeight,
+    uint8_t bitsPerPixel )
+{
+    const uint8_t indexMask = (uint8_t) ( ( 1U << bitsPerPixel ) - 1U );
+    int16_t high;
+    int16_t low;
+    int16_t indexes = 0;
+    uint8_t bitsLeft;
+    uint16_t colour;
+
+    for( uint16_t index = 0U; index < ( 1U << bitsPerPixel ); index++ )
+    {
+        high = m_sdReadByte( filPtr );
+        low = m_sdReadByte( filPtr );
+        if( ( high < 0 ) || ( low < 0 ) )
+            return false;
+        m_sdColours[index] = (uint16_t) ( ( high << 8 ) | low );
     }
-    else if( angle > 0U )
+
+    for( uint8_t row = 0U; row < visibleHeight; row++ )
     {
-        // Need to draw a partial quadrant
-        int32_t lineValue;      // y in y=mx+c, using bitmap coordinates
-        int32_t circleValue;    // vertical distance between centre of circle and circumference for a given x
-        uint8_t triangleWidth;
-        uint8_t limit; // For quadrants where we need to draw up to the minimum of two values
-        const int32_t gradientScaleFactor = 100;
+        // Each row starts on a new byte
+        bitsLeft = 0U;
+        for( uint16_t column = 0U; column < imageWidth; column++ )
+        {
+            if( bitsLeft == 0U )
+            {
+                indexes = m_sdReadByte( filPtr );
+                if( indexes < 0 )
+                    return false;
+                bitsLeft = 8U;
+            }
+            bitsLeft -= bitsPerPixel;
+
+            if( column < visibleWidth )
+            {
+                colour = m_sdColours[( indexes >> bitsLeft ) & indexMask];
+                m_lineBuffer[column * 2U] = (uint8_t) ( colour >> 8 );
+                m_lineBuffer[( column * 2U ) + 1U] = (uint8_t) colour;
+            }
+        }
+
+        m_windowWrite( m_lineBuffer, (size_t) visibleWidth * 2U );
+    }
+
+    return true;
+}
+
+/*
+ * Function: m_sdImageDrawText
+ * --------------------
+ * Draw an image in the old text format, where each ascii character is a nibble
+ * plus 32. The first two bytes are the width and height, then the pixels are
+ * RGB565, left to right and top to bottom
+ *
+ * filPtr: The open file, at the start
+ * originX, originY: Coordinates of the top left of the image
+ *
+ * returns: void
+ */
+static void m_sdImageDrawText( FIL* filPtr, uint8_t originX, uint8_t originY )
+{
+    char* buf = (char*) m_sdBuffer;
 
-        if( yIsPositive )
+    // Read the file and push to the display
+    // Row and column are relative to the image origin
+    uint8_t column = 0U;
+    uint8_t row = 0U;
+    uint8_t imageWidth = 0U;  // Init to invalid number
+    uint8_t imageHeight = 0U; // Init to invalid number
+    // Part of the image that fits on the display
+    uint8_t visibleWidth = 0U;
+    uint8_t visibleHeight = 0U;
+    bool windowOpen = false;
+    uint16_t nibbleBuffer;
+    uint8_t nibblesInBuffer = 0U;
+    bool end = false;
+    while( f_gets( buf, OLED_SD_BUFFER_SIZE, filPtr ) )
+    {
+        for( uint16_t bufferIndex = 0U; bufferIndex < OLED_SD_BUFFER_SIZE; bufferIndex++ )
         {
-            if( xLowerBound == 0U ) // Quadrant 3
+            if( buf[bufferIndex] == 0 )
+                break; // End of buffer
+            if( buf[bufferIndex] == 10 )
+                continue; // Newline within file
+            if( ( (uint8_t) buf[bufferIndex] < 32U ) || ( (uint8_t) buf[bufferIndex] > 63U ) )
+                buf[bufferIndex] = 32; // To avoid bad nibbles over spilling
+
+            // Add the nibble to the nibbleBuffer
+            if( nibblesInBuffer == 0U )
+            {
+                nibbleBuffer = ( (uint8_t) buf[bufferIndex] - 32U ) << 12;
+            }
+            else if( nibblesInBuffer == 1U )
+            {
+                nibbleBuffer += ( (uint8_t) buf[bufferIndex] - 32U ) << 8;
+            }
+            else if( nibblesInBuffer == 2U )
             {
-                // To make the transition between Q2 and Q3 smoother
-                if( angle < 4U )
+                nibbleBuffer += ( (uint8_t) buf[bufferIndex] - 32U ) << 4;
+            }
+            else // if( nibbleBuffer == 3U )
+            {
+                nibbleBuffer += (uint8_t) buf[bufferIndex] - 32U;
+            }
+            ++nibblesInBuffer;
+
+            // Check if the nibble buffer is full
+            if( nibblesInBuffer == 4U )
+            {
+                // Do something with the full nibbleBuffer
+                // Check if the image width and height have been read
+                if( imageWidth == 0U )
                 {
-                    angle += 2;
-                }
+                    imageWidth = (uint8_t) ( ( nibbleBuffer & 0b1111111100000000U ) >> 8 );
+                    imageHeight = (uint8_t) ( nibbleBuffer & 0b0000000011111111U );
+
+                    // Clip the image to the display
+                    if( originX < m_displayWidth )
+                        visibleWidth = ( ( (uint16_t) originX + imageWidth ) > m_displayWidth ) ? ( m_displayWidth - originX ) : imageWidth;
+                    if( originY < m_displayHeight )
+                        visibleHeight = ( ( (uint16_t) originY + imageHeight ) > m_displayHeight ) ? ( m_displayHeight - originY ) : imageHeight;
+
+                    // The whole image is streamed into a single display window
+                    if( ( visibleWidth != 0U ) && ( visibleHeight != 0U ) )
+                    {
+                        m_windowBegin( originX, originY, visibleWidth, visibleHeight );
+                        windowOpen = true;
+                    }
+                }
+                // Otherwise add the pixel to the line buffer
+                else
+                {
+                    if( column < visibleWidth )
+                    {
+                        m_lineBuffer[column * 2U] = (uint8_t) ( nibbleBuffer >> 8 );
+                        m_lineBuffer[( column * 2U ) + 1U] = (uint8_t) nibbleBuffer;
+                    }
+
+                    ++column;
+                    if( column == imageWidth )
+                    {
+                        // Push the visible part of the row to the display
+                        if( ( windowOpen == true ) && ( row < visibleHeight ) )
+                            m_windowWrite( m_lineBuffer, (size_t) visibleWidth * 2U );
+
+                        column = 0U;
+                        ++row;
+                        if( row == imageHeight )
+                        {
+                            end = true;
+                            break;
+                        }
+                    }
+
+                }
+                // The nibbleBuffer is now considered empty
+                nibblesInBuffer = 0U;
+            }
+        }
+        if( end )
+            break;
+    }
+
+    if( windowOpen == true )
+        m_windowEnd();
+}
+
+#endif // OLED_INCLUDE_SD_IMAGES
+
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+
+/*
+ * Function: m_imageCacheFind
+ * --------------------
+ * Find an image which is kept in the cache
+ *
+ * filename: Name of the image file
+ *
+ * returns: t_imageCacheEntry* the entry, NULL if it isn't kept
+ */
+static t_imageCacheEntry* m_imageCacheFind( const char filename[] )
+{
+    for( uint8_t entry = 0U; entry < OLED_IMAGE_CACHE_ENTRIES; entry++ )
+    {
+        if( ( m_imageCache[entry].dataPtr != NULL ) && ( strcmp( m_imageCache[entry].filename, filename ) == 0 ) )
+            return &m_imageCache[entry];
+    }
+
+    return NULL;
+}
+
+/*
+ * Function: m_imageCacheAdd
+ * --------------------
+ * Allocate an entry for an image, dropping the least recently drawn images
+ * until it fits in OLED_IMAGE_CACHE_BYTES and there is a free entry
+ *
+ * filename: Name of the image file
+ * size: Size of the whole file in bytes
+ * assetPtr: The file in the asset pack, which is used instead of allocating
+ *           RAM for it, or NULL
+ *
+ * returns: t_imageCacheEntry* the entry, with size bytes at dataPtr for the
+ *          file. NULL if the image can't be kept
+ */
+static t_imageCacheEntry* m_imageCacheAdd( const char filename[], UINT size, const uint8_t* assetPtr )
+{
+    t_imageCacheEntry* entryPtr;
+    UINT bytes = ( assetPtr == NULL ) ? size : 0U; // Of RAM
+
+    if( ( size < OLED_SD_IMAGE_HEADER_SIZE ) || ( bytes > OLED_IMAGE_CACHE_BYTES ) ||
+        ( strlen( filename ) >= OLED_IMAGE_CACHE_NAME_SIZE ) )
+        return NULL;
+
+    while( true )
+    {
+        // Find a free entry and the least recently drawn one
+        t_imageCacheEntry* freeEntryPtr = NULL;
+        t_imageCacheEntry* oldestEntryPtr = NULL;
+        for( uint8_t entry = 0U; entry < OLED_IMAGE_CACHE_ENTRIES; entry++ )
+        {
+            entryPtr = &m_imageCache[entry];
+            if( entryPtr->dataPtr == NULL )
+                freeEntryPtr = entryPtr;
+            else if( ( oldestEntryPtr == NULL ) || ( entryPtr->lastUsed < oldestEntryPtr->lastUsed ) )
+                oldestEntryPtr = entryPtr;
+        }
+
+        if( ( freeEntryPtr != NULL ) && ( ( m_imageCacheBytes + bytes ) <= OLED_IMAGE_CACHE_BYTES ) )
+        {
+            entryPtr = freeEntryPtr;
+            break;
+        }
+        m_imageCacheRemove( oldestEntryPtr );
+    }
+
+    entryPtr->isInFlash = ( assetPtr != NULL );
+    if( entryPtr->isInFlash )
+        entryPtr->dataPtr = assetPtr;
+    else
+        entryPtr->dataPtr = (uint8_t*) calloc( size, sizeof( uint8_t ) );
+    if( entryPtr->dataPtr == NULL )
+        return NULL;
+    strcpy( entryPtr->filename, filename );
+    entryPtr->size = size;
+    m_imageCacheBytes += bytes;
+
+    return entryPtr;
+}
+
+/*
+ * Function: m_imageCacheRemove
+ * --------------------
+ * Free an image kept in the cache
+ *
+ * entryPtr: The entry, which must be in use
+ *
+ * returns: void
+ */
+static void m_imageCacheRemove( t_imageCacheEntry* entryPtr )
+{
+    if( !entryPtr->isInFlash )
+    {
+        free( (void*) entryPtr->dataPtr );
+        m_imageCacheBytes -= entryPtr->size;
+    }
+    entryPtr->dataPtr = NULL;
+}
+
+/*
+ * Function: m_imageCacheDraw
+ * --------------------
+ * Draw an image kept in the cache, and mark it as the most recently drawn
+ *
+ * entryPtr: The entry, which must be in use
+ * originX, originY: Coordinates of the top left of the image
+ *
+ * returns: int the same as m_sdImageDraw
+ */
+static int m_imageCacheDraw( t_imageCacheEntry* entryPtr, uint8_t originX, uint8_t originY )
+{
+    entryPtr->lastUsed = ++m_imageCacheClock;
+    m_sdBufferPtr = entryPtr->dataPtr;
+    m_sdBufferLength = entryPtr->size;
+    m_sdBufferIndex = 0U;
+    return m_sdImageDraw( NULL, originX, originY );
+}
+
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
+#ifdef OLED_INCLUDE_ASSET_PACK
+
+/*
+ * Function: m_assetFind
+ * --------------------
+ * Find an image in the asset pack
+ *
+ * filename: Name of the image file
+ *
+ * returns: const t_asset* where it is, NULL if it isn't in the pack
+ */
+static const t_asset* m_assetFind( const char filename[] )
+{
+    // Assets_Index is sorted by filename
+    uint32_t low = 0U;
+    uint32_t high = ASSETS_COUNT;
+    uint32_t middle;
+    int comparison;
+
+    while( low < high )
+    {
+        middle = ( low + high ) / 2U;
+        comparison = strcmp( filename, Assets_Index[middle].filename );
+        if( comparison == 0 )
+            return &Assets_Index[middle];
+        if( comparison < 0 )
+            high = middle;
+        else
+            low = middle + 1U;
+    }
+
+    return NULL;
+}
+
+#endif // OLED_INCLUDE_ASSET_PACK
+
+#ifdef OLED_INCLUDE_LOADING_CIRCLE
+
+/*
+ * Function: m_loadingCircleGetThreshold
+ * --------------------
+ * Get the progress at which a pixel of the loading circle lights up, it's lit
+ * while the progress is greater than this. The quadrants are rotations of
+ * each other, so a single quadrant of thresholds is stored and looked up in
+ * the rotated coordinates:
+ * Q3 | Q0
+ * -------
+ * Q2 | Q1
+ * Q0 includes the centre and the row through it, the others then take the
+ * column or row on their clockwise side
+ *
+ * quadrant: The quadrant that dx, dy is in, 0 to 3
+ * dx, dy: Position of the pixel relative to the centre of the circle
+ *
+ * returns: uint8_t the progress, 0 to 251, or OLED_LOADING_CIRCLE_OUTSIDE if
+ *          the pixel isn't part of the loading circle
+ */
+static inline uint8_t m_loadingCircleGetThreshold( uint8_t quadrant, int16_t dx, int16_t dy )
+{
+    int16_t u; // Distance clockwise from the start of the quadrant
+    int16_t v; // Distance out along the start of the quadrant
+    uint8_t threshold;
+
+    switch( quadrant )
+    {
+        case 0U:
+            u = dx;
+            v = -dy;
+            break;
+        case 1U:
+            u = dy;
+            v = dx;
+            break;
+        case 2U:
+            u = -dx;
+            v = dy;
+            break;
+        default:
+            u = -dy;
+            v = -dx;
+            break;
+    }
+
+    threshold = m_loadingCircleThresholdsPtr[( v * m_loadingCircleOuterRadius ) + u];
+    if( threshold == OLED_LOADING_CIRCLE_OUTSIDE )
+        return OLED_LOADING_CIRCLE_OUTSIDE;
+
+    return threshold + ( quadrant * 63U );
+}
+
+/*
+ * Function: m_loadingCirclePaintQuadrant
+ * --------------------
+ * Paint the pixels of one quadrant of the loading circle which light up
+ * between two progress values, as horizontal spans
+ *
+ * quadrant: The quadrant to paint, 0 to 3, see m_loadingCircleGetThreshold
+ * progressLow, progressHigh: Pixels with a threshold from progressLow up to
+ *                            but not including progressHigh are painted
+ * colour: colour to paint them in RGB565
+ *
+ * returns: void
+ */
+static void m_loadingCirclePaintQuadrant( uint8_t quadrant, uint8_t progressLow, uint8_t progressHigh,
+    uint16_t colour )
+{
+    const int16_t lastOffset = m_loadingCircleOuterRadius - 1;
+    // The pixels that belong to each quadrant
+    const int16_t xMin = ( quadrant == 1U ) ? 1 : ( ( quadrant == 0U ) ? 0 : -lastOffset );
+    const int16_t xMax = ( quadrant == 3U ) ? -1 : ( ( quadrant == 2U ) ? 0 : lastOffset );
+    const int16_t yMin = ( ( quadrant == 1U ) || ( quadrant == 2U ) ) ? 1 : -lastOffset;
+    const int16_t yMax = ( ( quadrant == 1U ) || ( quadrant == 2U ) ) ? lastOffset : 0;
+    int16_t spanStart = 0;
+    bool isInSpan;
+    uint8_t threshold;
+    bool isPainted;
+
+    for( int16_t dy = yMin; dy <= yMax; dy++ )
+    {
+        isInSpan = false;
+        for( int16_t dx = xMin; dx <= xMax + 1; dx++ )
+        {
+            // One past the end closes the last span
+            isPainted = false;
+            if( dx <= xMax )
+            {
+                threshold = m_loadingCircleGetThreshold( quadrant, dx, dy );
+                isPainted = ( threshold != OLED_LOADING_CIRCLE_OUTSIDE ) && ( threshold >= progressLow ) &&
+                    ( threshold < progressHigh );
+            }
+
+            if( isPainted && !isInSpan )
+            {
+                spanStart = dx;
+                isInSpan = true;
+            }
+            else if( !isPainted && isInSpan )
+            {
+                m_fillArea( m_loadingCircleCenterX + spanStart, m_loadingCircleCenterY + dy,
+                    m_loadingCircleCenterX + dx - 1, m_loadingCircleCenterY + dy, colour );
+                isInSpan = false;
+            }
+        }
+    }
+}
+
+#endif // OLED_INCLUDE_LOADING_CIRCLE
+
+/*
+ * Function: m_displayInit
+ * --------------------
+ * Initialise the display by writing data to registers
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_displayInit( void )
+{
+    // CS should be set low (active) prior to calling this function
+    // Now for some inexplicable magic from the manufacturer. Comments here are from the manufacturer
+    m_writeReg(0xFD);  // Command lock
+    m_writeData(0x12);
+    m_writeReg(0xFD);  // Command lock
+    m_writeData(0xB1);
+
+    m_writeReg(0xAE);  // Display off
+    m_writeReg(0xA4);  // Normal Display mode
+
+    m_writeReg(0x15);  // Set column address
+    m_writeData(0x00); // Column address start 00
+    m_writeData(0x7F); // Column address end 127
+    m_writeReg(0x75);  // Set row address
+    m_writeData(0x00); // Row address start 00
+    m_writeData(0x7F); // Row address end 127    
+
+    m_writeReg(0xB3);
+    m_writeData(0xF1);
+
+    m_writeReg(0xCA);  
+    m_writeData(0x7F);
+
+    m_writeReg(0xA0);  // Set re-map & data format
+    m_writeData(0x74); // Horizontal address increment
+
+    m_writeReg(0xA1);  // Set display start line
+    m_writeData(0x00); // Start 00 line
+
+    m_writeReg(0xA2);  // Set display offset
+    m_writeData(0x00);
+
+    m_writeReg(0xAB);  
+    m_writeReg(0x01);  
+
+    m_writeReg(0xB4);  
+    m_writeData(0xA0);   
+    m_writeData(0xB5);  
+    m_writeData(0x55);    
+
+    m_writeReg(0xC1);  
+    m_writeData(0xC8); 
+    m_writeData(0x80);
+    m_writeData(0xC0);
+
+    m_writeReg(0xC7);  
+    m_writeData(0x0F);
+
+    m_writeReg(0xB1);  
+    m_writeData(0x32);
+
+    m_writeReg(0xB2);  
+    m_writeData(0xA4);
+    m_writeData(0x00);
+    m_writeData(0x00);
+
+    m_writeReg(0xBB);  
+    m_writeData(0x17);
+
+    m_writeReg(0xB6);
+    m_writeData(0x01);
+
+    m_writeReg(0xBE);
+    m_writeData(0x05);
+
+    m_writeReg(0xA6);
+}
+
+/*
+ * Function: m_chipSelect
+ * --------------------
+ * Select the display as an SPI device by setting CS to low
+ *
+ * parameters: none
+ *
+ * returns: void                                                                         
+ */
+static inline void m_chipSelect( void )
+{
+    oledTransport_select();
+}
+
+/*
+ * Function: m_chipDeselect
+ * --------------------
+ * Deselct the display as an SPI device by setting CS to high
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_chipDeselect( void )
+{
+    oledTransport_deselect();
+}
+
+/*
+ * Function: m_writeReg
+ * --------------------
+ * Select register to write data to
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_writeReg( uint8_t reg )
+{
+    oledTransport_writeCommand( reg );
+}
+
+/*
+ * Function: m_writeData
+ * --------------------
+ * Write data to the selected register
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_writeData( uint8_t data )
+{
+    oledTransport_writeData( &data, 1U );
+}
+
+/*
+ * Function: m_writeDataBuffer
+ * --------------------
+ * Write several bytes of data to the selected register in one SPI write
+ *
+ * data: Bytes to be written
+ * length: Number of bytes to be written
+ *
+ * returns: void
+ */
+static inline void m_writeDataBuffer( const uint8_t* data, size_t length )
+{
+    oledTransport_writeData( data, length );
+}
+
+/*
+ * Function: m_windowBegin
+ * --------------------
+ * Start drawing into a window. Pixel data for the window is then sent with
+ * m_windowWrite, left to right and top to bottom, and the window is finished
+ * with m_windowEnd. The window must be within the display. If a layer is
+ * selected the pixels go into it, otherwise if the framebuffer is included the
+ * pixels go to RAM, otherwise they go straight to the display
+ *
+ * x, y: Coordinates of the top left of the window
+ * width, height: Size of the window in pixels, must not be 0
+ *
+ * returns: void
+ */
+static inline void m_windowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height )
+{
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( m_layerSelected != OLED_LAYER_NONE )
+    {
+        m_layerWindowBegin( x, y, width, height );
+        return;
+    }
+    // The layers go back over this at the next flush
+    if( ( m_layerCount > 0U ) && !m_isComposing )
+        m_tilesMarkDirty( x, y, x + width - 1U, y + height - 1U, true );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+    m_windowX = x;
+    m_windowY = y;
+    m_windowWidth = width;
+    m_windowColumn = 0U;
+    m_windowRow = 0U;
+    m_framebufferAddDirty( x, y, x + width - 1U, y + height - 1U );
+#else
+    m_panelWindowBegin( x, y, width, height );
+#endif // OLED_INCLUDE_FRAMEBUFFER
+}
+
+/*
+ * Function: m_windowWrite
+ * --------------------
+ * Stream pixel data into the window opened by m_windowBegin
+ *
+ * data: RGB565 pixels, most significant byte first
+ * length: Number of bytes to be written, must be a whole number of pixels
+ *
+ * returns: void
+ */
+static inline void m_windowWrite( const uint8_t* data, size_t length )
+{
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( m_layerSelected != OLED_LAYER_NONE )
+    {
+        m_layerWindowWrite( data, length );
+        return;
+    }
+#endif // OLED_INCLUDE_COMPOSITOR
+
+#ifdef OLED_INCLUDE_FRAMEBUFFER
+    size_t bytesLeftInRow;
+    size_t bytesToCopy;
+
+    while( length > 0U )
+    {
+        // Copy as much as fits in the current row of the window
+        bytesLeftInRow = (size_t) ( m_windowWidth - m_windowColumn ) * 2U;
+        bytesToCopy = ( length < bytesLeftInRow ) ? length : bytesLeftInRow;
+        memcpy( &m_framebuffer[( ( (uint16_t) ( m_windowY + m_windowRow ) * m_displayWidth ) + m_windowX + m_windowColumn ) * 2U],
+            data, bytesToCopy );
+
+        data += bytesToCopy;
+        length -= bytesToCopy;
+        m_windowColumn += (uint8_t) ( bytesToCopy / 2U );
+        if( m_windowColumn == m_windowWidth )
+        {
+            m_windowColumn = 0U;
+            ++m_windowRow;
+        }
+    }
+#else
+    m_panelWindowWrite( data, length );
+#endif // OLED_INCLUDE_FRAMEBUFFER
+}
+
+/*
+ * Function: m_windowWriteInPlace
+ * --------------------
+ * The same as m_windowWrite, for data which doesn't change until the window
+ * ends, e.g. an image in flash. When it's going straight to the display with
+ * DMA it's sent from where it is, in one transfer, rather than copied through
+ * the line buffers
+ *
+ * data: RGB565 pixels, most significant byte first
+ * length: Number of bytes to be written, must be a whole number of pixels
+ *
+ * returns: void
+ */
+static inline void m_windowWriteInPlace( const uint8_t* data, size_t length )
+{
+#if defined OLED_INCLUDE_DMA && !defined OLED_INCLUDE_FRAMEBUFFER
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( m_layerSelected == OLED_LAYER_NONE )
+#endif // OLED_INCLUDE_COMPOSITOR
+    {
+        oledTransport_writeDataAsync( data, length );
+        return;
+    }
+#endif // defined OLED_INCLUDE_DMA && !defined OLED_INCLUDE_FRAMEBUFFER
+
+    m_windowWrite( data, length );
+}
+
+/*
+ * Function: m_windowEnd
+ * --------------------
+ * Finish the window started by m_windowBegin
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_windowEnd( void )
+{
+#ifdef OLED_INCLUDE_COMPOSITOR
+    if( m_layerSelected != OLED_LAYER_NONE )
+        return; // Nothing to finish
+#endif // OLED_INCLUDE_COMPOSITOR
+
+#ifndef OLED_INCLUDE_FRAMEBUFFER
+    m_panelWindowEnd();
+#endif // not defined OLED_INCLUDE_FRAMEBUFFER
+}
+
+/*
+ * Function: m_panelWindowBegin
+ * --------------------
+ * Select the display, set the column and row window and start a RAM write.
+ * Pixel data for the window is then sent with m_panelWindowWrite, left to right
+ * and top to bottom, and the transaction is finished with m_panelWindowEnd.
+ * The window must be within the display
+ *
+ * x, y: Coordinates of the top left of the window
+ * width, height: Size of the window in pixels, must not be 0
+ *
+ * returns: void
+ */
+static inline void m_panelWindowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height )
+{
+    const uint8_t columns[2] = { x, (uint8_t) ( x + width - 1U ) };
+    const uint8_t rows[2] = { y, (uint8_t) ( y + height - 1U ) };
+
+    m_chipSelect();
+
+    m_writeReg( 0x15 ); // Set column address
+    m_writeDataBuffer( columns, sizeof( columns ) );
+    m_writeReg( 0x75 ); // Set row address
+    m_writeDataBuffer( rows, sizeof( rows ) );
+    m_writeReg( 0x5C ); // Write RAM
+    // Everything until m_panelWindowEnd is pixel data
+}
+
+/*
+ * Function: m_panelWindowWrite
+ * --------------------
+ * Stream pixel data into the window opened by m_panelWindowBegin. With DMA the
+ * data is copied into a line buffer and sent in the background, so the caller
+ * can prepare the next row while this one goes out
+ *
+ * data: RGB565 pixels, most significant byte first
+ * length: Number of bytes to be written
+ *
+ * returns: void
+ */
+static inline void m_panelWindowWrite( const uint8_t* data, size_t length )
+{
+#ifdef OLED_INCLUDE_DMA
+    uint8_t* bufferPtr;
+    size_t bytesToSend;
+
+    while( length > 0U )
+    {
+        bytesToSend = ( length < OLED_LINE_BUFFER_SIZE ) ? length : OLED_LINE_BUFFER_SIZE;
+        // The other buffer may still be going out, this one is free
+        bufferPtr = m_dmaLineBuffers[m_dmaLineBufferIndex];
+        memcpy( bufferPtr, data, bytesToSend );
+        oledTransport_writeDataAsync( bufferPtr, bytesToSend );
+        m_dmaLineBufferIndex ^= 1U;
+
+        data += bytesToSend;
+        length -= bytesToSend;
+    }
+#else
+    oledTransport_writeData( data, length );
+#endif // OLED_INCLUDE_DMA
+}
 
-                const int32_t cosTheta = intcos( (int16_t) angle );
-                if( cosTheta == 0U )
-                {
-                    // No 0 division errors
-                    return;
-                }
+/*
+ * Function: m_panelWindowEnd
+ * --------------------
+ * Finish the transaction started by m_panelWindowBegin
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_panelWindowEnd( void )
+{
+    // The transport waits for any transfer still going before CS goes high
+    m_chipDeselect();
+}
 
-                const int32_t gradientScaled = ( intsin( (int16_t) angle ) * gradientScaleFactor ) / cosTheta; // scale up the gradient, so that we can use integers
-                const int32_t c = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - ( ( gradientScaled * ( (int32_t) m_loadingCircleOuterRadius - 1 ) ) / gradientScaleFactor );
+#ifdef OLED_INCLUDE_COMPOSITOR
 
-                triangleWidth = m_loadingCircleOuterRadius;
-                for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
-                {
-                    lineValue = ( ( gradientScaled * x ) / gradientScaleFactor ) + c;
-                    circleValue = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - (int32_t) ( sqrt( ( (uint16_t) m_loadingCircleOuterRadius * (uint16_t) m_loadingCircleOuterRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) ) );
-
-                    if( circleValue < 0 )
-                        circleValue = 0;
-                    else if( circleValue > 0xFF )
-                        circleValue = 0xFF;
-                    
-                    if( lineValue < 0 )
-                        lineValue = 0;
-                    else if( lineValue > 0xFF )
-                        lineValue = 0xFF;
-
-                    limit = ( lineValue > circleValue ) ? (uint8_t) lineValue : (uint8_t) circleValue;
-
-                    for( uint8_t y = limit; y < (m_loadingCircleOuterRadius - 1U); y++ )
-                    {
-                        m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
-                    }
-                    --triangleWidth;
-                }
-            }
-            else // Quadrant 0
-            {
-                // Angle for the y=mx+c line is 90-angle
-                const int32_t cosTheta = intcos( (int16_t) ( 90U - angle ) );
-                if( cosTheta == 0 )
-                {
-                    // No div0 errors please
-                    return;
-                }
+/*
+ * Function: m_layerGet
+ * --------------------
+ * Get the state of a layer which is being used
+ *
+ * layer: The layer
+ *
+ * returns: t_layer* the layer's state, NULL if it isn't a layer being used
+ */
+static inline t_layer* m_layerGet( t_oledLayer layer )
+{
+    if( ( layer >= OLED_MAX_LAYERS ) || ( m_layers[layer].pixelsPtr == NULL ) )
+        return NULL;
 
-                const int32_t gradientScaled = -1 * ( intsin( (int16_t) ( 90U - angle ) ) * gradientScaleFactor ) / cosTheta; // scale up the gradient, so that we can use integers
-                const int32_t c = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - ( ( gradientScaled * ( (int32_t) m_loadingCircleOuterRadius - 1 ) ) / gradientScaleFactor );
+    return &m_layers[layer];
+}
 
-                triangleWidth = 0U;
-                for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
-                {
-                    lineValue = ( ( gradientScaled * x ) / gradientScaleFactor ) + c;
-                    circleValue = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - (int32_t) ( sqrt( ( (uint16_t) m_loadingCircleOuterRadius * (uint16_t) m_loadingCircleOuterRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) ) );
+/*
+ * Function: m_layerCreateForWidget
+ * --------------------
+ * Create a mono layer for one of the widgets, clipped to the display. If it
+ * can't be created the widget draws straight to the display instead
+ *
+ * x1, y1, x2, y2: Corners of the widget, inclusive, may be off the display
+ * z: Where the layer goes, see OLED_LAYER_Z_LOADING
+ * colour: colour of the widget in RGB565
+ *
+ * returns: t_oledLayer the layer, or OLED_LAYER_NONE
+ */
+static t_oledLayer m_layerCreateForWidget( int16_t x1, int16_t y1, int16_t x2, int16_t y2, int8_t z,
+    uint16_t colour )
+{
+    t_oledLayer layer;
 
-                    if( circleValue >= lineValue ) // SHOULD THIS BE A > NOT >= ?
-                        break; // Intersection
+    x1 = ( x1 < 0 ) ? 0 : x1;
+    y1 = ( y1 < 0 ) ? 0 : y1;
+    x2 = ( x2 >= m_displayWidth ) ? ( m_displayWidth - 1 ) : x2;
+    y2 = ( y2 >= m_displayHeight ) ? ( m_displayHeight - 1 ) : y2;
+    if( ( x1 > x2 ) || ( y1 > y2 ) )
+        return OLED_LAYER_NONE; // All off the display
 
-                    if( ( lineValue < 0 ) || ( lineValue > ( ( (int32_t) m_loadingCircleOuterRadius * 2 ) - 2 ) ) ||
-                        ( circleValue < 0 ) || ( circleValue > ( ( (int32_t) m_loadingCircleOuterRadius * 2 ) - 2 ) ) )
-                    {
-                        ++triangleWidth;
-                        continue;
-                    }
-                    
-                    for( uint8_t y = (uint8_t) circleValue; y < (uint8_t) lineValue; y++ )
-                    {
-                        m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
-                    }
-                    ++triangleWidth;
-                }
-            }
-        }
-        else // Then yIsPositive == false
-        {
-            if( xLowerBound == 0U ) // Quadrant 2
-            {
-                // To make the transition between Q2 and Q3 smoother
-                if( angle > ( 90U - 4U ) )
-                {
-                    angle -= 2U;
-                }
+    (void) oled_layerCreate( (uint8_t) x1, (uint8_t) y1, (uint8_t) ( x2 - x1 + 1 ), (uint8_t) ( y2 - y1 + 1 ), z,
+        e_oledLayerMono, colour, &layer );
 
-                // Angle for the y=mx+c line is 90-angle
-                const int32_t cosTheta = intcos( (int16_t) ( 90U - angle ) );
-                if( cosTheta == 0 )
-                {
-                    // No 0 division errors
-                    return;
-                }
+    return layer;
+}
 
-                const int32_t gradientScaled = ( intsin( (int16_t) ( 90U - angle ) ) * gradientScaleFactor * -1 ) / cosTheta; // scale up the gradient, so that we can use integers
-                const int32_t c = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - ( ( gradientScaled * ( (int32_t) m_loadingCircleOuterRadius - 1 ) ) / gradientScaleFactor );
+/*
+ * Function: m_layerWindowBegin
+ * --------------------
+ * m_windowBegin for when a layer is selected. The window doesn't have to be
+ * within the layer, the tiles under the part which is are marked as dirty
+ *
+ * x, y: Coordinates of the top left of the window on the display
+ * width, height: Size of the window in pixels, must not be 0
+ *
+ * returns: void
+ */
+static void m_layerWindowBegin( uint8_t x, uint8_t y, uint8_t width, uint8_t height )
+{
+    const t_layer* layerPtr = &m_layers[m_layerSelected];
+    const uint8_t layerX2 = layerPtr->x + layerPtr->width - 1U;
+    const uint8_t layerY2 = layerPtr->y + layerPtr->height - 1U;
+    const uint8_t windowX2 = x + width - 1U;
+    const uint8_t windowY2 = y + height - 1U;
+
+    m_layerWindowX = x;
+    m_layerWindowY = y;
+    m_layerWindowWidth = width;
+    m_layerWindowColumn = 0U;
+    m_layerWindowRow = 0U;
+
+    if( ( x <= layerX2 ) && ( windowX2 >= layerPtr->x ) && ( y <= layerY2 ) && ( windowY2 >= layerPtr->y ) )
+    {
+        m_tilesMarkDirty( ( x > layerPtr->x ) ? x : layerPtr->x, ( y > layerPtr->y ) ? y : layerPtr->y,
+            ( windowX2 < layerX2 ) ? windowX2 : layerX2, ( windowY2 < layerY2 ) ? windowY2 : layerY2, false );
+    }
+}
 
-                triangleWidth = m_loadingCircleOuterRadius;
-                for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
-                {
-                    lineValue = ( ( gradientScaled * x ) / gradientScaleFactor ) + c;
-                    circleValue = ( (int32_t) m_loadingCircleOuterRadius - 1 ) + (int32_t) ( sqrt( ( (uint16_t) m_loadingCircleOuterRadius * (uint16_t) m_loadingCircleOuterRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) ) );
+/*
+ * Function: m_layerWindowWrite
+ * --------------------
+ * m_windowWrite for when a layer is selected. Pixels outside of the layer are
+ * dropped, and a mono layer only keeps whether each pixel is black or not. A
+ * colour layer covers what's under it wherever it's written, even with black
+ *
+ * data: RGB565 pixels, most significant byte first
+ * length: Number of bytes to be written, must be a whole number of pixels
+ *
+ * returns: void
+ */
+static void m_layerWindowWrite( const uint8_t* data, size_t length )
+{
+    t_layer* layerPtr = &m_layers[m_layerSelected];
+    uint8_t* pixelPtr;
+    int16_t column;
+    int16_t row;
+    uint8_t bitmask;
 
-                    if( ( lineValue >= circleValue ) ||  // SHOULD THIS BE A > NOT >= ?
-                        ( lineValue < 0 ) || ( lineValue > ( ( (int32_t) m_loadingCircleOuterRadius * 2 ) - 2 ) ) ||
-                        ( circleValue < 0 ) || ( circleValue > ( ( (int32_t) m_loadingCircleOuterRadius * 2 ) - 2 ) ) )
-                    {
-                        --triangleWidth;
-                        continue;
-                    }
-                    
-                    for( uint8_t y = (uint8_t) lineValue; y < (uint8_t) circleValue; y++ )
-                    {
-                        m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
-                    }
-                    --triangleWidth;
-                }
+    for( size_t index = 0U; index + 1U < length; index += 2U )
+    {
+        // Position within the layer
+        column = (int16_t) ( m_layerWindowX + m_layerWindowColumn ) - layerPtr->x;
+        row = (int16_t) ( m_layerWindowY + m_layerWindowRow ) - layerPtr->y;
+        if( ( column >= 0 ) && ( column < layerPtr->width ) && ( row >= 0 ) && ( row < layerPtr->height ) )
+        {
+            if( layerPtr->format == e_oledLayerMono )
+            {
+                pixelPtr = &layerPtr->pixelsPtr[( row * layerPtr->bytesPerRow ) + ( column / 8 )];
+                bitmask = 0b10000000U >> ( column % 8 );
+                if( ( data[index] | data[index + 1U] ) != 0U )
+                    *pixelPtr |= bitmask;
+                else
+                    *pixelPtr &= (uint8_t) ~bitmask;
             }
-            else // Quadrant 1
-            {   
-                const int32_t cosTheta = intcos( (int16_t) angle );
-                if( cosTheta == 0 )
-                {
-                    // No 0 division errors
-                    return;
-                }
-
-                const int32_t gradientScaled = ( intsin( (int16_t) angle ) * gradientScaleFactor ) / cosTheta; // scale up the gradient, so that we can use integers
-                const int32_t c = ( (int32_t) m_loadingCircleOuterRadius - 1 ) - ( ( gradientScaled * ( (int32_t) m_loadingCircleOuterRadius - 1 ) ) / gradientScaleFactor );
-
-                triangleWidth = 0U;
-                for( uint8_t x = xLowerBound; x < xUpperBound; x++ )
-                {
-                    lineValue = ( ( gradientScaled * x ) / gradientScaleFactor ) + c;
-                    circleValue = ( (int32_t) m_loadingCircleOuterRadius - 1 ) + (int32_t) ( sqrt( ( (uint16_t) m_loadingCircleOuterRadius * (uint16_t) m_loadingCircleOuterRadius ) - ( (uint16_t) triangleWidth * (uint16_t) triangleWidth ) ) );
-
-                    if( circleValue < 0 )
-                        circleValue = 0;
-                    else if( circleValue > 0xFF )
-                        circleValue = 0xFF;
-                    
-                    if( lineValue < 0 )
-                        lineValue = 0;
-                    else if( lineValue > 0xFF )
-                        lineValue = 0xFF;
-
-                    limit = ( lineValue < circleValue ) ? (uint8_t) lineValue : (uint8_t) circleValue;
-                    
-                    for( uint8_t y = ( m_loadingCircleOuterRadius - 1U ); y < (uint8_t) limit; y++ )
-                    {
-                        m_loadingCircleSetBitmap( bitmapPtr, x, y, true );
-                    }
-                    ++triangleWidth;
-                }
+            else
+            {
+                pixelPtr = &layerPtr->pixelsPtr[( row * layerPtr->bytesPerRow ) + ( column * 2 )];
+                pixelPtr[0] = data[index];
+                pixelPtr[1] = data[index + 1U];
+                layerPtr->coveragePtr[( row * ( ( layerPtr->width + 7 ) / 8 ) ) + ( column / 8 )] |=
+                    (uint8_t) ( 0b10000000U >> ( column % 8 ) );
             }
         }
+
+        ++m_layerWindowColumn;
+        if( m_layerWindowColumn == m_layerWindowWidth )
+        {
+            m_layerWindowColumn = 0U;
+            ++m_layerWindowRow;
+        }
     }
 }
 
 /*
- * Function: m_loadingCircleSetBitmap
+ * Function: m_layerGetPixel
  * --------------------
- * Used to set values in the loading circle bitmap. The top left of the bitmap is 0,0,
- * and this may not be 0,0 on the display.
+ * Get a pixel of a layer
  *
- * bitmapPtr: Pointer to the loading circle bitmap that needs to be changed
- * x, y: Coordinates of the position within the the bitmap to be changed
- * val: Set the bit within the bitmap to high or low
+ * layerPtr: The layer
+ * x, y: Coordinates on the display, must be within the layer
+ * colourPtr: Set to the RGB565 colour if the layer covers the pixel
  *
- * returns: void
+ * returns: bool true if the layer covers the pixel, false if it's see through
  */
-static inline void m_loadingCircleSetBitmap( uint8_t* bitmapPtr, uint8_t x, uint8_t y, bool val ) 
+static inline bool m_layerGetPixel( const t_layer* layerPtr, uint8_t x, uint8_t y, uint16_t* colourPtr )
 {
-    if( m_loadingBarState != e_loadingBarStateCircle )
-        return;
+    const uint8_t column = x - layerPtr->x;
+    const uint8_t row = y - layerPtr->y;
+    const uint8_t* rowPtr;
+
+    if( ( layerPtr->coveragePtr[( row * ( ( layerPtr->width + 7U ) / 8U ) ) + ( column / 8U )] &
+          ( 0b10000000U >> ( column % 8U ) ) ) == 0U )
+        return false;
 
-    // The function that calls this function should ensure that the bitmaps are properly initialised
-    uint16_t bitNumber = ( m_loadingCircleBitmapWidth * y ) + x;
-    uint16_t byteNumber = bitNumber / 8U;
-    // Check it's within bounds
-    if( byteNumber < m_loadingBarCallocSize )
+    if( layerPtr->format == e_oledLayerMono )
     {
-        if( val )
-            bitmapPtr[byteNumber] |= ( 0b10000000 >> ( bitNumber % 8U ) ); // Set a bit high
-        else
-            bitmapPtr[byteNumber] &= ~( 0b10000000 >> ( bitNumber % 8U ) ); // Set a bit low
+        *colourPtr = layerPtr->colour;
     }
-    else // TEMP
+    else
     {
-        printf("Prevented writing outside of loading circle bitmap!\n");
+        rowPtr = &layerPtr->pixelsPtr[(uint16_t) row * layerPtr->bytesPerRow];
+        *colourPtr = (uint16_t) ( ( rowPtr[column * 2U] << 8 ) | rowPtr[( column * 2U ) + 1U] );
     }
+    return true;
 }
 
-#endif // OLED_INCLUDE_LOADING_CIRCLE
+/*
+ * Function: m_tilesMarkDirty
+ * --------------------
+ * Mark the tiles under an area to be composed at the next flush
+ *
+ * x1, y1, x2, y2: Corners of the area, inclusive, within the display
+ * isDisplayUnknown: true if the area was drawn on without a layer, so the
+ *                   tiles are sent even if the layers over them haven't changed
+ *
+ * returns: void
+ */
+static void m_tilesMarkDirty( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, bool isDisplayUnknown )
+{
+    const uint8_t firstColumn = x1 / OLED_TILE_SIZE;
+    const uint8_t lastColumn = x2 / OLED_TILE_SIZE;
+    // Bits firstColumn to lastColumn
+    const uint16_t columnBits = (uint16_t) ( ( ( 1UL << ( lastColumn + 1U ) ) - 1UL ) & ~( ( 1UL << firstColumn ) - 1UL ) );
+
+    for( uint8_t tileRow = y1 / OLED_TILE_SIZE; tileRow <= y2 / OLED_TILE_SIZE; tileRow++ )
+    {
+        m_tileDirtyRows[tileRow] |= columnBits;
+        if( isDisplayUnknown )
+        {
+            for( uint8_t tileColumn = firstColumn; tileColumn <= lastColumn; tileColumn++ )
+                m_tileHashes[tileRow][tileColumn] = OLED_TILE_HASH_UNKNOWN;
+        }
+    }
+}
 
 /*
- * Function: m_displayInit
+ * Function: m_compositorFlush
  * --------------------
- * Initialise the display by writing data to registers
+ * Compose the dirty tiles and draw the ones which changed. Changed tiles next
+ * to each other on a row of tiles are drawn with one window
  *
  * parameters: none
  *
  * returns: void
  */
-static inline void m_displayInit( void )
+static void m_compositorFlush( void )
 {
-    // CS should be set low (active) prior to calling this function
-    // Now for some inexplicable magic from the manufacturer. Comments here are from the manufacturer
-    m_writeReg(0xFD);  // Command lock
-    m_writeData(0x12);
-    m_writeReg(0xFD);  // Command lock
-    m_writeData(0xB1);
+    const t_oledLayer previousLayer = m_layerSelected;
+    uint16_t changedTiles;
+    uint32_t hash;
+    uint8_t tileColumn;
+    uint8_t firstColumn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
 
-    m_writeReg(0xAE);  // Display off
-    m_writeReg(0xA4);  // Normal Display mode
+    // The composed tiles are drawn like anything else, but not into a layer
+    m_layerSelected = OLED_LAYER_NONE;
+    m_isComposing = true;
 
-    m_writeReg(0x15);  // Set column address
-    m_writeData(0x00); // Column address start 00
-    m_writeData(0x7F); // Column address end 127
-    m_writeReg(0x75);  // Set row address
-    m_writeData(0x00); // Row address start 00
-    m_writeData(0x7F); // Row address end 127    
+    for( uint8_t tileRow = 0U; ( tileRow < OLED_TILE_ROWS ) && ( tileRow * OLED_TILE_SIZE < m_displayHeight ); tileRow++ )
+    {
+        if( m_tileDirtyRows[tileRow] == 0U )
+            continue;
 
-    m_writeReg(0xB3);
-    m_writeData(0xF1);
+        changedTiles = 0U;
+        for( tileColumn = 0U; ( tileColumn < OLED_TILE_COLUMNS ) && ( tileColumn * OLED_TILE_SIZE < m_displayWidth ); tileColumn++ )
+        {
+            if( ( m_tileDirtyRows[tileRow] & ( 1U << tileColumn ) ) == 0U )
+                continue;
 
-    m_writeReg(0xCA);  
-    m_writeData(0x7F);
+            hash = m_composeTile( tileColumn, tileRow );
+            if( hash != m_tileHashes[tileRow][tileColumn] )
+            {
+                m_tileHashes[tileRow][tileColumn] = hash;
+                // No layers means there's nothing to draw
+                if( hash != OLED_TILE_HASH_UNKNOWN )
+                    changedTiles |= (uint16_t) ( 1U << tileColumn );
+            }
+        }
+        m_tileDirtyRows[tileRow] = 0U;
 
-    m_writeReg(0xA0);  // Set re-map & data format
-    m_writeData(0x74); // Horizontal address increment
+        y = tileRow * OLED_TILE_SIZE;
+        height = ( (uint8_t) ( m_displayHeight - y ) < OLED_TILE_SIZE ) ? ( m_displayHeight - y ) : OLED_TILE_SIZE;
+        tileColumn = 0U;
+        while( changedTiles != 0U )
+        {
+            if( ( changedTiles & ( 1U << tileColumn ) ) == 0U )
+            {
+                ++tileColumn;
+                continue;
+            }
 
-    m_writeReg(0xA1);  // Set display start line
-    m_writeData(0x00); // Start 00 line
+            firstColumn = tileColumn;
+            while( ( changedTiles & ( 1U << tileColumn ) ) != 0U )
+            {
+                changedTiles &= (uint16_t) ~( 1U << tileColumn );
+                ++tileColumn;
+            }
 
-    m_writeReg(0xA2);  // Set display offset
-    m_writeData(0x00);
+            x = firstColumn * OLED_TILE_SIZE;
+            width = ( ( tileColumn * OLED_TILE_SIZE > m_displayWidth ) ? m_displayWidth : ( tileColumn * OLED_TILE_SIZE ) ) - x;
+            m_windowBegin( x, y, width, height );
+            for( uint8_t row = 0U; row < height; row++ )
+                m_windowWrite( &m_tileRowBuffer[( ( (uint16_t) row * OLED_MAX_DISPLAY_WIDTH ) + x ) * 2U], (size_t) width * 2U );
+            m_windowEnd();
+        }
+    }
 
-    m_writeReg(0xAB);  
-    m_writeReg(0x01);  
+    m_isComposing = false;
+    m_layerSelected = previousLayer;
+}
 
-    m_writeReg(0xB4);  
-    m_writeData(0xA0);   
-    m_writeData(0xB5);  
-    m_writeData(0x55);    
+/*
+ * Function: m_composeTile
+ * --------------------
+ * Compose a tile from the layers over it into m_tileRowBuffer
+ *
+ * tileColumn, tileRow: The tile, within the display
+ *
+ * returns: uint32_t hash of the composed tile, or OLED_TILE_HASH_UNKNOWN if
+ *          there are no layers over it, in which case nothing is composed
+ */
+static uint32_t m_composeTile( uint8_t tileColumn, uint8_t tileRow )
+{
+    const uint8_t x1 = tileColumn * OLED_TILE_SIZE;
+    const uint8_t y1 = tileRow * OLED_TILE_SIZE;
+    const uint8_t x2 = ( ( (uint8_t) ( m_displayWidth - x1 ) < OLED_TILE_SIZE ) ? m_displayWidth : ( x1 + OLED_TILE_SIZE ) ) - 1U;
+    const uint8_t y2 = ( ( (uint8_t) ( m_displayHeight - y1 ) < OLED_TILE_SIZE ) ? m_displayHeight : ( y1 + OLED_TILE_SIZE ) ) - 1U;
+    const t_layer* tileLayers[OLED_MAX_LAYERS];
+    uint8_t tileLayerCount = 0U;
+    const t_layer* layerPtr;
+    uint8_t* pixelPtr;
+    uint16_t colour;
+    bool isCovered;
+    uint32_t hash = 2166136261UL; // FNV-1a
+
+    // The layers over this tile, top first
+    for( uint8_t orderIndex = 0U; orderIndex < m_layerCount; orderIndex++ )
+    {
+        layerPtr = &m_layers[m_layerOrder[orderIndex]];
+        if( ( layerPtr->x <= x2 ) && ( layerPtr->x + layerPtr->width > x1 ) &&
+            ( layerPtr->y <= y2 ) && ( layerPtr->y + layerPtr->height > y1 ) )
+            tileLayers[tileLayerCount++] = layerPtr;
+    }
+    if( tileLayerCount == 0U )
+        return OLED_TILE_HASH_UNKNOWN;
 
-    m_writeReg(0xC1);  
-    m_writeData(0xC8); 
-    m_writeData(0x80);
-    m_writeData(0xC0);
+    for( uint8_t y = y1; y <= y2; y++ )
+    {
+        pixelPtr = &m_tileRowBuffer[( ( (uint16_t) ( y - y1 ) * OLED_MAX_DISPLAY_WIDTH ) + x1 ) * 2U];
+        for( uint8_t x = x1; x <= x2; x++ )
+        {
+            // The first layer which isn't see through here, black if none
+            colour = 0x0000U;
+            isCovered = false;
+            for( uint8_t index = 0U; ( index < tileLayerCount ) && !isCovered; index++ )
+            {
+                layerPtr = tileLayers[index];
+                if( ( x >= layerPtr->x ) && ( x - layerPtr->x < layerPtr->width ) &&
+                    ( y >= layerPtr->y ) && ( y - layerPtr->y < layerPtr->height ) )
+                    isCovered = m_layerGetPixel( layerPtr, x, y, &colour );
+            }
 
-    m_writeReg(0xC7);  
-    m_writeData(0x0F);
+            *pixelPtr++ = (uint8_t) ( colour >> 8 );
+            *pixelPtr++ = (uint8_t) ( colour & 0xFFU );
+            hash = ( hash ^ colour ) * 16777619UL;
+        }
+    }
 
-    m_writeReg(0xB1);  
-    m_writeData(0x32);
+    return ( hash == OLED_TILE_HASH_UNKNOWN ) ? 1U : hash;
+}
 
-    m_writeReg(0xB2);  
-    m_writeData(0xA4);
-    m_writeData(0x00);
-    m_writeData(0x00);
+#endif // OLED_INCLUDE_COMPOSITOR
 
-    m_writeReg(0xBB);  
-    m_writeData(0x17);
+/*
+ * Function: m_lineBufferFill
+ * --------------------
+ * Fill the start of the line buffer with a single colour
+ *
+ * numberOfPixels: Number of pixels to fill, no more than OLED_MAX_DISPLAY_WIDTH
+ * colour: Pixel colour in RGB565 format
+ *
+ * returns: void
+ */
+static inline void m_lineBufferFill( uint8_t numberOfPixels, uint16_t colour )
+{
+    for( uint8_t pixel = 0U; pixel < numberOfPixels; pixel++ )
+    {
+        m_lineBuffer[pixel * 2U] = (uint8_t) ( colour >> 8 );
+        m_lineBuffer[( pixel * 2U ) + 1U] = (uint8_t) colour;
+    }
+}
 
-    m_writeReg(0xB6);
-    m_writeData(0x01);
+#ifdef OLED_INCLUDE_FRAMEBUFFER
 
-    m_writeReg(0xBE);
-    m_writeData(0x05);
+/*
+ * Function: m_framebufferAddDirty
+ * --------------------
+ * Record that part of the framebuffer has changed and needs to be flushed.
+ * The new rectangle is merged with any rectangle it overlaps or is close to.
+ * If there is no room for another rectangle, the two rectangles which are
+ * cheapest to merge are merged
+ *
+ * x1, y1: Top left corner of the changed area
+ * x2, y2: Bottom right corner of the changed area (inclusive)
+ *
+ * returns: void
+ */
+static void m_framebufferAddDirty( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2 )
+{
+    t_dirtyRectangle newRectangle = { x1, y1, x2, y2 };
+    t_dirtyRectangle mergedRectangle;
+    bool wasMerged = true;
 
-    m_writeReg(0xA6);
+    // Keep merging until the new rectangle doesn't merge with anything else
+    while( wasMerged == true )
+    {
+        wasMerged = false;
+        for( uint8_t index = 0U; index < m_dirtyRectangleCount; index++ )
+        {
+            mergedRectangle = m_dirtyRectangleUnion( &newRectangle, &m_dirtyRectangles[index] );
+            if( m_dirtyRectangleArea( &mergedRectangle ) <= ( m_dirtyRectangleArea( &newRectangle ) +
+                m_dirtyRectangleArea( &m_dirtyRectangles[index] ) + OLED_DIRTY_MERGE_SLACK ) )
+            {
+                // Remove the old rectangle from the list and carry on with the merged one
+                newRectangle = mergedRectangle;
+                --m_dirtyRectangleCount;
+                m_dirtyRectangles[index] = m_dirtyRectangles[m_dirtyRectangleCount];
+                wasMerged = true;
+                break;
+            }
+        }
+    }
+
+    if( m_dirtyRectangleCount < OLED_MAX_DIRTY_RECTANGLES )
+    {
+        m_dirtyRectangles[m_dirtyRectangleCount] = newRectangle;
+        ++m_dirtyRectangleCount;
+        return;
+    }
+
+    // The list is full, merge the new rectangle with whichever rectangle grows the least
+    uint8_t bestIndex = 0U;
+    uint16_t bestGrowth = 0xFFFFU;
+    uint16_t growth;
+    for( uint8_t index = 0U; index < m_dirtyRectangleCount; index++ )
+    {
+        mergedRectangle = m_dirtyRectangleUnion( &newRectangle, &m_dirtyRectangles[index] );
+        growth = m_dirtyRectangleArea( &mergedRectangle ) - m_dirtyRectangleArea( &m_dirtyRectangles[index] );
+        if( growth < bestGrowth )
+        {
+            bestGrowth = growth;
+            bestIndex = index;
+        }
+    }
+    m_dirtyRectangles[bestIndex] = m_dirtyRectangleUnion( &newRectangle, &m_dirtyRectangles[bestIndex] );
 }
 
 /*
- * Function: m_chipSelect
+ * Function: m_dirtyRectangleArea
  * --------------------
- * Select the display as an SPI device by setting CS to low
+ * Number of pixels within a dirty rectangle
  *
- * parameters: none
+ * rectanglePtr: Pointer to the rectangle
  *
- * returns: void                                                                         
+ * returns: uint16_t area in pixels
  */
-static inline void m_chipSelect( void )
+static inline uint16_t m_dirtyRectangleArea( const t_dirtyRectangle* rectanglePtr )
 {
-    gpio_put( PICO_DEFAULT_SPI_CSN_PIN, 0 );
+    return (uint16_t) ( ( rectanglePtr->x2 - rectanglePtr->x1 ) + 1U ) *
+        (uint16_t) ( ( rectanglePtr->y2 - rectanglePtr->y1 ) + 1U );
 }
 
 /*
- * Function: m_chipDeselect
+ * Function: m_dirtyRectangleUnion
  * --------------------
- * Deselct the display as an SPI device by setting CS to high
+ * Smallest rectangle which contains both rectangles
  *
- * parameters: none
+ * rectangle1Ptr, rectangle2Ptr: Pointers to the rectangles
  *
- * returns: void
+ * returns: t_dirtyRectangle containing both rectangles
  */
-static inline void m_chipDeselect( void )
+static inline t_dirtyRectangle m_dirtyRectangleUnion( const t_dirtyRectangle* rectangle1Ptr,
+    const t_dirtyRectangle* rectangle2Ptr )
 {
-    gpio_put( PICO_DEFAULT_SPI_CSN_PIN, 1 );
+    t_dirtyRectangle unionRectangle;
+    unionRectangle.x1 = ( rectangle1Ptr->x1 < rectangle2Ptr->x1 ) ? rectangle1Ptr->x1 : rectangle2Ptr->x1;
+    unionRectangle.y1 = ( rectangle1Ptr->y1 < rectangle2Ptr->y1 ) ? rectangle1Ptr->y1 : rectangle2Ptr->y1;
+    unionRectangle.x2 = ( rectangle1Ptr->x2 > rectangle2Ptr->x2 ) ? rectangle1Ptr->x2 : rectangle2Ptr->x2;
+    unionRectangle.y2 = ( rectangle1Ptr->y2 > rectangle2Ptr->y2 ) ? rectangle1Ptr->y2 : rectangle2Ptr->y2;
+    return unionRectangle;
 }
 
+#endif // OLED_INCLUDE_FRAMEBUFFER
+
+#if defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
+
 /*
- * Function: m_writeReg
+ * Function: m_dmaFlushSendNext
  * --------------------
- * Select register to write data to
+ * Start the next transfer of an asynchronous flush, straight from the
+ * framebuffer. Moves on to the next dirty rectangle when the current one is
+ * done, and finishes the flush after the last one. Called from oled_flushAsync
+ * for the first transfer and from the DMA interrupt after that
  *
  * parameters: none
  *
  * returns: void
  */
-static inline void m_writeReg( uint8_t reg )
+static void m_dmaFlushSendNext( void )
 {
-    gpio_put( m_dcPin, 0 );
-    if( m_spiInstance == 0 )
-        spi_write_blocking( spi0, &reg, 1 );
-    else
-        spi_write_blocking( spi1, &reg, 1 );
+    const t_dirtyRectangle* rectanglePtr = &m_flushRectangles[m_flushRectangleIndex];
+    const uint8_t* dataPtr;
+    uint8_t width;
+    uint8_t rows = 1U;
+
+    if( m_flushRow > rectanglePtr->y2 )
+    {
+        // This rectangle has been sent
+        m_panelWindowEnd();
+        if( ++m_flushRectangleIndex >= m_flushRectangleCount )
+        {
+            m_flushInProgress = false;
+            if( m_flushCallback != NULL )
+                m_flushCallback();
+            return;
+        }
+
+        rectanglePtr = &m_flushRectangles[m_flushRectangleIndex];
+        m_panelWindowBegin( rectanglePtr->x1, rectanglePtr->y1, ( rectanglePtr->x2 - rectanglePtr->x1 ) + 1U,
+            ( rectanglePtr->y2 - rectanglePtr->y1 ) + 1U );
+        m_flushRow = rectanglePtr->y1;
+    }
+
+    width = ( rectanglePtr->x2 - rectanglePtr->x1 ) + 1U;
+    // Full width rows are next to each other in the framebuffer, so they can go in one transfer
+    if( width == m_displayWidth )
+        rows = ( rectanglePtr->y2 - m_flushRow ) + 1U;
+
+    dataPtr = &m_framebuffer[( ( (uint16_t) m_flushRow * m_displayWidth ) + rectanglePtr->x1 ) * 2U];
+    // Move on before starting, the interrupt can come as soon as the transfer starts
+    m_flushRow += rows;
+    oledTransport_writeDataAsync( dataPtr, (size_t) rows * width * 2U );
 }
 
 /*
- * Function: m_writeData
+ * Function: m_dmaTransferDone
  * --------------------
- * Write data to the selected register
+ * Called by the transport, from the DMA interrupt, each time an asynchronous
+ * write finishes
  *
  * parameters: none
  *
  * returns: void
  */
-static inline void m_writeData( uint8_t data )
+static void m_dmaTransferDone( void )
 {
-    gpio_put( m_dcPin, 1 );
-    if( m_spiInstance == 0 )
-        spi_write_blocking( spi0, &data, 1 );
-    else
-        spi_write_blocking( spi1, &data, 1 );
+    if( m_flushInProgress )
+        m_dmaFlushSendNext();
 }
+
+#endif // defined OLED_INCLUDE_DMA && defined OLED_INCLUDE_FRAMEBUFFER
@@ -5,14 +5,21 @@
 // #define OLED_INCLUDE_TEST_FUNCTION
 #define OLED_INCLUDE_LOADING_BAR_HORIZONTAL
 #define OLED_INCLUDE_LOADING_CIRCLE
-// #define OLED_INCLUDE_FONT8                      // Uses ~760 bytes
-#define OLED_INCLUDE_FONT12                     // Uses ~1144 bytes
-// #define OLED_INCLUDE_FONT16                     // Uses ~3044 bytes
-#define OLED_INCLUDE_FONT20                     // Uses ~3804 bytes
-// #define OLED_INCLUDE_FONT24                     // Uses ~6844 bytes
+// Fonts are packed at build time by utils/makefonts.py
+#define OLED_INCLUDE_FONT8                      // Uses ~660 bytes
+#define OLED_INCLUDE_FONT12                     // Uses ~850 bytes
+#define OLED_INCLUDE_FONT16                     // Uses ~1200 bytes
+#define OLED_INCLUDE_FONT20                     // Uses ~1610 bytes
+#define OLED_INCLUDE_FONT24                     // Uses ~2150 bytes
 #define OLED_WRITE_TEXT_CHARACTER_GAP     ( 0 ) // Number of pixels between characters
 #define OLED_INCLUDE_SD_IMAGES
+#define OLED_INCLUDE_IMAGE_CACHE                // Needs OLED_INCLUDE_SD_IMAGES
+#define OLED_IMAGE_CACHE_BYTES        ( 4096U ) // Most RAM used to keep images from the SD card
+#define OLED_INCLUDE_ASSET_PACK                 // Needs OLED_INCLUDE_IMAGE_CACHE, builds the sd_card images into flash
 #define OLED_INCLUDE_QR_GENERATOR
+// #define OLED_INCLUDE_FRAMEBUFFER                // Uses 32768 bytes of RAM for a 128x128 display
+#define OLED_INCLUDE_DMA                        // Uses one DMA channel and 512 bytes of RAM
+#define OLED_INCLUDE_COMPOSITOR                 // Uses ~3.4 kB of RAM, plus each layer while it exists
 
 #include <stdint.h>
 
@@ -33,7 +40,8 @@
  * rstPin: GPIO on pico connected to RST (Reset) on the display, Will be used as GPIO
  * spiOutput: set to 0 for pico SPI0 and 1 for pico SPI1. See pico pin diagram, depends on your din and clk
  *
- * returns: void
+ * returns: int 0 on success
+ *              1 on fail due to invalid settings or no free DMA channel
  */
 int oled_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
     int8_t rstPin, int8_t spiOutput, unsigned int baudrate, uint8_t displayWidth,
@@ -51,6 +59,70 @@ int oled_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
  */
 void oled_clear( void );
 
+/*
+ * Function: oled_flush
+ * --------------------
+ * Push everything that has been drawn since the last flush to the display.
+ * When OLED_INCLUDE_FRAMEBUFFER is defined, drawing only changes the framebuffer
+ * in RAM and the changed areas are tracked as dirty rectangles. Overlapping and
+ * nearby rectangles are merged, and each remaining rectangle is sent with a
+ * single window write. Without the framebuffer, drawing goes straight to the
+ * display and this function does nothing.
+ * With OLED_INCLUDE_COMPOSITOR, any tiles that were drawn on in a layer are
+ * composed from all of the layers over them first, and only the tiles which
+ * come out different to what the display already has are sent
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oled_flush( void );
+
+// Called when a flush has finished, may be called from interrupt context
+typedef void (*t_oledFlushCallback)( void );
+
+/*
+ * Function: oled_flushAsync
+ * --------------------
+ * Start pushing everything that has been drawn since the last flush to the
+ * display, and return straight away. With OLED_INCLUDE_FRAMEBUFFER and
+ * OLED_INCLUDE_DMA defined the dirty rectangles are sent from the framebuffer
+ * by DMA, so the caller can carry on (e.g. sampling the ADC) while pixels go
+ * out. Drawing while a flush is in progress is fine, anything drawn is sent by
+ * the next flush. Without both options this is the same as oled_flush
+ *
+ * parameters: none
+ *
+ * returns: int 0 on success
+ *              1 on fail because a flush is already in progress, nothing
+ *                is lost, call again later
+ */
+int oled_flushAsync( void );
+
+/*
+ * Function: oled_isBusy
+ * --------------------
+ * Check whether pixels are still being sent to the display by DMA
+ *
+ * parameters: none
+ *
+ * returns: bool true if a flush or transfer is in progress
+ */
+bool oled_isBusy( void );
+
+/*
+ * Function: oled_setFlushCallback
+ * --------------------
+ * Set a function to be called each time a flush finishes. When the flush was
+ * started by oled_flushAsync, the callback is called from the DMA interrupt,
+ * so it must be short and must not draw to the display
+ *
+ * callback: Function to be called, or NULL for no callback
+ *
+ * returns: void
+ */
+void oled_setFlushCallback( t_oledFlushCallback callback );
+
 /*
  * Function: oled_deinitAll
  * --------------------
@@ -79,7 +151,7 @@ void oled_setPixel( uint8_t x, uint8_t y, uint16_t colour );
 /*
  * Function: oled_fill
  * --------------------
- * Set the colour of a specific pixel
+ * Fill the rectangle between two corners (inclusive) with a single colour
  *
  * x1: x coordinate of corner 1
  * y1: y coordinate of corner 1
@@ -91,20 +163,201 @@ void oled_setPixel( uint8_t x, uint8_t y, uint16_t colour );
  */
 void oled_fill( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint16_t colour );
 
+/*
+ * Function: oled_fillRect
+ * --------------------
+ * Fill a rectangle with a single colour. The display window is set once and
+ * the whole rectangle is streamed in one SPI transaction. Anything outside of
+ * the display is clipped
+ *
+ * x: x coordinate of the top left of the rectangle
+ * y: y coordinate of the top left of the rectangle
+ * width: Width of the rectangle in pixels
+ * height: Height of the rectangle in pixels
+ * colour: Pixel colour in RGB565 format
+ *
+ * returns: void
+ */
+void oled_fillRect( uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint16_t colour );
+
+/*
+ * Function: oled_blitRect
+ * --------------------
+ * Copy a rectangle of pixels to the display. The display window is set once and
+ * the whole rectangle is streamed in one SPI transaction. Anything outside of
+ * the display is clipped
+ *
+ * x: x coordinate of the top left of the rectangle
+ * y: y coordinate of the top left of the rectangle
+ * width: Width of the rectangle in pixels
+ * height: Height of the rectangle in pixels
+ * pixels: width * height pixels in RGB565 format, left to right and top to bottom
+ *
+ * returns: void
+ */
+void oled_blitRect( uint8_t x, uint8_t y, uint8_t width, uint8_t height,
+    const uint16_t* pixels );
+
 /*
  * Function: oled_drawLineBetweenPoints
  * --------------------
- * Draw a line between two cartesian points using Bresenham's line algorithm
+ * Draw a line between two cartesian points using Bresenham's line algorithm.
+ * Thick lines are drawn a row at a time, so no pixel is drawn twice
  *
- * x1, y1, x2, y2: Coordinates for line
+ * x1, y1, x2, y2: Coordinates for line, both ends are drawn
  * colour: Colour of line in RGB565
- * thickness: 0 for thin line, 2 is fairly thick
+ * thickness: 0 for thin line, otherwise the line is 2 * thickness + 1 pixels
+ *            wide. 2 is fairly thick
  *
  * returns: void
  */
-void oled_drawLineBetweenPoints( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, 
+void oled_drawLineBetweenPoints( uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2,
     uint16_t colour, uint8_t thickness );
 
+/*
+ * Function: oled_fillCircle
+ * --------------------
+ * Draw a filled circle, a row at a time
+ *
+ * centerX, centerY: Center of the circle
+ * radius: Radius of the circle in pixels
+ * colour: Colour of the circle in RGB565
+ *
+ * returns: void
+ */
+void oled_fillCircle( uint8_t centerX, uint8_t centerY, uint8_t radius, uint16_t colour );
+
+/*
+ * Function: oled_drawCircle
+ * --------------------
+ * Draw the outline of a circle, a row at a time
+ *
+ * centerX, centerY: Center of the circle
+ * radius: Radius of the outside of the outline in pixels
+ * thickness: Thickness of the outline in pixels, going in from the radius
+ * colour: Colour of the outline in RGB565
+ *
+ * returns: void
+ */
+void oled_drawCircle( uint8_t centerX, uint8_t centerY, uint8_t radius, uint8_t thickness,
+    uint16_t colour );
+
+/*
+ * Function: oled_drawArc
+ * --------------------
+ * Draw part of a ring, a row at a time. Angles are in degrees clockwise from
+ * the top of the display, e.g. 0 to 90 is the top right quarter
+ *
+ * centerX, centerY: Center of the ring
+ * outerRadius: Radius of the outside of the ring in pixels
+ * innerRadius: Radius of the inside of the ring in pixels, 0 for a pie slice
+ * startAngle: Angle the arc starts at
+ * endAngle: Angle the arc ends at, going clockwise. The whole ring is drawn if
+ *           this is 360 or more degrees past startAngle
+ * colour: Colour of the arc in RGB565
+ *
+ * returns: void
+ */
+void oled_drawArc( uint8_t centerX, uint8_t centerY, uint8_t outerRadius, uint8_t innerRadius,
+    int16_t startAngle, int16_t endAngle, uint16_t colour );
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+/* Layers let widgets which overlap be drawn in any order, e.g. the pump gauge
+ * and its redline. While a layer is selected with oled_layerSelect, all drawing
+ * goes into it rather than to the display. The display is split into 8x8
+ * tiles, and at each flush the tiles which were drawn on are composed from the
+ * layers over them, top first. A layer is see through until it's drawn on:
+ * anything drawn into a colour layer covers what's under it, black included,
+ * while a mono layer only covers where it's drawn in a colour other than black.
+ * Where no layer covers a pixel it is black.
+ * Layers always cover whatever is drawn without one: drawing with no layer
+ * selected in a tile which a layer touches is replaced at the next flush, as
+ * is anything already there when a layer is drawn into.
+ * The scrolling terminal moves the whole display so it doesn't use layers,
+ * and layers shouldn't be used while it's initialised */
+typedef uint8_t t_oledLayer;
+#define OLED_LAYER_NONE         ( 0xFFU )
+// Where the widgets put their own layers, higher is on top
+#define OLED_LAYER_Z_LOADING    ( 10 )
+#define OLED_LAYER_Z_TERMINAL   ( 20 )
+
+typedef enum
+{
+    e_oledLayerMono,   // One bit per pixel, set pixels are the layer's colour
+    e_oledLayerColour, // RGB565, two bytes per pixel, plus a bit for whether it has been drawn on
+} t_oledLayerFormat;
+
+/*
+ * Function: oled_layerCreate
+ * --------------------
+ * Create an empty (see through) layer, calloc its pixels. Nothing changes on
+ * the display until something is drawn into it
+ *
+ * x, y: Coordinates of the top left of the layer
+ * width, height: Size of the layer, it must be within the display
+ * z: Layers with a higher z are drawn on top, later layers win a tie
+ * format: How the pixels are stored, a mono layer is 1/17th of the size
+ * colour: Colour of the set pixels of a mono layer in RGB565, anything that
+ *         isn't black drawn into a mono layer is shown in this colour
+ * layerPtr: Set to the new layer on success, otherwise OLED_LAYER_NONE
+ *
+ * returns: int 0 on success
+ *              1 on fail because there are no free layers
+ *              2 on fail due to failed calloc
+ *              3 on fail due to bad parameters
+ */
+int oled_layerCreate( uint8_t x, uint8_t y, uint8_t width, uint8_t height, int8_t z,
+    t_oledLayerFormat format, uint16_t colour, t_oledLayer* layerPtr );
+
+/*
+ * Function: oled_layerDestroy
+ * --------------------
+ * Free a layer. Its area of the display is set to black straight away, and the
+ * layers under it are put back at the next flush
+ *
+ * layer: Layer to be destroyed, OLED_LAYER_NONE does nothing
+ *
+ * returns: void
+ */
+void oled_layerDestroy( t_oledLayer layer );
+
+/*
+ * Function: oled_layerSelect
+ * --------------------
+ * Send all drawing to a layer until another one is selected. Anything drawn
+ * outside of the layer is dropped
+ *
+ * layer: Layer to draw into, or OLED_LAYER_NONE to draw to the display
+ *
+ * returns: t_oledLayer the layer that was selected before, so it can be put back
+ */
+t_oledLayer oled_layerSelect( t_oledLayer layer );
+
+/*
+ * Function: oled_layerClear
+ * --------------------
+ * Make every pixel of a layer see through
+ *
+ * layer: Layer to be cleared
+ *
+ * returns: void
+ */
+void oled_layerClear( t_oledLayer layer );
+
+/*
+ * Function: oled_layerSetColour
+ * --------------------
+ * Change the colour of a mono layer, the whole layer is recomposed at the next
+ * flush. Does nothing to a colour layer
+ *
+ * layer: Layer to be changed
+ * colour: New colour in RGB565
+ *
+ * returns: void
+ */
+void oled_layerSetColour( t_oledLayer layer, uint16_t colour );
+#endif // OLED_INCLUDE_COMPOSITOR
+
 #ifdef OLED_INCLUDE_TEST_FUNCTION
 /*
  * Function: oled_test
@@ -174,7 +427,8 @@ void oled_loadingBarDeinit();
 /*
  * Function: oled_loadingCircleInit
  * --------------------
- * Initialise the loading circle, calloc some bitmaps
+ * Initialise the loading circle, calloc a table of when each pixel lights up.
+ * That's outerRadius squared bytes
  *
  * originX, originY: Coordinates for the centre of the circle
  * outerRadius: Radius of the loading circle
@@ -203,7 +457,8 @@ bool oled_loadingCircleIsInit( void );
 /*
  * Function: oled_loadingCircleDisplay
  * --------------------
- * Update the display with the loading circle
+ * Update the display with the loading circle. Only the part between the last
+ * progress and this one is drawn, so small steps are quick
  *
  * progress: 0 to 252 (NOT 255), 0 is not started and 252 is finished
  *
@@ -263,6 +518,40 @@ void oled_writeChar( uint8_t x, uint8_t y, char asciiCharacter, uint8_t fontSize
 void oled_writeText( uint8_t xStartPos, uint8_t yStartPos, const char text[],
     uint8_t fontSize, uint16_t colour, bool useTextWrapping );
 
+/*
+ * Function: oled_writeTextWithBackground
+ * --------------------
+ * Print a character array to the display, with the space around the glyphs
+ * filled in. Each line of text is rendered a row at a time and sent as one
+ * display window, which is much faster than oled_writeText. Only whole
+ * characters are drawn
+ *
+ * xStartPos: Display x coordinate of the top left of the first character to be written
+ * yStartPos: Display y coordinate of the top left of the first character to be written
+ * text: Text to write to display
+ * fontSize: Height of text in pixels, can be 8, 12, 16, 20 or 24
+ * colour: Text colour in RGB565 format
+ * backgroundColour: Colour behind the text in RGB565 format
+ * useTextWrapping: If true, when the end of the display is reached a new line will be started
+ *
+ * returns: void
+ */
+void oled_writeTextWithBackground( uint8_t xStartPos, uint8_t yStartPos, const char text[],
+    uint8_t fontSize, uint16_t colour, uint16_t backgroundColour, bool useTextWrapping );
+
+/*
+ * Function: oled_measureText
+ * --------------------
+ * Width of text written on one line by oled_writeText, e.g. for centering it
+ *
+ * text: Text to measure
+ * fontSize: Height of text in pixels, can be 8, 12, 16, 20 or 24
+ *
+ * returns: uint16_t width in pixels, 0 if the text is empty or the font size
+ *          isn't supported
+ */
+uint16_t oled_measureText( const char text[], uint8_t fontSize );
+
 /*
  * Function: oled_terminalInit
  * --------------------
@@ -280,6 +569,27 @@ void oled_writeText( uint8_t xStartPos, uint8_t yStartPos, const char text[],
  */
 int oled_terminalInit( uint8_t fontSize, uint16_t colour );
 
+/*
+ * Function: oled_terminalInitScrolling
+ * --------------------
+ * Initialise a terminal which scrolls using the display's start line instead
+ * of bitmaps. The display RAM is used as a ring of lines, so scrolling is one
+ * command plus drawing the new line. Only the text of each line is kept, this
+ * is 190 bytes for font 12 on a 128x128 display. The display is cleared.
+ * While it is initialised, the rest of the display is scrolled too, so other
+ * drawing functions shouldn't be used. oled_terminalSetHeight isn't supported
+ *
+ * fontSize: Height of text in pixels, can be 8, 12, 16, 20 or 24
+ * colour: Colour of text in RGB 565
+ *
+ * returns: int 0 on success
+ *          1 on failed malloc
+ *          2 if terminal is already initialised
+ *          3 if font size is not valid
+ *          4 if the display isn't 128 pixels tall
+ */
+int oled_terminalInitScrolling( uint8_t fontSize, uint16_t colour );
+
 /*
  * Function: oled_terminalIsInit
  * --------------------
@@ -299,7 +609,8 @@ bool oled_terminalIsInit( void );
  *
  * newHeightInLines: Maximum height of the terminal in lines
  *
- * returns: true if successful
+ * returns: int 0 on success
+ *          1 if the height is invalid or the terminal is a scrolling terminal
  */
 int oled_terminalSetHeight( uint8_t newHeightInLines );
 
@@ -387,10 +698,10 @@ void oled_terminalSetNewColour( uint16_t colour );
 #endif /* defined OLED_INCLUDE_FONT8 || defined OLED_INCLUDE_FONT12 || defined OLED_INCLUDE_FONT16 || defined OLED_INCLUDE_FONT20 || defined OLED_INCLUDE_FONT24 */
 
 /*
- * Function: oled_terminalClear
+ * Function: oled_terminalDeinit
  * --------------------
- * Write a temporary line to the terminal, next time a line is written it will
- * replace this temporary line
+ * Free the terminal's memory. For a scrolling terminal the display is put back
+ * to unscrolled, so clear the display first or the contents will move
  *
  * parameters: void
  *
@@ -403,22 +714,80 @@ void oled_terminalDeinit( void );
 /*
  * Function: oled_sdWriteImage
  * --------------------
- * Write an image to the screen has been encoded into a txt file. This is probably
- * very inefficient, but it does what it needs to do for me, for now. The txt files
- * are created using a .py file. You can specify where the image is drawn on the 
- * screen by using the xOrigin and yOrigin.
+ * Draw an image from the SD card. The images are .oimg files made by
+ * assets/image_encoder.py, which are streamed into the display a sector at a
+ * time. Images in the old .txt format still work, but are slower. You can
+ * specify where the image is drawn on the screen by using the xOrigin and
+ * yOrigin, any part of it off the display isn't drawn.
  * IMPORTANT: When this function is called, sd_init_driver() must have already been
- * called (and returned 0), and the sd card should be unmounted.
+ * called (and returned 0). The card is mounted through storage.hpp, so it must
+ * not be mounted any other way.
  *
- * filename: Name of encoded txt file, e.g. "image1.txt"
+ * filename: Name of the image file, e.g. "image1.oimg"
  *
  * returns: int 0 on success
  *              1 on fail due to failed SD card mounting
  *              2 on fail because the specified file couldn't be opened
  *              3 on fail because the file couldn't be closed
+ *              4 on fail because the image's pixel format isn't supported
+ *              5 on fail because the file couldn't be read or ended early
  */
 int oled_sdWriteImage( const char filename[], uint8_t originX, uint8_t originY );
 
+#ifdef OLED_INCLUDE_IMAGE_CACHE
+
+/*
+ * Function: oled_drawCachedImage
+ * --------------------
+ * The same as oled_sdWriteImage, but the image file is kept in RAM after it is
+ * first drawn, so drawing it again doesn't use the SD card at all. When the
+ * images kept would be more than OLED_IMAGE_CACHE_BYTES, the ones drawn least
+ * recently are dropped. Images too big for the cache, or in the old .txt
+ * format, are drawn straight from the SD card each time. With
+ * OLED_INCLUDE_ASSET_PACK, if the SD card can't be mounted or doesn't have the
+ * file, the copy built into flash is drawn instead and remembered, which uses
+ * no RAM.
+ * IMPORTANT: The same as oled_sdWriteImage, unless the image is already kept
+ *
+ * filename: Name of the image file, e.g. "image1.oimg"
+ *
+ * returns: int the same as oled_sdWriteImage
+ */
+int oled_drawCachedImage( const char filename[], uint8_t originX, uint8_t originY );
+
+/*
+ * Function: oled_imageCacheClear
+ * --------------------
+ * Free all of the images kept by oled_drawCachedImage, e.g. if the SD card has
+ * been changed
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oled_imageCacheClear( void );
+
+#ifdef OLED_INCLUDE_ASSET_PACK
+
+/*
+ * Function: oled_drawAsset
+ * --------------------
+ * Draw one of the images built into flash from the sd_card folder, without
+ * using the SD card. oled_drawCachedImage also falls back to these, but an
+ * image on the SD card with the same name is drawn instead
+ *
+ * filename: Name of the image file, e.g. "image1.oimg"
+ * originX, originY: Coordinates of the top left of the image
+ *
+ * returns: int 0 on success, 2 if the image isn't in flash, otherwise the
+ *          same as oled_sdWriteImage
+ */
+int oled_drawAsset( const char filename[], uint8_t originX, uint8_t originY );
+
+#endif // OLED_INCLUDE_ASSET_PACK
+
+#endif // OLED_INCLUDE_IMAGE_CACHE
+
 #endif // defined OLED_INCLUDE_SD_IMAGES
 
 #ifdef OLED_INCLUDE_QR_GENERATOR
@@ -0,0 +1,131 @@
+#ifndef OLED_TRANSPORT_HPP
+#define OLED_TRANSPORT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Everything oled.cpp needs to talk to the SSD1351. oled_transport_rp2040.cpp
+ * drives the real panel over SPI, host/oled_transport_host.cpp emulates the
+ * panel in RAM so the driver can be run and measured on a Linux machine.
+ * Exactly one of them is linked in. */
+
+// Called when an asynchronous write has finished, may be called from interrupt context
+typedef void (*t_oledTransportCallback)( void );
+
+/*
+ * Function: oledTransport_init
+ * --------------------
+ * Set up the pins and SPI used to talk to the display. The arguments are the
+ * same as those of oled_init
+ *
+ * returns: int 0 on success
+ *              1 on fail due to invalid settings or no free DMA channel
+ */
+int oledTransport_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
+    int8_t rstPin, int8_t spiOutput, unsigned int baudrate );
+
+/*
+ * Function: oledTransport_reset
+ * --------------------
+ * Pulse the reset pin of the display
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oledTransport_reset( void );
+
+/*
+ * Function: oledTransport_delayMs
+ * --------------------
+ * Wait for a number of milliseconds
+ *
+ * ms: Number of milliseconds to wait
+ *
+ * returns: void
+ */
+void oledTransport_delayMs( uint32_t ms );
+
+/*
+ * Function: oledTransport_select
+ * --------------------
+ * Start a transaction by setting CS low
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oledTransport_select( void );
+
+/*
+ * Function: oledTransport_deselect
+ * --------------------
+ * Finish a transaction by setting CS high, after any asynchronous write has
+ * completely left the SPI
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void oledTransport_deselect( void );
+
+/*
+ * Function: oledTransport_writeCommand
+ * --------------------
+ * Send a command byte, i.e. with DC low
+ *
+ * command: The command byte
+ *
+ * returns: void
+ */
+void oledTransport_writeCommand( uint8_t command );
+
+/*
+ * Function: oledTransport_writeData
+ * --------------------
+ * Send parameter or pixel bytes, i.e. with DC high, and wait until they've gone
+ *
+ * data: Bytes to be sent
+ * length: Number of bytes to be sent
+ *
+ * returns: void
+ */
+void oledTransport_writeData( const uint8_t* data, size_t length );
+
+/*
+ * Function: oledTransport_writeDataAsync
+ * --------------------
+ * Start sending data bytes in the background. Waits for the previous
+ * asynchronous write first, so at most one is ever in progress. The data must
+ * not be changed until the write has finished
+ *
+ * data: Bytes to be sent
+ * length: Number of bytes to be sent
+ *
+ * returns: void
+ */
+void oledTransport_writeDataAsync( const uint8_t* data, size_t length );
+
+/*
+ * Function: oledTransport_isBusy
+ * --------------------
+ * Check whether an asynchronous write is in progress
+ *
+ * parameters: none
+ *
+ * returns: bool true if a write is in progress
+ */
+bool oledTransport_isBusy( void );
+
+/*
+ * Function: oledTransport_setCallback
+ * --------------------
+ * Set a function to be called each time an asynchronous write finishes
+ *
+ * callback: Function to be called, or NULL for no callback
+ *
+ * returns: void
+ */
+void oledTransport_setCallback( t_oledTransportCallback callback );
+
+#endif // OLED_TRANSPORT_HPP
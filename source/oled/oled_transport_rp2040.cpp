@@ -0,0 +1,251 @@
+/* --- STANDARD LIBRARY INCLUDES ---------------------------------------------- */
+#include "oled_transport.hpp"
+
+// For the OLED_INCLUDE_* settings
+#include "oled.hpp"
+
+/* --- PICO LIBRARY INCLUDES -------------------------------------------------- */
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#ifdef OLED_INCLUDE_DMA
+#include "hardware/dma.h"
+#endif // OLED_INCLUDE_DMA
+
+/* --- OTHER LIBRARY INCLUDES ------------------------------------------------ */
+#ifdef OLED_INCLUDE_DMA
+#include "dma_alloc.h"
+#endif // OLED_INCLUDE_DMA
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+static int8_t m_csPin;
+static int8_t m_dcPin;
+static int8_t m_rstPin;
+static spi_inst_t* m_spi;
+static t_oledTransportCallback m_callback = NULL;
+#ifdef OLED_INCLUDE_DMA
+static int m_dmaChannel = -1;
+#endif // OLED_INCLUDE_DMA
+
+/* --- MODULE SCOPE FUNCTION PROTOTYPES --------------------------------------- */
+#ifdef OLED_INCLUDE_DMA
+static int m_dmaInit( void );
+static inline void m_dmaWaitForTransfer( void );
+static void m_dmaIrqCallback( unsigned int channel );
+#endif // OLED_INCLUDE_DMA
+
+/* --- PUBLIC FUNCTION IMPLEMENTATIONS ---------------------------------------- */
+
+int oledTransport_init( int8_t dinPin, int8_t clkPin, int8_t csPin, int8_t dcPin,
+    int8_t rstPin, int8_t spiOutput, unsigned int baudrate )
+{
+    // Set module variables
+    m_csPin = csPin;
+    m_dcPin = dcPin;
+    m_rstPin = rstPin;
+
+    // Set cs, dc and rst pins to be GPIO output pins
+    gpio_init( m_csPin );
+    gpio_init( m_dcPin );
+    gpio_init( m_rstPin );
+    gpio_set_dir( m_csPin, GPIO_OUT );
+    gpio_set_dir( m_dcPin, GPIO_OUT );
+    gpio_set_dir( m_rstPin, GPIO_OUT );
+    // Set cs, dc and rst pins to high output
+    gpio_put( m_csPin, 1 );
+    gpio_put( m_dcPin, 1 );
+    gpio_put( m_rstPin, 1 );
+
+    // Set the SPI pins
+    gpio_set_function( clkPin, GPIO_FUNC_SPI );
+    gpio_set_function( dinPin, GPIO_FUNC_SPI );
+
+    // Check din and clk pins are suitable, and init SPI at specified baud rate
+    if( ( spiOutput == 0 ) &&
+        ( ( dinPin == 3 ) || ( dinPin == 7 ) || ( dinPin == 19 ) ) && // Check din pin is connected to a SPI0 TX
+        ( ( clkPin == 2 ) || ( clkPin == 6 ) || ( clkPin == 18 ) ) )  // Check clk pin is connected to a SPI0 SCK
+    {
+        m_spi = spi0;
+    }
+    else if( ( spiOutput == 1 ) &&
+        ( ( dinPin == 11 ) || ( dinPin == 15 ) ) && // Check din pin is connected to a SPI1 TX
+        ( ( clkPin == 10 ) || ( clkPin == 14 ) ) )  // Check clk pin is connected to a SPI1 SCK
+    {
+        m_spi = spi1;
+    }
+    else
+    {
+        // Invalid settings
+        return 1;
+    }
+
+    spi_init( m_spi, baudrate );
+    /* Set the SPI format to be the same as Arduino's SPI Mode 3, i.e.:
+     * Most significant bit first, clock polarity = 1, clock phase = 1
+     * This line made no difference, but I'd like to ensure correct settings */
+    spi_set_format( m_spi, 8U, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST );
+
+#ifdef OLED_INCLUDE_DMA
+    if( m_dmaInit() != 0 )
+        return 1;
+#endif // OLED_INCLUDE_DMA
+
+    return 0;
+}
+
+void oledTransport_reset( void )
+{
+    gpio_put( m_rstPin, 1 );
+    sleep_ms( 10U );
+    gpio_put( m_rstPin, 0 );
+    sleep_ms( 10U );
+    gpio_put( m_rstPin, 1 );
+}
+
+void oledTransport_delayMs( uint32_t ms )
+{
+    sleep_ms( ms );
+}
+
+void oledTransport_select( void )
+{
+#ifdef OLED_INCLUDE_DMA
+    m_dmaWaitForTransfer();
+#endif // OLED_INCLUDE_DMA
+    gpio_put( m_csPin, 0 );
+}
+
+void oledTransport_deselect( void )
+{
+#ifdef OLED_INCLUDE_DMA
+    // CS must stay low until the last byte has left the SPI
+    m_dmaWaitForTransfer();
+#endif // OLED_INCLUDE_DMA
+    gpio_put( m_csPin, 1 );
+}
+
+void oledTransport_writeCommand( uint8_t command )
+{
+#ifdef OLED_INCLUDE_DMA
+    m_dmaWaitForTransfer();
+#endif // OLED_INCLUDE_DMA
+    gpio_put( m_dcPin, 0 );
+    spi_write_blocking( m_spi, &command, 1 );
+}
+
+void oledTransport_writeData( const uint8_t* data, size_t length )
+{
+#ifdef OLED_INCLUDE_DMA
+    m_dmaWaitForTransfer();
+#endif // OLED_INCLUDE_DMA
+    gpio_put( m_dcPin, 1 );
+    spi_write_blocking( m_spi, data, length );
+}
+
+void oledTransport_writeDataAsync( const uint8_t* data, size_t length )
+{
+#ifdef OLED_INCLUDE_DMA
+    // Only the DMA needs to be finished, the SPI FIFO can still be emptying
+    dma_channel_wait_for_finish_blocking( (uint) m_dmaChannel );
+    gpio_put( m_dcPin, 1 );
+    dma_channel_transfer_from_buffer_now( (uint) m_dmaChannel, data, (uint32_t) length );
+#else
+    oledTransport_writeData( data, length );
+    if( m_callback != NULL )
+        m_callback();
+#endif // OLED_INCLUDE_DMA
+}
+
+bool oledTransport_isBusy( void )
+{
+#ifdef OLED_INCLUDE_DMA
+    return dma_channel_is_busy( (uint) m_dmaChannel );
+#else
+    return false;
+#endif // OLED_INCLUDE_DMA
+}
+
+void oledTransport_setCallback( t_oledTransportCallback callback )
+{
+    m_callback = callback;
+}
+
+/* --- MODULE SCOPE FUNCTION IMPLEMENTATIONS ---------------------------------- */
+
+#ifdef OLED_INCLUDE_DMA
+
+/*
+ * Function: m_dmaInit
+ * --------------------
+ * Claim a DMA channel and set it up to feed the display's SPI TX FIFO. The
+ * SPI must already be initialised
+ *
+ * parameters: none
+ *
+ * returns: int 0 on success
+ *              1 on fail because there are no free DMA channels
+ */
+static int m_dmaInit( void )
+{
+    dma_channel_config config;
+
+    if( m_dmaChannel < 0 )
+    {
+        m_dmaChannel = dmaAlloc_claim( e_dmaAllocOwnerOled );
+        if( m_dmaChannel < 0 )
+            return 1;
+    }
+
+    // Bytes from memory to the SPI data register, paced by the TX FIFO
+    config = dma_channel_get_default_config( (uint) m_dmaChannel );
+    channel_config_set_transfer_data_size( &config, DMA_SIZE_8 );
+    channel_config_set_read_increment( &config, true );
+    channel_config_set_write_increment( &config, false );
+    channel_config_set_dreq( &config, spi_get_dreq( m_spi, true ) );
+    dma_channel_configure( (uint) m_dmaChannel, &config, &spi_get_hw( m_spi )->dr, NULL, 0U, false );
+
+    (void) dmaAlloc_setCallback( m_dmaChannel, m_dmaIrqCallback );
+
+    return 0;
+}
+
+/*
+ * Function: m_dmaWaitForTransfer
+ * --------------------
+ * Wait until the last DMA transfer has completely left the SPI, so that DC
+ * and CS can be changed. Safe to call from the DMA interrupt
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static inline void m_dmaWaitForTransfer( void )
+{
+    dma_channel_wait_for_finish_blocking( (uint) m_dmaChannel );
+    // The DMA finishing only means the last bytes are in the TX FIFO
+    while( spi_is_busy( m_spi ) )
+        tight_loop_contents();
+    // Nothing reads the RX FIFO during a DMA write, so empty it and clear the overrun
+    while( spi_is_readable( m_spi ) )
+        (void) spi_get_hw( m_spi )->dr;
+    spi_get_hw( m_spi )->icr = SPI_SSPICR_RORIC_BITS;
+}
+
+/*
+ * Function: m_dmaIrqCallback
+ * --------------------
+ * Called from the DMA interrupt each time a transfer on the display's channel
+ * finishes
+ *
+ * channel: The DMA channel, always the display's
+ *
+ * returns: void
+ */
+static void m_dmaIrqCallback( unsigned int channel )
+{
+    (void) channel;
+
+    if( m_callback != NULL )
+        m_callback();
+}
+
+#endif // OLED_INCLUDE_DMA
@@ -22,6 +22,10 @@
 static uint8_t m_pumpControlPin;
 static uint8_t m_adcInput;
 static bool m_isInitialised = false;
+#ifdef OLED_INCLUDE_COMPOSITOR
+// Over the gauge, so the gauge can't draw over the redline
+static t_oledLayer m_redlineLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
 
 static void m_drawRedline( t_globalData* globalDataPtr, uint16_t redlinePosition );
 
@@ -80,6 +84,7 @@ void pump_run( t_globalData* globalDataPtr )
     // Init the loading circle, to be used as a motor gauge
     oled_loadingCircleInit( globalDataPtr->hardwareData.displayWidth / 2, globalDataPtr->hardwareData.displayHeight / 2,
                             GAUGE_OUTER_RADIUS, GAUGE_INNER_RADIUS, GAUGE_COLOUR );
+    oled_flush();
 
     // Calculate end times
     settleEndTime = make_timeout_time_ms( PUMP_SETTLE_TIME_MS );
@@ -93,6 +98,8 @@ void pump_run( t_globalData* globalDataPtr )
         adcValue = adc_read();
         // Update the gauge
         oled_loadingCircleDisplay( (uint8_t) ( ( (uint32_t) adcValue * 252UL ) / 0x0FFFUL ) );
+        // Keep sampling while the gauge is sent, if a flush is still going it's picked up next time
+        (void) oled_flushAsync();
     }
     // Wait until the pump needs to be turned off, or the pump is detected as being dry
     while( absolute_time_diff_us( get_absolute_time(), pumpEndTime ) > 0 )
@@ -107,6 +114,8 @@ void pump_run( t_globalData* globalDataPtr )
         }
         // Update the gauge
         oled_loadingCircleDisplay( (uint8_t) ( ( (uint32_t) adcValue * 252UL ) / 0x0FFFUL ) );
+        // Keep sampling while the gauge is sent, if a flush is still going it's picked up next time
+        (void) oled_flushAsync();
     }
     // Stop the pump
     gpio_put( m_pumpControlPin, 0 );
@@ -116,12 +125,18 @@ void pump_run( t_globalData* globalDataPtr )
 
     // Update the loading gauge
     oled_loadingCircleDisplay( (uint8_t) ( ( (uint32_t) adcValue * 252UL ) / 0x0FFFUL ) );
+    oled_flush();
     sleep_ms( 50 );
     adcValue = adc_read();
     oled_loadingCircleDisplay( (uint8_t) ( ( (uint32_t) adcValue * 252UL ) / 0x0FFFUL ) );
+    oled_flush();
 
     // Deinit the loading circle
     oled_loadingCircleDeinit();
+#ifdef OLED_INCLUDE_COMPOSITOR
+    oled_layerDestroy( m_redlineLayer );
+    m_redlineLayer = OLED_LAYER_NONE;
+#endif // OLED_INCLUDE_COMPOSITOR
 }
 
 // Draw the redline for the loading circle which shows where the dry detection cutoff is
@@ -135,40 +150,32 @@ static void m_drawRedline( t_globalData* globalDataPtr, uint16_t redlinePosition
 
     int16_t theta = (int16_t) ( ( (uint64_t) redlinePosition * 360ULL ) / 0x0FFFULL );
 
-    if( theta < 90 )
-    {
-        oled_drawLineBetweenPoints( displayCenterX, 
-                                    displayCenterY,
-                                    displayCenterX + ( ( GAUGE_REDLINE_LENGTH * intsin( theta ) ) / 1000U ),
-                                    displayCenterY - ( ( GAUGE_REDLINE_LENGTH * intcos( theta ) ) / 1000U ),
-                                    GAUGE_REDLINE_COLOUR,
-                                    GAUGE_REDLINE_THICKNESS );
-    }
-    else if( theta < 180 ) // and theta >= 90
-    {
-        oled_drawLineBetweenPoints( displayCenterX, 
-                                    displayCenterY,
-                                    displayCenterX + ( ( GAUGE_REDLINE_LENGTH * intcos( theta - 90 ) ) / 1000U ),
-                                    displayCenterY + ( ( GAUGE_REDLINE_LENGTH * intsin( theta - 90 ) ) / 1000U ),
-                                    GAUGE_REDLINE_COLOUR,
-                                    GAUGE_REDLINE_THICKNESS );
-    }
-    else if( theta < 270 ) // and theta >- 180
-    {
-        oled_drawLineBetweenPoints( displayCenterX, 
-                                    displayCenterY,
-                                    displayCenterX - ( ( GAUGE_REDLINE_LENGTH * intsin( theta - 180 ) ) / 1000U ),
-                                    displayCenterY + ( ( GAUGE_REDLINE_LENGTH * intcos( theta - 180 ) ) / 1000U ),
-                                    GAUGE_REDLINE_COLOUR,
-                                    GAUGE_REDLINE_THICKNESS );
-    }
-    else // 270 <= theta < 360
-    {
-        oled_drawLineBetweenPoints( displayCenterX, 
-                                    displayCenterY,
-                                    displayCenterX - ( ( GAUGE_REDLINE_LENGTH * intcos( theta - 270 ) ) / 1000U ),
-                                    displayCenterY - ( ( GAUGE_REDLINE_LENGTH * intsin( theta - 270 ) ) / 1000U ),
-                                    GAUGE_REDLINE_COLOUR,
-                                    GAUGE_REDLINE_THICKNESS );
-    }
+    // theta is clockwise from the top of the display, where y is down
+    int16_t endX = displayCenterX + ( ( GAUGE_REDLINE_LENGTH * intsin( theta ) ) / 1000 );
+    int16_t endY = displayCenterY - ( ( GAUGE_REDLINE_LENGTH * intcos( theta ) ) / 1000 );
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+    // A layer just big enough for the line, within the display
+    int16_t left = ( ( endX < displayCenterX ) ? endX : displayCenterX ) - GAUGE_REDLINE_THICKNESS;
+    int16_t top = ( ( endY < displayCenterY ) ? endY : displayCenterY ) - GAUGE_REDLINE_THICKNESS;
+    int16_t right = ( ( endX > displayCenterX ) ? endX : displayCenterX ) + GAUGE_REDLINE_THICKNESS;
+    int16_t bottom = ( ( endY > displayCenterY ) ? endY : displayCenterY ) + GAUGE_REDLINE_THICKNESS;
+    left = ( left < 0 ) ? 0 : left;
+    top = ( top < 0 ) ? 0 : top;
+    right = ( right >= globalDataPtr->hardwareData.displayWidth ) ? ( globalDataPtr->hardwareData.displayWidth - 1 ) : right;
+    bottom = ( bottom >= globalDataPtr->hardwareData.displayHeight ) ? ( globalDataPtr->hardwareData.displayHeight - 1 ) : bottom;
+
+    oled_layerDestroy( m_redlineLayer );
+    // If there's no layer the redline is drawn straight to the display
+    (void) oled_layerCreate( left, top, ( right - left ) + 1, ( bottom - top ) + 1, OLED_LAYER_Z_LOADING + 1,
+        e_oledLayerMono, GAUGE_REDLINE_COLOUR, &m_redlineLayer );
+    t_oledLayer previousLayer = oled_layerSelect( m_redlineLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
+
+    oled_drawLineBetweenPoints( displayCenterX, displayCenterY, endX, endY, GAUGE_REDLINE_COLOUR,
+                                GAUGE_REDLINE_THICKNESS );
+
+#ifdef OLED_INCLUDE_COMPOSITOR
+    (void) oled_layerSelect( previousLayer );
+#endif // OLED_INCLUDE_COMPOSITOR
 }
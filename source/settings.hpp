@@ -51,6 +51,7 @@
 #define INIT_TO_WIFI_DELAY_MS               ( 3000ULL )
 #define WIFI_CONNECTION_MAX_ATTEMPTS        ( 3 )
 #define WIFI_CONNECTION_RETRY_DELAY_MINS    ( 1 )
+#define SETTINGS_CHECK_PERIOD_MS            ( 10000U ) // How often settings.txt is checked for changes while idle, the SD card is mounted for each check then unmounts again
 
 /* --- TYPEDEFS --- */
 typedef enum {
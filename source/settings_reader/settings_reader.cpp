@@ -1,6 +1,7 @@
-/* TODO: Make the reading and writing more extensible, so that instead of using custom
- * for loops for each function, you could have m_readCommaSeparatedIntegers or m_readInteger
- * 
+/* Reads and writes settings.txt. Every setting is described once in
+ * m_settingDescriptors, which both the reader and the writer work from, so
+ * adding a setting to t_sdCardSettings only needs a line there.
+ *
  * TODO: Make the error codes more useful, maybe by adding an enum. Add printf to every
  * error return for debugging
  */
@@ -8,151 +9,217 @@
 #include "settings_reader.hpp"
 
 #include "stdio.h"
+#include <stddef.h>
 #include <string.h>
 
-#define SD_CARD_READ_BUFFER_SIZE    ( 100 )
+#define SD_CARD_FILE_BUFFER_SIZE    ( 512 ) // One sector, so f_read and f_write go straight to the card
+#define SETTING_KEY_BUFFER_SIZE     ( 32 )
 #define CURRENT_SETTING_BUFFER_SIZE ( 50 )
 
-#define SD_CARD_WRITE_BUFFER_SIZE   ( 100 )
+typedef enum
+{
+    e_settingType_string,        // A char array, count is its size including the 0
+    e_settingType_militaryTimes, // An int32_t array of seconds since midnight, -1 if unused, written as "0700,1815"
+    e_settingType_uint16,        // A uint16_t
+} t_settingType;
+
+typedef struct
+{
+    const char* key;
+    t_settingType type;
+    size_t offset;         // Of the field in t_sdCardSettings
+    uint16_t count;        // Size of a string, or the number of elements in an array
+    uint32_t minimum;      // Bounds of a number, or of each element of an array
+    uint32_t maximum;
+    const char* preamble;  // Written on the lines before the setting, NULL for none
+} t_settingDescriptor;
 
 typedef enum
 {
-    e_wifiSsid,
-    e_wifiPassword,
-    e_wateringTimes,
-    e_wateringDuration,
-    e_done,
-    e_bufferOverfull,
-    e_settingsReadError,
-} t_sdCardReadCurrentSetting;
-
-int m_readSetting( t_globalData* globalDataPtr, t_sdCardReadCurrentSetting currentSetting, const char settingsBuffer[] );
+    e_parseState_lineStart,
+    e_parseState_skipLine, // Comments, text without a key, and anything after a value
+    e_parseState_key,
+    e_parseState_beforeValue, // After the colon, looking for the opening quote mark
+    e_parseState_value,
+    e_parseState_valueEscape, // After a backslash within quotes
+} t_parseState;
+
+typedef struct
+{
+    t_parseState state;
+    char key[SETTING_KEY_BUFFER_SIZE];
+    uint8_t keyLength;
+    int8_t keyIndex; // Into m_settingDescriptors, -1 if the key isn't known
+    char value[CURRENT_SETTING_BUFFER_SIZE];
+    uint8_t valueLength;
+    uint8_t foundSettings; // A bit for each of m_settingDescriptors
+    int error;
+} t_settingsParser;
+
+// Builds the whole of settings.txt, isOverfull is set instead of writing past the end
+typedef struct
+{
+    char* text;
+    size_t size;
+    size_t length;
+    bool isOverfull;
+} t_settingsText;
+
+// Size and modified time of settings.txt, to see if it has changed without reading it
+typedef struct
+{
+    FSIZE_t size;
+    WORD date;
+    WORD time;
+    bool isKnown; // False if settings.txt couldn't be found
+} t_settingsFileStamp;
+
+static bool m_readFileStamp( t_settingsFileStamp* stampPtr );
+static void m_parseCharacter( t_settingsParser* parserPtr, t_sdCardSettings* sdCardSettingsPtr, char c );
+static void m_parseKey( t_settingsParser* parserPtr );
+static void m_parseValue( t_settingsParser* parserPtr, t_sdCardSettings* sdCardSettingsPtr );
+static int m_readString( const t_settingDescriptor* descriptorPtr, char field[], const char value[] );
+static int m_readMilitaryTimes( const t_settingDescriptor* descriptorPtr, int32_t field[], const char value[] );
+static int m_readUint16( const t_settingDescriptor* descriptorPtr, uint16_t* fieldPtr, const char value[] );
+static void m_writeSetting( const t_settingDescriptor* descriptorPtr, const t_sdCardSettings* sdCardSettingsPtr, t_settingsText* textPtr );
+static void m_textAppend( t_settingsText* textPtr, const char text[], size_t length );
+static void m_textAppendNumber( t_settingsText* textPtr, uint32_t number, uint8_t minimumDigits );
 static inline bool m_charIsNumber( char c );
 
-int settings_readFromSDCard( t_globalData* globalDataPtr )
+// Every setting in settings.txt, in the order they are written. All of them
+// have to be in the file when it is read, in any order
+static constexpr t_settingDescriptor m_settingDescriptors[] =
 {
-    FRESULT fr;
-    FATFS fs;
-    FIL fil;
-    char buf[SD_CARD_READ_BUFFER_SIZE];
-    const char filename[] = "settings.txt";
-
-    // Create a buffer which will store the text within quote marks
-    char currentSettingBuffer[CURRENT_SETTING_BUFFER_SIZE];
-    uint8_t currentSettingBufferIndex = 0U;
-    // Create a variable to remember which setting we are trying to read
-    t_sdCardReadCurrentSetting currentSetting = e_wifiSsid;
-
-    // Mount the SD card
-    fr = f_mount( &fs, "0:", 1 );
-    if( fr != FR_OK )
-        return 1;
+    { "WIFI SSID", e_settingType_string, offsetof( t_sdCardSettings, wifiSsid ),
+        sizeof( t_sdCardSettings::wifiSsid ), 0U, 0U, NULL },
+    { "WIFI PASSWORD", e_settingType_string, offsetof( t_sdCardSettings, wifiPassword ),
+        sizeof( t_sdCardSettings::wifiPassword ), 0U, 0U, NULL },
+    { "WATERING TIMES", e_settingType_militaryTimes, offsetof( t_sdCardSettings, wateringTimes ),
+        MAX_NUMBER_OF_WATERING_TIMES, 0U, ( 24U * 60U * 60U ) - 1U,
+        "\r\nNOTE WATERING TIMES MUST BE 4 DIGIT MILIRARY TIME COMMA DELIMITED WITH NO SPACE\r\n" },
+    { "WATERING DURATION MS", e_settingType_uint16, offsetof( t_sdCardSettings, wateringDurationMs ),
+        1U, 0U, UINT16_MAX, NULL },
+};
+#define NUMBER_OF_SETTINGS ( sizeof( m_settingDescriptors ) / sizeof( m_settingDescriptors[0] ) )
+
+/*
+ * Function: m_isSchemaValid
+ * --------------------
+ * Check m_settingDescriptors at compile time: every key fits in the parser,
+ * every field is inside t_sdCardSettings, and the longest possible file fits
+ * in m_fileBuffer
+ *
+ * parameters: none
+ *
+ * returns: bool true if it is valid
+ */
+static constexpr bool m_isSchemaValid( void )
+{
+    size_t fileLength = 0U;
 
-    // Open the settings file
-    fr = f_open( &fil, filename, FA_READ );
-    if( fr != FR_OK )
-    {
-        f_unmount( "0:" );
-        return 2;
-    }
-    
-    /* This function should read the following:
-     *      WIFI SSID
-     *      WIFI Password
-     *      Watering times
-     *      Watering duration
-     */
-    bool withinQuotes = false; // Is the buffer index currently within quotes
-    while( f_gets( buf, sizeof( buf ), &fil ) )
+    if( NUMBER_OF_SETTINGS > ( sizeof( t_settingsParser::foundSettings ) * 8U ) )
+        return false;
+    for( const t_settingDescriptor& descriptor : m_settingDescriptors )
     {
-        for( uint8_t bufferIndex = 0U; bufferIndex < sizeof( buf ); bufferIndex++ )
+        size_t keyLength = 0U;
+        while( descriptor.key[keyLength] != 0 )
+            ++keyLength;
+        // The key, a colon, a space, two quote marks and \r\n
+        size_t lineLength = keyLength + 6U;
+        size_t fieldSize = 0U;
+        switch( descriptor.type )
         {
-            if( buf[bufferIndex] == 0 )
-                break; // End of buffer
-            else if( buf[bufferIndex] == 10 )
-                continue; // Newline in file
-            else if( withinQuotes == true )
-            {
-                // The index is currently within quotes
-                // If we read another quotemark we have reached the end of quotes
-                if( buf[bufferIndex] == '"' )
-                {
-                    withinQuotes = false;
-                    currentSettingBuffer[currentSettingBufferIndex] = 0; // Show end of string
-                    
-                    // Process the current setting buffer
-                    if( m_readSetting( globalDataPtr, currentSetting, currentSettingBuffer ) != 0 )
-                    {
-                        currentSetting = e_settingsReadError;
-                        break;
-                    }
-
-                    // Adjust variables ready for next setting
-                    currentSettingBufferIndex = 0U;
-                    if( currentSetting == e_wifiSsid )
-                        currentSetting = e_wifiPassword;
-                    else if( currentSetting == e_wifiPassword )
-                        currentSetting = e_wateringTimes;
-                    else if( currentSetting == e_wateringTimes )
-                        currentSetting = e_wateringDuration;
-                    else if( currentSetting == e_wateringDuration )
-                    {
-                        currentSetting = e_done;
-                        break;
-                    }
-                }
-                // If we read something that isn't a quotemark, add it to the currentSettingBuffer
-                else
-                {
-                    currentSettingBuffer[currentSettingBufferIndex] = buf[bufferIndex];
-                    ++currentSettingBufferIndex;
-
-                    // Check that the buffer isn't overfull,
-                    // bear in mind we need space for a 0 at the end of the buffer
-                    if( currentSettingBufferIndex >= ( CURRENT_SETTING_BUFFER_SIZE - 1U ) )
-                    {
-                        currentSetting = e_bufferOverfull;
-                        break;
-                    }
-                }
-            }
-            else // withinQuotes == false
-            {
-                // All we're looking for is quotemarks
-                if( buf[bufferIndex] == '"' )
-                    withinQuotes = true;
-            }
+            case e_settingType_string:
+                fieldSize = descriptor.count;
+                lineLength += 2U * ( descriptor.count - 1U ); // Every character escaped
+                break;
+            case e_settingType_militaryTimes:
+                fieldSize = descriptor.count * sizeof( int32_t );
+                lineLength += ( 5U * descriptor.count ) - 1U;
+                break;
+            case e_settingType_uint16:
+                fieldSize = sizeof( uint16_t );
+                lineLength += 5U;
+                break;
+            default:
+                return false;
         }
-        if( ( currentSetting == e_done ) ||
-            ( currentSetting == e_bufferOverfull ) ||
-            ( currentSetting == e_settingsReadError ) )
+        if( ( keyLength >= ( SETTING_KEY_BUFFER_SIZE - 1U ) ) ||
+            ( ( descriptor.offset + fieldSize ) > sizeof( t_sdCardSettings ) ) ||
+            ( descriptor.minimum > descriptor.maximum ) )
         {
-            break;
+            return false;
         }
+        fileLength += lineLength;
+        for( size_t index = 0U; ( descriptor.preamble != NULL ) && ( descriptor.preamble[index] != 0 ); index++ )
+            ++fileLength;
     }
+    return fileLength <= SD_CARD_FILE_BUFFER_SIZE;
+}
+static_assert( m_isSchemaValid(), "m_settingDescriptors doesn't fit t_sdCardSettings or the buffers" );
+
+// For reading and writing settings.txt, static to keep it off the stack
+static char m_fileBuffer[SD_CARD_FILE_BUFFER_SIZE];
+static const char m_filename[] = "settings.txt";
+// Written in full first, then renamed to settings.txt
+static const char m_tempFilename[] = "settings.tmp";
+// When settings.txt was last read or written, see settings_checkForChanges
+static t_settingsFileStamp m_fileStamp = {};
 
-    // Close the file
-    fr = f_close( &fil );
-    if( fr != FR_OK )
+int settings_readFromSDCard( t_globalData* globalDataPtr )
+{
+    int result;
+    FIL fil;
+    UINT length;
+    t_settingsParser parser = {};
+    parser.state = e_parseState_lineStart;
+    // Read into a copy, so the settings are left alone if the file is wrong.
+    // Zeroed, so the same file always gives the same bytes, see sm_init.cpp
+    t_sdCardSettings sdCardSettings = {};
+
+    // Before reading, so if it's changed part way through it is read again.
+    // Even if reading it fails, so a broken file is only read again once it's
+    // been changed
+    (void) m_readFileStamp( &m_fileStamp );
+
+    // Open the settings file, mounting the SD card if needed. If it isn't there
+    // the power may have been cut while settings_writeToSDCard was replacing it,
+    // after it had written settings.tmp in full
+    result = storage_open( &fil, m_filename, FA_READ );
+    if( result == 2 )
+        result = ( storage_open( &fil, m_tempFilename, FA_READ ) == 0 ) ? 0 : 2;
+    if( result != 0 )
+        return result;
+
+    // Read the file a sector at a time, passing each character through the parser once
+    do
     {
-        f_unmount( "0:" );
+        if( f_read( &fil, m_fileBuffer, sizeof( m_fileBuffer ), &length ) != FR_OK )
+        {
+            parser.error = 7;
+            break;
+        }
+        for( UINT index = 0U; ( index < length ) && ( parser.error == 0 ); index++ )
+            m_parseCharacter( &parser, &sdCardSettings, m_fileBuffer[index] );
+    } while( ( length == sizeof( m_fileBuffer ) ) && ( parser.error == 0 ) );
+    // The last line might not end with a newline
+    if( parser.error == 0 )
+        m_parseCharacter( &parser, &sdCardSettings, '\n' );
+
+    // Close the file, storage_update unmounts the SD card later
+    if( storage_close( &fil ) != 0 )
         return 3;
-    }
 
-    // Unmount the SD card
-    f_unmount( "0:" );
-
-    // Error code if buffer got too full
-    if( currentSetting == e_bufferOverfull )
-        return 4;
-    // Error code if reading a specific setting went wrong
-    if( currentSetting == e_settingsReadError )
-        return 5;
+    // Error code 4 if a value was too long, 5 if reading a specific setting
+    // went wrong, 7 if the file couldn't be read
+    if( parser.error != 0 )
+        return parser.error;
     // Error code if file ended but we didn't get all the settings
-    if( currentSetting != e_done )
+    if( parser.foundSettings != ( ( 1U << NUMBER_OF_SETTINGS ) - 1U ) )
         return 6;
 
     // Otherwise exit successfully
+    globalDataPtr->sdCardSettings = sdCardSettings;
     return 0;
 }
 
@@ -162,294 +229,521 @@ int settings_writeToSDCard( t_globalData* globalDataPtr )
     if( globalDataPtr->hardwareData.settingsReadOk == false )
         return 100;
 
-    FRESULT fr;
-    FATFS fs;
+    int result;
     FIL fil;
-    const char filename[] = "settings.txt";
-
-    char textBuffer[SD_CARD_WRITE_BUFFER_SIZE];
-    // Create a temporary text buffer
-    char tempTextBuffer[SD_CARD_WRITE_BUFFER_SIZE];
-
-    // Mount the SD card
-    fr = f_mount( &fs, "0:", 1 );
-    if( fr != FR_OK )
-        return 1;
+    UINT length;
+    t_settingsText text = { m_fileBuffer, sizeof( m_fileBuffer ), 0U, false };
 
-    // Open the settings file
-    fr = f_open( &fil, filename, FA_WRITE | FA_CREATE_ALWAYS );
-    if( fr != FR_OK )
-    {   
-        f_unmount( "0:" );
-        return 2;
+    // Build the whole file first, so it is written in one go
+    for( const t_settingDescriptor& descriptor : m_settingDescriptors )
+    {
+        if( descriptor.preamble != NULL )
+            m_textAppend( &text, descriptor.preamble, strlen( descriptor.preamble ) );
+        m_writeSetting( &descriptor, &( globalDataPtr->sdCardSettings ), &text );
     }
-    
-    // Note: f_printf returns the number of characters it wrote on sucess, or negative on fail
-    // Note: remember to put \r\n at the end of each line
+    if( text.isOverfull )
+        return 4;
 
-    snprintf( textBuffer, sizeof( textBuffer ), "WIFI SSID: \"%s\"\r\n", globalDataPtr->sdCardSettings.wifiSsid );
-    if( ( f_printf( &fil, textBuffer ) < 0 ) )
+    // Write settings.tmp and make sure it has reached the card, then swap it
+    // for settings.txt, so settings.txt is never left half written if the
+    // power is cut
+    result = storage_open( &fil, m_tempFilename, FA_WRITE | FA_CREATE_ALWAYS );
+    if( result != 0 )
+        return result;
+    bool isWritten = ( f_write( &fil, text.text, (UINT) text.length, &length ) == FR_OK ) &&
+                     ( length == text.length ) && ( f_sync( &fil ) == FR_OK );
+    // Closed whether it worked or not, storage_update unmounts the SD card later
+    if( ( storage_close( &fil ) != 0 ) || ( isWritten == false ) )
         return 3;
-    
-    snprintf( textBuffer, sizeof( textBuffer ), "WIFI PASSWORD: \"%s\"\r\n\r\n", globalDataPtr->sdCardSettings.wifiPassword );
-    if( ( f_printf( &fil, textBuffer ) < 0 ) )
-        return 4;
-    
-    snprintf( textBuffer, sizeof( textBuffer ), "NOTE WATERING TIMES MUST BE 4 DIGIT MILIRARY TIME COMMA DELIMITED WITH NO SPACE\r\n" );
-    if( ( f_printf( &fil, textBuffer ) < 0 ) )
+
+    if( storage_replace( m_filename, m_tempFilename ) != 0 )
         return 5;
 
-    // Turn the watering times from seconds from midnight to military time, and into a string
-    bool isTextBufferEmpty = true;
-    uint16_t militaryTime;
-    int32_t remainingTime;
-    uint8_t stringLength = 0U;
-    for( uint8_t i = 0U; i < MAX_NUMBER_OF_WATERING_TIMES; i++ )
+    // So settings_checkForChanges doesn't read it back
+    (void) m_readFileStamp( &m_fileStamp );
+
+    return 0;
+}
+
+uint8_t settings_checkForChanges( t_globalData* globalDataPtr )
+{
+    t_settingsFileStamp stamp;
+    uint8_t changes = 0U;
+    int result;
+
+    // Only the directory entry is read, the file is only read if it has changed
+    if( m_readFileStamp( &stamp ) == false )
+        return 0U;
+    if( ( m_fileStamp.isKnown == true ) && ( stamp.size == m_fileStamp.size ) &&
+        ( stamp.date == m_fileStamp.date ) && ( stamp.time == m_fileStamp.time ) )
+        return 0U;
+
+    // settings_readFromSDCard only changes the settings if the whole file is
+    // valid, so they are never left half changed
+    t_sdCardSettings previousSettings = globalDataPtr->sdCardSettings;
+    bool wasSettingsReadOk = globalDataPtr->hardwareData.settingsReadOk;
+    result = settings_readFromSDCard( globalDataPtr );
+    if( result != 0 )
     {
-        if( globalDataPtr->sdCardSettings.wateringTimes[i] >= 0 )
+        printf( "settings.txt changed but couldn't be read, error %d\n", result );
+        return 0U;
+    }
+    globalDataPtr->hardwareData.settingsReadOk = true;
+
+    // Everything has changed if there were no settings before
+    const t_sdCardSettings* newSettingsPtr = &( globalDataPtr->sdCardSettings );
+    if( ( wasSettingsReadOk == false ) ||
+        ( memcmp( previousSettings.wifiSsid, newSettingsPtr->wifiSsid, sizeof( previousSettings.wifiSsid ) ) != 0 ) ||
+        ( memcmp( previousSettings.wifiPassword, newSettingsPtr->wifiPassword, sizeof( previousSettings.wifiPassword ) ) != 0 ) )
+        changes |= SETTINGS_CHANGED_WIFI;
+    if( ( wasSettingsReadOk == false ) ||
+        ( memcmp( previousSettings.wateringTimes, newSettingsPtr->wateringTimes, sizeof( previousSettings.wateringTimes ) ) != 0 ) ||
+        ( previousSettings.wateringDurationMs != newSettingsPtr->wateringDurationMs ) )
+        changes |= SETTINGS_CHANGED_WATERING;
+
+    return changes;
+}
+
+/*
+ * Function: m_readFileStamp
+ * --------------------
+ * Get the size and modified time of settings.txt with storage_stat
+ *
+ * stampPtr: Where they go, isKnown is false if it couldn't be found
+ *
+ * returns: bool true if settings.txt was found
+ */
+static bool m_readFileStamp( t_settingsFileStamp* stampPtr )
+{
+    FILINFO filInfo;
+
+    stampPtr->isKnown = ( storage_stat( m_filename, &filInfo ) == 0 );
+    if( stampPtr->isKnown == true )
+    {
+        stampPtr->size = filInfo.fsize;
+        stampPtr->date = filInfo.fdate;
+        stampPtr->time = filInfo.ftime;
+    }
+
+    return stampPtr->isKnown;
+}
+
+/*
+ * Function: m_parseCharacter
+ * --------------------
+ * Move the parser on by one character of settings.txt. Each line is either
+ *      KEY: "value"    anything after the closing quote mark is ignored
+ *      # comment
+ *      or any other text without a colon, which is ignored
+ * Within quotes \" is a quote mark and \\ is a backslash. Keys which aren't in
+ * m_settingDescriptors are skipped
+ *
+ * parserPtr: The parser, parserPtr->error is set if something went wrong
+ * sdCardSettingsPtr: Where the settings go
+ * c: The character
+ *
+ * returns: void
+ */
+static void m_parseCharacter( t_settingsParser* parserPtr, t_sdCardSettings* sdCardSettingsPtr, char c )
+{
+    switch( parserPtr->state )
+    {
+        case e_parseState_lineStart:
         {
-            // Convert time to military
-            militaryTime = 0U;
-            remainingTime = globalDataPtr->sdCardSettings.wateringTimes[i];
-            while( remainingTime >= ( 10LL * 60LL * 60LL ) ) // Tens of hours
+            if( ( c == '#' ) || ( c == '"' ) || ( c == ':' ) )
+                parserPtr->state = e_parseState_skipLine;
+            else if( ( c != '\n' ) && ( c != '\r' ) && ( c != ' ' ) && ( c != '\t' ) )
             {
-                remainingTime -= 10LL * 60LL * 60LL;
-                militaryTime += 1000;
+                parserPtr->state = e_parseState_key;
+                parserPtr->key[0] = c;
+                parserPtr->keyLength = 1U;
             }
-            while( remainingTime >= ( 60LL * 60LL ) ) // Hours
+            break;
+        }
+        case e_parseState_skipLine:
+        {
+            if( c == '\n' )
+                parserPtr->state = e_parseState_lineStart;
+            break;
+        }
+        case e_parseState_key:
+        {
+            if( c == '\n' )
+                parserPtr->state = e_parseState_lineStart;
+            else if( c == '"' )
+                parserPtr->state = e_parseState_skipLine; // A quote mark before a colon, so not a setting
+            else if( c == ':' )
             {
-                remainingTime -= 60LL * 60LL;
-                militaryTime += 100;
+                m_parseKey( parserPtr );
+                parserPtr->state = e_parseState_beforeValue;
             }
-            while( remainingTime >= ( 10LL * 60LL ) ) // Tens of minutes
+            else
             {
-                remainingTime -= 10LL * 60LL;
-                militaryTime += 10;
+                // Keep one more character than the longest key, so a longer key doesn't match
+                if( parserPtr->keyLength < ( SETTING_KEY_BUFFER_SIZE - 1U ) )
+                {
+                    parserPtr->key[parserPtr->keyLength] = c;
+                    ++parserPtr->keyLength;
+                }
             }
-            while( remainingTime >= ( 60LL ) ) // Minutes
+            break;
+        }
+        case e_parseState_beforeValue:
+        {
+            if( c == '"' )
             {
-                remainingTime -= 60LL;
-                militaryTime += 1;
+                parserPtr->state = e_parseState_value;
+                parserPtr->valueLength = 0U;
             }
-
-            if( isTextBufferEmpty == true )
+            else if( c == '\n' )
+                parserPtr->state = e_parseState_lineStart;
+            else if( ( c != ' ' ) && ( c != '\t' ) )
+                parserPtr->state = e_parseState_skipLine;
+            break;
+        }
+        case e_parseState_value:
+        {
+            if( c == '\\' )
+                parserPtr->state = e_parseState_valueEscape;
+            else if( c == '"' )
             {
-                snprintf( textBuffer, sizeof(textBuffer), "%04d", militaryTime );
-                isTextBufferEmpty = false;
-                stringLength += 4;
+                m_parseValue( parserPtr, sdCardSettingsPtr );
+                parserPtr->state = e_parseState_skipLine;
             }
-            else
+            else if( c == '\n' )
             {
-                // Copy from textBuffer into the temporary buffer
-                strncpy( tempTextBuffer, textBuffer, SD_CARD_WRITE_BUFFER_SIZE );
-                // Format the temp buffer back into text buffer
-                snprintf( textBuffer, sizeof(textBuffer), "%s,%04d", tempTextBuffer, militaryTime );
-                stringLength += 5;
+                // The closing quote mark is missing
+                if( parserPtr->keyIndex >= 0 )
+                    parserPtr->error = 5;
+                parserPtr->state = e_parseState_lineStart;
             }
-            if( stringLength >= sizeof(textBuffer) )
+            else if( parserPtr->keyIndex >= 0 )
             {
-                break;
+                // Bear in mind we need space for a 0 at the end of the buffer
+                if( parserPtr->valueLength >= ( CURRENT_SETTING_BUFFER_SIZE - 1U ) )
+                    parserPtr->error = 4;
+                else
+                {
+                    parserPtr->value[parserPtr->valueLength] = c;
+                    ++parserPtr->valueLength;
+                }
+            }
+            break;
+        }
+        case e_parseState_valueEscape:
+        {
+            parserPtr->state = e_parseState_value;
+            if( parserPtr->keyIndex >= 0 )
+            {
+                if( parserPtr->valueLength >= ( CURRENT_SETTING_BUFFER_SIZE - 1U ) )
+                    parserPtr->error = 4;
+                else
+                {
+                    parserPtr->value[parserPtr->valueLength] = c;
+                    ++parserPtr->valueLength;
+                }
             }
+            break;
         }
-        printf(textBuffer);
-        printf("\n");
     }
+}
 
-    strncpy( tempTextBuffer, textBuffer, SD_CARD_WRITE_BUFFER_SIZE );
-    snprintf( textBuffer, sizeof( textBuffer ), "WATERING TIMES: \"%s\"\r\n", tempTextBuffer );
-    if( ( f_printf( &fil, textBuffer ) < 0 ) )
-        return 6;
+/*
+ * Function: m_parseKey
+ * --------------------
+ * Look up the key the parser has just read, up to the colon
+ *
+ * parserPtr: The parser, parserPtr->keyIndex is set
+ *
+ * returns: void
+ */
+static void m_parseKey( t_settingsParser* parserPtr )
+{
+    // Remove any spaces between the key and the colon
+    while( ( parserPtr->keyLength > 0U ) &&
+           ( ( parserPtr->key[parserPtr->keyLength - 1U] == ' ' ) || ( parserPtr->key[parserPtr->keyLength - 1U] == '\t' ) ) )
+    {
+        --parserPtr->keyLength;
+    }
+    parserPtr->key[parserPtr->keyLength] = 0;
 
-    snprintf( textBuffer, sizeof( textBuffer ), "WATERING DURATION MS: \"%d\"\r\n", globalDataPtr->sdCardSettings.wateringDurationMs );
-    if( ( f_printf( &fil, textBuffer ) < 0 ) )
-        return 7;
+    parserPtr->keyIndex = -1;
+    for( uint8_t index = 0U; index < NUMBER_OF_SETTINGS; index++ )
+    {
+        if( strcmp( parserPtr->key, m_settingDescriptors[index].key ) == 0 )
+        {
+            parserPtr->keyIndex = (int8_t) index;
+            break;
+        }
+    }
+}
+
+/*
+ * Function: m_parseValue
+ * --------------------
+ * Read the value the parser has just read into its field, checking it against
+ * its descriptor. If the same key is in the file more than once, the last one
+ * is used
+ *
+ * parserPtr: The parser
+ * sdCardSettingsPtr: Where the setting goes
+ *
+ * returns: void
+ */
+static void m_parseValue( t_settingsParser* parserPtr, t_sdCardSettings* sdCardSettingsPtr )
+{
+    if( parserPtr->keyIndex < 0 )
+        return;
 
-    fr = f_close( &fil );
-    if( fr != FR_OK )
+    const t_settingDescriptor* descriptorPtr = &m_settingDescriptors[parserPtr->keyIndex];
+    uint8_t* fieldPtr = (uint8_t*) sdCardSettingsPtr + descriptorPtr->offset;
+    int result = 1;
+
+    parserPtr->value[parserPtr->valueLength] = 0;
+    switch( descriptorPtr->type )
     {
-        f_unmount( "0:" );
-        return 8;
+        case e_settingType_string:
+            result = m_readString( descriptorPtr, (char*) fieldPtr, parserPtr->value );
+            break;
+        case e_settingType_militaryTimes:
+            result = m_readMilitaryTimes( descriptorPtr, (int32_t*) fieldPtr, parserPtr->value );
+            break;
+        case e_settingType_uint16:
+            result = m_readUint16( descriptorPtr, (uint16_t*) fieldPtr, parserPtr->value );
+            break;
     }
 
-    // Unmount the SD card
-    f_unmount( "0:" );
+    if( result != 0 )
+        parserPtr->error = 5;
+    else
+        parserPtr->foundSettings |= (uint8_t) ( 1U << parserPtr->keyIndex );
+}
+
+/*
+ * Function: m_readString
+ * --------------------
+ * Copy a string setting, checking it fits
+ *
+ * descriptorPtr: The setting, count is the size of the field
+ * field: Where it goes
+ * value: The text within the quote marks
+ *
+ * returns: int 0 on success
+ *              1 on fail because it is too long
+ */
+static int m_readString( const t_settingDescriptor* descriptorPtr, char field[], const char value[] )
+{
+    size_t length = strlen( value );
 
+    if( length >= descriptorPtr->count )
+        return 1;
+    memcpy( field, value, length + 1U );
     return 0;
 }
 
-int m_readSetting( t_globalData* globalDataPtr, t_sdCardReadCurrentSetting currentSetting, const char settingsBuffer[] )
+/*
+ * Function: m_readMilitaryTimes
+ * --------------------
+ * Read times in 4 digit military time, comma delimited with no spaces, e.g.
+ * "0700,1815". They are stored as seconds since midnight, in ascending order,
+ * with -1 for the unused ones
+ *
+ * descriptorPtr: The setting, count is the number of elements in the field
+ * field: Where the times go
+ * value: The text within the quote marks
+ *
+ * returns: int 0 on success
+ *              1 on fail because there are no times, too many, or one isn't a time
+ */
+static int m_readMilitaryTimes( const t_settingDescriptor* descriptorPtr, int32_t field[], const char value[] )
 {
-    if( currentSetting == e_wifiSsid )
+    int32_t times[MAX_NUMBER_OF_WATERING_TIMES];
+    uint8_t numberOfTimes = 0U;
+    const char* textPtr = value;
+
+    while( true )
     {
-        bool stringWasTerminated = false;
-        // Copy the settingBuffer string to the global data struct
-        // Also ensure the string in the buffer is terminated with a 0
-        for( uint8_t index = 0U; index < CURRENT_SETTING_BUFFER_SIZE; index++ )
+        for( uint8_t index = 0U; index < 4U; index++ )
         {
-            if( index >= WIFI_SSID_MAX_LEN )
-            {
-                // Outside of wifiSsid string bounds, error
-                return 1;
-            }
-            globalDataPtr->sdCardSettings.wifiSsid[index] = settingsBuffer[index];
-            if( settingsBuffer[index] == 0 )
-            {
-                stringWasTerminated = true;
-                break;
-            }
+            if( m_charIsNumber( textPtr[index] ) == false )
+                return 1; // A character was not a number, or the string ended
         }
-        if( stringWasTerminated == false )
+        uint32_t hours = ( (uint32_t) ( textPtr[0] - '0' ) * 10U ) + (uint32_t) ( textPtr[1] - '0' );
+        uint32_t minutes = ( (uint32_t) ( textPtr[2] - '0' ) * 10U ) + (uint32_t) ( textPtr[3] - '0' );
+        uint32_t time = ( hours * 60U * 60U ) + ( minutes * 60U );
+        if( ( minutes >= 60U ) || ( time < descriptorPtr->minimum ) || ( time > descriptorPtr->maximum ) ||
+            ( numberOfTimes >= descriptorPtr->count ) || ( numberOfTimes >= MAX_NUMBER_OF_WATERING_TIMES ) )
         {
-            // Bad news, never reached the end of the string
             return 1;
         }
-    }
-    else if( currentSetting == e_wifiPassword )
-    {
-        bool stringWasTerminated = false;
-        // Copy the settingBuffer string to the global data struct
-        // Also ensure the string in the buffer is terminated with a 0
-        for( uint8_t index = 0U; index < CURRENT_SETTING_BUFFER_SIZE; index++ )
+
+        // Insert it in ascending order
+        uint8_t index = numberOfTimes;
+        while( ( index > 0U ) && ( times[index - 1U] > (int32_t) time ) )
         {
-            if( index >= WIFI_PASSWORD_MAX_LEN )
-            {
-                // Outside of wifiPassword string bounds, error
-                return 1;
-            }
-            globalDataPtr->sdCardSettings.wifiPassword[index] = settingsBuffer[index];
-            if( settingsBuffer[index] == 0 )
-            {
-                stringWasTerminated = true;
-                break;
-            }
+            times[index] = times[index - 1U];
+            --index;
         }
-        if( stringWasTerminated == false )
-        {
-            // Never reached the end of the string
+        times[index] = (int32_t) time;
+        ++numberOfTimes;
+
+        textPtr += 4;
+        if( *textPtr == 0 )
+            break;
+        if( *textPtr != ',' )
             return 1;
-        }
+        ++textPtr;
     }
-    else if( currentSetting == e_wateringTimes )
-    {
-        // Should be in 4 digit military time, comma delimited
-        // Convert 24 hour time into minutes since midnight 
 
-        // Find the end of the string
-        int16_t bufferIndex;
-        for( bufferIndex = 0; bufferIndex < CURRENT_SETTING_BUFFER_SIZE; bufferIndex++ )
-        {
-            if( settingsBuffer[bufferIndex] == 0 )
-                break;
-        }
-        // Now read the string backwards
-        uint8_t wateringTimesIndex = 0U;
-        int32_t wateringTimes[MAX_NUMBER_OF_WATERING_TIMES];
-        // Initialise all values of wateringTimes with -1
-        for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
-            wateringTimes[index] = -1;
-        
-        bool hasFoundValue = false;
-        --bufferIndex; // Move index back onto a value
-        while( bufferIndex >= 3 )
-        {
-            // Check the next (in reverse) 4 characters are numbers
-            if( ( m_charIsNumber( settingsBuffer[bufferIndex] ) == false ) ||
-                ( m_charIsNumber( settingsBuffer[bufferIndex - 1] == false ) ) ||
-                ( m_charIsNumber( settingsBuffer[bufferIndex - 2] ==false ) ) ||
-                ( m_charIsNumber( settingsBuffer[bufferIndex - 3] ==false ) ) )
-            {
-                return 1; // A character was not a number
-            }
+    for( uint8_t index = 0U; index < descriptorPtr->count; index++ )
+        field[index] = ( index < numberOfTimes ) ? times[index] : -1;
+    return 0;
+}
 
-            hasFoundValue = true;
-            wateringTimes[wateringTimesIndex] = ( ( (int32_t) settingsBuffer[bufferIndex] - 48) * 60 ) +
-                                                ( ( (int32_t) settingsBuffer[bufferIndex - 1] - 48 ) * 10 * 60 ) +
-                                                ( ( (int32_t) settingsBuffer[bufferIndex - 2] - 48 ) * 60 * 60 ) +
-                                                ( ( (int32_t) settingsBuffer[bufferIndex - 3] - 48 ) * 10 * 60 * 60 );
+/*
+ * Function: m_readUint16
+ * --------------------
+ * Read a number setting, checking it is within its bounds
+ *
+ * descriptorPtr: The setting
+ * fieldPtr: Where it goes
+ * value: The text within the quote marks
+ *
+ * returns: int 0 on success
+ *              1 on fail because it isn't a number, or is out of bounds
+ */
+static int m_readUint16( const t_settingDescriptor* descriptorPtr, uint16_t* fieldPtr, const char value[] )
+{
+    uint32_t runningCount = 0U;
 
-            ++wateringTimesIndex;
-            if( wateringTimesIndex == MAX_NUMBER_OF_WATERING_TIMES )
-                break;
+    if( value[0] == 0 )
+        return 1;
+    for( uint8_t index = 0U; value[index] != 0; index++ )
+    {
+        if( m_charIsNumber( value[index] ) == false )
+            return 1;
+        runningCount = ( runningCount * 10U ) + (uint32_t) ( value[index] - '0' );
+        if( runningCount > descriptorPtr->maximum )
+            return 1;
+    }
+    if( runningCount < descriptorPtr->minimum )
+        return 1;
 
-            bufferIndex -= 5;
-        }
+    *fieldPtr = (uint16_t) runningCount;
+    return 0;
+}
+
+/*
+ * Function: m_writeSetting
+ * --------------------
+ * Add the line of settings.txt for a setting, KEY: "value" then \r\n.
+ * Quote marks and backslashes in strings are escaped with a backslash, so
+ * m_parseCharacter reads them back the same. Times which are unused or out of
+ * bounds are left out
+ *
+ * descriptorPtr: The setting
+ * sdCardSettingsPtr: The settings
+ * textPtr: Where the line goes, textPtr->isOverfull is set if it didn't fit
+ *
+ * returns: void
+ */
+static void m_writeSetting( const t_settingDescriptor* descriptorPtr, const t_sdCardSettings* sdCardSettingsPtr, t_settingsText* textPtr )
+{
+    const uint8_t* fieldPtr = (const uint8_t*) sdCardSettingsPtr + descriptorPtr->offset;
+
+    m_textAppend( textPtr, descriptorPtr->key, strlen( descriptorPtr->key ) );
+    m_textAppend( textPtr, ": \"", 3U );
 
-        if( hasFoundValue == false )
+    switch( descriptorPtr->type )
+    {
+        case e_settingType_string:
         {
-            // No watering times
-            return 1;
+            const char* text = (const char*) fieldPtr;
+            for( uint16_t index = 0U; ( index < descriptorPtr->count ) && ( text[index] != 0 ); index++ )
+            {
+                if( ( text[index] == '"' ) || ( text[index] == '\\' ) )
+                    m_textAppend( textPtr, "\\", 1U );
+                m_textAppend( textPtr, &text[index], 1U );
+            }
+            break;
         }
-
-        // Now move values from wateringTimes into globalDataPtr->wateringTimes, in ascendinging order
-        int32_t currentMinimum;
-        uint8_t minimumValueIndex;
-        wateringTimesIndex = 0U;
-        for( uint8_t loop = 0U; loop < MAX_NUMBER_OF_WATERING_TIMES; loop++ )
+        case e_settingType_militaryTimes:
         {
-            currentMinimum = -1;
-
-            for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
+            const int32_t* times = (const int32_t*) fieldPtr;
+            bool isFirst = true;
+            for( uint16_t index = 0U; index < descriptorPtr->count; index++ )
             {
-                if( wateringTimes[index] >= 0 )
+                if( ( times[index] < 0 ) || ( (uint32_t) times[index] < descriptorPtr->minimum ) ||
+                    ( (uint32_t) times[index] > descriptorPtr->maximum ) )
                 {
-                    if( ( currentMinimum == -1 ) || ( wateringTimes[index] < currentMinimum ) )
-                    {
-                        currentMinimum = wateringTimes[index];
-                        minimumValueIndex = index;
-                    }
+                    continue;
                 }
+                if( isFirst == false )
+                    m_textAppend( textPtr, ",", 1U );
+                isFirst = false;
+                // Seconds since midnight to military time
+                uint32_t minutesSinceMidnight = (uint32_t) times[index] / 60U;
+                m_textAppendNumber( textPtr, ( ( minutesSinceMidnight / 60U ) * 100U ) + ( minutesSinceMidnight % 60U ), 4U );
             }
-
-            if( currentMinimum == -1 )
-                break;
-
-            globalDataPtr->sdCardSettings.wateringTimes[wateringTimesIndex] = currentMinimum;
-            wateringTimes[minimumValueIndex] = -1;
-            ++wateringTimesIndex;
+            break;
         }
-        // Fill the rest of the values with -1
-        while( wateringTimesIndex < MAX_NUMBER_OF_WATERING_TIMES )
+        case e_settingType_uint16:
         {
-            globalDataPtr->sdCardSettings.wateringTimes[wateringTimesIndex] = -1;
-            ++wateringTimesIndex;
+            m_textAppendNumber( textPtr, *(const uint16_t*) fieldPtr, 1U );
+            break;
         }
     }
-    else if( currentSetting == e_wateringDuration )
-    {
-        // Find the end of the string
-        uint8_t bufferIndex = 0U;
-        while( settingsBuffer[bufferIndex] != 0 )
-        {
-            ++bufferIndex;
-            if( bufferIndex >= CURRENT_SETTING_BUFFER_SIZE )
-                return 1;
-        }
-        if( bufferIndex == 0 )
-            return 1;
 
-        // Scroll back a character
-        --bufferIndex;
-        // Do stuff
-        uint16_t powerOfTen = 1U;
-        uint16_t runningCount = 0U;
-        while( true )
-        {
-            if( m_charIsNumber( settingsBuffer[bufferIndex] ) == false )
-                return 1;
+    m_textAppend( textPtr, "\"\r\n", 3U );
+}
 
-            runningCount += powerOfTen * ( settingsBuffer[bufferIndex] - 48 );
-            powerOfTen *= 10;
+/*
+ * Function: m_textAppend
+ * --------------------
+ * Add text to the end of the file being built
+ *
+ * textPtr: The file
+ * text: The text
+ * length: Number of characters of text
+ *
+ * returns: void
+ */
+static void m_textAppend( t_settingsText* textPtr, const char text[], size_t length )
+{
+    if( ( textPtr->length + length ) > textPtr->size )
+    {
+        textPtr->isOverfull = true;
+        return;
+    }
+    memcpy( &( textPtr->text[textPtr->length] ), text, length );
+    textPtr->length += length;
+}
 
-            if( bufferIndex == 0U )
-                break;
-            
-            --bufferIndex;
-        }
+/*
+ * Function: m_textAppendNumber
+ * --------------------
+ * Add a number in decimal to the end of the file being built
+ *
+ * textPtr: The file
+ * number: The number
+ * minimumDigits: Padded with 0s to at least this many digits
+ *
+ * returns: void
+ */
+static void m_textAppendNumber( t_settingsText* textPtr, uint32_t number, uint8_t minimumDigits )
+{
+    char digits[10]; // Enough for any uint32_t
+    uint8_t numberOfDigits = 0U;
 
-        globalDataPtr->sdCardSettings.wateringDurationMs = runningCount;
-    }
+    // Fill from the end
+    do
+    {
+        ++numberOfDigits;
+        digits[sizeof( digits ) - numberOfDigits] = (char) ( '0' + ( number % 10U ) );
+        number /= 10U;
+    } while( ( ( number > 0U ) || ( numberOfDigits < minimumDigits ) ) && ( numberOfDigits < sizeof( digits ) ) );
 
-    return 0;
+    m_textAppend( textPtr, &digits[sizeof( digits ) - numberOfDigits], numberOfDigits );
 }
 
 static inline bool m_charIsNumber( char c )
@@ -3,13 +3,66 @@
 
 #include "pico/stdlib.h"
 
-#include "sd_card.h"
-#include "ff.h"
+#include "storage.hpp"
 
 #include "settings.hpp"
 
+// Bits returned by settings_checkForChanges
+#define SETTINGS_CHANGED_WIFI     ( 0x01U ) // wifiSsid or wifiPassword
+#define SETTINGS_CHANGED_WATERING ( 0x02U ) // wateringTimes or wateringDurationMs
+
+/*
+ * Function: settings_readFromSDCard
+ * --------------------
+ * Read settings.txt into globalDataPtr->sdCardSettings. Each line is
+ * KEY: "value", in any order, see m_settingDescriptors in settings_reader.cpp.
+ * The settings are only changed if the whole file was read successfully
+ *
+ * globalDataPtr: Where the settings go
+ *
+ * returns: int 0 on success
+ *              1 or 2 on fail from storage_open
+ *              3 on fail because the file couldn't be closed
+ *              4 on fail because a value was too long
+ *              5 on fail because a value wasn't valid
+ *              6 on fail because a setting was missing
+ *              7 on fail because the file couldn't be read
+ */
 int settings_readFromSDCard( t_globalData* globalDataPtr );
 
+/*
+ * Function: settings_writeToSDCard
+ * --------------------
+ * Write globalDataPtr->sdCardSettings to settings.txt, so that
+ * settings_readFromSDCard reads back the same settings. The whole file is
+ * written to settings.tmp in one f_write, synced, then renamed over
+ * settings.txt, so a power cut leaves either the old file or the new one
+ *
+ * globalDataPtr: The settings
+ *
+ * returns: int 0 on success
+ *              1 or 2 on fail from storage_open
+ *              3 on fail because settings.tmp couldn't be written
+ *              4 on fail because the settings didn't fit in the buffer
+ *              5 on fail because settings.txt couldn't be replaced
+ *              100 on fail because the settings weren't read from the SD card
+ */
 int settings_writeToSDCard( t_globalData* globalDataPtr );
 
+/*
+ * Function: settings_checkForChanges
+ * --------------------
+ * See if settings.txt has been changed since it was last read or written, e.g.
+ * the card was taken out and edited on a PC, from its size and modified time.
+ * Only the directory is read, unless it has changed, then it is read again
+ * with settings_readFromSDCard. Sets globalDataPtr->hardwareData.settingsReadOk
+ * if it was read
+ *
+ * globalDataPtr: Where the settings go
+ *
+ * returns: uint8_t SETTINGS_CHANGED_ bits for the settings which are different
+ *                  now, 0 if nothing changed or settings.txt couldn't be read
+ */
+uint8_t settings_checkForChanges( t_globalData* globalDataPtr );
+
 #endif
@@ -0,0 +1,860 @@
+/* Runs FatFs on a RAM disk, through the sector cache in sd_driver/sector_cache.c
+ * the same way glue.c does, and prints how many commands and sectors each
+ * workload sends to the "card" with and without the cache, and with the cache
+ * reading ahead in the background like sd_read_blocks_start. The workloads are
+ * what the project does with the SD card: reading the settings and the icons
+ * at boot, drawing the icons again on each WiFi reconnection attempt, and
+ * writing the settings.
+ * The exit code is 1 if any file reads back different to what was written, or
+ * if a random mix of reads, writes and syncs straight through the cache ever
+ * reads back something different to a plain copy of the disk.
+ * It also writes random settings with settings_writeToSDCard and checks
+ * settings_readFromSDCard reads them back the same, including from
+ * settings.tmp when settings.txt is missing, checks settings_checkForChanges
+ * only reads settings.txt again after it's edited, then reads randomly damaged
+ * copies of settings.txt, checking anything accepted is in bounds.
+ *
+ * usage: storage_bench */
+
+#include "ff.h"
+#include "diskio.h"
+#include "sector_cache.h"
+#include "settings_reader.hpp"
+#include "storage.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* --- PREPROCESSOR -----------------------------------------------------------*/
+// 16 MB, big enough for FAT16
+#define BENCH_SECTORS           ( 32768U )
+#define BENCH_SECTOR_SIZE       ( 512U )
+// The same size as oled.cpp reads images in
+#define BENCH_READ_SIZE         ( 512U )
+#define BENCH_MAX_FILE_SIZE     ( 16384U )
+#define BENCH_RECONNECTIONS     ( 3U )
+// Random operations, on sectors below BENCH_STRESS_SECTORS
+#define BENCH_STRESS_OPERATIONS ( 100000U )
+#define BENCH_STRESS_SECTORS    ( 64U )
+#define BENCH_STRESS_MAX_COUNT  ( 4U )
+// Random settings written and read back, and damaged copies of settings.txt read
+#define BENCH_SETTINGS_ROUND_TRIPS ( 1000U )
+#define BENCH_SETTINGS_DAMAGED     ( 10000U )
+#define BENCH_SETTINGS_DAMAGES     ( 4U ) // Characters changed in each copy
+
+/* --- MODULE SCOPE VARIABLES ------------------------------------------------- */
+typedef struct
+{
+    uint32_t commands;
+    uint32_t sectorsRead;
+    uint32_t sectorsWritten;
+} t_diskStats;
+
+// A background read, which only arrives when it is finished
+typedef struct
+{
+    bool isPending;
+    uint8_t* buffer;
+    uint64_t sector;
+    uint32_t count;
+} t_diskAsyncRead;
+
+static uint8_t m_disk[BENCH_SECTORS][BENCH_SECTOR_SIZE];
+static t_diskStats m_diskStats;
+static t_diskAsyncRead m_diskAsyncRead;
+static sector_cache_t m_cache;
+static bool m_isCacheUsed = false;
+static bool m_isAsyncUsed = false;
+static bool m_isWrong = false;
+static bool m_isSettingsWritten = false;
+
+// What the project reads from the card, from sd_card/
+static const char* const m_imageFilenames[] = { "wifi64.oimg", "cross64.oimg", "tick64.oimg" };
+static const char m_settingsFilename[] = "settings.txt";
+
+/* --- MODULE SCOPE FUNCTION PROTOTYPES --------------------------------------- */
+static int m_diskReadBlocks( void* context, uint8_t* buffer, uint64_t sector, uint32_t count );
+static int m_diskWriteBlocks( void* context, const uint8_t* buffer, uint64_t sector, uint32_t count );
+static int m_diskReadBlocksStart( void* context, uint8_t* buffer, uint64_t sector, uint32_t count );
+static int m_diskReadBlocksFinish( void* context );
+static bool m_diskIsBusy( void );
+static void m_cacheInit( void );
+static size_t m_loadHostFile( const char filename[], uint8_t data[] );
+static void m_copyToDisk( const char filename[] );
+static void m_readFile( const char filename[] );
+static void m_readSettings( void );
+static void m_writeSettings( void );
+static void m_benchBegin( void );
+static void m_benchEnd( const char name[] );
+static void m_stress( bool isAsyncUsed );
+static void m_settingsRoundTrip( void );
+static void m_settingsRandomise( t_sdCardSettings* sdCardSettingsPtr );
+static void m_settingsRandomString( char text[], size_t size );
+static bool m_settingsAreEqual( const t_sdCardSettings* writtenPtr, const t_sdCardSettings* readPtr );
+static bool m_settingsAreInBounds( const t_sdCardSettings* sdCardSettingsPtr );
+
+/* --- MAIN ------------------------------------------------------------------- */
+
+int main( void )
+{
+    static uint8_t work[FF_MAX_SS];
+    const MKFS_PARM format = { FM_FAT, 0U, 0U, 0U, 0U };
+    FATFS fs;
+
+    if( f_mkfs( "0:", &format, work, sizeof( work ) ) != FR_OK )
+    {
+        printf( "Couldn't format the RAM disk\n" );
+        return 1;
+    }
+    f_mount( &fs, "0:", 1 );
+    for( size_t index = 0U; index < ( sizeof( m_imageFilenames ) / sizeof( m_imageFilenames[0] ) ); index++ )
+        m_copyToDisk( m_imageFilenames[index] );
+    m_copyToDisk( m_settingsFilename );
+    f_unmount( "0:" );
+
+    printf( "%-20s %5s %8s %8s %8s %6s %6s %6s %6s %6s\n", "test", "cache", "commands", "read", "written",
+        "hits", "misses", "ahead", "waits", "wback" );
+
+    for( uint8_t pass = 0U; pass < 3U; pass++ )
+    {
+        m_isCacheUsed = ( pass >= 1U );
+        m_isAsyncUsed = ( pass == 2U );
+
+        // Like smInit then smWifi, the card stays mounted between them, see storage.cpp
+        m_benchBegin();
+        f_mount( &fs, "0:", 1 );
+        m_readSettings();
+        m_readFile( m_imageFilenames[0] );
+        m_readFile( m_imageFilenames[1] );
+        m_benchEnd( "boot" );
+
+        m_benchBegin();
+        for( uint8_t attempt = 0U; attempt < BENCH_RECONNECTIONS; attempt++ )
+        {
+            m_readFile( m_imageFilenames[0] );
+            m_readFile( m_imageFilenames[2] );
+        }
+        m_benchEnd( "wifi_reconnections" );
+
+        m_benchBegin();
+        m_writeSettings();
+        m_benchEnd( "settings_write" );
+        f_unmount( "0:" );
+
+        // Mounting again empties the cache, so this checks what reached the disk
+        f_mount( &fs, "0:", 1 );
+        m_readSettings();
+        f_unmount( "0:" );
+    }
+
+    // Before m_stress, which leaves random data where the FAT was
+    m_settingsRoundTrip();
+    m_stress( false );
+    m_stress( true );
+
+    return m_isWrong ? 1 : 0;
+}
+
+/* --- DISKIO, LIKE GLUE.C ---------------------------------------------------- */
+
+DSTATUS disk_status( BYTE pdrv )
+{
+    (void) pdrv;
+    return 0;
+}
+
+DSTATUS disk_initialize( BYTE pdrv )
+{
+    (void) pdrv;
+    m_cacheInit();
+    return 0;
+}
+
+DRESULT disk_read( BYTE pdrv, BYTE* buff, LBA_t sector, UINT count )
+{
+    (void) pdrv;
+    if( m_isCacheUsed )
+        return ( sector_cache_read( &m_cache, buff, sector, count ) == 0 ) ? RES_OK : RES_ERROR;
+    return ( m_diskReadBlocks( NULL, buff, sector, count ) == 0 ) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_write( BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count )
+{
+    (void) pdrv;
+    if( m_isCacheUsed )
+        return ( sector_cache_write( &m_cache, buff, sector, count ) == 0 ) ? RES_OK : RES_ERROR;
+    return ( m_diskWriteBlocks( NULL, buff, sector, count ) == 0 ) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_ioctl( BYTE pdrv, BYTE cmd, void* buff )
+{
+    (void) pdrv;
+    switch( cmd )
+    {
+        case GET_SECTOR_COUNT:
+            *(LBA_t*) buff = BENCH_SECTORS;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD*) buff = 1U;
+            return RES_OK;
+        case CTRL_SYNC:
+            if( m_isCacheUsed )
+                return ( sector_cache_sync( &m_cache ) == 0 ) ? RES_OK : RES_ERROR;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+DWORD get_fattime( void )
+{
+    // 2024-01-01 00:00:00
+    return ( (DWORD) ( 2024 - 1980 ) << 25 ) | ( (DWORD) 1 << 21 ) | ( (DWORD) 1 << 16 );
+}
+
+/* --- MODULE SCOPE FUNCTIONS ------------------------------------------------- */
+
+/*
+ * Function: m_diskReadBlocks
+ * --------------------
+ * The sector_cache_backend_t read, one command to the RAM disk
+ *
+ * context: Not used
+ * buffer: Where the sectors go
+ * sector: First sector
+ * count: Number of sectors
+ *
+ * returns: int 0 on success, -1 if the sectors are off the end of the disk
+ */
+static int m_diskReadBlocks( void* context, uint8_t* buffer, uint64_t sector, uint32_t count )
+{
+    (void) context;
+    if( ( ( sector + count ) > BENCH_SECTORS ) || m_diskIsBusy() )
+        return -1;
+
+    memcpy( buffer, m_disk[sector], (size_t) count * BENCH_SECTOR_SIZE );
+    ++m_diskStats.commands;
+    m_diskStats.sectorsRead += count;
+    return 0;
+}
+
+/*
+ * Function: m_diskWriteBlocks
+ * --------------------
+ * The sector_cache_backend_t write, one command to the RAM disk
+ *
+ * context: Not used
+ * buffer: The sectors
+ * sector: First sector
+ * count: Number of sectors
+ *
+ * returns: int 0 on success, -1 if the sectors are off the end of the disk
+ */
+static int m_diskWriteBlocks( void* context, const uint8_t* buffer, uint64_t sector, uint32_t count )
+{
+    (void) context;
+    if( ( ( sector + count ) > BENCH_SECTORS ) || m_diskIsBusy() )
+        return -1;
+
+    memcpy( m_disk[sector], buffer, (size_t) count * BENCH_SECTOR_SIZE );
+    ++m_diskStats.commands;
+    m_diskStats.sectorsWritten += count;
+    return 0;
+}
+
+/*
+ * Function: m_diskReadBlocksStart
+ * --------------------
+ * The sector_cache_backend_t background read. Nothing arrives in the buffer
+ * until m_diskReadBlocksFinish, so the cache using it too early is caught
+ *
+ * context: Not used
+ * buffer: Where the sectors go
+ * sector: First sector
+ * count: Number of sectors
+ *
+ * returns: int 0 on success, -1 if the sectors are off the end of the disk
+ */
+static int m_diskReadBlocksStart( void* context, uint8_t* buffer, uint64_t sector, uint32_t count )
+{
+    (void) context;
+    if( ( ( sector + count ) > BENCH_SECTORS ) || m_diskIsBusy() )
+        return -1;
+
+    m_diskAsyncRead = ( t_diskAsyncRead ) { true, buffer, sector, count };
+    ++m_diskStats.commands;
+    m_diskStats.sectorsRead += count;
+    return 0;
+}
+
+/*
+ * Function: m_diskReadBlocksFinish
+ * --------------------
+ * Finish the read from m_diskReadBlocksStart
+ *
+ * context: Not used
+ *
+ * returns: int 0 on success, -1 if there isn't one
+ */
+static int m_diskReadBlocksFinish( void* context )
+{
+    (void) context;
+    if( !m_diskAsyncRead.isPending )
+    {
+        printf( "Finished a background read which wasn't started\n" );
+        m_isWrong = true;
+        return -1;
+    }
+
+    memcpy( m_diskAsyncRead.buffer, m_disk[m_diskAsyncRead.sector],
+        (size_t) m_diskAsyncRead.count * BENCH_SECTOR_SIZE );
+    m_diskAsyncRead.isPending = false;
+    return 0;
+}
+
+/*
+ * Function: m_diskIsBusy
+ * --------------------
+ * Check nothing is sent to the RAM disk while a background read is going, the
+ * SD card can't do that either
+ *
+ * parameters: none
+ *
+ * returns: bool true if a background read is going, which is a bug in the cache
+ */
+static bool m_diskIsBusy( void )
+{
+    if( !m_diskAsyncRead.isPending )
+        return false;
+
+    printf( "Sent a command while a background read was going\n" );
+    m_isWrong = true;
+    return true;
+}
+
+/*
+ * Function: m_cacheInit
+ * --------------------
+ * Start the cache empty, with or without background reads from m_isAsyncUsed
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_cacheInit( void )
+{
+    sector_cache_backend_t backend = { NULL, m_diskReadBlocks, m_diskWriteBlocks, NULL, NULL };
+
+    if( m_isAsyncUsed )
+    {
+        backend.read_blocks_start = m_diskReadBlocksStart;
+        backend.read_blocks_finish = m_diskReadBlocksFinish;
+    }
+    // A background read left over from before is finished as if by sd_init
+    if( m_diskAsyncRead.isPending )
+        m_diskReadBlocksFinish( NULL );
+    sector_cache_init( &m_cache, &backend, BENCH_SECTORS );
+}
+
+/*
+ * Function: m_loadHostFile
+ * --------------------
+ * Read a file in sd_card/ on the PC
+ *
+ * filename: Name of the file
+ * data: Where it goes, BENCH_MAX_FILE_SIZE bytes
+ *
+ * returns: size_t its size, 0 if it couldn't be read
+ */
+static size_t m_loadHostFile( const char filename[], uint8_t data[] )
+{
+    char path[256];
+    FILE* filePtr;
+    size_t size;
+
+    snprintf( path, sizeof( path ), "%s/%s", STORAGE_HOST_SD_CARD_DIRECTORY, filename );
+    filePtr = fopen( path, "rb" );
+    if( filePtr == NULL )
+        return 0U;
+    size = fread( data, 1U, BENCH_MAX_FILE_SIZE, filePtr );
+    fclose( filePtr );
+    return size;
+}
+
+/*
+ * Function: m_copyToDisk
+ * --------------------
+ * Copy a file in sd_card/ onto the RAM disk
+ *
+ * filename: Name of the file
+ *
+ * returns: void
+ */
+static void m_copyToDisk( const char filename[] )
+{
+    static uint8_t data[BENCH_MAX_FILE_SIZE];
+    size_t size = m_loadHostFile( filename, data );
+    FIL fil;
+    UINT length;
+
+    if( ( size == 0U ) || ( f_open( &fil, filename, FA_WRITE | FA_CREATE_ALWAYS ) != FR_OK ) ||
+        ( f_write( &fil, data, (UINT) size, &length ) != FR_OK ) || ( length != size ) ||
+        ( f_close( &fil ) != FR_OK ) )
+    {
+        printf( "Couldn't copy %s onto the RAM disk\n", filename );
+        m_isWrong = true;
+    }
+}
+
+/*
+ * Function: m_readFile
+ * --------------------
+ * Read a file from the RAM disk the way oled_sdWriteImage does, and check it
+ * is the same as the one in sd_card/
+ *
+ * filename: Name of the file
+ *
+ * returns: void
+ */
+static void m_readFile( const char filename[] )
+{
+    static uint8_t expected[BENCH_MAX_FILE_SIZE];
+    static uint8_t data[BENCH_MAX_FILE_SIZE];
+    size_t expectedSize = m_loadHostFile( filename, expected );
+    size_t size = 0U;
+    FIL fil;
+    UINT length;
+
+    if( f_open( &fil, filename, FA_READ ) != FR_OK )
+    {
+        printf( "Couldn't open %s\n", filename );
+        m_isWrong = true;
+        return;
+    }
+    do
+    {
+        length = 0U;
+        if( ( size + BENCH_READ_SIZE ) > sizeof( data ) )
+            break;
+        if( f_read( &fil, &data[size], BENCH_READ_SIZE, &length ) != FR_OK )
+            break;
+        size += length;
+    } while( length == BENCH_READ_SIZE );
+    f_close( &fil );
+
+    if( ( size != expectedSize ) || ( memcmp( data, expected, size ) != 0 ) )
+    {
+        printf( "%s read back wrong\n", filename );
+        m_isWrong = true;
+    }
+}
+
+/*
+ * Function: m_readSettings
+ * --------------------
+ * Read settings.txt from the RAM disk a line at a time, like
+ * settings_readFromSDCard, and check it is what m_writeSettings wrote, or the
+ * one in sd_card/ if it hasn't been written yet
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_readSettings( void )
+{
+    static char expected[BENCH_MAX_FILE_SIZE];
+    static char text[BENCH_MAX_FILE_SIZE];
+    char line[100];
+    size_t expectedSize;
+    size_t size = 0U;
+    FIL fil;
+
+    // m_writeSettings writes it with a \r\n after each line, f_gets keeps them
+    snprintf( expected, sizeof( expected ), "WIFI SSID: \"bench\"\r\nWATERING TIMES: \"0800,1800\"\r\n" );
+    expectedSize = strlen( expected );
+    if( !m_isSettingsWritten )
+        expectedSize = m_loadHostFile( m_settingsFilename, (uint8_t*) expected );
+
+    if( f_open( &fil, m_settingsFilename, FA_READ ) != FR_OK )
+    {
+        printf( "Couldn't open %s\n", m_settingsFilename );
+        m_isWrong = true;
+        return;
+    }
+    while( f_gets( line, sizeof( line ), &fil ) != NULL )
+    {
+        size_t length = strlen( line );
+        if( ( size + length ) > sizeof( text ) )
+            break;
+        memcpy( &text[size], line, length );
+        size += length;
+    }
+    f_close( &fil );
+
+    if( ( size != expectedSize ) || ( memcmp( text, expected, size ) != 0 ) )
+    {
+        printf( "%s read back wrong\n", m_settingsFilename );
+        m_isWrong = true;
+    }
+}
+
+/*
+ * Function: m_writeSettings
+ * --------------------
+ * Write settings.txt a line at a time, like settings_writeToSDCard
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_writeSettings( void )
+{
+    FIL fil;
+
+    if( ( f_open( &fil, m_settingsFilename, FA_WRITE | FA_CREATE_ALWAYS ) != FR_OK ) ||
+        ( f_printf( &fil, "WIFI SSID: \"%s\"\r\n", "bench" ) < 0 ) ||
+        ( f_printf( &fil, "WATERING TIMES: \"%s\"\r\n", "0800,1800" ) < 0 ) ||
+        ( f_close( &fil ) != FR_OK ) )
+    {
+        printf( "Couldn't write %s\n", m_settingsFilename );
+        m_isWrong = true;
+    }
+    m_isSettingsWritten = true;
+}
+
+/*
+ * Function: m_benchBegin
+ * --------------------
+ * Start counting what goes to the RAM disk
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_benchBegin( void )
+{
+    m_diskStats = ( t_diskStats ) { 0U, 0U, 0U };
+    m_cache.stats = ( sector_cache_stats_t ) { 0 };
+}
+
+/*
+ * Function: m_benchEnd
+ * --------------------
+ * Print what went to the RAM disk since m_benchBegin
+ *
+ * name: Name of the workload
+ *
+ * returns: void
+ */
+static void m_benchEnd( const char name[] )
+{
+    printf( "%-20s %5s %8u %8u %8u %6u %6u %6u %6u %6u\n", name,
+        m_isAsyncUsed ? "async" : ( m_isCacheUsed ? "on" : "off" ), m_diskStats.commands,
+        m_diskStats.sectorsRead, m_diskStats.sectorsWritten, m_cache.stats.hits, m_cache.stats.misses,
+        m_cache.stats.read_aheads, m_cache.stats.ahead_waits, m_cache.stats.write_backs );
+}
+
+/*
+ * Function: m_stress
+ * --------------------
+ * Do random reads, writes and syncs straight through the cache, checking every
+ * read against a plain copy of the disk, then check the disk after a sync.
+ * The first half of the sectors are pinned, as if they were a FAT
+ *
+ * isAsyncUsed: Whether the cache reads ahead in the background
+ *
+ * returns: void
+ */
+static void m_stress( bool isAsyncUsed )
+{
+    static uint8_t reference[BENCH_STRESS_SECTORS][BENCH_SECTOR_SIZE];
+    static uint8_t buffer[BENCH_STRESS_MAX_COUNT][BENCH_SECTOR_SIZE];
+    uint32_t wrongReads = 0U;
+    uint32_t nextSector = 0U;
+
+    srand( 1U );
+    m_isCacheUsed = true;
+    m_isAsyncUsed = isAsyncUsed;
+    m_cacheInit();
+    m_benchBegin();
+    memcpy( reference, m_disk, sizeof( reference ) );
+    m_cache.pinned_ranges[0].first = 0U;
+    m_cache.pinned_ranges[0].end = BENCH_STRESS_SECTORS / 2U;
+
+    for( uint32_t operation = 0U; operation < BENCH_STRESS_OPERATIONS; operation++ )
+    {
+        // Mostly single sectors, like FatFs
+        uint32_t count = ( ( rand() % 4 ) == 0 ) ? (uint32_t) ( rand() % BENCH_STRESS_MAX_COUNT ) + 1U : 1U;
+        uint32_t sector = (uint32_t) rand() % ( BENCH_STRESS_SECTORS - count + 1U );
+        int choice = rand() % 16;
+
+        // Often carry on from the last sector, so it reads ahead
+        if( ( ( rand() % 2 ) == 0 ) && ( ( nextSector + count ) <= BENCH_STRESS_SECTORS ) )
+            sector = nextSector;
+        nextSector = sector + count;
+
+        if( choice == 0 )
+        {
+            sector_cache_sync( &m_cache );
+        }
+        else if( choice < 6 )
+        {
+            for( uint32_t byte = 0U; byte < ( count * BENCH_SECTOR_SIZE ); byte++ )
+                buffer[0][byte] = (uint8_t) rand();
+            memcpy( reference[sector], buffer, (size_t) count * BENCH_SECTOR_SIZE );
+            sector_cache_write( &m_cache, buffer[0], sector, count );
+        }
+        else
+        {
+            sector_cache_read( &m_cache, buffer[0], sector, count );
+            if( memcmp( buffer, reference[sector], (size_t) count * BENCH_SECTOR_SIZE ) != 0 )
+                ++wrongReads;
+        }
+    }
+
+    sector_cache_sync( &m_cache );
+    m_benchEnd( "random_mix" );
+    if( ( wrongReads != 0U ) || ( memcmp( reference, m_disk, sizeof( reference ) ) != 0 ) )
+    {
+        printf( "random_mix: %u reads were wrong, the disk is %s\n", wrongReads,
+            ( memcmp( reference, m_disk, sizeof( reference ) ) != 0 ) ? "wrong" : "right" );
+        m_isWrong = true;
+    }
+}
+
+/*
+ * Function: m_settingsRoundTrip
+ * --------------------
+ * Write random settings through the cache and read them back, then read
+ * damaged copies of the file. The parser mustn't accept anything out of bounds
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+static void m_settingsRoundTrip( void )
+{
+    static char text[BENCH_MAX_FILE_SIZE];
+    t_globalData written = {};
+    t_globalData read = {};
+    uint32_t wrongRoundTrips = 0U;
+    uint32_t accepted = 0U;
+    uint32_t outOfBounds = 0U;
+    FIL fil;
+    UINT length;
+    UINT size;
+
+    srand( 2U );
+    m_isCacheUsed = true;
+    m_benchBegin();
+    written.hardwareData.settingsReadOk = true;
+    for( uint32_t roundTrip = 0U; roundTrip < BENCH_SETTINGS_ROUND_TRIPS; roundTrip++ )
+    {
+        m_settingsRandomise( &written.sdCardSettings );
+        read = {};
+        if( ( settings_writeToSDCard( &written ) != 0 ) || ( settings_readFromSDCard( &read ) != 0 ) ||
+            ( m_settingsAreEqual( &written.sdCardSettings, &read.sdCardSettings ) == false ) )
+        {
+            ++wrongRoundTrips;
+        }
+    }
+    m_benchEnd( "settings_round_trip" );
+
+    // As if the power was cut after settings.txt was removed, but before
+    // settings.tmp was renamed, the reader should fall back to settings.tmp
+    read = {};
+    if( ( storage_replace( "settings.tmp", m_settingsFilename ) != 0 ) ||
+        ( settings_readFromSDCard( &read ) != 0 ) ||
+        ( m_settingsAreEqual( &written.sdCardSettings, &read.sdCardSettings ) == false ) ||
+        ( storage_replace( m_settingsFilename, "settings.tmp" ) != 0 ) )
+    {
+        printf( "settings.tmp wasn't read when settings.txt was missing\n" );
+        m_isWrong = true;
+    }
+
+    // As if settings.txt was edited on a PC. The bench's clock doesn't move,
+    // so the edit changes the size
+    t_globalData edited = written;
+    strcpy( edited.sdCardSettings.wifiSsid, ( strlen( written.sdCardSettings.wifiSsid ) == 5U ) ? "bench!" : "bench" );
+    ++edited.sdCardSettings.wateringDurationMs;
+    if( ( settings_writeToSDCard( &edited ) != 0 ) || ( storage_open( &fil, m_settingsFilename, FA_READ ) != 0 ) ||
+        ( f_read( &fil, text, sizeof( text ), &size ) != FR_OK ) || ( storage_close( &fil ) != 0 ) ||
+        ( settings_writeToSDCard( &written ) != 0 ) )
+    {
+        printf( "Couldn't write the edited settings\n" );
+        m_isWrong = true;
+        return;
+    }
+    read = written;
+    uint8_t unchanged = settings_checkForChanges( &read );
+    if( ( storage_open( &fil, m_settingsFilename, FA_WRITE | FA_CREATE_ALWAYS ) != 0 ) ||
+        ( f_write( &fil, text, size, &length ) != FR_OK ) || ( storage_close( &fil ) != 0 ) )
+    {
+        printf( "Couldn't write %s\n", m_settingsFilename );
+        m_isWrong = true;
+        return;
+    }
+    uint8_t changed = settings_checkForChanges( &read );
+    if( ( unchanged != 0U ) || ( settings_checkForChanges( &read ) != 0U ) ||
+        ( changed != ( SETTINGS_CHANGED_WIFI | SETTINGS_CHANGED_WATERING ) ) ||
+        ( m_settingsAreEqual( &edited.sdCardSettings, &read.sdCardSettings ) == false ) )
+    {
+        printf( "settings_checkForChanges gave 0x%02x for settings.txt written by itself, 0x%02x for an edit\n",
+            unchanged, changed );
+        m_isWrong = true;
+    }
+
+    // Damage the last file written a few characters at a time
+    if( ( storage_open( &fil, m_settingsFilename, FA_READ ) != 0 ) ||
+        ( f_read( &fil, text, sizeof( text ), &size ) != FR_OK ) || ( storage_close( &fil ) != 0 ) )
+    {
+        printf( "Couldn't read %s back\n", m_settingsFilename );
+        m_isWrong = true;
+        return;
+    }
+    for( uint32_t copy = 0U; copy < BENCH_SETTINGS_DAMAGED; copy++ )
+    {
+        static const char damages[] = { '"', '\\', ':', '#', '\n', ',', '0', '9', 'A', ' ' };
+        static char damaged[BENCH_MAX_FILE_SIZE];
+
+        memcpy( damaged, text, size );
+        for( uint8_t damage = 0U; damage < BENCH_SETTINGS_DAMAGES; damage++ )
+            damaged[(UINT) rand() % size] = damages[(size_t) rand() % sizeof( damages )];
+        if( ( storage_open( &fil, m_settingsFilename, FA_WRITE | FA_CREATE_ALWAYS ) != 0 ) ||
+            ( f_write( &fil, damaged, size, &length ) != FR_OK ) || ( storage_close( &fil ) != 0 ) )
+        {
+            printf( "Couldn't write %s\n", m_settingsFilename );
+            m_isWrong = true;
+            return;
+        }
+
+        read = {};
+        if( settings_readFromSDCard( &read ) == 0 )
+        {
+            ++accepted;
+            if( m_settingsAreInBounds( &read.sdCardSettings ) == false )
+                ++outOfBounds;
+        }
+    }
+    storage_unmount();
+
+    printf( "settings: %u of %u round trips wrong, %u of %u damaged files accepted, %u out of bounds\n",
+        wrongRoundTrips, BENCH_SETTINGS_ROUND_TRIPS, accepted, BENCH_SETTINGS_DAMAGED, outOfBounds );
+    if( ( wrongRoundTrips != 0U ) || ( outOfBounds != 0U ) )
+        m_isWrong = true;
+}
+
+/*
+ * Function: m_settingsRandomise
+ * --------------------
+ * Fill settings with random values which are all valid
+ *
+ * sdCardSettingsPtr: The settings
+ *
+ * returns: void
+ */
+static void m_settingsRandomise( t_sdCardSettings* sdCardSettingsPtr )
+{
+    uint8_t numberOfTimes = (uint8_t) ( ( rand() % MAX_NUMBER_OF_WATERING_TIMES ) + 1 );
+
+    m_settingsRandomString( sdCardSettingsPtr->wifiSsid, sizeof( sdCardSettingsPtr->wifiSsid ) );
+    m_settingsRandomString( sdCardSettingsPtr->wifiPassword, sizeof( sdCardSettingsPtr->wifiPassword ) );
+    // Any order, to the minute
+    for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
+        sdCardSettingsPtr->wateringTimes[index] = ( index < numberOfTimes ) ? ( rand() % ( 24 * 60 ) ) * 60 : -1;
+    sdCardSettingsPtr->wateringDurationMs = (uint16_t) rand();
+}
+
+/*
+ * Function: m_settingsRandomString
+ * --------------------
+ * Fill a string with random printable characters, including quote marks and
+ * backslashes
+ *
+ * text: The string
+ * size: Its size, including the 0 at the end
+ *
+ * returns: void
+ */
+static void m_settingsRandomString( char text[], size_t size )
+{
+    size_t length = (size_t) rand() % size;
+
+    for( size_t index = 0U; index < length; index++ )
+        text[index] = (char) ( ' ' + ( rand() % ( '~' - ' ' + 1 ) ) );
+    text[length] = 0;
+}
+
+/*
+ * Function: m_settingsAreEqual
+ * --------------------
+ * Check settings read back the same as they were written. The watering times
+ * are read back in ascending order
+ *
+ * writtenPtr: The settings written
+ * readPtr: The settings read
+ *
+ * returns: bool true if they are the same
+ */
+static bool m_settingsAreEqual( const t_sdCardSettings* writtenPtr, const t_sdCardSettings* readPtr )
+{
+    int32_t sortedTimes[MAX_NUMBER_OF_WATERING_TIMES];
+    uint8_t numberOfTimes = 0U;
+
+    for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
+    {
+        if( writtenPtr->wateringTimes[index] >= 0 )
+            sortedTimes[numberOfTimes++] = writtenPtr->wateringTimes[index];
+    }
+    for( uint8_t index = 1U; index < numberOfTimes; index++ )
+    {
+        for( uint8_t other = index; ( other > 0U ) && ( sortedTimes[other - 1U] > sortedTimes[other] ); other-- )
+        {
+            int32_t time = sortedTimes[other];
+            sortedTimes[other] = sortedTimes[other - 1U];
+            sortedTimes[other - 1U] = time;
+        }
+    }
+    for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
+    {
+        if( readPtr->wateringTimes[index] != ( ( index < numberOfTimes ) ? sortedTimes[index] : -1 ) )
+            return false;
+    }
+
+    return ( strcmp( writtenPtr->wifiSsid, readPtr->wifiSsid ) == 0 ) &&
+           ( strcmp( writtenPtr->wifiPassword, readPtr->wifiPassword ) == 0 ) &&
+           ( writtenPtr->wateringDurationMs == readPtr->wateringDurationMs );
+}
+
+/*
+ * Function: m_settingsAreInBounds
+ * --------------------
+ * Check settings which were read are all valid: the strings end inside their
+ * arrays, and there are one or more watering times in a day, in ascending
+ * order, followed by -1s
+ *
+ * sdCardSettingsPtr: The settings
+ *
+ * returns: bool true if they are valid
+ */
+static bool m_settingsAreInBounds( const t_sdCardSettings* sdCardSettingsPtr )
+{
+    if( ( memchr( sdCardSettingsPtr->wifiSsid, 0, sizeof( sdCardSettingsPtr->wifiSsid ) ) == NULL ) ||
+        ( memchr( sdCardSettingsPtr->wifiPassword, 0, sizeof( sdCardSettingsPtr->wifiPassword ) ) == NULL ) ||
+        ( sdCardSettingsPtr->wateringTimes[0] < 0 ) )
+    {
+        return false;
+    }
+    for( uint8_t index = 0U; index < MAX_NUMBER_OF_WATERING_TIMES; index++ )
+    {
+        int32_t time = sdCardSettingsPtr->wateringTimes[index];
+        int32_t previousTime = ( index > 0U ) ? sdCardSettingsPtr->wateringTimes[index - 1U] : 0;
+        if( ( time < -1 ) || ( time >= ( 24 * 60 * 60 ) ) )
+            return false;
+        // Times go up, and once one is -1 the rest are
+        if( ( time >= 0 ) && ( time < previousTime ) )
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+#include "storage.hpp"
+
+#include "pico/stdlib.h"
+
+static FATFS m_fs;
+static bool m_isMounted = false;
+static uint8_t m_openFiles = 0U;
+// When the card can be unmounted, nil while files are open
+static absolute_time_t m_unmountTime = nil_time;
+
+static bool m_mount( void );
+static void m_fileClosed( void );
+
+int storage_open( FIL* filPtr, const char filename[], BYTE mode )
+{
+    FRESULT fr;
+
+    if( !m_mount() )
+        return 1;
+
+    ++m_openFiles;
+    m_unmountTime = nil_time;
+
+    fr = f_open( filPtr, filename, mode );
+    if( fr != FR_OK )
+    {
+        m_fileClosed();
+        // Anything other than a missing file may mean the card has been
+        // changed or removed, so mount it again next time
+        if( ( fr != FR_NO_FILE ) && ( fr != FR_NO_PATH ) )
+            storage_unmount();
+        return 2;
+    }
+
+    return 0;
+}
+
+int storage_close( FIL* filPtr )
+{
+    FRESULT fr = f_close( filPtr );
+
+    m_fileClosed();
+
+    return ( fr == FR_OK ) ? 0 : 3;
+}
+
+void storage_update( void )
+{
+    if( m_isMounted && ( m_openFiles == 0U ) && !is_nil_time( m_unmountTime ) &&
+        ( absolute_time_diff_us( get_absolute_time(), m_unmountTime ) < 0LL ) )
+    {
+        storage_unmount();
+    }
+}
+
+int storage_stat( const char filename[], FILINFO* filInfoPtr )
+{
+    FRESULT fr;
+
+    if( !m_mount() )
+        return 1;
+
+    fr = f_stat( filename, filInfoPtr );
+    if( fr != FR_OK )
+    {
+        // As storage_open, the card may have been changed or removed
+        if( ( fr != FR_NO_FILE ) && ( fr != FR_NO_PATH ) )
+            storage_unmount();
+        return 2;
+    }
+
+    // Nothing is left open, so it can be unmounted later like after a file
+    if( m_openFiles == 0U )
+        m_unmountTime = make_timeout_time_ms( STORAGE_IDLE_UNMOUNT_MS );
+
+    return 0;
+}
+
+int storage_replace( const char filename[], const char newFilename[] )
+{
+    FRESULT fr;
+    int result = 0;
+
+    if( !m_mount() )
+        return 1;
+
+    // Counted as an open file, so it isn't unmounted part way through
+    ++m_openFiles;
+    m_unmountTime = nil_time;
+
+    fr = f_unlink( filename );
+    if( ( fr != FR_OK ) && ( fr != FR_NO_FILE ) )
+        result = 4;
+    else if( f_rename( newFilename, filename ) != FR_OK )
+        result = 5;
+
+    m_fileClosed();
+    return result;
+}
+
+void storage_unmount( void )
+{
+    if( !m_isMounted || ( m_openFiles != 0U ) )
+        return;
+
+    f_unmount( "0:" );
+    m_isMounted = false;
+    m_unmountTime = nil_time;
+}
+
+// --- MODULE SCOPE FUNCTIONS ---
+
+static bool m_mount( void )
+{
+    if( !m_isMounted )
+    {
+        if( f_mount( &m_fs, "0:", 1 ) != FR_OK )
+            return false;
+        m_isMounted = true;
+    }
+    return true;
+}
+
+static void m_fileClosed( void )
+{
+    --m_openFiles;
+    if( m_openFiles == 0U )
+        m_unmountTime = make_timeout_time_ms( STORAGE_IDLE_UNMOUNT_MS );
+}
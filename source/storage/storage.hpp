@@ -0,0 +1,103 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+/* Shares one mount of the SD card between everything that reads or writes it.
+ * The card is mounted by the first storage_open, stays mounted while files are
+ * open and for STORAGE_IDLE_UNMOUNT_MS after the last one is closed, so files
+ * opened close together only pay for mounting once. The FIL from storage_open
+ * is an ordinary FatFs file, use f_read, f_gets, f_printf etc. on it */
+
+#include "sd_card.h"
+#include "ff.h"
+
+#define STORAGE_IDLE_UNMOUNT_MS ( 5000U ) // Time the card stays mounted with no files open
+
+/*
+ * Function: storage_open
+ * --------------------
+ * Mount the SD card if it isn't already, then open a file on it. Every file
+ * opened must be closed with storage_close
+ *
+ * filPtr: File object to open the file with
+ * filename: Path of the file on the SD card
+ * mode: FatFs access mode, e.g. FA_READ
+ *
+ * returns: int 0 on success
+ *              1 on fail because the SD card couldn't be mounted
+ *              2 on fail because the file couldn't be opened
+ */
+int storage_open( FIL* filPtr, const char filename[], BYTE mode );
+
+/*
+ * Function: storage_close
+ * --------------------
+ * Close a file opened with storage_open. The card is unmounted by
+ * storage_update once nothing has been open for STORAGE_IDLE_UNMOUNT_MS
+ *
+ * filPtr: The open file
+ *
+ * returns: int 0 on success
+ *              3 on fail because the file couldn't be closed
+ */
+int storage_close( FIL* filPtr );
+
+/*
+ * Function: storage_update
+ * --------------------
+ * Unmount the SD card if nothing has been open on it for
+ * STORAGE_IDLE_UNMOUNT_MS. Should be called regularly, e.g. every main loop
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void storage_update( void );
+
+/*
+ * Function: storage_stat
+ * --------------------
+ * Get a file's size and modified time, mounting the SD card if needed. Only
+ * the directory is read, not the file, so it is cheap enough to call often to
+ * see if a file has changed. Like closing a file, it restarts the
+ * STORAGE_IDLE_UNMOUNT_MS timeout, so calling it more often keeps the card mounted
+ *
+ * filename: Path of the file on the SD card
+ * filInfoPtr: Where the size, time etc. go
+ *
+ * returns: int 0 on success
+ *              1 on fail because the SD card couldn't be mounted
+ *              2 on fail because the file couldn't be found
+ */
+int storage_stat( const char filename[], FILINFO* filInfoPtr );
+
+/*
+ * Function: storage_replace
+ * --------------------
+ * Replace a file with another one by renaming it, mounting the SD card if
+ * needed, e.g. to swap in a file which has been written in full under a
+ * temporary name. FatFs can't rename over a file, so there is a moment when
+ * only newFilename exists, readers can fall back to it
+ *
+ * filename: Path of the file to replace, it doesn't have to exist
+ * newFilename: Path of the file to rename to filename, it mustn't be open
+ *
+ * returns: int 0 on success
+ *              1 on fail because the SD card couldn't be mounted
+ *              4 on fail because filename couldn't be removed
+ *              5 on fail because newFilename couldn't be renamed
+ */
+int storage_replace( const char filename[], const char newFilename[] );
+
+/*
+ * Function: storage_unmount
+ * --------------------
+ * Unmount the SD card now, e.g. before it's removed, rather than waiting for
+ * storage_update. Does nothing while a file is open
+ *
+ * parameters: none
+ *
+ * returns: void
+ */
+void storage_unmount( void );
+
+#endif // STORAGE_HPP
@@ -1,16 +1,28 @@
 #include "sm_idle.hpp"
 
+#include <string.h>
+
 #include "oled.hpp"
 #include "pico/cyw43_arch.h"
+#include "hw_config.h"
+#include "flash_settings.hpp"
+#include "settings_reader.hpp"
 #include "system.hpp"
 
+// When settings.txt is next checked for changes
+static absolute_time_t m_settingsCheckTime = nil_time;
+
 static bool m_checkWifiReconnection( t_globalData* globalDataPtr );
+static void m_checkSettings( t_globalData* globalDataPtr );
+static void m_saveFlashSettings( t_globalData* globalDataPtr );
 
 void smIdle_init( t_globalData* globalDataPtr )
 {
     // Clear the screen
     oled_clear();
     oled_deinitAll();
+
+    m_settingsCheckTime = make_timeout_time_ms( SETTINGS_CHECK_PERIOD_MS );
 }
 
 void smIdle_update( t_globalData* globalDataPtr )
@@ -53,6 +65,8 @@ void smIdle_update( t_globalData* globalDataPtr )
     // This state cannot time out
 
     // Check if something needs doing
+    // Check if settings.txt has been changed, this can also ask for a WiFi reconnection
+    m_checkSettings( globalDataPtr );
     // Check if a reconnection to WiFi is needed
     if( m_checkWifiReconnection( globalDataPtr ) )
         system_setState( globalDataPtr, e_systemState_wifi );
@@ -74,3 +88,60 @@ static bool m_checkWifiReconnection( t_globalData* globalDataPtr )
         return false;
     }
 }
+
+static void m_checkSettings( t_globalData* globalDataPtr )
+{
+    if( absolute_time_diff_us( get_absolute_time(), m_settingsCheckTime ) >= 0LL )
+        return; // Not time to check yet
+    m_settingsCheckTime = make_timeout_time_ms( SETTINGS_CHECK_PERIOD_MS );
+
+    // The card has been unmounted since the last check, so checking mounts it
+    // again with an empty sector cache. The driver still thinks the card is
+    // initialised though, so first make sure it is the same card. If it was
+    // taken out to be edited it's marked as needing initialising again
+    sd_card_t* sdCardPtr = sd_get_by_num( 0U );
+    if( sdCardPtr->sd_test_com( sdCardPtr ) == false )
+        return; // No card, or it's been changed and is initialised at the next check
+
+    uint8_t changes = settings_checkForChanges( globalDataPtr );
+    if( changes == 0U )
+        return;
+
+    // Only what uses the changed settings is started again, the new settings
+    // are already in use by everything else
+    if( changes & SETTINGS_CHANGED_WIFI )
+    {
+        printf( "WiFi settings changed, reconnecting\n" );
+        if( globalDataPtr->wifiData.connectionSuccess == true )
+            cyw43_wifi_leave( &cyw43_state, CYW43_ITF_STA );
+        // The new network gets all of its connection attempts, starting now
+        globalDataPtr->wifiData.connectionSuccess = false;
+        globalDataPtr->wifiData.connectionAttempts = 0U;
+        globalDataPtr->wifiData.reconnectionAttemptTime = get_absolute_time();
+    }
+    if( changes & SETTINGS_CHANGED_WATERING )
+    {
+        // Nothing keeps its own copy of the watering times or duration, they
+        // are used from globalDataPtr->sdCardSettings the next time it waters
+        printf( "Watering settings changed\n" );
+    }
+
+    m_saveFlashSettings( globalDataPtr );
+}
+
+static void m_saveFlashSettings( t_globalData* globalDataPtr )
+{
+    t_flashSettings flashSettings;
+
+    // Zeroed, as in sm_init.cpp, so the record only changes when something in it does
+    memset( &flashSettings, 0, sizeof( flashSettings ) );
+    // Only the settings change. The SD clock step stays the one calibrated at
+    // boot, not whatever the card has stepped down to since
+    if( flashSettings_read( &flashSettings ) != 0 )
+        flashSettings.sdClockStep = sd_get_by_num( 0U )->clock_calibrated;
+    flashSettings.isSdCardSettingsValid = true;
+    flashSettings.sdCardSettings = globalDataPtr->sdCardSettings;
+    // Interrupts are off for a while when the flash sector is erased, but nothing is going on while idle
+    if( flashSettings_write( &flashSettings ) != 0 )
+        printf( "flashSettings_write failed\n" );
+}
@@ -1,21 +1,32 @@
 #include "sm_init.hpp"
 
+#include <string.h>
+
 #include "oled.hpp"
 #include "pico/cyw43_arch.h"
 #include "pump.hpp"
 #include "sd_card.h"
+#include "hw_config.h"
 #include "ff.h"
+#include "diskio.h"
+#include "flash_settings.hpp"
 #include "settings_reader.hpp"
 #include "system.hpp"
 
 absolute_time_t m_setWifiStateTimeout = nil_time;
+// Read from flash at boot, written back once the SD card has been read
+static t_flashSettings m_flashSettings;
+static bool m_isFlashSettingsRead = false;
 
 static inline void m_initialiseOled( void );
 static inline void m_initialiseCyw43( void );
 static inline void m_initialisePump( void );
 static inline void m_initialiseSdCardDriver( void );
+static inline void m_loadFlashSettings( t_globalData* globalDataPtr );
+static inline void m_saveFlashSettings( t_globalData* globalDataPtr, bool isSdCardRead );
 static inline void m_sdSuccessfulReadMessage( t_sdCardSettings* sdCardSettingsPtr );
 static inline void m_sdFailedReadMessage( void );
+static inline void m_scheduleMessage( t_sdCardSettings* sdCardSettingsPtr );
 
 void smInit_init( t_globalData* globalDataPtr )
 {
@@ -29,24 +40,42 @@ void smInit_init( t_globalData* globalDataPtr )
     m_initialiseCyw43();
     // Initialise pump
     m_initialisePump();
+    // Use the settings saved in flash straight away, the SD card only changes them
+    m_loadFlashSettings( globalDataPtr );
     // Init the SD card driver
     m_initialiseSdCardDriver();
     // Now attempt to read the SD card
     oled_terminalWrite( "" );
     oled_terminalWrite( "Reading SDC..." );
-    if( settings_readFromSDCard( globalDataPtr ) != 0 )
+    oled_flush();
+    bool isSdCardRead = ( settings_readFromSDCard( globalDataPtr ) == 0 );
+    if( isSdCardRead == true )
     {
-        globalDataPtr->hardwareData.settingsReadOk = false;
-        m_sdFailedReadMessage();
+        // Only show the schedule again if it changed
+        if( ( globalDataPtr->hardwareData.settingsReadOk == false ) ||
+            ( memcmp( &( globalDataPtr->sdCardSettings ), &( m_flashSettings.sdCardSettings ), sizeof( t_sdCardSettings ) ) != 0 ) )
+            m_sdSuccessfulReadMessage( &(globalDataPtr->sdCardSettings) );
+        else
+            oled_terminalWrite( "No changes" );
+        globalDataPtr->hardwareData.settingsReadOk = true;
+    }
+    else if( globalDataPtr->hardwareData.settingsReadOk == true )
+    {
+        oled_terminalWrite( "FAILED to read" );
+        oled_terminalWrite( "settings, using" );
+        oled_terminalWrite( "saved settings" );
     }
     else
     {
-        globalDataPtr->hardwareData.settingsReadOk = false;
-        m_sdSuccessfulReadMessage( &(globalDataPtr->sdCardSettings) );
-
+        m_sdFailedReadMessage();
+    }
+    if( globalDataPtr->hardwareData.settingsReadOk == true )
+    {
         // Change to the wifi state after this delay
         m_setWifiStateTimeout = make_timeout_time_ms( INIT_TO_WIFI_DELAY_MS );
     }
+    // Reading the settings initialised the card, if there is one
+    m_saveFlashSettings( globalDataPtr, isSdCardRead );
 
     // Setup a timeout for this state
     globalDataPtr->stateTimeout = make_timeout_time_ms( INIT_STATE_TIMEOUT_MS );
@@ -122,8 +151,9 @@ static inline void m_initialiseOled( void )
             sleep_ms( 1000 );
         }
     }
-    // Create a terminal with the OLED
-    oled_terminalInit( TERMINAL_FONT_12, TERMINAL_INIT_COLOUR );
+    // Create a terminal with the OLED. Nothing else is drawn during init, so it
+    // can use the display's hardware scrolling
+    oled_terminalInitScrolling( TERMINAL_FONT_12, TERMINAL_INIT_COLOUR );
     oled_terminalWrite( "OLED initialised" );
 }
 
@@ -131,9 +161,11 @@ static inline void m_initialiseCyw43( void )
 {
     // Intialise the CYW43 driver
     oled_terminalWrite( "CYW43 initialising" );
+    oled_flush();
     if( cyw43_arch_init() )
     {
         oled_terminalWrite( "Failed" );
+        oled_flush();
         for( ;; )
         {
             printf( "cyw43_arch_init failed\n" );
@@ -154,21 +186,72 @@ static inline void m_initialisePump( void )
 static inline void m_initialiseSdCardDriver( void )
 {
     oled_terminalWrite( "Init SDC driver" );
+    oled_flush();
     if( !sd_init_driver() )
     {
         oled_terminalWrite( "Failed" );
+        oled_flush();
         for( ;; )
         {
             printf( "sd_init_driver failed\n" );
             sleep_ms( 1000 );
         }
     }
+    // Start the card at the SPI clock it calibrated to last boot, rather than
+    // ramping up to it again
+    if( m_isFlashSettingsRead == true )
+        sd_get_by_num( 0U )->clock_hint = m_flashSettings.sdClockStep;
+}
+
+static inline void m_loadFlashSettings( t_globalData* globalDataPtr )
+{
+    // Zeroed, so the record only changes when something in it does
+    memset( &m_flashSettings, 0, sizeof( m_flashSettings ) );
+    m_isFlashSettingsRead = ( flashSettings_read( &m_flashSettings ) == 0 );
+    if( ( m_isFlashSettingsRead == false ) || ( m_flashSettings.isSdCardSettingsValid == false ) )
+    {
+        globalDataPtr->hardwareData.settingsReadOk = false;
+        return;
+    }
+
+    globalDataPtr->sdCardSettings = m_flashSettings.sdCardSettings;
+    globalDataPtr->hardwareData.settingsReadOk = true;
+    oled_terminalWrite( "" );
+    oled_terminalWrite( "Saved settings:" );
+    m_scheduleMessage( &(globalDataPtr->sdCardSettings) );
+    oled_flush();
+}
+
+static inline void m_saveFlashSettings( t_globalData* globalDataPtr, bool isSdCardRead )
+{
+    sd_card_t* sdCardPtr = sd_get_by_num( 0U );
+
+    // Not if the card couldn't be initialised, the step would mean nothing and
+    // the settings can't have changed
+    if( sdCardPtr->m_Status & STA_NOINIT )
+        return;
+
+    // The step it calibrated to, not one it may have stepped down to since
+    m_flashSettings.sdClockStep = sdCardPtr->clock_calibrated;
+    if( isSdCardRead == true )
+    {
+        m_flashSettings.isSdCardSettingsValid = true;
+        m_flashSettings.sdCardSettings = globalDataPtr->sdCardSettings;
+    }
+    // flashSettings_write does nothing if nothing has changed, so this doesn't wear the flash
+    if( flashSettings_write( &m_flashSettings ) != 0 )
+        printf( "flashSettings_write failed\n" );
 }
 
 static inline void m_sdSuccessfulReadMessage( t_sdCardSettings* sdCardSettingsPtr )
 {
     oled_terminalWrite( "Settings read" );
     oled_terminalWrite( "successfully" );
+    m_scheduleMessage( sdCardSettingsPtr );
+}
+
+static inline void m_scheduleMessage( t_sdCardSettings* sdCardSettingsPtr )
+{
     oled_terminalWrite( "" );
     oled_terminalWrite( "Watering at:" );
     char text[20];
@@ -1,5 +1,8 @@
 #include "system.hpp"
 
+#include "oled.hpp"
+#include "storage.hpp"
+
 typedef struct {
     uint8_t pin;
     absolute_time_t buttonPressTimestamps[SPAM_PRESS_COUNT];
@@ -111,6 +114,13 @@ void system_run( t_globalData* globalDataPtr )
             break;
         }
 
+        // Unmount the SD card once nothing has used it for a while
+        storage_update();
+
+        // Push anything drawn during this loop to the display, this goes on
+        // in the background while waiting for the end of the loop
+        (void) oled_flushAsync();
+
         // Wait until the end of the loop
         sleep_until( loopEndTime );
     }
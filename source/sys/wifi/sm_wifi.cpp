@@ -115,15 +115,17 @@ static void m_connectToWifi( t_globalData* globalDataPtr )
         oled_terminalWrite( "Max connection" );
         oled_terminalWrite( "attempts reached" );
 
-        oled_sdWriteImage( "wifi64.txt", 0, 64 );
-        oled_sdWriteImage( "cross64.txt", 64, 64 );
+        oled_drawCachedImage( "wifi64.oimg", 0, 64 );
+        oled_drawCachedImage( "cross64.oimg", 64, 64 );
     }
     else
     {
         // Attempt to connect
-        oled_sdWriteImage( "wifi64.txt", 0, 64 );
+        oled_drawCachedImage( "wifi64.oimg", 0, 64 );
         oled_terminalWrite( "Connecting to:" );
         oled_terminalWrite( globalDataPtr->sdCardSettings.wifiSsid );
+        // The connection attempt blocks, so show the screen now
+        oled_flush();
 
         int result = cyw43_arch_wifi_connect_timeout_ms( globalDataPtr->sdCardSettings.wifiSsid, 
             globalDataPtr->sdCardSettings.wifiPassword, 
@@ -139,7 +141,7 @@ static void m_connectToWifi( t_globalData* globalDataPtr )
 
             oled_terminalWrite( "" );
             oled_terminalWrite( "Success" );
-            oled_sdWriteImage( "tick64.txt", 64, 64 );
+            oled_drawCachedImage( "tick64.oimg", 64, 64 );
         }
         else
         {
@@ -147,7 +149,7 @@ static void m_connectToWifi( t_globalData* globalDataPtr )
 
             oled_terminalWrite( "" );
             oled_terminalWrite( "Failed" );
-            oled_sdWriteImage( "cross49.txt", 69, 44 );
+            oled_drawCachedImage( "cross64.oimg", 64, 64 );
 
             if( globalDataPtr->wifiData.connectionAttempts == WIFI_CONNECTION_MAX_ATTEMPTS )
             {
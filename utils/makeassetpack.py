@@ -0,0 +1,78 @@
+"""
+Packs the .oimg images in sd_card/ into source/oled/autogen_assets.h, so that
+they're built into flash and can be drawn without the SD card. It's run by
+CMake from the sd_card folder.
+
+The pack is:
+- One data array with every file back to back, exactly as it is on the card
+- An index with the name of each file and where it is in the data array,
+  sorted by name
+
+An image on the SD card with the same name is drawn instead of the one in
+flash, see oled_drawCachedImage. Fonts don't need to be in here, they're
+already in flash, see makefonts.py
+"""
+
+OUTPUT_FILE_NAME = "../source/oled/autogen_assets.h"
+EXTENSION = ".oimg"
+# The same as OLED_IMAGE_CACHE_NAME_SIZE in oled.cpp, including the '\0'
+MAX_NAME_SIZE = 32
+
+import os
+
+def main():
+    file_names = sorted(name for name in os.listdir(".") if name.endswith(EXTENSION))
+    data = bytearray()
+    index = []
+
+    for file_name in file_names:
+        if len(file_name) >= MAX_NAME_SIZE:
+            raise ValueError(file_name + " is too long a name")
+        with open(file_name, "rb") as asset_file:
+            asset = asset_file.read()
+        index.append((file_name, len(data), len(asset)))
+        data += asset
+
+    output = []
+    output.append("// Generated by utils/makeassetpack.py from the sd_card/*" + EXTENSION + " files, don't edit")
+    output.append("#ifndef AUTOGEN_ASSETS_H")
+    output.append("#define AUTOGEN_ASSETS_H")
+    output.append("")
+    output.append("#include <stdint.h>")
+    output.append("")
+    output.append("typedef struct")
+    output.append("{")
+    output.append("    const char* filename;")
+    output.append("    uint32_t offset; // In Assets_Data")
+    output.append("    uint32_t size;")
+    output.append("} t_asset;")
+    output.append("")
+    output.append("// " + str(len(data)) + " bytes")
+    output.append("static const uint8_t Assets_Data[] = {")
+    for position in range(0, len(data), 16):
+        output.append("    " + " ".join("0x%02X," % byte for byte in data[position:position + 16]))
+    output.append("};")
+    output.append("")
+    output.append("// Sorted by filename")
+    output.append("static const t_asset Assets_Index[] = {")
+    for file_name, offset, size in index:
+        output.append("    { \"%s\", %u, %u }," % (file_name, offset, size))
+    output.append("};")
+    output.append("")
+    output.append("#define ASSETS_COUNT ( " + str(len(index)) + "U )")
+    output.append("")
+    output.append("#endif // AUTOGEN_ASSETS_H")
+    output.append("")
+    output = "\n".join(output)
+
+    # Only touch the file if it changed, so that oled.cpp isn't rebuilt every time
+    if os.path.exists(OUTPUT_FILE_NAME):
+        with open(OUTPUT_FILE_NAME, "r") as output_file:
+            if output_file.read() == output:
+                return
+    with open(OUTPUT_FILE_NAME, "w") as output_file:
+        output_file.write(output)
+    print("Generated", OUTPUT_FILE_NAME)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,155 @@
+"""
+Packs the font tables in source/oled/font/font*.h into autogen_fonts.h, which
+is what oled.cpp actually uses. It's run by CMake from the font folder.
+
+The tables in font*.h pad every row of every glyph out to whole bytes and keep
+the blank space around each glyph. The packed format only keeps the bounding
+box of the lit pixels of each glyph:
+- A tFontGlyph for each of the 95 printable ascii characters, with the position
+  and size of the bounding box within the character cell and where its bits
+  start in the data array. These are bitfields packed into 4 bytes
+- The data array, which is the bits inside each bounding box, left to right and
+  top to bottom, most significant bit first, with no padding until the end of
+  the glyph
+
+Use the FONTS constant to change what gets packed
+"""
+
+# FONTS: font size, header to read
+FONTS = [
+    [8, "font8.h"],
+    [12, "font12.h"],
+    [16, "font16.h"],
+    [20, "font20.h"],
+    [24, "font24.h"],
+]
+
+OUTPUT_FILE_NAME = "autogen_fonts.h"
+# Space to tilde
+GLYPH_COUNT = 95
+# Bytes in a tFontGlyph, and the largest values of its bitfields
+GLYPH_SIZE = 4
+GLYPH_MAX_BOX = 0x1F
+GLYPH_MAX_OFFSET = 0xFFF
+
+import os
+import re
+
+def main():
+    output = []
+    output.append("// Generated by utils/makefonts.py from the font*.h files, don't edit")
+    output.append("#ifndef AUTOGEN_FONTS_H")
+    output.append("#define AUTOGEN_FONTS_H")
+    output.append("")
+    output.append("#include <stdint.h>")
+    output.append("")
+    output.append("#include \"fontCommon.h\"")
+
+    for font_size, header_file_name in FONTS:
+        table, width, height = read_font_table(header_file_name)
+        glyphs, data = pack_font(table, width, height)
+        name = "Font" + str(font_size)
+
+        output.append("")
+        output.append("#ifdef OLED_INCLUDE_FONT" + str(font_size))
+        output.append("// " + str(len(data) + (len(glyphs) * GLYPH_SIZE)) + " bytes, down from " + str(len(table)))
+        output.append("static const uint8_t " + name + "_Data[] = {")
+        for index in range(0, len(data), 16):
+            output.append("    " + " ".join("0x%02X," % byte for byte in data[index:index + 16]))
+        output.append("};")
+        output.append("")
+        output.append("static const tFontGlyph " + name + "_Glyphs[] = {")
+        for character, glyph in enumerate(glyphs):
+            output.append("    { %u, %u, %u, %u, %u }, // '%s'" % (glyph + (chr(character + 32),)))
+        output.append("};")
+        output.append("")
+        output.append("static const tFontPacked " + name + " = {")
+        output.append("    " + name + "_Data,")
+        output.append("    " + name + "_Glyphs,")
+        output.append("    " + str(width) + ", /* Width */")
+        output.append("    " + str(height) + ", /* Height */")
+        output.append("};")
+        output.append("#endif // OLED_INCLUDE_FONT" + str(font_size))
+
+    output.append("")
+    output.append("#endif // AUTOGEN_FONTS_H")
+    output.append("")
+    output = "\n".join(output)
+
+    # Only touch the file if it changed, so that oled.cpp isn't rebuilt every time
+    if os.path.exists(OUTPUT_FILE_NAME):
+        with open(OUTPUT_FILE_NAME, "r") as output_file:
+            if output_file.read() == output:
+                return
+    with open(OUTPUT_FILE_NAME, "w") as output_file:
+        output_file.write(output)
+    print("Generated", OUTPUT_FILE_NAME)
+
+# Returns the bytes of the table, the glyph width and the glyph height
+def read_font_table(header_file_name):
+    with open(header_file_name, "r") as header_file:
+        text = header_file.read()
+    # Drop the comments, which draw each glyph
+    text = re.sub(r"//[^\n]*", "", text)
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.DOTALL)
+
+    table_text = re.search(r"_Table\s*\[\]\s*=\s*\{(.*?)\};", text, flags=re.DOTALL).group(1)
+    table = [int(byte, 16) for byte in re.findall(r"0x([0-9A-Fa-f]{2})", table_text)]
+    width, height = re.search(r"tFontTable\s+\w+\s*=\s*\{\s*\w+\s*,\s*(\d+)\s*,\s*(\d+)", text).groups()
+    width = int(width)
+    height = int(height)
+
+    if len(table) != GLYPH_COUNT * height * ((width // 8) + 1):
+        raise ValueError(header_file_name + " doesn't have " + str(GLYPH_COUNT) + " glyphs")
+
+    return table, width, height
+
+# Returns a (x, y, width, height, data offset) tuple for each glyph and the data array
+def pack_font(table, width, height):
+    bytes_per_row = (width // 8) + 1
+    bytes_per_glyph = bytes_per_row * height
+    glyphs = []
+    data = []
+
+    for character in range(GLYPH_COUNT):
+        glyph_table = table[character * bytes_per_glyph:(character + 1) * bytes_per_glyph]
+
+        # Find which pixels are lit, the table is most significant bit first
+        lit = set()
+        for y in range(height):
+            for x in range(width):
+                if glyph_table[(y * bytes_per_row) + (x // 8)] & (0x80 >> (x % 8)):
+                    lit.add((x, y))
+
+        if not lit:
+            # e.g. space
+            glyphs.append((0, 0, 0, 0, len(data)))
+            continue
+
+        box_x = min(x for x, y in lit)
+        box_y = min(y for x, y in lit)
+        box_width = max(x for x, y in lit) - box_x + 1
+        box_height = max(y for x, y in lit) - box_y + 1
+        glyphs.append((box_x, box_y, box_width, box_height, len(data)))
+
+        bits = []
+        for y in range(box_y, box_y + box_height):
+            for x in range(box_x, box_x + box_width):
+                bits.append(1 if (x, y) in lit else 0)
+        # Pad the glyph to a whole number of bytes
+        bits += [0] * (-len(bits) % 8)
+        for index in range(0, len(bits), 8):
+            byte = 0
+            for bit in bits[index:index + 8]:
+                byte = (byte << 1) | bit
+            data.append(byte)
+
+    if width > GLYPH_MAX_BOX or height > GLYPH_MAX_BOX:
+        raise ValueError("Glyphs are too big for tFontGlyph")
+    if glyphs[-1][4] > GLYPH_MAX_OFFSET:
+        raise ValueError("Packed font is too big for tFontGlyph")
+
+    return glyphs, data
+
+if __name__ == '__main__':
+    main()